@@ -101,7 +101,6 @@ class PointcloudAdapter
 public:
     PointcloudAdapter( envire::Pointcloud* model, double density )
 	: model(model), index( 0.0 ),
-	vertices( &model->vertices ), 
 	density( density )
     {
 	envire::FrameNode* fm = model->getFrameNode();
@@ -127,14 +126,14 @@ public:
     {
 	VertexNode n;
 	const size_t idx = index;
-	n.point = C_local2globalnew * (*vertices)[idx];
+	n.point = C_local2globalnew * model->getVertex( idx );
 	index += 1.0/density;
 	return n;
     }
     bool hasNext() const
     {
 	const size_t idx = index;
-	return idx < vertices->size();
+	return idx < model->getVertexCount();
     }
     void reset() 
     {
@@ -142,7 +141,7 @@ public:
     }
     size_t size() const
     {
-	return vertices->size() * density;
+	return model->getVertexCount() * density;
     }
 
     void applyTransform(const Eigen::Affine3d& C_global2globalnew)
@@ -166,7 +165,6 @@ protected:
     Eigen::Affine3d C_local2global, C_local2globalnew;
 
     double index;
-    const std::vector<Eigen::Vector3d> *vertices;
     double density;
 };
 
@@ -174,8 +172,15 @@ class PointcloudEdgeAndNormalAdapter : public PointcloudAdapter
 {
 public:
     PointcloudEdgeAndNormalAdapter( envire::Pointcloud* model, double density )
-	: PointcloudAdapter( model, density ) 
+	: PointcloudAdapter( model, density ), normals( NULL ), attrs( NULL )
     {
+	if( model->getStorage() == envire::Pointcloud::FLOAT_COLUMNS )
+	{
+	    if( !model->columns.hasAttribute( envire::PointColumns::NORMAL ) 
+		    || !model->columns.hasAttribute( envire::PointColumns::FLAGS ) )
+		throw std::runtime_error("PointcloudEdgeAndNormalAdapter: the pointcloud has no normal or flag column");
+	    return;
+	}
 	attrs = &model->getVertexData<envire::Pointcloud::vertex_attr>(envire::Pointcloud::VERTEX_ATTRIBUTES);
 	normals = &model->getVertexData<Eigen::Vector3d>(envire::Pointcloud::VERTEX_NORMAL);
 
@@ -185,9 +190,18 @@ public:
     {
 	VertexEdgeAndNormalNode n;
 	const size_t idx = index;
-	n.point = C_local2globalnew * (*vertices)[idx];
-	n.edge = (*attrs)[idx] & (1 << envire::Pointcloud::SCAN_EDGE);
-	n.normal = C_local2globalnew.linear() * (*normals)[idx];
+	n.point = C_local2globalnew * model->getVertex( idx );
+	if( attrs )
+	{
+	    n.edge = (*attrs)[idx] & (1 << envire::Pointcloud::SCAN_EDGE);
+	    n.normal = C_local2globalnew.linear() * (*normals)[idx];
+	}
+	else
+	{
+	    // the pointcloud is stored in columns
+	    n.edge = model->columns.flags[idx] & (1 << envire::Pointcloud::SCAN_EDGE);
+	    n.normal = C_local2globalnew.linear() * model->columns.getNormal( idx );
+	}
 	index += 1.0/density;
 	return n;
     }
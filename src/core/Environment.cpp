@@ -25,18 +25,18 @@ void envire::intrusive_ptr_add_ref( EnvironmentItem* item ) { item->ref_count++;
 void envire::intrusive_ptr_release( EnvironmentItem* item ) { if(!--item->ref_count) delete item; }
 
 EnvironmentItem::EnvironmentItem(std::string const& unique_id)
-    : ref_count(0), unique_id(unique_id), env(NULL)
+    : ref_count(0), unique_id(unique_id), env(NULL), modification_count(0)
 {
 }
 
 EnvironmentItem::EnvironmentItem(Environment* envPtr)
-   : ref_count(0), unique_id( Environment::ITEM_NOT_ATTACHED ), env(NULL)
+   : ref_count(0), unique_id( Environment::ITEM_NOT_ATTACHED ), env(NULL), modification_count(0)
 {
     envPtr->attachItem( this );
 }
 
 EnvironmentItem::EnvironmentItem(const EnvironmentItem& item)
-    : ref_count(0), unique_id( Environment::ITEM_NOT_ATTACHED ), env(NULL)
+    : ref_count(0), unique_id( Environment::ITEM_NOT_ATTACHED ), env(NULL), modification_count(0)
 {
 }
 
@@ -126,6 +126,8 @@ void EnvironmentItem::itemModified()
 {
     if( isAttached() )
 	env->itemModified(this);
+    else
+	modification_count++;
 }
 
 EnvironmentItem::Ptr EnvironmentItem::detach()
@@ -398,6 +400,7 @@ EnvironmentItem::Ptr Environment::detachItem(EnvironmentItem* item, bool deep)
 
 void Environment::itemModified(EnvironmentItem* item) 
 {
+    item->modification_count++;
     handle( Event( event::ITEM, event::UPDATE, item ) );
 }
 
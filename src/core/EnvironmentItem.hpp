@@ -102,6 +102,10 @@ namespace envire
 	 */
 	Environment* env;
 
+	/** counts the modifications of this item, see getModificationCount()
+	 */
+	unsigned long modification_count;
+
     public:
 	static const std::string className;
 	
@@ -174,6 +178,13 @@ namespace envire
 	 */
 	void itemModified();
 
+	/** @return a counter which is increased each time the item is
+	 * marked as modified, either through itemModified() or through
+	 * Layer::setDirty(). Data that is derived from the item and cached can
+	 * store this value, and is outdated once it changed.
+	 */
+	unsigned long getModificationCount() const { return modification_count; }
+
 	/** will detach the item from the current environment
 	 */
 	EnvironmentItem::Ptr detach();
@@ -2,12 +2,25 @@
 #define ENVIRE_HOLDER__
 
 #include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <stdexcept>
 
 namespace envire
 {
     /** Baseclass for generically holding pointer to objects, while still
      * ensuring, that the destructor of that object is called, when the holder
      * object is destructed.
+     *
+     * Cloning a holder copies the held object. Holders can share their
+     * object explicitly instead, see share(). Holders that share an object
+     * use copy-on-write: the first
+     * access through the non-const get() makes a private copy. References
+     * that have been obtained through the non-const get() before the object
+     * got shared therefore do not point to the object of the holder anymore
+     * once it has been copied, and must not be used after the sharing.
+     *
+     * The sharing is not thread-safe, i.e. holders that share an object
+     * must not be accessed concurrently.
      */
     class HolderBase
     {
@@ -18,21 +31,25 @@ namespace envire
 	template <typename T> T& get();
     	template <typename T> const T& get() const;
 	virtual HolderBase* clone() const = 0;
+	/** @return a holder that shares the object of this holder */
+	virtual HolderBase* share() const = 0;
+	/** @return true if the held object is shared with another holder */
+	virtual bool isShared() const = 0;
     };
 
     /** Templated holder class, that will construct an object of type T,
      * provide access to it, and also delete the object again when it is
-     * destroyed.
+     * destroyed and no other holder shares it.
      */
     template <typename T>
 	class Holder : public HolderBase, boost::noncopyable 
     {
-	T* ptr;
+	boost::shared_ptr<T> ptr;
 
     public:
 	Holder()
+	    : ptr( new T() )
 	{
-	    ptr = new T();
 	};
 
 	explicit Holder( T* ptr )
@@ -40,20 +57,39 @@ namespace envire
 	{
 	}
 
-	~Holder()
+	explicit Holder( boost::shared_ptr<T> const& ptr )
+	    : ptr( ptr )
 	{
-	    delete ptr;
-	};
+	}
 
-	T* getData() const
+	/** @return the held object for modification. The object is copied
+	 * first if it is shared with another holder.
+	 */
+	T* getData()
 	{
-	    return ptr;
+	    if( !ptr.unique() )
+		ptr.reset( new T(*ptr) );
+	    return ptr.get();
+	}
+
+	const T* getData() const
+	{
+	    return ptr.get();
 	}
 
 	Holder<T>* clone() const
 	{
-	    T* clone = new T(*ptr);
-	    return new Holder<T>(clone);
+	    return new Holder<T>( new T(*ptr) );
+	}
+
+	Holder<T>* share() const
+	{
+	    return new Holder<T>(ptr);
+	}
+
+	bool isShared() const
+	{
+	    return !ptr.unique();
 	}
     };
 
@@ -64,13 +100,19 @@ namespace envire
     }
     template <typename T> T& HolderBase::get()
     {
-        return *dynamic_cast< Holder<T>* >(this)->getData();
+        Holder<T>* myself = dynamic_cast< Holder<T>* >(this);
+        if( !myself )
+            throw std::runtime_error("data type mismatch.");
+        return *myself->getData();
     }
 
     template <typename T> 
     const T& HolderBase::get() const
     {
-        return *dynamic_cast< Holder<T>* >(this)->getData();
+        Holder<T> const* myself = dynamic_cast< Holder<T> const* >(this);
+        if( !myself )
+            throw std::runtime_error("data type mismatch.");
+        return *myself->getData();
     }
 }
 
@@ -14,14 +14,15 @@ namespace fs = boost::filesystem;
 const std::string Layer::className = "envire::Layer";
 
 Layer::Layer(std::string const& id) :
-    EnvironmentItem(id), immutable(false), dirty(false)
+    EnvironmentItem(id), immutable(false), dirty(false), data_generation(0)
 {
 }
 
 Layer::Layer(const Layer& other) :
     EnvironmentItem( other ),
     immutable( other.immutable ),
-    dirty( other.dirty )
+    dirty( other.dirty ),
+    data_generation( 0 )
 {
     // copy the data map, and clone the holders
     for( DataMap::const_iterator it = other.data_map.begin(); it != other.data_map.end(); it++ )
@@ -36,6 +37,7 @@ Layer& Layer::operator=(const Layer& other)
 	immutable = other.immutable;
 	dirty = other.dirty;
 	removeData();
+	data_generation++;
 	for( DataMap::const_iterator it = other.data_map.begin(); it != other.data_map.end(); it++ )
 	    data_map.insert( std::make_pair( it->first, it->second->clone() ) );
     }
@@ -91,6 +93,7 @@ void Layer::resetDirty()
 void Layer::setDirty() 
 {
     dirty = true;
+    modification_count++;
 }
 
 bool Layer::isDirty() const
@@ -155,15 +158,51 @@ void Layer::removeData(const std::string& type)
     {
 	delete data_map[type];
 	data_map.erase( type );
+	data_generation++;
     }
 }
 
+void Layer::shareDataFrom(const Layer& source, const std::string& source_type, const std::string& target_type)
+{
+    DataMap::const_iterator it = source.data_map.find(source_type);
+    if( it == source.data_map.end() )
+	throw std::runtime_error("No metadata with name " + source_type + " available ");
+
+    // share before removing, source and target may be the same entry
+    HolderBase* holder = it->second->share();
+    removeData( target_type );
+    data_map[target_type] = holder;
+    // writes through pointers into the data of either layer would now
+    // be seen by the other one
+    data_generation++;
+    source.data_generation++;
+}
+
+void Layer::copyDataFrom(const Layer& source, const std::string& source_type, const std::string& target_type)
+{
+    DataMap::const_iterator it = source.data_map.find(source_type);
+    if( it == source.data_map.end() )
+	throw std::runtime_error("No metadata with name " + source_type + " available ");
+
+    // clone before removing, source and target may be the same entry
+    HolderBase* holder = it->second->clone();
+    removeData( target_type );
+    data_map[target_type] = holder;
+}
+
+bool Layer::isDataShared(const std::string& type) const
+{
+    DataMap::const_iterator it = data_map.find(type);
+    return it != data_map.end() && it->second->isShared();
+}
+
 void Layer::removeData()
 {
     for( DataMap::iterator it = data_map.begin();it != data_map.end(); it++)
 	delete it->second;
     
     data_map.clear();
+    data_generation++;
 }
 
 const std::string CartesianMap::className = "envire::CartesianMap";
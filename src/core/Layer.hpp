@@ -24,6 +24,9 @@ namespace envire
 	/** associating key values with metadata stored in holder objects */ 
 	DataMap data_map;
 
+	/** see getDataGeneration() */
+	mutable unsigned long data_generation;
+
     public:
 	static const std::string className;
 
@@ -135,6 +138,10 @@ namespace envire
 	/** For a given key, return the metadata associated with it. If the data
 	 * does not exist, it will be created.
 	 * Will throw a runtime error if the datatypes don't match.
+	 *
+	 * If the data is shared with another layer (see shareDataFrom()),
+	 * this makes a private copy of it first, and changes the data
+	 * generation. Use the const overload to only read the data.
 	 */
 	template <typename T>
 	    T& getData(const std::string& type)
@@ -143,6 +150,8 @@ namespace envire
 	    {
 		data_map[type] = new Holder<T>;
 	    }
+	    else if( data_map[type]->isShared() )
+		data_generation++;
 
 	    /*
 	    if( typeid(*data_map[type]) != typeid(Holder<T>) )
@@ -190,9 +199,48 @@ namespace envire
 	 */
 	void removeData(const std::string& type);
 
+	/** @brief makes the metadata \c source_type of \c source available as
+	 * \c target_type in this layer.
+	 *
+	 * The data is not copied, both layers share it until one of them
+	 * accesses it through the non-const getData(). Sharing is never done
+	 * implicitly, copies of a layer copy its data.
+	 *
+	 * The data generation of both layers changes. A reference into the
+	 * data of \c source that has been obtained before the call writes
+	 * into the data of both layers, and must not be used afterwards.
+	 *
+	 * @throw std::runtime_error if source has no data for \c source_type
+	 */
+	void shareDataFrom(const Layer& source, const std::string& source_type, const std::string& target_type);
+
+	/** @brief copies the metadata \c source_type of \c source to \c
+	 * target_type in this layer.
+	 *
+	 * @throw std::runtime_error if source has no data for \c source_type
+	 */
+	void copyDataFrom(const Layer& source, const std::string& source_type, const std::string& target_type);
+
+	/** @return true if the metadata with the given key is shared with
+	 * another layer, see shareDataFrom()
+	 */
+	bool isDataShared(const std::string& type) const;
+
 	/** @brief remove all metadata associated with this object
 	 */
 	void removeData();
+
+	/** @return a counter that changes whenever the object held for a key
+	 * may have been replaced, or may have become shared with another
+	 * layer, i.e. on removeData(), shareDataFrom() (for both layers), the
+	 * assignment and when getData() copies shared data.
+	 *
+	 * Pointers to data obtained through the non-const getData() can be
+	 * kept, and be written through, as long as the generation does not
+	 * change. The generation of a copy of a layer is unrelated to the one
+	 * of the original.
+	 */
+	unsigned long getDataGeneration() const { return data_generation; }
     };
 }
 
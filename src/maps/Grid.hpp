@@ -5,6 +5,9 @@
 #include <envire/core/Serialization.hpp>
 #include <base/samples/Frame.hpp>
 #include <envire/maps/GridBase.hpp>
+#include <envire/tools/TiledArray.hpp>
+#include <envire/tools/GdalBlockCache.hpp>
+#include <envire/tools/BandCodec.hpp>
 
 #include <boost/tuple/tuple.hpp>
 #include <Eigen/Core>
@@ -21,6 +24,8 @@
 #include <boost/multi_array.hpp>
 
 #include <vector>
+#include <limits>
+#include <algorithm>
 #include <stdexcept>
 #include <base-logging/Logging.hpp>
 
@@ -69,19 +74,36 @@ namespace envire
      * <code>
      * getGridData().data()[y * cellSizeX + x]
      * </code>
+     *
+     * Alternatively, a band can use a tiled storage (see TiledArray and
+     * getTiledGridData()), in which memory is only allocated for the tiles
+     * that have been written to. The other cells return the nodata value of
+     * the band. A band is either dense or tiled, getGridData() throws if it is
+     * called on a tiled band.
      */
     template <typename T>
     class Grid : public BandedGrid
     {
     public:
 	typedef boost::multi_array<T,2> ArrayType; 
+	typedef TiledArray<T> TiledArrayType;
         typedef T DataType;
+
+        /** Encoding of the bands in binary streams, see setBandEncoding() */
+        enum BandEncoding
+        {
+            /** the cells are written as-is */
+            ENCODING_RAW,
+            /** the cells are compressed with BandCodec */
+            ENCODING_DELTA_RLE
+        };
 	static const std::string className;
 	static const std::string GRID_DATA;
 
     private:
 	const static std::vector<std::string> &bands;
         std::map<std::string, T> nodata;
+        std::map<std::string, BandEncoding> encodings;
 
     protected:	
         /** @deprecated
@@ -107,7 +129,11 @@ namespace envire
                 double scalex, double scaley,
                 double offsetx = 0.0, double offsety = 0.0,
                 std::string const& id = Environment::ITEM_NOT_ATTACHED);
+	/** The copy does not share the cached statistics and overviews of
+	 * other, which are tagged with the modification count of other */
+	Grid(const Grid& other);
 	virtual ~Grid();
+	Grid& operator=(const Grid& other);
 	void serialize(Serialization& so);
 	void unserialize(Serialization& so);
 
@@ -117,10 +143,21 @@ namespace envire
             return hasData<ArrayType>(key);
         }
 
+        /** Returns true if the band for the given key uses the tiled storage */
+        bool hasTiledBand(std::string const& key) const
+        {
+            return hasData<TiledArrayType>(key);
+        }
+
         /** Sets the nodata value for the given band */
         void setNoData(std::string const& key, T value)
         {
             nodata[key] = value;
+            // only access the band for modification when required, as this
+            // copies it if it is shared
+            const Grid<T>& self(*this);
+            if (hasTiledBand(key) && !TiledArrayType::isSameValue(self.getTiledGridData(key).getNoData(), value))
+                getData<TiledArrayType>(key).setNoData(value);
         }
         
         /**
@@ -128,6 +165,29 @@ namespace envire
          */
         virtual const std::string& getClassName() const {return className;};
 
+        /** Sets how the given band is written into binary streams, i.e. by
+         * the serialization into memory and by writeGridData(key, os)
+         *
+         * Compressed bands are marked in the serialized metadata, so that
+         * readers that do not support the encoding fail to load the grid
+         * instead of reading garbage. GeoTiff files are not affected.
+         */
+        void setBandEncoding(std::string const& key, BandEncoding encoding)
+        {
+            if (encoding == ENCODING_RAW)
+                encodings.erase(key);
+            else
+                encodings[key] = encoding;
+        }
+
+        /** Returns the encoding of the given band in binary streams */
+        BandEncoding getBandEncoding(std::string const& key) const
+        {
+            typename std::map<std::string, BandEncoding>::const_iterator it =
+                encodings.find(key);
+            return it == encodings.end() ? ENCODING_RAW : it->second;
+        }
+
         /** Returns the nodata value for the given band, if one has been
          * defined.
          *
@@ -150,6 +210,8 @@ namespace envire
             {
                 if (it->second->isOfType<ArrayType>())
                     nodata[it->first] = value;
+                else if (it->second->isOfType<TiledArrayType>())
+                    setNoData(it->first, value);
             }
         }
         /** Returns the nodata value of the first band */
@@ -173,31 +235,168 @@ namespace envire
 	    getGridData( key );
 	}
 
+        /** Statistics of the cells of a band, see getStatistics()
+         *
+         * Cells that are set to the nodata value of the band, and NaN cells
+         * of floating point bands, are not taken into account. If a band has
+         * no valid cells, count is zero, min is larger than max and mean is
+         * zero.
+         */
+        struct BandStatistics
+        {
+            T min;
+            T max;
+            double mean;
+            /** number of cells which have been taken into account */
+            size_t count;
+            /** number of cells which are nodata or NaN */
+            size_t nodata_count;
+            /** histogram of the valid cells, with equally sized bins over
+             * [min, max]. It is empty unless bins have been requested in
+             * getStatistics()
+             */
+            std::vector<size_t> histogram;
+
+            BandStatistics()
+                : min(std::numeric_limits<T>::max()), max(std::numeric_limits<T>::is_integer ? std::numeric_limits<T>::min() : -std::numeric_limits<T>::max()),
+                mean(0), count(0), nodata_count(0), modification_count(0) {}
+
+        private:
+            friend class Grid<T>;
+            /** modification count of the grid when the statistics were
+             * computed */
+            unsigned long modification_count;
+        };
+
+        /** Returns the statistics of the given band.
+         *
+         * The statistics are cached per band, and only recomputed when the
+         * grid has been marked as modified (through setDirty() or
+         * itemModified()) since they were computed, or when a different
+         * number of histogram bins is requested. The methods that replace
+         * the content of a band, i.e. readGridData(), readGridDataWindow(),
+         * copyBandFrom() and the unserialization, drop its cached
+         * statistics and overviews, and so do the non-const getGridData()
+         * and getTiledGridData(). Code that keeps the reference returned by
+         * these methods, and writes to it after the statistics or overviews
+         * have been computed, has to mark the grid as modified, or call
+         * invalidateStatistics() and invalidateOverviews() (or
+         * setOverviewDirty()).
+         *
+         * The cache is not protected against concurrent access.
+         *
+         * @param histogram_bins the number of bins of the histogram, no
+         *        histogram is computed if zero
+         */
+        const BandStatistics& getStatistics( const std::string& key, size_t histogram_bins = 0 ) const;
+
+        /** Drops the cached statistics of all bands */
+        void invalidateStatistics() { statistics.clear(); }
+
         /** 
-         * @return the minimum and maximum values in the grid
+         * @return the minimum and maximum values in the grid, ignoring the
+         * nodata cells. If the band has no valid cell, min is larger than
+         * max.
          */
-        void getMinMaxValues( const std::string& key, T& min, T& max )
+        void getMinMaxValues( const std::string& key, T& min, T& max ) const
         {
-            min = std::numeric_limits<T>::max();
-            max = std::numeric_limits<T>::min();
+            const BandStatistics& stats( getStatistics( key ) );
+            min = stats.min;
+            max = stats.max;
+        }
 
-            ArrayType& a = getGridData( key );
-            for( T* i = a.data(); i < (a.data() + a.num_elements()); i++ )
-            {
-                const T val = *i;
-                if( val < min )
-                    min = val;
-                if( val > max )
-                    max = val;
-            }
+        /** Reduction used to compute the cells of an overview level from the
+         * cells of the next finer level, see setOverviews()
+         */
+        enum OverviewReducer
+        {
+            /** average of the valid cells, e.g. for elevations */
+            OVERVIEW_MEAN,
+            /** smallest valid cell, e.g. for drivability values */
+            OVERVIEW_MIN,
+            /** largest valid cell, e.g. for obstacle heights */
+            OVERVIEW_MAX
+        };
+
+        /** Creates reduced resolution overviews for the given band
+         *
+         * Level i of the overview has half the resolution of level i - 1
+         * along both axes, level 0 being the band itself. Each overview cell
+         * is computed from the (up to) 2x2 cells of the previous level that
+         * it covers, using \c reducer. Nodata and NaN cells are ignored, and
+         * an overview cell is nodata if none of its source cells is valid.
+         *
+         * The overviews are computed lazily in getOverview(), and are
+         * updated when the grid has been marked as modified (through
+         * setDirty() or itemModified()). If setOverviewDirty() has been
+         * called since the last update, only the cells covered by the dirty
+         * regions are recomputed. Otherwise, all the levels are rebuilt.
+         * The levels are always rebuilt after the band has been accessed
+         * through the non-const getGridData() or getTiledGridData(), so
+         * incremental updates require to keep the reference to the band
+         * and to write through it.
+         *
+         * The configuration of the overviews is saved during serialization,
+         * and they are exported as GDAL overviews in the GeoTiff files.
+         *
+         * @param levels the number of overview levels, not counting the band
+         *        itself. Zero removes the overviews of the band.
+         */
+        void setOverviews( const std::string& key, size_t levels, OverviewReducer reducer = OVERVIEW_MEAN );
+
+        /** Returns the number of overview levels of the given band, which is
+         * zero if the band has no overviews
+         */
+        size_t getOverviewCount( const std::string& key ) const
+        {
+            typename std::map<std::string, BandOverview>::const_iterator it = overviews.find( key );
+            return it == overviews.end() ? 0 : it->second.levels.size();
         }
 
+        /** Returns the reducer of the overviews of the given band
+         *
+         * @throw std::runtime_error if the band has no overviews
+         */
+        OverviewReducer getOverviewReducer( const std::string& key ) const
+        {
+            return getBandOverview( key ).reducer;
+        }
+
+        /** Returns the overview level \c level of the given band, updating it
+         * if needed. Its cells are 2^level times the size of the grid cells
+         * along both axes, and the grid offset applies unchanged.
+         *
+         * @param level the overview level in [1, getOverviewCount(key)]
+         * @throw std::runtime_error if the level does not exist
+         */
+        const ArrayType& getOverview( const std::string& key, size_t level ) const;
+
+        /** Marks the cells [x0, x1[ x [y0, y1[ of the given band as modified.
+         * The next call to getOverview() only recomputes the overview cells
+         * that cover these cells. Multiple regions are merged into their
+         * bounding box.
+         */
+        void setOverviewDirty( const std::string& key, size_t x0, size_t y0, size_t x1, size_t y1 );
+
+        /** Forces the overviews of the given band to be rebuilt completely on
+         * the next call to getOverview() */
+        void invalidateOverviews( const std::string& key );
+
         /** Returns the boost::multiarray that stores the data of the specified band
+         *
+         * Bands can be shared with other grids through shareBandFrom().
+         * Calling this method makes a private copy of a shared band, and
+         * drops the cached statistics and overviews of the band (see
+         * getStatistics()). Use the const overload if the band is only read.
          */
 	ArrayType& getGridData( const std::string& key )
 	{
 	    ArrayType& data( getData<ArrayType>(key) );
-	    data.resize( boost::extents[cellSizeY][cellSizeX] );
+	    bandModified( key );
+	    // multi_array::resize always reallocates, even if the size does
+	    // not change
+	    if( data.shape()[0] != cellSizeY || data.shape()[1] != cellSizeX )
+		data.resize( boost::extents[cellSizeY][cellSizeX] );
 	    return data;
 	};
         /** Returns the boost::multiarray that stores the data of the specified band
@@ -206,6 +405,70 @@ namespace envire
 	{
 	    return getData<ArrayType>(key);
 	};
+
+        /** Returns the tiled storage of the specified band. The band is
+         * created with the given tile size if it does not exist yet, and its
+         * unallocated cells are set to the nodata value of the band.
+         *
+         * Shared bands are copied, and the cached statistics and overviews
+         * are dropped, as in getGridData().
+         *
+         * @throw std::runtime_error if the band exists and is dense
+         */
+	TiledArrayType& getTiledGridData( const std::string& key, size_t tileSize = TiledArrayType::DEFAULT_TILE_SIZE )
+	{
+	    if( hasData( key ) && !hasTiledBand( key ) )
+		throw std::runtime_error("Grid: band " + key + " does not use the tiled storage.");
+
+	    const bool created = !hasData( key );
+	    TiledArrayType& data( getData<TiledArrayType>(key) );
+	    if( created )
+	    {
+		std::pair<T, bool> no_data = getNoData(key);
+		if( no_data.second )
+		    data.setNoData( no_data.first );
+		data.setTileSize( tileSize );
+	    }
+	    data.resize( cellSizeX, cellSizeY );
+	    bandModified( key );
+	    return data;
+	};
+        /** Returns the tiled storage of the specified band
+         */
+	const TiledArrayType& getTiledGridData( const std::string& key ) const
+	{
+	    return getData<TiledArrayType>(key);
+	};
+
+        /** Converts a dense band to the tiled storage. Only the tiles that
+         * contain cells that are not nodata are kept.
+         */
+        void convertToTiledBand( const std::string& key, size_t tileSize = TiledArrayType::DEFAULT_TILE_SIZE )
+        {
+            if( hasTiledBand( key ) )
+                return;
+
+            TiledArrayType tiled( cellSizeX, cellSizeY, getNoData(key).first, tileSize );
+            const Grid<T>& self( *this );
+            if( hasBand( key ) )
+                tiled.fromArray( self.getGridData( key ) );
+            removeData( key );
+            getTiledGridData( key, tileSize ) = tiled;
+        }
+
+        /** Converts a tiled band to the dense storage
+         */
+        void convertToDenseBand( const std::string& key )
+        {
+            if( !hasTiledBand( key ) )
+                return;
+
+            ArrayType dense;
+            const Grid<T>& self( *this );
+            self.getTiledGridData( key ).toArray( dense );
+            removeData( key );
+            getGridData( key ) = dense;
+        }
 	
         /** Returns the list of bands defined on this grid
          */
@@ -272,8 +535,8 @@ namespace envire
         void writeGridData(const std::vector<std::string>& bands,const std::string& path);
 	/** Helper method for serialization
          *
-         * Saves the data contained in the provided band in raw form in the
-         * provided stream
+         * Saves the data contained in the provided band in the provided
+         * stream, using the encoding of the band (see setBandEncoding())
          */
         void writeGridData(const std::string &key, std::ostream& os);
 	
@@ -293,27 +556,63 @@ namespace envire
 	/** Helper method for deserialization
          *
          * Reads the data contained in the given stream into the provided band
-         * of this map
+         * of this map. The stream must have been written with the encoding
+         * that the band currently has.
          */
         void readGridData(const std::string &band, std::istream& is, boost::enable_if< boost::is_fundamental<T> >* enabler = 0);
 
+	/** Reads the part of the band \c base_band of a GDAL-readable file
+	 * that covers \c window, extended by \c margin on all sides, into the
+	 * \c key band of this map
+	 *
+	 * The window is given in the georeferenced coordinates of the file. The
+	 * grid is resized to the covered cells, its scale is taken from the file
+	 * and its offsets are set such that the cells are at their georeferenced
+	 * position, i.e. the map frame is the frame of the file. Since the
+	 * other bands are resized as well, all bands of the grid should be
+	 * loaded through the same window.
+	 *
+	 * The file is accessed through \c cache, so that moving the window
+	 * only reads the blocks of the file that have not been loaded yet.
+	 *
+	 * @return false if the window does not overlap the raster. The grid is
+	 * not changed in that case.
+	 */
+	bool readGridDataWindow(const std::string &key, GdalBlockCache& cache, const Extents& window, double margin = 0.0, int base_band = 1);
+	/** @overload
+	 *
+	 * Opens the file at \c path for a single read
+	 */
+	bool readGridDataWindow(const std::string &key, const std::string& path, const Extents& window, double margin = 0.0, int base_band = 1);
+
         /** Copy the data from the band \c source_band of \c _source into the \c
          * _target_band of this map
          *
          * @throw std::bad_cast if the source grid is not of the same cell type
          * than this grid
+         * @throw std::runtime_error if the grids differ in size
          */
         void copyBandFrom(GridBase const& _source, std::string const& source_band, std::string const& _target_band = "")
         {
-            Grid<T> const& source = dynamic_cast< Grid<T> const& >(_source);
-            std::string target_band = _target_band;
-            if (_target_band.empty())
-                target_band = source_band;
+            setBandFrom(_source, source_band, _target_band, false);
+        }
 
-            getGridData(target_band) = source.getGridData(source_band);
-            std::pair<T, bool> no_data = source.getNoData(source_band);
-            if (no_data.second)
-                setNoData(target_band, no_data.first);
+        /** Makes the band \c source_band of \c _source available as the \c
+         * _target_band of this map, without copying it. Both grids share the
+         * data until either of them accesses it for modification
+         * (copy-on-write), see Layer::shareDataFrom().
+         *
+         * References into the band of \c _source that have been obtained
+         * through the non-const getGridData() before this call write into
+         * the band of both grids, and must not be used afterwards.
+         *
+         * @throw std::bad_cast if the source grid is not of the same cell type
+         * than this grid
+         * @throw std::runtime_error if the grids differ in size
+         */
+        void shareBandFrom(GridBase const& _source, std::string const& source_band, std::string const& _target_band = "")
+        {
+            setBandFrom(_source, source_band, _target_band, true);
         }
 
       protected:
@@ -328,8 +627,84 @@ namespace envire
 	
 	//checks if poBand can be loaded into this
 	void checkBandType(GDALRasterBand  *poBand);
+	//computes the range [first, last[ of raster indexes along one axis
+	//of a GDAL file, which covers the world coordinates [min, max]
+	static bool getRasterRange(double origin, double step, double min, double max, int size, int& first, int& last);
 	GDALDataType getGDALDataTypeOfArray();
 
+	//drops the cached statistics and overviews of a band that is about
+	//to be written to. Nothing is looked up if nothing is cached
+	void bandModified(const std::string& key)
+	{
+	    if( !statistics.empty() || !overviews.empty() )
+		bandReplaced( key );
+	}
+
+	//statistics kernels, which process the contiguous run of cells
+	//[data, data + size[
+	static bool isValidCell(T value, std::pair<T, bool> const& no_data)
+	{ return !(value != value) && !(no_data.second && value == no_data.first); }
+	static void accumulateStatistics(const T* data, size_t size, std::pair<T, bool> const& no_data, BandStatistics& stats, double& sum);
+	static void accumulateHistogram(const T* data, size_t size, std::pair<T, bool> const& no_data, BandStatistics& stats);
+	static size_t getHistogramBin(T value, BandStatistics const& stats);
+
+      private:
+	mutable std::map<std::string, BandStatistics> statistics;
+
+	/** overview levels of a band, see setOverviews() */
+	struct BandOverview
+	{
+	    OverviewReducer reducer;
+	    /** levels[i] is the overview level i + 1 */
+	    std::vector<ArrayType> levels;
+	    /** modification count of the grid at the last update */
+	    unsigned long modification_count;
+	    bool full_update;
+	    /** bounding box [x0, x1[ x [y0, y1[ of the dirty cells of the
+	     * band, empty if x0 >= x1 */
+	    size_t dirty_x0, dirty_y0, dirty_x1, dirty_y1;
+	};
+	mutable std::map<std::string, BandOverview> overviews;
+
+	const BandOverview& getBandOverview( const std::string& key ) const;
+	/** drops the cached statistics and marks all overviews for a full
+	 * update */
+	void resetCaches();
+	//implementation of copyBandFrom() and shareBandFrom()
+	void setBandFrom(GridBase const& _source, std::string const& source_band, std::string const& _target_band, bool share)
+	{
+	    Grid<T> const& source = dynamic_cast< Grid<T> const& >(_source);
+	    std::string target_band = _target_band;
+	    if (_target_band.empty())
+		target_band = source_band;
+
+	    if (source.getCellSizeX() != cellSizeX || source.getCellSizeY() != cellSizeY)
+		throw std::runtime_error("Grid: copyBandFrom requires grids of the same size.");
+
+	    if (share)
+		shareDataFrom(source, source_band, target_band);
+	    else
+		copyDataFrom(source, source_band, target_band);
+	    std::pair<T, bool> no_data = source.getNoData(source_band);
+	    if (no_data.second)
+		setNoData(target_band, no_data.first);
+	    bandReplaced(target_band);
+	}
+	//drops the cached statistics and overviews of a band whose content
+	//has been replaced
+	void bandReplaced(const std::string& key)
+	{
+	    statistics.erase(key);
+	    invalidateOverviews(key);
+	}
+	void updateOverview( const std::string& key, BandOverview& overview ) const;
+	//computes the cells [x0, x1[ x [y0, y1[ of target from the cells of
+	//source (dense) or tiled_source (tiled) that they cover
+	static void reduceOverview( const ArrayType* source, const TiledArrayType* tiled_source,
+		size_t source_width, size_t source_height, ArrayType& target,
+		size_t x0, size_t y0, size_t x1, size_t y1,
+		OverviewReducer reducer, std::pair<T, bool> const& no_data );
+
     };
 
     /* Explicit instanciations in Grids.cpp for the purpose of serialization */
@@ -374,10 +749,38 @@ namespace envire
       }
     }
     
+    template<class T>Grid<T>::Grid(const Grid& other) :
+	BandedGrid( other ), nodata( other.nodata ), encodings( other.encodings ),
+	overviews( other.overviews )
+    {
+	resetCaches();
+    }
+
     template<class T>Grid<T>::~Grid()
     {
       
     }
+
+    template<class T>Grid<T>& Grid<T>::operator=(const Grid& other)
+    {
+	if( this == &other )
+	    return *this;
+
+	BandedGrid::operator=( other );
+	nodata = other.nodata;
+	encodings = other.encodings;
+	overviews = other.overviews;
+	// the caches of other refer to its own modification count
+	resetCaches();
+	return *this;
+    }
+
+    template<class T>void Grid<T>::resetCaches()
+    {
+	statistics.clear();
+	for (typename std::map<std::string, BandOverview>::iterator it = overviews.begin(); it != overviews.end(); ++it)
+	    it->second.full_update = true;
+    }
     template<class T>void Grid<T>::unserialize(Serialization& so)
     {
         GridBase::unserialize(so);
@@ -390,13 +793,37 @@ namespace envire
         // load old maps the old way
         FileSerialization* fso = dynamic_cast<FileSerialization*>(&so);
 
-	if (so.hasKey("map_count"))
+	// grids with compressed bands use a different key for the band
+	// count, so that readers that can not decode them fail
+	if (so.hasKey("map_count") || so.hasKey("encoded_map_count"))
 	{
 	    // read in the layer names 
-	    int count = so.read<int>("map_count");
+	    int count = so.hasKey("map_count") ? so.read<int>("map_count") : so.read<int>("encoded_map_count");
 	    std::vector<std::string> layers;
+	    std::vector<size_t> tile_sizes;
 	    for (int i = 0; i < count; ++i)
+	    {
 		layers.push_back( so.read<std::string>(boost::lexical_cast<std::string>(i)) );
+		size_t tile_size = 0;
+		so.read(boost::lexical_cast<std::string>(i) + "_tile_size", tile_size);
+		tile_sizes.push_back( tile_size );
+
+		size_t overview_levels = 0;
+		int overview_reducer = OVERVIEW_MEAN;
+		if (so.read(boost::lexical_cast<std::string>(i) + "_overview_levels", overview_levels))
+		{
+		    so.read(boost::lexical_cast<std::string>(i) + "_overview_reducer", overview_reducer);
+		    setOverviews(layers.back(), overview_levels, static_cast<OverviewReducer>(overview_reducer));
+		}
+
+		std::string encoding;
+		if (!so.read(boost::lexical_cast<std::string>(i) + "_encoding", encoding) || encoding == "raw")
+		    setBandEncoding(layers.back(), ENCODING_RAW);
+		else if (encoding == "delta_rle")
+		    setBandEncoding(layers.back(), ENCODING_DELTA_RLE);
+		else
+		    throw std::runtime_error("can't unserialize " + className + ": unsupported encoding " + encoding + " of band " + layers.back());
+	    }
 
 	    // there are three cases to differentiate here
 	    // single file access, multi-file access and memory access
@@ -408,12 +835,23 @@ namespace envire
 		else
 		    for (int i = 0; i < count; ++i)
 			readGridData(layers[i], getFullPath(getMapFileName( fso->getMapPath(), getClassName() ), layers[i]));
+
+		// GDAL files are read in dense form and converted afterwards
+		for (int i = 0; i < count; ++i)
+		    if (tile_sizes[i])
+			convertToTiledBand(layers[i], tile_sizes[i]);
 	    }
 	    else
 	    {
 		for (int i = 0; i < count; ++i)
+		{
+		    if (tile_sizes[i])
+			getTiledGridData(layers[i], tile_sizes[i]);
 		    readGridData(layers[i], so.getBinaryInputStream(getFullPath(getMapFileName( getClassName() ), layers[i])));
+		}
 	    }
+	    // the grid size may have changed as well
+	    resetCaches();
 	}
 	else
 	{
@@ -438,12 +876,26 @@ namespace envire
 	// base it on the bands and see if there additional layers available
 	std::vector<std::string> layers; 
         for (DataMap::const_iterator it = data_map.begin(); it != data_map.end(); ++it)
-            if (it->second->isOfType<ArrayType>() && find( layers.begin(), layers.end(), it->first ) == layers.end() )
+            if ((it->second->isOfType<ArrayType>() || it->second->isOfType<TiledArrayType>()) && find( layers.begin(), layers.end(), it->first ) == layers.end() )
 		layers.push_back( it->first );
 
 	// write layer configuration to properties
+	const Grid<T>& self(*this);
 	for( size_t i=0; i<layers.size(); i++ )
+	{
 	    so.write(boost::lexical_cast<std::string>(i), layers[i]);
+	    if (hasTiledBand(layers[i]))
+		so.write(boost::lexical_cast<std::string>(i) + "_tile_size", self.getTiledGridData(layers[i]).getTileSize());
+	    // the overviews are derived from the band, only their
+	    // configuration is saved
+	    if (getOverviewCount(layers[i]))
+	    {
+		so.write(boost::lexical_cast<std::string>(i) + "_overview_levels", getOverviewCount(layers[i]));
+		so.write(boost::lexical_cast<std::string>(i) + "_overview_reducer", static_cast<int>(getOverviewReducer(layers[i])));
+	    }
+	    if (getBandEncoding(layers[i]) == ENCODING_DELTA_RLE)
+		so.write(boost::lexical_cast<std::string>(i) + "_encoding", std::string("delta_rle"));
+	}
 
 	// differentiate between single file, multi-file and memory serialization
 	if( fso && singleFile() )
@@ -456,7 +908,13 @@ namespace envire
 		for( size_t i=0; i<layers.size(); i++ )
 		    writeGridData(layers[i], so.getBinaryOutputStream(getFullPath(getMapFileName(), layers[i])));
 
-        so.write("map_count", layers.size());
+        bool encoded = false;
+        for( size_t i=0; i<layers.size(); i++ )
+            encoded |= (getBandEncoding(layers[i]) != ENCODING_RAW);
+        if (encoded && !fso)
+            so.write("encoded_map_count", layers.size());
+        else
+            so.write("map_count", layers.size());
     }
 
     template<class T>void Grid<T>::readMap(const std::string& path)
@@ -476,13 +934,352 @@ namespace envire
     template<class T>void Grid<T>::set(EnvironmentItem* other)
     {
 	Grid<T>* gp = dynamic_cast<Grid<T>*>( other );
-	if( gp ) operator=( *gp );
+	if( gp ) 
+	    operator=( *gp );
+    }
+
+    template<class T>
+    const typename Grid<T>::BandStatistics& Grid<T>::getStatistics(const std::string& key, size_t histogram_bins) const
+    {
+        typename std::map<std::string, BandStatistics>::iterator it = statistics.find(key);
+        if (it != statistics.end() && it->second.modification_count == getModificationCount()
+                && it->second.histogram.size() == histogram_bins)
+            return it->second;
+
+        if (!hasData(key))
+            throw std::runtime_error("Grid: band " + key + " does not exist.");
+
+        BandStatistics stats;
+        stats.modification_count = getModificationCount();
+        const std::pair<T, bool> no_data = getNoData(key);
+
+        // two passes, as the range of the histogram is only known once
+        // the minimum and maximum have been computed
+        double sum = 0;
+        for (int pass = 0; pass < (histogram_bins ? 2 : 1); ++pass)
+        {
+            if (pass == 1)
+                stats.histogram.resize(histogram_bins, 0);
+
+            if (hasTiledBand(key))
+            {
+                const TiledArrayType& tiled = getTiledGridData(key);
+                size_t allocated = 0;
+                for (typename TiledArrayType::const_tile_iterator it = tiled.beginTiles(); it != tiled.endTiles(); ++it)
+                {
+                    typename TiledArrayType::ConstTile tile(*it);
+                    for (size_t y = 0; y < tile.height; ++y)
+                    {
+                        if (pass == 0)
+                            accumulateStatistics(tile.row(y), tile.width, no_data, stats, sum);
+                        else
+                            accumulateHistogram(tile.row(y), tile.width, no_data, stats);
+                    }
+                    allocated += tile.width * tile.height;
+                }
+
+                // the cells of the unallocated tiles all have the nodata
+                // value of the array, which is only a valid value if the
+                // band has no nodata value
+                const size_t unallocated = cellSizeX * cellSizeY - allocated;
+                const T value = tiled.getNoData();
+                if (!unallocated)
+                    continue;
+                else if (!isValidCell(value, no_data))
+                {
+                    if (pass == 0)
+                        stats.nodata_count += unallocated;
+                }
+                else if (pass == 0)
+                {
+                    stats.min = std::min(stats.min, value);
+                    stats.max = std::max(stats.max, value);
+                    stats.count += unallocated;
+                    sum += static_cast<double>(value) * unallocated;
+                }
+                else
+                    stats.histogram[getHistogramBin(value, stats)] += unallocated;
+            }
+            else
+            {
+                const ArrayType& data = getGridData(key);
+                if (pass == 0)
+                    accumulateStatistics(data.data(), data.num_elements(), no_data, stats, sum);
+                else
+                    accumulateHistogram(data.data(), data.num_elements(), no_data, stats);
+            }
+        }
+
+        if (stats.count)
+            stats.mean = sum / stats.count;
+        return statistics[key] = stats;
+    }
+
+    template<class T>
+    void Grid<T>::accumulateStatistics(const T* data, size_t size, std::pair<T, bool> const& no_data, BandStatistics& stats, double& sum)
+    {
+        T min = stats.min, max = stats.max;
+        double run_sum = 0;
+        size_t count = 0;
+        if (!no_data.second && !std::numeric_limits<T>::has_quiet_NaN)
+        {
+            // all cells are valid, the loop has no branches and can be
+            // vectorized by the compiler
+            for (size_t i = 0; i < size; ++i)
+            {
+                const T value = data[i];
+                min = value < min ? value : min;
+                max = value > max ? value : max;
+                run_sum += value;
+            }
+            count = size;
+        }
+        else
+        {
+            // the invalid cells are masked out with selects instead of
+            // being skipped, so that this loop can be vectorized as well.
+            // The mask is computed without short-circuit evaluation for
+            // the same reason.
+            const bool has_nodata = no_data.second;
+            const T nodata = no_data.first;
+            for (size_t i = 0; i < size; ++i)
+            {
+                const T value = data[i];
+                const bool valid = (value == value) & !(has_nodata & (value == nodata));
+                min = valid & (value < min) ? value : min;
+                max = valid & (value > max) ? value : max;
+                run_sum += valid ? static_cast<double>(value) : 0.0;
+                count += valid;
+            }
+        }
+        stats.min = min;
+        stats.max = max;
+        stats.count += count;
+        stats.nodata_count += size - count;
+        sum += run_sum;
+    }
+
+    template<class T>
+    size_t Grid<T>::getHistogramBin(T value, BandStatistics const& stats)
+    {
+        const size_t bins = stats.histogram.size();
+        if (!(stats.max > stats.min))
+            return 0;
+        const double bin = (static_cast<double>(value) - stats.min) * bins / (static_cast<double>(stats.max) - stats.min);
+        return std::min(static_cast<size_t>(bin), bins - 1);
+    }
+
+    template<class T>
+    void Grid<T>::accumulateHistogram(const T* data, size_t size, std::pair<T, bool> const& no_data, BandStatistics& stats)
+    {
+        const size_t bins = stats.histogram.size();
+        const double min = stats.min;
+        const double scale = stats.max > stats.min ? bins / (static_cast<double>(stats.max) - min) : 0;
+        size_t* histogram = &stats.histogram[0];
+        for (size_t i = 0; i < size; ++i)
+        {
+            const T value = data[i];
+            if (!isValidCell(value, no_data))
+                continue;
+            const size_t bin = static_cast<size_t>((value - min) * scale);
+            histogram[bin < bins ? bin : bins - 1]++;
+        }
+    }
+
+    template<class T>
+    void Grid<T>::setOverviews(const std::string& key, size_t levels, OverviewReducer reducer)
+    {
+        if (!levels)
+        {
+            overviews.erase(key);
+            return;
+        }
+
+        BandOverview& overview = overviews[key];
+        overview.reducer = reducer;
+        overview.levels.resize(levels);
+        overview.modification_count = getModificationCount();
+        overview.full_update = true;
+        overview.dirty_x0 = overview.dirty_x1 = 0;
+        overview.dirty_y0 = overview.dirty_y1 = 0;
+    }
+
+    template<class T>
+    const typename Grid<T>::BandOverview& Grid<T>::getBandOverview(const std::string& key) const
+    {
+        typename std::map<std::string, BandOverview>::const_iterator it = overviews.find(key);
+        if (it == overviews.end())
+            throw std::runtime_error("Grid: band " + key + " has no overviews.");
+        return it->second;
+    }
+
+    template<class T>
+    void Grid<T>::setOverviewDirty(const std::string& key, size_t x0, size_t y0, size_t x1, size_t y1)
+    {
+        typename std::map<std::string, BandOverview>::iterator it = overviews.find(key);
+        if (it == overviews.end())
+            return;
+
+        BandOverview& overview = it->second;
+        x1 = std::min(x1, cellSizeX);
+        y1 = std::min(y1, cellSizeY);
+        if (x0 >= x1 || y0 >= y1)
+            return;
+
+        if (overview.dirty_x0 >= overview.dirty_x1)
+        {
+            overview.dirty_x0 = x0; overview.dirty_x1 = x1;
+            overview.dirty_y0 = y0; overview.dirty_y1 = y1;
+        }
+        else
+        {
+            overview.dirty_x0 = std::min(overview.dirty_x0, x0);
+            overview.dirty_x1 = std::max(overview.dirty_x1, x1);
+            overview.dirty_y0 = std::min(overview.dirty_y0, y0);
+            overview.dirty_y1 = std::max(overview.dirty_y1, y1);
+        }
+    }
+
+    template<class T>
+    void Grid<T>::invalidateOverviews(const std::string& key)
+    {
+        typename std::map<std::string, BandOverview>::iterator it = overviews.find(key);
+        if (it != overviews.end())
+            it->second.full_update = true;
+    }
+
+    template<class T>
+    const typename Grid<T>::ArrayType& Grid<T>::getOverview(const std::string& key, size_t level) const
+    {
+        typename std::map<std::string, BandOverview>::iterator it = overviews.find(key);
+        if (it == overviews.end())
+            throw std::runtime_error("Grid: band " + key + " has no overviews.");
+        if (level < 1 || level > it->second.levels.size())
+            throw std::runtime_error("Grid: band " + key + " has no overview level " + boost::lexical_cast<std::string>(level));
+
+        updateOverview(key, it->second);
+        return it->second.levels[level - 1];
+    }
+
+    template<class T>
+    void Grid<T>::updateOverview(const std::string& key, BandOverview& overview) const
+    {
+        if (!hasData(key))
+            throw std::runtime_error("Grid: band " + key + " does not exist.");
+
+        // the grid might have been resized since the last update
+        size_t width = cellSizeX, height = cellSizeY;
+        for (size_t i = 0; i < overview.levels.size(); ++i)
+        {
+            width = (width + 1) / 2;
+            height = (height + 1) / 2;
+            ArrayType& level = overview.levels[i];
+            if (level.shape()[0] != height || level.shape()[1] != width)
+            {
+                level.resize(boost::extents[height][width]);
+                overview.full_update = true;
+            }
+        }
+
+        const bool has_region = overview.dirty_x0 < overview.dirty_x1;
+        if (!overview.full_update && !has_region && overview.modification_count == getModificationCount())
+            return;
+
+        size_t x0 = 0, y0 = 0, x1 = cellSizeX, y1 = cellSizeY;
+        if (!overview.full_update && has_region)
+        {
+            x0 = overview.dirty_x0; x1 = overview.dirty_x1;
+            y0 = overview.dirty_y0; y1 = overview.dirty_y1;
+        }
+
+        const std::pair<T, bool> no_data = getNoData(key);
+        const ArrayType* source = hasTiledBand(key) ? 0 : &getGridData(key);
+        const TiledArrayType* tiled_source = source ? 0 : &getTiledGridData(key);
+        width = cellSizeX;
+        height = cellSizeY;
+        for (size_t i = 0; i < overview.levels.size(); ++i)
+        {
+            // the cells of the next level that cover the dirty region
+            x0 /= 2; y0 /= 2;
+            x1 = (x1 + 1) / 2; y1 = (y1 + 1) / 2;
+
+            reduceOverview(source, tiled_source, width, height, overview.levels[i],
+                    x0, y0, x1, y1, overview.reducer, no_data);
+
+            source = &overview.levels[i];
+            tiled_source = 0;
+            width = source->shape()[1];
+            height = source->shape()[0];
+        }
+
+        overview.modification_count = getModificationCount();
+        overview.full_update = false;
+        overview.dirty_x0 = overview.dirty_x1 = 0;
+        overview.dirty_y0 = overview.dirty_y1 = 0;
+    }
+
+    template<class T>
+    void Grid<T>::reduceOverview(const ArrayType* source, const TiledArrayType* tiled_source,
+            size_t source_width, size_t source_height, ArrayType& target,
+            size_t x0, size_t y0, size_t x1, size_t y1,
+            OverviewReducer reducer, std::pair<T, bool> const& no_data)
+    {
+        T values[4];
+        for (size_t y = y0; y < y1; ++y)
+        {
+            const size_t sy0 = 2 * y, sy1 = std::min(2 * y + 2, source_height);
+            for (size_t x = x0; x < x1; ++x)
+            {
+                const size_t sx0 = 2 * x, sx1 = std::min(2 * x + 2, source_width);
+
+                size_t count = 0;
+                T invalid = T();
+                for (size_t sy = sy0; sy < sy1; ++sy)
+                    for (size_t sx = sx0; sx < sx1; ++sx)
+                    {
+                        const T value = source ? (*source)[sy][sx] : tiled_source->get(sx, sy);
+                        if (isValidCell(value, no_data))
+                            values[count++] = value;
+                        else
+                            invalid = value;
+                    }
+
+                T& result = target[y][x];
+                if (!count)
+                {
+                    // either the nodata value or NaN
+                    result = no_data.second ? no_data.first : invalid;
+                    continue;
+                }
+
+                result = values[0];
+                if (reducer == OVERVIEW_MIN)
+                {
+                    for (size_t i = 1; i < count; ++i)
+                        result = std::min(result, values[i]);
+                }
+                else if (reducer == OVERVIEW_MAX)
+                {
+                    for (size_t i = 1; i < count; ++i)
+                        result = std::max(result, values[i]);
+                }
+                else
+                {
+                    double sum = 0;
+                    for (size_t i = 0; i < count; ++i)
+                        sum += values[i];
+                    const double mean = sum / count;
+                    result = std::numeric_limits<T>::is_integer ? static_cast<T>(floor(mean + 0.5)) : static_cast<T>(mean);
+                }
+            }
+        }
     }
 
     template<class T>
     void Grid<T>::convertToFrame(const std::string &key,base::samples::frame::Frame &frame)
     {
-        ArrayType& data_ = getGridData(key);
+        const Grid<T>& self(*this);
+        const ArrayType& data_ = self.getGridData(key);
         frame.init(cellSizeX,cellSizeY,sizeof(T)*8,base::samples::frame::MODE_GRAYSCALE);
         memcpy(frame.image.data(),data_.data(),frame.image.size());
         frame.frame_status = base::samples::frame::STATUS_VALID;
@@ -492,12 +1289,71 @@ namespace envire
 
     template<class T>void Grid<T>::writeGridData(const std::string &key, std::ostream& os)
     {
-        ArrayType &data = getGridData(key);
+        // the bands are only read, which must not copy them if they are
+        // shared
+        const Grid<T>& self(*this);
+        if (getBandEncoding(key) == ENCODING_DELTA_RLE)
+        {
+            if (hasTiledBand(key))
+            {
+                ArrayType dense;
+                self.getTiledGridData(key).toArray(dense);
+                BandCodec::encode(dense.data(), sizeof(T), cellSizeX, cellSizeY, os);
+            }
+            else
+                BandCodec::encode(self.getGridData(key).data(), sizeof(T), cellSizeX, cellSizeY, os);
+            return;
+        }
+
+        if (hasTiledBand(key))
+        {
+            // written row by row, so that the stream format does not depend
+            // on the storage of the band
+            const TiledArrayType &tiled = self.getTiledGridData(key);
+            std::vector<T> row(cellSizeX);
+            for (size_t y = 0; y < cellSizeY; ++y)
+            {
+                for (size_t x = 0; x < cellSizeX; ++x)
+                    row[x] = tiled.get(x, y);
+                os.write(reinterpret_cast<const char*>(&row[0]), sizeof(T) * cellSizeX);
+            }
+            return;
+        }
+
+        const ArrayType &data = self.getGridData(key);
         os.write(reinterpret_cast<const char*>(data.data()), sizeof(T) * data.num_elements());
     }
     
     template<class T>void Grid<T>::readGridData(const std::string &key, std::istream& is, boost::enable_if< boost::is_fundamental<T> >* enabler)
     {
+        bandReplaced(key);
+        if (getBandEncoding(key) == ENCODING_DELTA_RLE)
+        {
+            if (hasTiledBand(key))
+            {
+                ArrayType dense( boost::extents[cellSizeY][cellSizeX] );
+                BandCodec::decode(is, dense.data(), sizeof(T), cellSizeX, cellSizeY);
+                getTiledGridData(key).fromArray(dense);
+            }
+            else
+                BandCodec::decode(is, getGridData(key).data(), sizeof(T), cellSizeX, cellSizeY);
+            return;
+        }
+
+        if (hasTiledBand(key))
+        {
+            TiledArrayType &tiled = getTiledGridData(key);
+            tiled.clear();
+            std::vector<T> row(cellSizeX);
+            for (size_t y = 0; y < cellSizeY; ++y)
+            {
+                is.read(reinterpret_cast<char*>(&row[0]), sizeof(T) * cellSizeX);
+                for (size_t x = 0; x < cellSizeX; ++x)
+                    tiled.set(x, y, row[x]);
+            }
+            return;
+        }
+
         ArrayType &data = getGridData(key);
         is.read(reinterpret_cast<char*>(data.data()), sizeof(T) * data.num_elements());
     }
@@ -512,6 +1368,8 @@ namespace envire
     template<class T> void Grid<T>::writeGridData(const std::vector<std::string> &keys,const std::string& path)
     {
 	LOG_DEBUG_S << "writing file "<< path;
+	// the bands are only read
+	const Grid<T>& self(*this);
 
         GDALAllRegister();
 	const char *pszFormat = "GTiff";
@@ -583,13 +1441,60 @@ namespace envire
 		  << " could not be written.";
 	    throw std::runtime_error(strstr.str());
 	  }
-	  ArrayType &data = getGridData(*iter);
           std::pair<T, bool> no_data = getNoData(*iter);
           if (no_data.second)
               poBand->SetNoDataValue(no_data.first);
-	  poBand->RasterIO(GF_Write ,0,0,cellSizeX,cellSizeY,data.data(),cellSizeX,cellSizeY,poBand->GetRasterDataType(),0,0);
+          if (hasTiledBand(*iter))
+          {
+              // only the allocated tiles are written, the rest of the band
+              // is filled with the nodata value
+              const TiledArrayType &tiled = self.getTiledGridData(*iter);
+              poBand->Fill(tiled.getNoData());
+              for (typename TiledArrayType::const_tile_iterator it = tiled.beginTiles(); it != tiled.endTiles(); ++it)
+              {
+                  typename TiledArrayType::ConstTile tile(*it);
+                  poBand->RasterIO(GF_Write, tile.x0, tile.y0, tile.width, tile.height,
+                          const_cast<T*>(tile.data), tile.width, tile.height, data_type,
+                          sizeof(T), sizeof(T) * tile.stride);
+              }
+          }
+          else
+          {
+              const ArrayType &data = self.getGridData(*iter);
+              poBand->RasterIO(GF_Write ,0,0,cellSizeX,cellSizeY,const_cast<T*>(data.data()),cellSizeX,cellSizeY,poBand->GetRasterDataType(),0,0);
+          }
 	  preCallWriteBand(*iter,poBand);
 	}
+
+	// GDAL overviews are defined for the whole dataset. They are created
+	// with the largest level count of all bands, and the levels that the
+	// bands define are overwritten with their own reduction
+	size_t overview_count = 0;
+	for (iter = keys.begin(); iter != keys.end(); ++iter)
+	    overview_count = std::max(overview_count, getOverviewCount(*iter));
+	if (overview_count)
+	{
+	    std::vector<int> factors;
+	    for (size_t level = 1; level <= overview_count; ++level)
+		factors.push_back(1 << level);
+	    if (poDstDS->BuildOverviews("NEAREST", factors.size(), &factors[0], 0, NULL, NULL, NULL) == CE_Failure)
+		throw std::runtime_error("failed to create the overviews of " + path);
+
+	    iter = keys.begin();
+	    for(int i=1;iter != keys.end(); iter++,i++)
+	    {
+		poBand = poDstDS->GetRasterBand(i);
+		for (size_t level = 1; level <= getOverviewCount(*iter); ++level)
+		{
+		    GDALRasterBand* poOverview = poBand->GetOverview(level - 1);
+		    const ArrayType& data = getOverview(*iter, level);
+		    if (!poOverview || poOverview->GetXSize() != static_cast<int>(data.shape()[1]) || poOverview->GetYSize() != static_cast<int>(data.shape()[0]))
+			throw std::runtime_error("failed to write the overviews of " + path);
+		    poOverview->RasterIO(GF_Write, 0, 0, data.shape()[1], data.shape()[0],
+			    const_cast<T*>(data.data()), data.shape()[1], data.shape()[0], data_type, 0, 0);
+		}
+	    }
+	}
 	GDALClose( (GDALDatasetH) poDstDS );
     }
       
@@ -660,6 +1565,7 @@ namespace envire
 	  throw std::runtime_error(strstr.str());
 	}
 	checkBandType(poBand);
+	bandReplaced(*iter);
 	//writing data into the grid object
 	boost::multi_array<T,2> &data(getGridData(*iter));
 
@@ -704,6 +1610,86 @@ namespace envire
 	readGridData(string_vector,path,base_band);
     }
 
+    template<class T> bool Grid<T>::getRasterRange(double origin, double step, double min, double max, int size, int& first, int& last)
+    {
+        double a = (min - origin) / step;
+        double b = (max - origin) / step;
+        if (a > b)
+            std::swap(a, b);
+        a = std::max(a, 0.0);
+        b = std::min(b, static_cast<double>(size));
+        if (a >= b)
+            return false;
+        first = floor(a);
+        last = ceil(b);
+        return true;
+    }
+
+    template<class T>bool Grid<T>::readGridDataWindow(const std::string &key, GdalBlockCache& cache, const Extents& window, double margin, int base_band)
+    {
+        double adfGeoTransform[6];
+        if (!cache.getGeoTransform(adfGeoTransform))
+            throw std::runtime_error("file has no geotransform information");
+        if (fabs(adfGeoTransform[4] * cache.getRasterSizeY()) > fabs(adfGeoTransform[5]) * 1e-2 || fabs(adfGeoTransform[2]) > fabs(adfGeoTransform[1]) * 1e-2)
+            throw std::runtime_error("cannot load rotated raster files");
+
+        const GDALDataType data_type = getGDALDataTypeOfArray();
+        if (cache.getRasterDataType(base_band) != data_type)
+            throw std::runtime_error("enview::Grid<T>: type missmatch between the band of " + cache.getPath() + " and " + getClassName());
+
+        int x0, x1, y0, y1;
+        if (!getRasterRange(adfGeoTransform[0], adfGeoTransform[1],
+                    window.min().x() - margin, window.max().x() + margin,
+                    cache.getRasterSizeX(), x0, x1))
+            return false;
+        if (!getRasterRange(adfGeoTransform[3], adfGeoTransform[5],
+                    window.min().y() - margin, window.max().y() + margin,
+                    cache.getRasterSizeY(), y0, y1))
+            return false;
+
+        cellSizeX = x1 - x0;
+        cellSizeY = y1 - y0;
+        scalex = fabs(adfGeoTransform[1]);
+        scaley = fabs(adfGeoTransform[5]);
+        offsetx = adfGeoTransform[0] + (adfGeoTransform[1] > 0 ? x0 : x1) * adfGeoTransform[1];
+        offsety = adfGeoTransform[3] + (adfGeoTransform[5] > 0 ? y0 : y1) * adfGeoTransform[5];
+        // the caches of all bands refer to the previous window
+        resetCaches();
+
+        double nodata_value;
+        if (cache.getNoData(base_band, nodata_value))
+            setNoData(key, T(nodata_value));
+
+        // tiled bands are filled from a dense copy of the window
+        ArrayType window_data;
+        ArrayType &data = hasTiledBand(key) ? window_data : getGridData(key);
+        data.resize( boost::extents[cellSizeY][cellSizeX] );
+
+        // the rows of the grid are ordered along increasing y, and the
+        // columns along increasing x (see readGridData)
+        char* data_ptr = reinterpret_cast<char*>(data.data());
+        long line_space = sizeof(T) * cellSizeX;
+        if (adfGeoTransform[5] < 0)
+        {
+            data_ptr += line_space * (cellSizeY - 1);
+            line_space = -line_space;
+        }
+        cache.read(base_band, x0, y0, cellSizeX, cellSizeY, data_type, data_ptr, line_space);
+        if (adfGeoTransform[1] < 0)
+            for (size_t yi = 0; yi < cellSizeY; ++yi)
+                std::reverse(&data[yi][0], &data[yi][0] + cellSizeX);
+
+        if (hasTiledBand(key))
+            getTiledGridData(key).fromArray(window_data);
+        return true;
+    }
+
+    template<class T>bool Grid<T>::readGridDataWindow(const std::string &key, const std::string& path, const Extents& window, double margin, int base_band)
+    {
+        GdalBlockCache cache(path);
+        return readGridDataWindow(key, cache, window, margin, base_band);
+    }
+
     template<class T> GDALDataType Grid<T>::getGDALDataTypeOfArray()
     {
       if(typeid(T) == typeid(unsigned char))
@@ -1,6 +1,5 @@
 #include "GridBase.hpp"
 #include "Grid.hpp"
-#include <envire/tools/BresenhamLine.hpp>
 
 using namespace envire;
 
@@ -113,265 +112,113 @@ bool envire::GridBase::getRectPoints(const base::Pose2D &pose, double sizeX, dou
 }
 
 
-bool envire::GridBase::forEachInRectangles(const base::Pose2D& rectCenter_w, double innerSizeX_w, double innerSizeY_w, boost::function< void (size_t, size_t)> innerCallback, double outerSizeX_w, double outerSizeY_w, boost::function< void (size_t, size_t)> outerCallback) const
+bool envire::GridBase::RectangleRaster::init(GridBase const& grid, const base::Pose2D &pose, double sizeX, double sizeY)
 {
-    double multiplier = 10;
-    envire::GridBase::Position upLeft_g;
-    envire::GridBase::Position upRight_g;
-    envire::GridBase::Position downLeft_g;
-    envire::GridBase::Position downRight_g;
-    
-    if(!getRectPoints(rectCenter_w, innerSizeX_w, innerSizeY_w, upLeft_g, upRight_g, downLeft_g, downRight_g, multiplier))
-        return false;
-
-    envire::GridBase::Position upLeftOut;
-    envire::GridBase::Position upRightOut;
-    envire::GridBase::Position downLeftOut;
-    envire::GridBase::Position downRightOut;
-    
-    if(!getRectPoints(rectCenter_w, outerSizeX_w, outerSizeY_w, upLeftOut, upRightOut, downLeftOut, downRightOut, multiplier))
-        return false;
-
-//     std::cout << "upLeftOut    X " << upLeftOut.x << " Y " << upLeftOut.y << std::endl;
-//     std::cout << "upRightOut   X " << upRightOut.x << " Y " << upRightOut.y << std::endl;
-//     std::cout << "downLeftOut  X " << downLeftOut.x << " Y " << downLeftOut.y << std::endl;
-//     std::cout << "downRightOut X " << downRightOut.x << " Y " << downRightOut.y << std::endl;
-    
-    std::vector<envire::GridBase::Position> leftIn;
-    std::vector<envire::GridBase::Position> rightIn;
-    std::vector<envire::GridBase::Position> leftOut;
-    std::vector<envire::GridBase::Position> rightOut;
-    
-    if(upRight_g.y > downRight_g.y)
-    {
-        //points of left side
-        lineBresenham(upRight_g, upLeft_g, leftIn);
-        lineBresenham(upLeft_g, downLeft_g, leftIn);
-
-        lineBresenham(upRightOut, upLeftOut, leftOut);
-        lineBresenham(upLeftOut, downLeftOut, leftOut);
-
-        //points of right side
-        lineBresenham(upRight_g, downRight_g, rightIn);
-        lineBresenham(downRight_g, downLeft_g, rightIn);
-
-        lineBresenham(upRightOut, downRightOut, rightOut);
-        lineBresenham(downRightOut, downLeftOut, rightOut);
-    }
-    else
+    const double sizeXHalf = sizeX / 2.0;
+    const double sizeYHalf = sizeY / 2.0;
+    const Eigen::Rotation2D<double> rot(pose.orientation);
+    const Eigen::Vector2d corners[4] = {
+        pose.position + rot * Eigen::Vector2d(sizeXHalf, -sizeYHalf),
+        pose.position + rot * Eigen::Vector2d(sizeXHalf, sizeYHalf),
+        pose.position + rot * Eigen::Vector2d(-sizeXHalf, sizeYHalf),
+        pose.position + rot * Eigen::Vector2d(-sizeXHalf, -sizeYHalf) };
+
+    double cornerX[4], cornerY[4];
+    for (int i = 0; i < 4; ++i)
     {
-        //points of left side
-        lineBresenham(downRight_g, upRight_g, leftIn);
-        lineBresenham(upRight_g, upLeft_g, leftIn);
-
-        lineBresenham(downRightOut, upRightOut, leftOut);
-        lineBresenham(upRightOut, upLeftOut, leftOut);
-
-        //points of right side
-        lineBresenham(downRight_g, downLeft_g, rightIn);
-        lineBresenham(downLeft_g, upLeft_g, rightIn);
-
-        lineBresenham(downRightOut, downLeftOut, rightOut);
-        lineBresenham(downLeftOut, upLeftOut, rightOut);
+        cornerX[i] = (corners[i].x() - grid.getOffsetX()) / grid.getScaleX();
+        cornerY[i] = (corners[i].y() - grid.getOffsetY()) / grid.getScaleY();
     }
+    return init(cornerX, cornerY, grid.getCellSizeX(), grid.getCellSizeY());
+}
 
-//     std::cout << "Left " << std::endl;
-//     for(std::vector<envire::GridBase::Position>::const_iterator it = leftOut.begin(); it != leftOut.end(); it++ )
-//     {
-//         std::cout << "X " << it->x << " Y " << it->y << std::endl;
-//     }
-//     std::cout << "Right " << std::endl;
-//     for(std::vector<envire::GridBase::Position>::const_iterator it = rightOut.begin(); it != rightOut.end(); it++ )
-//     {
-//         std::cout << "X " << it->x << " Y " << it->y << std::endl;
-//     }
-    
-    std::vector<envire::GridBase::Position>::const_iterator leftInIt = leftIn.begin();
-    std::vector<envire::GridBase::Position>::const_iterator rightInIt = rightIn.begin();
-    std::vector<envire::GridBase::Position>::const_iterator leftOutIt = leftOut.begin();
-    std::vector<envire::GridBase::Position>::const_iterator rightOutIt = rightOut.begin();
+bool envire::GridBase::RectangleRaster::init(const double cornerX[4], const double cornerY[4], size_t cellSizeX, size_t cellSizeY)
+{
+    minY = 1;
+    maxY = 0;
+    this->cellSizeX = cellSizeX;
 
-    
-    size_t inY;
-    size_t outY;
-    size_t minX, maxX;
-    size_t minXOut, maxXOut;
-    while((leftOutIt != leftOut.end()) && (rightOutIt != rightOut.end()))
+    double minCornerY = std::numeric_limits<double>::max();
+    double maxCornerY = -std::numeric_limits<double>::max();
+    for (int i = 0; i < 4; ++i)
     {
-        if(leftInIt != leftIn.end())
-            inY = leftInIt->y / multiplier;
-        
-        outY = leftOutIt->y / multiplier;
-
-        maxX = 0;
-        minX = std::numeric_limits<size_t>::max();
-        maxXOut = 0;
-        minXOut = std::numeric_limits<size_t>::max();
-
-        while((leftInIt != leftIn.end()) && (((size_t) (leftInIt->y / multiplier)) == outY))
-        {
-            if(minX > leftInIt->x)
-                minX = leftInIt->x;
-            if(maxX < leftInIt->x)
-                maxX = leftInIt->x;
-            
-            leftInIt++;
-        }
+        this->cornerX[i] = cornerX[i];
+        this->cornerY[i] = cornerY[i];
+        if (!(cornerX[i] >= 0 && cornerX[i] < cellSizeX && cornerY[i] >= 0 && cornerY[i] < cellSizeY))
+            return false;
+        minCornerY = std::min(minCornerY, cornerY[i]);
+        maxCornerY = std::max(maxCornerY, cornerY[i]);
+    }
 
-        while((rightInIt != rightIn.end()) && (((size_t) (rightInIt->y / multiplier)) == outY))
-        {
-            if(minX > rightInIt->x)
-                minX = rightInIt->x;
-            if(maxX < rightInIt->x)
-                maxX = rightInIt->x;
-            
-            rightInIt++;
-        }
+    // rows whose interior overlaps the rectangle. A rectangle that ends
+    // exactly on a row boundary does not cover the next row.
+    minY = floor(minCornerY);
+    maxY = std::max(minY, static_cast<size_t>(std::max(0.0, ceil(maxCornerY) - 1)));
+    return true;
+}
 
-        while((leftOutIt != leftOut.end()) && (((size_t) (leftOutIt->y / multiplier)) == outY))
-        {
-            if(minXOut > leftOutIt->x)
-                minXOut = leftOutIt->x;
-            if(maxXOut < leftOutIt->x)
-                maxXOut = leftOutIt->x;
-            
-            leftOutIt++;
-        }
+bool envire::GridBase::RectangleRaster::getSpan(size_t y, size_t& x0, size_t& x1) const
+{
+    if (y < minY || y > maxY)
+        return false;
 
-        while((rightOutIt != rightOut.end()) && (((size_t) (rightOutIt->y / multiplier)) == outY))
-        {
-            if(minXOut > rightOutIt->x)
-                minXOut = rightOutIt->x;
-            if(maxXOut < rightOutIt->x)
-                maxXOut = rightOutIt->x;
-            
-            rightOutIt++;
-        }
-        
-        minX /= multiplier;
-        maxX /= multiplier;
-        minXOut /= multiplier;
-        maxXOut /= multiplier;
-        
-        if(outY >= cellSizeY)
+    // extent along x of the part of the border that is within the strip
+    // [y, y + 1]. As the rectangle is convex, this is the extent of the
+    // rectangle in that strip.
+    const double stripMin = y, stripMax = y + 1.0;
+    double minX = std::numeric_limits<double>::max();
+    double maxX = -std::numeric_limits<double>::max();
+    for (int i = 0; i < 4; ++i)
+    {
+        const int j = (i + 1) % 4;
+        const double ax = cornerX[i], ay = cornerY[i];
+        const double bx = cornerX[j], by = cornerY[j];
+        const double a = std::max(stripMin, std::min(ay, by));
+        const double b = std::min(stripMax, std::max(ay, by));
+        if (a > b)
             continue;
-        
-        if(inY == outY)
-        {
-            for(size_t x = minXOut; x < minX; x++)
-            {
-                if(x < cellSizeX)
-                    outerCallback(x, outY);
-            }
-            for(size_t x = minX; x <= maxX; x++)
-            {
-                if(x < cellSizeX)
-                    innerCallback(x, outY);
-            }
-            for(size_t x = maxX+1; x <= maxXOut; x++)
-            {
-                if(x < cellSizeX)
-                    outerCallback(x, outY);
-            }
 
-        }
-        else
+        double xa = ax, xb = bx;
+        if (ay != by)
         {
-            for(size_t x = minXOut; x <= maxXOut; x++)
-            {
-                if(x < cellSizeX)
-                    outerCallback(x, outY);
-            }        
+            xa = ax + (a - ay) * (bx - ax) / (by - ay);
+            xb = ax + (b - ay) * (bx - ax) / (by - ay);
         }
-        
+        minX = std::min(minX, std::min(xa, xb));
+        maxX = std::max(maxX, std::max(xa, xb));
     }
-    return true;
+    if (minX > maxX)
+        return false;
 
+    x0 = floor(minX);
+    x1 = std::min(static_cast<size_t>(std::max(minX, ceil(maxX) - 1)), cellSizeX - 1);
+    return true;
 }
 
-bool envire::GridBase::forEachInRectangle(const base::Pose2D& pose, double sizeXWorld, double sizeYWorld, boost::function<void (size_t, size_t) > callbackGrid) const
+bool envire::GridBase::getRectangleSpans(const base::Pose2D &rectCenterWorld, double sizeXWorld, double sizeYWorld, std::vector<Span>& spans) const
 {
-//     return forEachInRectangles(pose, 0, 0, callbackGrid, widthWorld, heightWorld, callbackGrid);
-    double multiplier = 10;
-    envire::GridBase::Position ulGrid;
-    envire::GridBase::Position urGrid;
-    envire::GridBase::Position dlGrid;
-    envire::GridBase::Position drGrid;
-    
-    if(!getRectPoints(pose, sizeXWorld, sizeYWorld, ulGrid, urGrid, dlGrid, drGrid, multiplier))
+    spans.clear();
+    RectangleRaster raster;
+    if (!raster.init(*this, rectCenterWorld, sizeXWorld, sizeYWorld))
         return false;
 
-    std::vector<envire::GridBase::Position> left;
-    std::vector<envire::GridBase::Position> right;
-
-    if(urGrid.y > drGrid.y)
-    {
-        //points of left side
-        lineBresenham(urGrid, ulGrid, left);
-        lineBresenham(ulGrid, dlGrid, left);
-
-        //points of right side
-        lineBresenham(urGrid, drGrid, right);
-        lineBresenham(drGrid, dlGrid, right);
-    }
-    else
-    {
-        //points of left side
-        lineBresenham(drGrid, urGrid, left);
-        lineBresenham(urGrid, ulGrid, left);
-
-        //points of right side
-        lineBresenham(drGrid, dlGrid, right);
-        lineBresenham(dlGrid, ulGrid, right);
-    }
-    
-    std::vector<envire::GridBase::Position>::const_iterator leftIt = left.begin();
-    std::vector<envire::GridBase::Position>::const_iterator rightIt = right.begin();
-
-    size_t curY;
-    size_t minX, maxX;
-    while((leftIt != left.end()) && (rightIt != right.end()))
-    {
-        curY = leftIt->y / multiplier;
-
-        maxX = 0;
-        minX = std::numeric_limits<size_t>::max();
-        
-        assert(rightIt->y == leftIt->y);
-        
-        while((leftIt != left.end()) && (((size_t) (leftIt->y / multiplier)) == curY))
-        {
-            if(minX > leftIt->x)
-                minX = leftIt->x;
-            if(maxX < leftIt->x)
-                maxX = leftIt->x;
-            
-            leftIt++;
-        }
+    Span span;
+    for (span.y = raster.getMinY(); span.y <= raster.getMaxY(); ++span.y)
+        if (raster.getSpan(span.y, span.x0, span.x1))
+            spans.push_back(span);
+    return true;
+}
 
-        while((rightIt != right.end()) && (((size_t) (rightIt->y / multiplier)) == curY))
-        {
-            if(minX > rightIt->x)
-                minX = rightIt->x;
-            if(maxX < rightIt->x)
-                maxX = rightIt->x;
-            
-            rightIt++;
-        }
-        
-        minX /= multiplier;
-        maxX /= multiplier;
-        
-        if(curY >= cellSizeY)
-            continue;
+bool envire::GridBase::forEachInRectangles(const base::Pose2D& rectCenter_w, double innerSizeX_w, double innerSizeY_w, boost::function< void (size_t, size_t)> innerCallback, double outerSizeX_w, double outerSizeY_w, boost::function< void (size_t, size_t)> outerCallback) const
+{
+    typedef boost::function<void (size_t, size_t)> Callback;
+    return forEachInRectangles<Callback, Callback>(rectCenter_w, innerSizeX_w, innerSizeY_w, innerCallback,
+            outerSizeX_w, outerSizeY_w, outerCallback);
+}
 
-        for(size_t x = minX; x <= maxX; x++)
-        {
-            if(x < cellSizeX)
-                callbackGrid(x, curY);
-        }        
-    }
-    return true;
+bool envire::GridBase::forEachInRectangle(const base::Pose2D& pose, double sizeXWorld, double sizeYWorld, boost::function<void (size_t, size_t) > callbackGrid) const
+{
+    return forEachInRectangle< boost::function<void (size_t, size_t)> >(pose, sizeXWorld, sizeYWorld, callbackGrid);
 }
 
 
@@ -413,6 +260,59 @@ bool GridBase::toGrid( double x, double y, size_t& xi, size_t& yi) const
     return toGrid( x, y, xi, yi, xmod, ymod );
 }
 
+size_t GridBase::toGridBatch(std::vector<Eigen::Vector3d> const& points,
+        std::vector<Position>& cells, std::vector<uint8_t>& inGrid,
+        Eigen::Affine3d const& transform, std::vector<double>* z) const
+{
+    const size_t count = points.size();
+    cells.resize(count);
+    inGrid.resize(count);
+
+    // the points are transformed as by toMap(), and then divided by the
+    // scale like in toGrid(), so that points on the border of a cell end
+    // up in the same cell as with toGrid(). The division does not keep
+    // the loop from being vectorized.
+    const Eigen::Matrix4d& m(transform.matrix());
+    const double ax = m(0,0), bx = m(0,1), cx = m(0,2), dx = m(0,3);
+    const double ay = m(1,0), by = m(1,1), cy = m(1,2), dy = m(1,3);
+    const double sizeX = cellSizeX, sizeY = cellSizeY;
+
+    size_t valid = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const double* p = points[i].data();
+        const double gx = (ax * p[0] + bx * p[1] + cx * p[2] + dx - offsetx) / scalex;
+        const double gy = (ay * p[0] + by * p[1] + cy * p[2] + dy - offsety) / scaley;
+        const bool in = (gx >= 0) & (gx < sizeX) & (gy >= 0) & (gy < sizeY);
+        // the conversion of a negative value to size_t is undefined
+        cells[i].x = static_cast<size_t>(in ? gx : 0);
+        cells[i].y = static_cast<size_t>(in ? gy : 0);
+        inGrid[i] = in;
+        valid += in;
+    }
+
+    if (z)
+    {
+        z->resize(count);
+        for (size_t i = 0; i < count; ++i)
+            (*z)[i] = m.row(2).head<3>().dot(points[i]) + m(2,3);
+    }
+    return valid;
+}
+
+void GridBase::fromGridBatch(std::vector<Position> const& cells, std::vector<Eigen::Vector3d>& points,
+        Eigen::Affine3d const& transform) const
+{
+    points.resize(cells.size());
+
+    // the cell centers are mapped by a single affine map
+    Eigen::Affine3d cellToPoint = transform;
+    cellToPoint.translate(Eigen::Vector3d(offsetx + 0.5 * scalex, offsety + 0.5 * scaley, 0));
+    cellToPoint.scale(Eigen::Vector3d(scalex, scaley, 1));
+    for (size_t i = 0; i < cells.size(); ++i)
+        points[i] = cellToPoint * Eigen::Vector3d(cells[i].x, cells[i].y, 0);
+}
+
 bool envire::GridBase::toGridTimesX(double x, double y, size_t& xi, size_t& yi, int multiplier) const
 {
     size_t am = floor(((x-offsetx)/scalex)*multiplier);
@@ -564,11 +464,60 @@ std::pair<GridBase::Ptr, envire::Transform> GridBase::readGridFromGdal(std::stri
     return std::make_pair(map, transform);
 }
 
+template<typename T>
+static GridBase::Ptr readGridWindowFromGdalHelper(GdalBlockCache& cache, std::string const& band_name, GridBase::Extents const& window, double margin, int band)
+{
+    typename envire::Grid<T>::Ptr result = new Grid<T>();
+    if (!result->readGridDataWindow(band_name, cache, window, margin, band))
+        throw std::runtime_error("the requested window does not overlap with " + cache.getPath());
+    return result;
+}
+
+std::pair<GridBase::Ptr, envire::Transform> GridBase::readGridFromGdal(std::string const& path, std::string const& band_name, Extents const& window, double margin, int band)
+{
+    GdalBlockCache cache(path);
+
+    GridBase::Ptr map;
+    switch(cache.getRasterDataType(band))
+    {
+    case  GDT_Byte:
+        map =  readGridWindowFromGdalHelper<uint8_t>(cache, band_name, window, margin, band);
+        break;
+    case GDT_Int16:
+        map =  readGridWindowFromGdalHelper<int16_t>(cache, band_name, window, margin, band);
+        break;
+    case GDT_UInt16:
+        map =  readGridWindowFromGdalHelper<uint16_t>(cache, band_name, window, margin, band);
+        break;
+    case GDT_Int32:
+        map =  readGridWindowFromGdalHelper<int32_t>(cache, band_name, window, margin, band);
+        break;
+    case GDT_UInt32:
+        map =  readGridWindowFromGdalHelper<uint32_t>(cache, band_name, window, margin, band);
+        break;
+    case GDT_Float32:
+        map =  readGridWindowFromGdalHelper<float>(cache, band_name, window, margin, band);
+        break;
+    case GDT_Float64:
+        map =  readGridWindowFromGdalHelper<double>(cache, band_name, window, margin, band);
+        break;
+    default:
+        throw std::runtime_error("enview::Grid<T>: GDT type is not supported.");  
+    }
+
+    return std::make_pair(map, Transform(Transform::Identity()));
+}
+
 void GridBase::copyBandFrom(GridBase const& source, std::string const& source_band, std::string const& _target_band)
 {
     throw std::runtime_error("copyBandFrom is not implemented for this type of grid");
 }
 
+void GridBase::shareBandFrom(GridBase const& source, std::string const& source_band, std::string const& _target_band)
+{
+    throw std::runtime_error("shareBandFrom is not implemented for this type of grid");
+}
+
 GridBase::Ptr GridBase::create(std::string const& type_name,
         size_t cellSizeX, size_t cellSizeY,
         double scale_x, double scale_y,
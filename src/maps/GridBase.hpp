@@ -5,6 +5,9 @@
 #include <envire/Core.hpp>
 #include <base/Pose.hpp>
 #include <boost/function.hpp>
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
 
 namespace envire 
 {
@@ -59,6 +62,66 @@ namespace envire
 	typedef Eigen::Vector2d Point2D;
 	typedef Eigen::AlignedBox<int, 2> CellExtents;
 
+        /** The cells [x0, x1] of row y */
+        struct Span
+        {
+            size_t y;
+            size_t x0;
+            size_t x1;
+
+            Span() {}
+            Span( size_t y, size_t x0, size_t x1 ) : y(y), x0(x0), x1(x1) {}
+        };
+
+        /** Scanline rasterization of an oriented rectangle
+         *
+         * The span of each row is computed directly from the corners of the
+         * rectangle, so iterating over the covered cells needs neither
+         * temporary storage nor oversampling. A cell is covered if the
+         * rectangle overlaps it.
+         */
+        class RectangleRaster
+        {
+        public:
+            RectangleRaster() : minY(1), maxY(0), cellSizeX(0) {}
+
+            /** Sets up the raster for the rectangle of size sizeX x sizeY
+             * centered at pose, given in the map frame of \c grid
+             *
+             * @return false if the rectangle is not inside the grid, in which
+             * case the raster covers no cell
+             */
+            bool init( GridBase const& grid, const base::Pose2D& pose, double sizeX, double sizeY );
+
+            /** Sets up the raster for the quadrilateral whose corners, given
+             * in order along its border, are (cornerX[i], cornerY[i]) in
+             * cell units, on a grid of cellSizeX x cellSizeY cells
+             *
+             * @return false if a corner is not inside the grid
+             */
+            bool init( const double cornerX[4], const double cornerY[4], size_t cellSizeX, size_t cellSizeY );
+
+            /** first row covered by the rectangle */
+            size_t getMinY() const { return minY; }
+            /** last row covered by the rectangle. It is smaller than
+             * getMinY() if the raster is empty */
+            size_t getMaxY() const { return maxY; }
+
+            /** Computes the cells [x0, x1] of row \c y that are covered by
+             * the rectangle
+             *
+             * @return false if the row is not covered at all
+             */
+            bool getSpan( size_t y, size_t& x0, size_t& x1 ) const;
+
+        private:
+            /** corners in cell units, in order along the border */
+            double cornerX[4];
+            double cornerY[4];
+            size_t minY, maxY;
+            size_t cellSizeX;
+        };
+
     protected:
         
         /**
@@ -140,6 +203,80 @@ namespace envire
         bool forEachInRectangles(const base::Pose2D &rectCenter_w, double innerSizeX_w, double innerSizeY_w, boost::function<void (size_t, size_t)> innerCallback, 
                                                         double outerSizeX_w, double outerSizeY_w, boost::function<void (size_t, size_t)> outerCallback) const;
 
+        /** @overload
+         *
+         * Calls callbackGrid(x, y) for each covered cell. Unlike the
+         * boost::function version, the call can be inlined. The callback is
+         * taken by const reference, i.e. callbacks that accumulate have to
+         * refer to their state.
+         */
+        template <class F>
+        bool forEachInRectangle(const base::Pose2D &rectCenterWorld, double sizeXWorld, double sizeYWorld, F const& callbackGrid) const
+        {
+            RectangleRaster raster;
+            if (!raster.init(*this, rectCenterWorld, sizeXWorld, sizeYWorld))
+                return false;
+
+            size_t x0, x1;
+            for (size_t y = raster.getMinY(); y <= raster.getMaxY(); ++y)
+            {
+                if (!raster.getSpan(y, x0, x1))
+                    continue;
+                for (size_t x = x0; x <= x1; ++x)
+                    callbackGrid(x, y);
+            }
+            return true;
+        }
+
+        /** @overload
+         *
+         * Calls innerCallback(x, y) for the cells covered by the inner
+         * rectangle, and outerCallback(x, y) for the other cells covered by
+         * the outer rectangle. The inner rectangle must be contained in the
+         * outer one.
+         */
+        template <class FInner, class FOuter>
+        bool forEachInRectangles(const base::Pose2D &rectCenter_w, double innerSizeX_w, double innerSizeY_w, FInner const& innerCallback,
+                double outerSizeX_w, double outerSizeY_w, FOuter const& outerCallback) const
+        {
+            RectangleRaster inner, outer;
+            if (!inner.init(*this, rectCenter_w, innerSizeX_w, innerSizeY_w))
+                return false;
+            if (!outer.init(*this, rectCenter_w, outerSizeX_w, outerSizeY_w))
+                return false;
+
+            size_t x0, x1, inner_x0, inner_x1;
+            for (size_t y = outer.getMinY(); y <= outer.getMaxY(); ++y)
+            {
+                if (!outer.getSpan(y, x0, x1))
+                    continue;
+                if (!inner.getSpan(y, inner_x0, inner_x1))
+                {
+                    for (size_t x = x0; x <= x1; ++x)
+                        outerCallback(x, y);
+                    continue;
+                }
+
+                inner_x0 = std::max(inner_x0, x0);
+                inner_x1 = std::min(inner_x1, x1);
+                for (size_t x = x0; x < inner_x0; ++x)
+                    outerCallback(x, y);
+                for (size_t x = inner_x0; x <= inner_x1; ++x)
+                    innerCallback(x, y);
+                for (size_t x = inner_x1 + 1; x <= x1; ++x)
+                    outerCallback(x, y);
+            }
+            return true;
+        }
+
+        /** Stores the spans of the cells covered by the given rectangle in
+         * \c spans, ordered by increasing row. The vector is cleared first,
+         * so that callers can reuse it to avoid allocations.
+         *
+         * @return false if the rectangle is not inside the grid
+         */
+        bool getRectangleSpans(const base::Pose2D &rectCenterWorld, double sizeXWorld, double sizeYWorld, std::vector<Span>& spans) const;
+
         /** Converts coordinates from the frame specified by \c frame to the
          * map-local grid coordinates
          *
@@ -165,6 +302,33 @@ namespace envire
          */
 	bool toGrid(double x, double y, size_t& xi, size_t& yi, double& xmod, double& ymod) const;
 
+        /** Converts a batch of points to grid coordinates
+         *
+         * Each point is first transformed by \c transform, which is meant
+         * to bring it into the map-local frame. The points are converted
+         * without any branch per point, and end up in the same cells as
+         * with toGrid(), also on the borders of the cells.
+         *
+         * @param cells the cell of each point. It is (0, 0) for the points
+         *        that are outside of the grid
+         * @param inGrid 1 for the points that are inside of the grid, and 0
+         *        for the others
+         * @param z if not NULL, receives the z coordinate of each point
+         *        after the transform
+         * @return the number of points that are inside of the grid
+         */
+        size_t toGridBatch(std::vector<Eigen::Vector3d> const& points,
+                std::vector<Position>& cells, std::vector<uint8_t>& inGrid,
+                Eigen::Affine3d const& transform = Eigen::Affine3d::Identity(),
+                std::vector<double>* z = NULL) const;
+
+        /** Converts a batch of cells to the positions of their centers,
+         * transformed by \c transform. The centers are at z = 0 before the
+         * transform.
+         */
+        void fromGridBatch(std::vector<Position> const& cells, std::vector<Eigen::Vector3d>& points,
+                Eigen::Affine3d const& transform = Eigen::Affine3d::Identity()) const;
+
         /** Converts coordinates from the map-local grid coordinates to
          * the coordinates in the specified \c frame
          *
@@ -257,6 +421,24 @@ namespace envire
          */
         static std::pair<GridBase::Ptr, Transform> readGridFromGdal(std::string const& path, std::string const& band_name, int band = 1);
 
+        /** Read the part of a band from a GDAL file that covers \c window,
+         * extended by \c margin on all sides, and returns a Grid map
+         * containing the loaded data
+         *
+         * The window is given in the georeferenced coordinates of the file.
+         * Unlike the full read, the offsets of the returned grid are set to
+         * the georeferenced position of the window, so the returned
+         * transform is the identity. See Grid<T>::readGridDataWindow.
+         *
+         * @arg path the path to the GDAL file
+         * @arg band_name the band name in the created Grid instance
+         * @arg window the area that should be loaded
+         * @arg margin the distance by which the window is extended
+         * @arg band the band index in the GDAL file
+         * @throw std::runtime_error if the window does not overlap the raster
+         */
+        static std::pair<GridBase::Ptr, Transform> readGridFromGdal(std::string const& path, std::string const& band_name, Extents const& window, double margin = 0.0, int band = 1);
+
         /** Copies the specified band in this grid map
          *
          * @arg target_name the name of the new band. If omitted, uses \c band_name
@@ -266,6 +448,16 @@ namespace envire
          */
         virtual void copyBandFrom(GridBase const& source, std::string const& band_name, std::string const& target_name = "");
 
+        /** Shares the specified band with this grid map, i.e. makes it
+         * available without copying it until either grid modifies it
+         *
+         * @arg target_name the name of the new band. If omitted, uses \c band_name
+         * @throw {std::runtime_error if it is not implemented for this grid and
+         * std::bad_dynamic_cast if GridBase and \c this are not of the same
+         * type }
+         */
+        virtual void shareBandFrom(GridBase const& source, std::string const& band_name, std::string const& target_name = "");
+
         /** Creates a new grid of the specified type and parameters
          */
         static Ptr create(std::string const& type_name,
@@ -0,0 +1,360 @@
+#ifndef ENVIRE_GRIDKERNELS_HPP
+#define ENVIRE_GRIDKERNELS_HPP
+
+#include <envire/maps/Grid.hpp>
+#include <envire/tools/ParallelFor.hpp>
+
+#include <boost/multi_array.hpp>
+#include <stdexcept>
+#include <vector>
+
+namespace envire
+{
+
+/** Neighbourhood of a cell, as passed to the functor of
+ * GridKernels::stencil()
+ *
+ * n(dx, dy) is the value of the cell (x + dx, y + dy), for dx in [-HX, HX]
+ * and dy in [-HY, HY].
+ */
+template <class T, int HX, int HY>
+class Neighbourhood
+{
+public:
+    static const int WIDTH = 2 * HX + 1;
+    static const int HEIGHT = 2 * HY + 1;
+
+    /** position of the center cell in the grid */
+    size_t x, y;
+
+    T const& operator()( int dx, int dy ) const
+    {
+        return center[dy * stride + dx];
+    }
+
+    /** true if the whole neighbourhood is inside the grid. Otherwise, the
+     * values outside of the grid are given by the border policy of the
+     * stencil.
+     */
+    bool isInterior() const { return interior; }
+
+private:
+    template <class> friend struct GridKernelsDetail;
+    const T* center;
+    long stride;
+    bool interior;
+};
+
+/** Data parallel operations on the bands of Grid<T>.
+ *
+ * The operations are given as functors, which are applied to every cell. The
+ * rows of the band are split into contiguous blocks that are processed in
+ * parallel (see parallelFor()), so the functors must be safe to call
+ * concurrently. Exceptions thrown by a functor are reported as
+ * std::runtime_error once all threads have finished.
+ *
+ * All bands given to one call must have the same size. The array versions
+ * take the band data as returned by Grid<T>::getGridData(), the grid versions
+ * look the bands up, creating the output band if required.
+ */
+class GridKernels
+{
+public:
+    /** Values of stencil neighbourhoods outside of the grid */
+    enum BorderPolicy
+    {
+        /** the output cells whose neighbourhood is not completely inside
+         * the grid are not written */
+        BORDER_SKIP,
+        /** the values of the closest cell inside the grid are used */
+        BORDER_CLAMP,
+        /** a constant value is used */
+        BORDER_CONSTANT
+    };
+
+    /** out[y][x] = f(in[y][x]) */
+    template <class T, class R, class F>
+    static void map( boost::multi_array<T, 2> const& in, boost::multi_array<R, 2>& out, F const& f, size_t threads = 0 );
+
+    /** out[y][x] = f(in1[y][x], in2[y][x]) */
+    template <class T1, class T2, class R, class F>
+    static void zipMap( boost::multi_array<T1, 2> const& in1, boost::multi_array<T2, 2> const& in2,
+            boost::multi_array<R, 2>& out, F const& f, size_t threads = 0 );
+
+    /** out[y][x] = f(n), where n is the Neighbourhood<T, HX, HY> of the
+     * cell (x, y) in \c in. The halo sizes HX and HY are template
+     * parameters, so that the functor can be specialized on them.
+     *
+     * \c in and \c out must not be the same band.
+     *
+     * @param border_value the value outside of the grid for BORDER_CONSTANT
+     */
+    template <int HX, int HY, class T, class R, class F>
+    static void stencil( boost::multi_array<T, 2> const& in, boost::multi_array<R, 2>& out, F const& f,
+            BorderPolicy border = BORDER_CLAMP, T border_value = T(), size_t threads = 0 );
+
+    /** Reduces all cells of \c in to a single value.
+     *
+     * The functor needs two methods:
+     *
+     * <code>
+     * void operator()(A& acc, T value) const; // adds value to acc
+     * void combine(A& acc, A const& other) const; // adds other to acc
+     * </code>
+     *
+     * Each block of rows is reduced separately, starting with \c init, and
+     * the partial results are combined in the order of the blocks. \c init
+     * must therefore be neutral with respect to combine().
+     */
+    template <class T, class A, class F>
+    static A reduce( boost::multi_array<T, 2> const& in, A const& init, F const& f, size_t threads = 0 );
+
+    template <class T, class R, class F>
+    static void map( Grid<T> const& in, std::string const& in_band,
+            Grid<R>& out, std::string const& out_band, F const& f, size_t threads = 0 )
+    {
+        boost::multi_array<R, 2>& out_data( out.getGridData( out_band ) );
+        map( in.getGridData( in_band ), out_data, f, threads );
+    }
+
+    template <class T1, class T2, class R, class F>
+    static void zipMap( Grid<T1> const& in1, std::string const& in1_band,
+            Grid<T2> const& in2, std::string const& in2_band,
+            Grid<R>& out, std::string const& out_band, F const& f, size_t threads = 0 )
+    {
+        boost::multi_array<R, 2>& out_data( out.getGridData( out_band ) );
+        zipMap( in1.getGridData( in1_band ), in2.getGridData( in2_band ), out_data, f, threads );
+    }
+
+    template <int HX, int HY, class T, class R, class F>
+    static void stencil( Grid<T> const& in, std::string const& in_band,
+            Grid<R>& out, std::string const& out_band, F const& f,
+            BorderPolicy border = BORDER_CLAMP, T border_value = T(), size_t threads = 0 )
+    {
+        boost::multi_array<R, 2>& out_data( out.getGridData( out_band ) );
+        stencil<HX, HY>( in.getGridData( in_band ), out_data, f, border, border_value, threads );
+    }
+
+    template <class T, class A, class F>
+    static A reduce( Grid<T> const& in, std::string const& in_band, A const& init, F const& f, size_t threads = 0 )
+    {
+        return reduce( in.getGridData( in_band ), init, f, threads );
+    }
+
+    /** the minimum number of cells per block of rows */
+    static const size_t MIN_BLOCK_CELLS = 4096;
+
+    static size_t getMinBlockRows( size_t width )
+    {
+        return width ? std::max<size_t>( 1, MIN_BLOCK_CELLS / width ) : 1;
+    }
+
+    template <class A, class B>
+    static void checkSize( boost::multi_array<A, 2> const& a, boost::multi_array<B, 2> const& b )
+    {
+        if( a.shape()[0] != b.shape()[0] || a.shape()[1] != b.shape()[1] )
+            throw std::runtime_error("GridKernels: the bands have different sizes");
+    }
+};
+
+/** the row functors that are run by parallelFor() */
+template <class Dummy>
+struct GridKernelsDetail
+{
+    template <class T, class R, class F>
+    struct MapRows
+    {
+        boost::multi_array<T, 2> const& in;
+        boost::multi_array<R, 2>& out;
+        F const& f;
+
+        MapRows( boost::multi_array<T, 2> const& in, boost::multi_array<R, 2>& out, F const& f )
+            : in( in ), out( out ), f( f ) {}
+
+        void operator()( size_t first, size_t last ) const
+        {
+            const size_t width = in.shape()[1];
+            for( size_t y = first; y < last; ++y )
+            {
+                const T* in_row = in.data() + y * width;
+                R* out_row = out.data() + y * width;
+                for( size_t x = 0; x < width; ++x )
+                    out_row[x] = f( in_row[x] );
+            }
+        }
+    };
+
+    template <class T1, class T2, class R, class F>
+    struct ZipMapRows
+    {
+        boost::multi_array<T1, 2> const& in1;
+        boost::multi_array<T2, 2> const& in2;
+        boost::multi_array<R, 2>& out;
+        F const& f;
+
+        ZipMapRows( boost::multi_array<T1, 2> const& in1, boost::multi_array<T2, 2> const& in2,
+                boost::multi_array<R, 2>& out, F const& f )
+            : in1( in1 ), in2( in2 ), out( out ), f( f ) {}
+
+        void operator()( size_t first, size_t last ) const
+        {
+            const size_t width = in1.shape()[1];
+            for( size_t y = first; y < last; ++y )
+            {
+                const T1* in1_row = in1.data() + y * width;
+                const T2* in2_row = in2.data() + y * width;
+                R* out_row = out.data() + y * width;
+                for( size_t x = 0; x < width; ++x )
+                    out_row[x] = f( in1_row[x], in2_row[x] );
+            }
+        }
+    };
+
+    template <int HX, int HY, class T, class R, class F>
+    struct StencilRows
+    {
+        typedef Neighbourhood<T, HX, HY> N;
+
+        boost::multi_array<T, 2> const& in;
+        boost::multi_array<R, 2>& out;
+        F const& f;
+        GridKernels::BorderPolicy border;
+        T border_value;
+
+        StencilRows( boost::multi_array<T, 2> const& in, boost::multi_array<R, 2>& out, F const& f,
+                GridKernels::BorderPolicy border, T border_value )
+            : in( in ), out( out ), f( f ), border( border ), border_value( border_value ) {}
+
+        void operator()( size_t first, size_t last ) const
+        {
+            const long height = in.shape()[0], width = in.shape()[1];
+            // copy of the neighbourhood of border cells
+            std::vector<T> buffer( N::WIDTH * N::HEIGHT );
+
+            N n;
+            for( long y = first; y < static_cast<long>( last ); ++y )
+            {
+                R* out_row = out.data() + y * width;
+                const bool interior_row = y >= HY && y < height - HY;
+                for( long x = 0; x < width; ++x )
+                {
+                    n.x = x;
+                    n.y = y;
+                    n.interior = interior_row && x >= HX && x < width - HX;
+                    if( n.interior )
+                    {
+                        n.center = in.data() + y * width + x;
+                        n.stride = width;
+                    }
+                    else if( border == GridKernels::BORDER_SKIP )
+                        continue;
+                    else
+                    {
+                        for( long dy = -HY; dy <= HY; ++dy )
+                        {
+                            for( long dx = -HX; dx <= HX; ++dx )
+                            {
+                                long cx = x + dx, cy = y + dy;
+                                T value;
+                                if( cx >= 0 && cx < width && cy >= 0 && cy < height )
+                                    value = in.data()[cy * width + cx];
+                                else if( border == GridKernels::BORDER_CONSTANT )
+                                    value = border_value;
+                                else
+                                {
+                                    cx = std::min( std::max( cx, 0L ), width - 1 );
+                                    cy = std::min( std::max( cy, 0L ), height - 1 );
+                                    value = in.data()[cy * width + cx];
+                                }
+                                buffer[(dy + HY) * N::WIDTH + dx + HX] = value;
+                            }
+                        }
+                        n.center = &buffer[HY * N::WIDTH + HX];
+                        n.stride = N::WIDTH;
+                    }
+                    out_row[x] = f( n );
+                }
+            }
+        }
+    };
+
+    template <class T, class A, class F>
+    struct ReduceBlocks
+    {
+        boost::multi_array<T, 2> const& in;
+        std::vector<A>& partial;
+        size_t block_rows;
+        F const& f;
+
+        ReduceBlocks( boost::multi_array<T, 2> const& in, std::vector<A>& partial, size_t block_rows, F const& f )
+            : in( in ), partial( partial ), block_rows( block_rows ), f( f ) {}
+
+        void operator()( size_t first, size_t last ) const
+        {
+            const size_t height = in.shape()[0], width = in.shape()[1];
+            for( size_t block = first; block < last; ++block )
+            {
+                A& acc( partial[block] );
+                const size_t end = std::min( height, (block + 1) * block_rows );
+                for( size_t y = block * block_rows; y < end; ++y )
+                {
+                    const T* row = in.data() + y * width;
+                    for( size_t x = 0; x < width; ++x )
+                        f( acc, row[x] );
+                }
+            }
+        }
+    };
+};
+
+template <class T, class R, class F>
+void GridKernels::map( boost::multi_array<T, 2> const& in, boost::multi_array<R, 2>& out, F const& f, size_t threads )
+{
+    checkSize( in, out );
+    parallelFor( 0, in.shape()[0], typename GridKernelsDetail<void>::template MapRows<T, R, F>( in, out, f ),
+            threads, getMinBlockRows( in.shape()[1] ) );
+}
+
+template <class T1, class T2, class R, class F>
+void GridKernels::zipMap( boost::multi_array<T1, 2> const& in1, boost::multi_array<T2, 2> const& in2,
+        boost::multi_array<R, 2>& out, F const& f, size_t threads )
+{
+    checkSize( in1, in2 );
+    checkSize( in1, out );
+    parallelFor( 0, in1.shape()[0], typename GridKernelsDetail<void>::template ZipMapRows<T1, T2, R, F>( in1, in2, out, f ),
+            threads, getMinBlockRows( in1.shape()[1] ) );
+}
+
+template <int HX, int HY, class T, class R, class F>
+void GridKernels::stencil( boost::multi_array<T, 2> const& in, boost::multi_array<R, 2>& out, F const& f,
+        BorderPolicy border, T border_value, size_t threads )
+{
+    checkSize( in, out );
+    if( static_cast<const void*>( in.data() ) == static_cast<const void*>( out.data() ) )
+        throw std::runtime_error("GridKernels: the input and output of a stencil can not be the same band");
+    parallelFor( 0, in.shape()[0], typename GridKernelsDetail<void>::template StencilRows<HX, HY, T, R, F>( in, out, f, border, border_value ),
+            threads, getMinBlockRows( in.shape()[1] ) );
+}
+
+template <class T, class A, class F>
+A GridKernels::reduce( boost::multi_array<T, 2> const& in, A const& init, F const& f, size_t threads )
+{
+    const size_t height = in.shape()[0];
+    if( height == 0 )
+        return init;
+
+    // the blocks do not depend on the number of threads, so that the
+    // result does not either
+    const size_t block_rows = getMinBlockRows( in.shape()[1] );
+    const size_t blocks = (height + block_rows - 1) / block_rows;
+    std::vector<A> partial( blocks, init );
+    parallelFor( 0, blocks, typename GridKernelsDetail<void>::template ReduceBlocks<T, A, F>( in, partial, block_rows, f ), threads );
+
+    A result( partial[0] );
+    for( size_t i = 1; i < blocks; ++i )
+        f.combine( result, partial[i] );
+    return result;
+}
+
+}
+#endif // ENVIRE_GRIDKERNELS_HPP
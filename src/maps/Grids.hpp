@@ -100,7 +100,7 @@ namespace envire
   template<class T1, class T2>
   void copyGridToGrid(Grid<T1> &grid1, Grid<T2> &grid2,float scale)
   {
-     typename Grid<T1>::ArrayType &data1 = grid1.getGridData();
+     typename Grid<T1>::ArrayType const &data1 = static_cast<const Grid<T1>&>(grid1).getGridData();
      typename Grid<T2>::ArrayType &data2 = grid2.getGridData("elevation");
      for (unsigned int i1 = 0; i1< min(grid1.getHeight(),grid2.getHeight());i1++)
      {
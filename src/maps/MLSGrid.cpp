@@ -14,6 +14,8 @@ static SerializationPlugin<MLSGrid> factory("MultiLevelSurfaceGrid");
 MLSGrid::MLSGrid()
     : GridBase()
     , cellcount( 0 )
+    , dirtyCells( 1 )
+    , firstCellGeneration( 0 )
 {
     clear();
 }
@@ -22,6 +24,8 @@ MLSGrid::MLSGrid(size_t cellSizeX, size_t cellSizeY, double scalex, double scale
     : GridBase( cellSizeX, cellSizeY, scalex, scaley, offsetx, offsety )
     , cells( cellSizeX, cellSizeY )
     , cellcount( 0 )
+    , dirtyCells( 1 )
+    , firstCellGeneration( 0 )
 {
     clear();
 }
@@ -33,6 +37,7 @@ void MLSGrid::clear()
     if(index) index->reset();
     extents = CellExtents();
     config.useColor = false;
+    setCellsDirty();
 }
 
 MLSGrid::MLSGrid(const MLSGrid& other)
@@ -41,7 +46,11 @@ MLSGrid::MLSGrid(const MLSGrid& other)
     , config( other.config )
     , cellcount( other.cellcount )
     , extents( other.extents )
+    , dirtyCells( 1 )
+    , firstCellGeneration( 0 )
 {
+    // the patches of the copy are new objects
+    setCellsDirty();
 }
 
 MLSGrid& MLSGrid::operator=(const MLSGrid& other)
@@ -54,6 +63,10 @@ MLSGrid& MLSGrid::operator=(const MLSGrid& other)
 	extents = other.extents;
 	config = other.config;
 	cellcount = other.cellcount;
+	// all patches have been replaced, so that anything that refers to
+	// the old ones, e.g. an incremental TraversabilityGrassfire, has to
+	// be updated for the whole grid
+	setCellsDirty();
     }
 
     return *this;
@@ -167,6 +180,7 @@ void MLSGrid::unserialize(Serialization& so)
 	config.useColor = false;
 
     cells.resize( cellSizeX, cellSizeY );
+    setCellsDirty();
 
     // this is a workaround to make the MLS generatable by 
     // the GridBase::create method, which sets the map_count
@@ -412,6 +426,15 @@ MLSGrid::iterator MLSGrid::erase( iterator position )
 {
     iterator res = cells.erase( position );
     cellcount--;
+    setCellsDirty();
+    return res; 
+}
+
+MLSGrid::iterator MLSGrid::erase( size_t xi, size_t yi, iterator position )
+{
+    iterator res = cells.erase( position );
+    cellcount--;
+    setCellDirty( Position( xi, yi ) );
     return res; 
 }
 
@@ -485,6 +508,7 @@ void MLSGrid::updateCell( size_t xi, size_t yi, const SurfacePatch& co )
     iterator_list merged;
     // make a copy of the surfacepatch as it may get updated in the merge
     SurfacePatch o( co );
+    setCellDirty( Position( xi, yi ) );
 
     for(MLSGrid::iterator it = beginCell( xi, yi ); it != endCell(); it++ )
     {
@@ -509,7 +533,7 @@ void MLSGrid::updateCell( size_t xi, size_t yi, const SurfacePatch& co )
 	    {
 		if( mergePatch( **merged.begin(), **it ) )
 		{
-		    erase( *it );
+		    erase( xi, yi, *it );
 		    it = merged.erase( it );
 		}
 		else
@@ -692,6 +716,7 @@ void MLSGrid::scalePatchWeights( double scale )
             }
         }
     }
+    setCellsDirty();
 }
 
 std::pair<double, double> MLSGrid::matchHeight( const MLSGrid& other )
@@ -735,6 +760,41 @@ void MLSGrid::addCell( const Position& pos )
 	index->addCell(pos);
 
     extents.extend( Eigen::Vector2i( pos.x, pos.y ) );
+    setCellDirty( pos );
+}
+
+void MLSGrid::setCellsDirty()
+{
+    if( cellSizeX && cellSizeY )
+    {
+	dirtyCells.back().extend( Eigen::Vector2i( 0, 0 ) );
+	dirtyCells.back().extend( Eigen::Vector2i( cellSizeX - 1, cellSizeY - 1 ) );
+    }
+}
+
+MLSGrid::CellExtents MLSGrid::getDirtyCellExtents( size_t generation ) const
+{
+    // the first entry contains the older generations as well
+    size_t first = generation > firstCellGeneration ? generation - firstCellGeneration : 0;
+    CellExtents result;
+    for( size_t i = first; i < dirtyCells.size(); i++ )
+	result.extend( dirtyCells[i] );
+    return result;
+}
+
+size_t MLSGrid::startCellGeneration()
+{
+    // the oldest generations are merged, so that the history does not
+    // grow without bounds
+    const size_t max_generations = 16;
+    if( dirtyCells.size() >= max_generations )
+    {
+	dirtyCells[1].extend( dirtyCells[0] );
+	dirtyCells.pop_front();
+	firstCellGeneration++;
+    }
+    dirtyCells.push_back( CellExtents() );
+    return firstCellGeneration + dirtyCells.size() - 1;
 }
 
 void MLSGrid::generateIndex(boost::shared_ptr<Index> gindex) const
@@ -762,5 +822,6 @@ void MLSGrid::initIndex()
 void MLSGrid::move(int x, int y)
 {
     cells.move(x, y);
+    setCellsDirty();
 }
 
@@ -13,6 +13,7 @@
 
 #include <algorithm>
 #include <set>
+#include <deque>
 
 #include <base/Eigen.hpp>
 
@@ -142,8 +143,16 @@ namespace envire
          * the given position
          */
 	void insertTail( size_t xi, size_t yi, const SurfacePatch& value );
-        /** Removes the patch pointed-to by \c position */
+        /** Removes the patch pointed-to by \c position. As the cell of
+         * the patch is not known, the whole grid is marked as modified, see
+         * getDirtyCellExtents(). Use the overload that takes the cell where
+         * it is known.
+         */
 	iterator erase( iterator position );
+        /** Removes the patch pointed-to by \c position, which is in the cell
+         * \c (xi, yi)
+         */
+	iterator erase( size_t xi, size_t yi, iterator position );
 
         /** Finds a surface patch at \c (position.x, position.y) that matches
          * the Z information contained in \c patch (patch is used to get mean
@@ -263,6 +272,36 @@ namespace envire
 	 */
 	CellExtents getCellExtents() const { return extents.isEmpty() ? CellExtents(Eigen::Vector2i(0,0),Eigen::Vector2i(0,0)) : extents; }
 
+	/** return the cells that have been modified since the given
+	 * generation was started, see startCellGeneration(). The box is
+	 * empty if no cell has been modified. It may contain cells that have
+	 * not been modified, if the generation is too old to be told apart
+	 * from older ones.
+	 *
+	 * Cells are marked by updateCell(), the insert methods and erase(),
+	 * and clear(), move(), scalePatchWeights(), unserialize(), the
+	 * assignment and the erase() overload without a cell mark the whole
+	 * grid, as does the copy constructor for the copy.
+	 * Patches that are modified through iterators have to be marked with
+	 * setCellDirty() by the caller.
+	 */
+	CellExtents getDirtyCellExtents( size_t generation ) const;
+
+	/** start a new generation of modified cells. Every user of the grid
+	 * keeps the number of the generation that it has started last, and
+	 * passes it to getDirtyCellExtents() to get the cells that have been
+	 * modified since, so that several users do not interfere.
+	 *
+	 * @return the number of the new generation
+	 */
+	size_t startCellGeneration();
+
+	/** mark a cell as modified, see getDirtyCellExtents() */
+	void setCellDirty( const Position& pos ) { dirtyCells.back().extend( Eigen::Vector2i( pos.x, pos.y ) ); }
+
+	/** mark the whole grid as modified, see getDirtyCellExtents() */
+	void setCellsDirty();
+
 	/**
          * Moves the content of the MLSGrid by 
          * x and y cells. Cells leaving the 
@@ -282,6 +321,13 @@ namespace envire
 	/// optionaly stores information on which grid cells are used
 	boost::shared_ptr<Index> index;
 	CellExtents extents;
+
+	/// the cells modified in each of the last generations, the last
+	/// entry is the current generation. The first entry also contains
+	/// the cells of all generations before it.
+	std::deque<CellExtents> dirtyCells;
+	/// the number of the generation of the first entry of dirtyCells
+	size_t firstCellGeneration;
     };
 
     /** For backward compatibility. Use MLSGrid instead. */
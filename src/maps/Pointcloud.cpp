@@ -1,8 +1,17 @@
 #include "Core.hpp"
 #include "maps/Pointcloud.hpp"
 #include "tools/PlyFile.hpp"
+#include <envire/tools/ParallelFor.hpp>
+#include <envire/tools/PointcloudIndex.hpp>
 
 #include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <locale.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace envire;
 
@@ -12,12 +21,154 @@ const std::string Pointcloud::VERTEX_COLOR = "vertex_color";
 const std::string Pointcloud::VERTEX_NORMAL = "vertex_normal";
 const std::string Pointcloud::VERTEX_VARIANCE = "vertex_variance";
 const std::string Pointcloud::VERTEX_ATTRIBUTES = "vertex_attributes";
+const std::string Pointcloud::SPATIAL_INDEX = "spatial_index";
 
-Pointcloud::Pointcloud() : sensor_origin(Eigen::Affine3d::Identity())
+void PointColumns::addAttribute(Attribute attribute)
 {
+    if( hasAttribute( attribute ) )
+	return;
+    attributes |= attribute;
+    resize( size() );
 }
 
-Pointcloud::Pointcloud(const base::samples::Pointcloud &pointcloud) : sensor_origin(Eigen::Affine3d::Identity())
+void PointColumns::removeAttribute(Attribute attribute)
+{
+    attributes &= ~attribute;
+    // swap to actually release the memory
+    switch( attribute )
+    {
+	case VARIANCE:
+	    std::vector<float>().swap( variance );
+	    break;
+	case COLOR:
+	    std::vector<uint8_t>().swap( red );
+	    std::vector<uint8_t>().swap( green );
+	    std::vector<uint8_t>().swap( blue );
+	    break;
+	case NORMAL:
+	    std::vector<float>().swap( normal_x );
+	    std::vector<float>().swap( normal_y );
+	    std::vector<float>().swap( normal_z );
+	    break;
+	case FLAGS:
+	    std::vector<uint8_t>().swap( flags );
+	    break;
+    }
+}
+
+void PointColumns::resize(size_t size)
+{
+    x.resize( size );
+    y.resize( size );
+    z.resize( size );
+    if( hasAttribute( VARIANCE ) )
+	variance.resize( size );
+    if( hasAttribute( COLOR ) )
+    {
+	red.resize( size );
+	green.resize( size );
+	blue.resize( size );
+    }
+    if( hasAttribute( NORMAL ) )
+    {
+	normal_x.resize( size );
+	normal_y.resize( size );
+	normal_z.resize( size );
+    }
+    if( hasAttribute( FLAGS ) )
+	flags.resize( size );
+}
+
+void PointColumns::reserve(size_t size)
+{
+    x.reserve( size );
+    y.reserve( size );
+    z.reserve( size );
+    if( hasAttribute( VARIANCE ) )
+	variance.reserve( size );
+    if( hasAttribute( COLOR ) )
+    {
+	red.reserve( size );
+	green.reserve( size );
+	blue.reserve( size );
+    }
+    if( hasAttribute( NORMAL ) )
+    {
+	normal_x.reserve( size );
+	normal_y.reserve( size );
+	normal_z.reserve( size );
+    }
+    if( hasAttribute( FLAGS ) )
+	flags.reserve( size );
+}
+
+void PointColumns::clear()
+{
+    resize( 0 );
+}
+
+void PointColumns::setPoint(size_t i, const Eigen::Vector3d& point)
+{
+    x[i] = point.x();
+    y[i] = point.y();
+    z[i] = point.z();
+}
+
+Eigen::Vector3d PointColumns::getColor(size_t i) const
+{
+    return Eigen::Vector3d( red[i], green[i], blue[i] ) / 255.0;
+}
+
+void PointColumns::setColor(size_t i, const Eigen::Vector3d& color)
+{
+    const Eigen::Vector3d c( (color * 255.0).cwiseMax( 0.0 ).cwiseMin( 255.0 ) );
+    red[i] = static_cast<uint8_t>( c.x() + 0.5 );
+    green[i] = static_cast<uint8_t>( c.y() + 0.5 );
+    blue[i] = static_cast<uint8_t>( c.z() + 0.5 );
+}
+
+void PointColumns::setNormal(size_t i, const Eigen::Vector3d& normal)
+{
+    normal_x[i] = normal.x();
+    normal_y[i] = normal.y();
+    normal_z[i] = normal.z();
+}
+
+namespace
+{
+    /** applies the affine transform m to the columns (x, y, z). The loop
+     * only involves independent float multiply-adds over contiguous arrays,
+     * so that the compiler can vectorize it */
+    void transformColumns(const Eigen::Matrix<float, 3, 4>& m, bool translate, float* x, float* y, float* z, size_t size)
+    {
+	const float m00 = m(0, 0), m01 = m(0, 1), m02 = m(0, 2);
+	const float m10 = m(1, 0), m11 = m(1, 1), m12 = m(1, 2);
+	const float m20 = m(2, 0), m21 = m(2, 1), m22 = m(2, 2);
+	const float t0 = translate ? m(0, 3) : 0, t1 = translate ? m(1, 3) : 0, t2 = translate ? m(2, 3) : 0;
+	for( size_t i = 0; i < size; i++ )
+	{
+	    const float px = x[i], py = y[i], pz = z[i];
+	    x[i] = m00 * px + m01 * py + m02 * pz + t0;
+	    y[i] = m10 * px + m11 * py + m12 * pz + t1;
+	    z[i] = m20 * px + m21 * py + m22 * pz + t2;
+	}
+    }
+}
+
+void PointColumns::transform(const Eigen::Affine3d& t)
+{
+    const Eigen::Matrix<float, 3, 4> m( t.matrix().topRows<3>().cast<float>() );
+    if( !empty() )
+	transformColumns( m, true, &x[0], &y[0], &z[0], size() );
+    if( hasAttribute( NORMAL ) && !empty() )
+	transformColumns( m, false, &normal_x[0], &normal_y[0], &normal_z[0], size() );
+}
+
+Pointcloud::Pointcloud() : sensor_origin(Eigen::Affine3d::Identity()), storage(DOUBLE_VERTICES)
+{
+}
+
+Pointcloud::Pointcloud(const base::samples::Pointcloud &pointcloud) : sensor_origin(Eigen::Affine3d::Identity()), storage(DOUBLE_VERTICES)
 {
     copyFrom(pointcloud);
 }
@@ -37,9 +188,22 @@ void Pointcloud::serialize(Serialization& so, bool handleMap)
     CartesianMap::serialize(so);
 
     so.write( "sensor_origin", sensor_origin );
+    so.write( "storage", static_cast<int>(storage) );
 
     if(handleMap)
+    {
 	writePly( getMapFileName() + ".ply", so.getBinaryOutputStream(getMapFileName() + ".ply") );
+
+	if( hasData<PointcloudIndex>( SPATIAL_INDEX ) )
+	{
+	    const PointcloudIndex& index( static_cast<const Pointcloud*>(this)->getData<PointcloudIndex>( SPATIAL_INDEX ) );
+	    if( index.isUpToDate( *this ) )
+	    {
+		so.write( "spatial_index", true );
+		index.write( so.getBinaryOutputStream(getMapFileName() + ".idx") );
+	    }
+	}
+    }
 }
 
 void Pointcloud::unserialize(Serialization& so, bool handleMap)
@@ -51,11 +215,27 @@ void Pointcloud::unserialize(Serialization& so, bool handleMap)
     else
         sensor_origin = Eigen::Affine3d::Identity();
 
+    int stored = DOUBLE_VERTICES;
+    if( so.hasKey( "storage" ) )
+        so.read( "storage", stored );
+
     if(handleMap)
     {
     if( !readPly( getMapFileName() + ".ply", so.getBinaryInputStream(getMapFileName() + ".ply") ) )
         readText( so.getBinaryInputStream(getMapFileName() + ".txt") );
     }
+    setStorage( static_cast<Storage>(stored) );
+
+    // the index is read after the vertices, as it refers to them
+    bool has_index = false;
+    if( handleMap && so.hasKey( "spatial_index" ) )
+	so.read( "spatial_index", has_index );
+    if( has_index )
+    {
+	PointcloudIndex index;
+	if( index.read( so.getBinaryInputStream(getMapFileName() + ".idx"), *this ) )
+	    getData<PointcloudIndex>( SPATIAL_INDEX ) = index;
+    }
 }
 
 bool Pointcloud::writePly(const std::string& filename, std::ostream& os, bool const doublePrecision /* = true */)
@@ -72,44 +252,430 @@ bool Pointcloud::readPly(const std::string& filename, std::istream& is)
 
 bool Pointcloud::writeText(std::ostream& os)
 {
-    for(size_t i=0;i<vertices.size();i++)
+    const size_t count = getVertexCount();
+    for(size_t i=0;i<count;i++)
     {
-	os << vertices[i].x() << " " << vertices[i].y() << " " << vertices[i].z() << std::endl;
+	const Eigen::Vector3d vertex( getVertex(i) );
+	os << vertex.x() << " " << vertex.y() << " " << vertex.z() << std::endl;
     }
     
     return true;
 }
 
-bool Pointcloud::readText(std::istream& is, int sample, TextFormat format)
+namespace
 {
-    const int max_line_length = 255;
-    std::vector<Eigen::Vector3d> *color = 0;
-    if(format == XYZR )
-        color = &getVertexData<Eigen::Vector3d>( VERTEX_COLOR );
-    while( !is.eof() )
+    /** minimum size of the text that is parsed by one thread */
+    const size_t MIN_TEXT_CHUNK = 1 << 20;
+    /** size of the blocks in which streams are read by readText */
+    const size_t TEXT_BLOCK = 64 << 20;
+
+    bool isSeparator(char c)
+    {
+	return c == ' ' || c == '\t' || c == ',' || c == '\r';
+    }
+
+    /** parses a floating point number at it, without depending on the
+     * locale, and moves it past the number
+     *
+     * Numbers with at most 15 significant digits and a small exponent are
+     * converted exactly by a single multiplication or division. The others
+     * are handed to strtod_l with the C locale.
+     */
+    bool parseDouble(const char*& it, const char* end, double& value)
     {
-	if( sample == 1 || (rand() % sample == 0) )
+	static const double powers[] = {
+	    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	while( it != end && isSeparator( *it ) )
+	    ++it;
+	const char* start = it;
+
+	bool negative = false;
+	if( it != end && (*it == '-' || *it == '+') )
+	    negative = (*it++ == '-');
+
+	uint64_t mantissa = 0;
+	int digits = 0, exponent = 0;
+	bool any = false;
+	for( ; it != end && *it >= '0' && *it <= '9'; ++it, any = true )
 	{
-	    double x, y, z, c;
-	    is >> x >> y >> z;
-	    if( format == XYZR && color )
+	    if( digits < 19 )
 	    {
-		is >> c;
-		color->push_back( Eigen::Vector3d::Identity() * c / 255.0 );
+		mantissa = mantissa * 10 + (*it - '0');
+		if( mantissa )
+		    digits++;
 	    }
-	
-	    vertices.push_back( Eigen::Vector3d( x,y,z ) );
-	    is.ignore( max_line_length, '\n' );
+	    else
+		exponent++;
+	}
+	if( it != end && *it == '.' )
+	{
+	    for( ++it; it != end && *it >= '0' && *it <= '9'; ++it, any = true )
+	    {
+		if( digits < 19 )
+		{
+		    mantissa = mantissa * 10 + (*it - '0');
+		    if( mantissa )
+			digits++;
+		    exponent--;
+		}
+	    }
+	}
+	if( any && it != end && (*it == 'e' || *it == 'E') )
+	{
+	    const char* e = it + 1;
+	    bool negativeExponent = false;
+	    if( e != end && (*e == '-' || *e == '+') )
+		negativeExponent = (*e++ == '-');
+	    if( e != end && *e >= '0' && *e <= '9' )
+	    {
+		int value = 0;
+		for( ; e != end && *e >= '0' && *e <= '9'; ++e )
+		    value = std::min( value * 10 + (*e - '0'), 100000 );
+		exponent += negativeExponent ? -value : value;
+		it = e;
+	    }
+	}
+
+	if( any && digits <= 15 && exponent >= -22 && exponent <= 22 )
+	{
+	    value = static_cast<double>( mantissa );
+	    value = exponent < 0 ? value / powers[-exponent] : value * powers[exponent];
+	    if( negative )
+		value = -value;
+	    return true;
+	}
+
+	// long mantissas, large exponents, nan, inf
+	it = start;
+	const char* tokenEnd = start;
+	while( tokenEnd != end && !isSeparator( *tokenEnd ) && *tokenEnd != '\n' )
+	    ++tokenEnd;
+	if( tokenEnd == start || tokenEnd - start > 64 )
+	    return false;
+	char token[65];
+	std::copy( start, tokenEnd, token );
+	token[tokenEnd - start] = 0;
+	// strtod would follow LC_NUMERIC, and expect e.g. a decimal comma
+	static const locale_t cLocale = newlocale( LC_ALL_MASK, "C", 0 );
+	char* parsed;
+	value = strtod_l( token, &parsed, cLocale );
+	if( parsed != token + (tokenEnd - start) )
+	    return false;
+	it = tokenEnd;
+	return true;
+    }
+
+    /** selects the lines that are read if only one in \c sample is read. The
+     * decision only depends on the position of the line in the input, so
+     * that it does not depend on the way the input is split between threads */
+    bool isSampled(uint64_t offset, int sample)
+    {
+	if( sample <= 1 )
+	    return true;
+	// splitmix64 finalizer
+	uint64_t z = offset + 0x9E3779B97F4A7C15ULL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z = z ^ (z >> 31);
+	return z % sample == 0;
+    }
+
+    /** calls f(line, lineEnd) for each sampled line in [it, end[ */
+    template <class F>
+    void forEachSampledLine(const char* data, uint64_t offset, int sample, const char* it, const char* end, F& f)
+    {
+	while( it != end )
+	{
+	    const char* lineEnd = static_cast<const char*>( memchr( it, '\n', end - it ) );
+	    if( !lineEnd )
+		lineEnd = end;
+	    if( isSampled( offset + (it - data), sample ) )
+		f( it, lineEnd );
+	    it = (lineEnd == end) ? end : lineEnd + 1;
+	}
+    }
+
+    /** counts the sampled lines of the chunks [first, last[, which is
+     * the largest number of points they can have */
+    struct CountTextLines
+    {
+	const char* data;
+	/** offset of data in the whole input */
+	uint64_t offset;
+	const std::vector<size_t>& bounds;
+	int sample;
+	std::vector<size_t>& counts;
+
+	CountTextLines(const char* data, uint64_t offset, const std::vector<size_t>& bounds, int sample, std::vector<size_t>& counts)
+	    : data(data), offset(offset), bounds(bounds), sample(sample), counts(counts) {}
+
+	struct Counter
+	{
+	    size_t count;
+	    Counter() : count(0) {}
+	    void operator()(const char*, const char*) { count++; }
+	};
+
+	void operator()(size_t first, size_t last) const
+	{
+	    for( size_t i = first; i < last; i++ )
+	    {
+		Counter counter;
+		forEachSampledLine( data, offset, sample, data + bounds[i], data + bounds[i + 1], counter );
+		counts[i] = counter.count;
+	    }
+	}
+    };
+
+    /** parses the lines of the chunks [first, last[ directly into the
+     * pointcloud, starting at the index starts[i] for chunk i */
+    struct ParseTextChunks
+    {
+	const char* data;
+	/** offset of data in the whole input */
+	uint64_t offset;
+	const std::vector<size_t>& bounds;
+	int sample;
+	bool remission;
+	const std::vector<size_t>& starts;
+	/** the number of points of each chunk, which is smaller than the
+	 * number of lines if some of them are malformed */
+	std::vector<size_t>& counts;
+	Pointcloud& pointcloud;
+	std::vector<Eigen::Vector3d>* colors;
+	bool columns;
+
+	ParseTextChunks(const char* data, uint64_t offset, const std::vector<size_t>& bounds, int sample, bool remission,
+		const std::vector<size_t>& starts, std::vector<size_t>& counts, Pointcloud& pointcloud, std::vector<Eigen::Vector3d>* colors)
+	    : data(data), offset(offset), bounds(bounds), sample(sample), remission(remission), starts(starts), counts(counts),
+	    pointcloud(pointcloud), colors(colors), columns(pointcloud.getStorage() == Pointcloud::FLOAT_COLUMNS) {}
+
+	/** parses one line to index, and advances index if it is valid */
+	void parse(const char* it, const char* lineEnd, size_t& index) const
+	{
+	    // malformed lines, e.g. headers, are skipped. The remission is
+	    // optional, e.g. in the files written by writeText()
+	    Eigen::Vector3d p;
+	    double c = 0;
+	    if( !parseDouble( it, lineEnd, p.x() )
+		    || !parseDouble( it, lineEnd, p.y() )
+		    || !parseDouble( it, lineEnd, p.z() ) )
+		return;
+	    if( remission && !parseDouble( it, lineEnd, c ) )
+		c = 0;
+
+	    // the remission goes to the red channel only
+	    const Eigen::Vector3d color( c / 255.0, 0, 0 );
+	    if( columns )
+	    {
+		pointcloud.columns.setPoint( index, p );
+		if( remission )
+		    pointcloud.columns.setColor( index, color );
+	    }
+	    else
+	    {
+		pointcloud.vertices[index] = p;
+		if( colors )
+		    (*colors)[index] = color;
+	    }
+	    index++;
+	}
+
+	struct Parser
+	{
+	    const ParseTextChunks& chunks;
+	    size_t index;
+	    Parser(const ParseTextChunks& chunks, size_t index) : chunks(chunks), index(index) {}
+	    void operator()(const char* it, const char* lineEnd) { chunks.parse( it, lineEnd, index ); }
+	};
+
+	void operator()(size_t first, size_t last) const
+	{
+	    for( size_t i = first; i < last; i++ )
+	    {
+		Parser parser( *this, starts[i] );
+		forEachSampledLine( data, offset, sample, data + bounds[i], data + bounds[i + 1], parser );
+		counts[i] = parser.index - starts[i];
+	    }
+	}
+    };
+
+    /** moves the points [from, from + count[ of the pointcloud to to */
+    void moveTextPoints(Pointcloud& pointcloud, std::vector<Eigen::Vector3d>* colors, bool remission, size_t from, size_t to, size_t count)
+    {
+	if( pointcloud.getStorage() == Pointcloud::FLOAT_COLUMNS )
+	{
+	    PointColumns& c( pointcloud.columns );
+	    std::copy( c.x.begin() + from, c.x.begin() + from + count, c.x.begin() + to );
+	    std::copy( c.y.begin() + from, c.y.begin() + from + count, c.y.begin() + to );
+	    std::copy( c.z.begin() + from, c.z.begin() + from + count, c.z.begin() + to );
+	    if( remission )
+		std::copy( c.red.begin() + from, c.red.begin() + from + count, c.red.begin() + to );
 	}
 	else
-	    is.ignore( max_line_length, '\n' );
-        // check for eof bit, to avoid a copy of the last sample
-        is.peek();
+	{
+	    std::copy( pointcloud.vertices.begin() + from, pointcloud.vertices.begin() + from + count, pointcloud.vertices.begin() + to );
+	    if( colors )
+		std::copy( colors->begin() + from, colors->begin() + from + count, colors->begin() + to );
+	}
+    }
+
+    /** appends the points of the lines in data to the pointcloud
+     *
+     * The sampled lines are counted first, and the pointcloud is resized
+     * for all of them, so that the lines are parsed directly into it. The
+     * points of the chunks are then moved together if malformed lines
+     * were skipped.
+     *
+     * @param offset the offset of data in the whole input, for the sampling
+     */
+    void parseText(Pointcloud& pointcloud, const char* data, size_t size, uint64_t offset, int sample, Pointcloud::TextFormat format)
+    {
+	if( !size )
+	    return;
+
+	// line aligned chunks
+	const size_t chunkCount = std::max<size_t>( 1, std::min( size / MIN_TEXT_CHUNK, 4 * getDefaultThreadCount() ) );
+	std::vector<size_t> bounds( 1, 0 );
+	for( size_t i = 1; i < chunkCount; i++ )
+	{
+	    size_t bound = std::max( size * i / chunkCount, bounds.back() );
+	    const char* lineEnd = static_cast<const char*>( memchr( data + bound, '\n', size - bound ) );
+	    bound = lineEnd ? lineEnd - data + 1 : size;
+	    if( bound > bounds.back() && bound < size )
+		bounds.push_back( bound );
+	}
+	bounds.push_back( size );
+
+	const size_t chunks = bounds.size() - 1;
+	std::vector<size_t> counts( chunks );
+	parallelFor( 0, chunks, CountTextLines( data, offset, bounds, sample, counts ) );
+
+	const size_t first = pointcloud.getVertexCount();
+	std::vector<size_t> starts( chunks );
+	size_t total = first;
+	for( size_t i = 0; i < chunks; i++ )
+	{
+	    starts[i] = total;
+	    total += counts[i];
+	}
+
+	const bool remission = format == Pointcloud::XYZR;
+	std::vector<Eigen::Vector3d>* colors = NULL;
+	if( pointcloud.getStorage() == Pointcloud::FLOAT_COLUMNS )
+	{
+	    if( remission )
+		pointcloud.columns.addAttribute( PointColumns::COLOR );
+	    pointcloud.columns.resize( total );
+	}
+	else
+	{
+	    if( remission )
+	    {
+		colors = &pointcloud.getVertexData<Eigen::Vector3d>( Pointcloud::VERTEX_COLOR );
+		colors->resize( total );
+	    }
+	    pointcloud.vertices.resize( total );
+	}
+	parallelFor( 0, chunks, ParseTextChunks( data, offset, bounds, sample, remission, starts, counts, pointcloud, colors ) );
+
+	// close the gaps of the skipped lines, in order, as the points only
+	// move towards the front
+	size_t end = first;
+	for( size_t i = 0; i < chunks; i++ )
+	{
+	    if( starts[i] != end )
+		moveTextPoints( pointcloud, colors, remission, starts[i], end, counts[i] );
+	    end += counts[i];
+	}
+	if( end != total )
+	{
+	    if( pointcloud.getStorage() == Pointcloud::FLOAT_COLUMNS )
+		pointcloud.columns.resize( end );
+	    else
+	    {
+		pointcloud.vertices.resize( end );
+		if( colors )
+		    colors->resize( end );
+	    }
+	}
+    }
+}
+
+bool Pointcloud::readText(const char* data, size_t size, int sample, TextFormat format)
+{
+    parseText( *this, data, size, 0, sample, format );
+    return true;
+}
+
+bool Pointcloud::readText(std::istream& is, int sample, TextFormat format)
+{
+    // the stream is parsed in blocks of whole lines
+    std::vector<char> block;
+    uint64_t offset = 0;
+    while( is )
+    {
+	const size_t carry = block.size();
+	block.resize( carry + TEXT_BLOCK );
+	is.read( &block[carry], TEXT_BLOCK );
+	block.resize( carry + is.gcount() );
+	if( block.empty() )
+	    break;
+
+	size_t size = block.size();
+	if( is )
+	{
+	    const char* lineEnd = static_cast<const char*>( memrchr( &block[0], '\n', block.size() ) );
+	    if( lineEnd )
+		size = lineEnd - &block[0] + 1;
+	    else
+		continue;
+	}
+	parseText( *this, &block[0], size, offset, sample, format );
+	offset += size;
+	block.erase( block.begin(), block.begin() + size );
     }
 
     return true;
 }
 
+bool Pointcloud::readTextFile(const std::string& path, int sample, TextFormat format)
+{
+    const int fd = open( path.c_str(), O_RDONLY );
+    if( fd < 0 )
+	return false;
+
+    struct stat info;
+    void* data = MAP_FAILED;
+    if( fstat( fd, &info ) == 0 && info.st_size > 0 )
+	data = mmap( NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+
+    if( data == MAP_FAILED )
+    {
+	// e.g. an empty file or a pipe
+	std::ifstream is( path.c_str() );
+	if( is.fail() )
+	    return false;
+	return readText( is, sample, format );
+    }
+
+    madvise( data, info.st_size, MADV_SEQUENTIAL );
+    try
+    {
+	parseText( *this, static_cast<const char*>( data ), info.st_size, 0, sample, format );
+    }
+    catch(...)
+    {
+	munmap( data, info.st_size );
+	throw;
+    }
+    munmap( data, info.st_size );
+    return true;
+}
+
 Pointcloud* Pointcloud::importCsv(const std::string& file, FrameNode* fn, int sample, TextFormat format)
 {
     std::ifstream data(file.c_str());
@@ -117,9 +683,9 @@ Pointcloud* Pointcloud::importCsv(const std::string& file, FrameNode* fn, int sa
     {
         throw std::runtime_error("Could not open file '" + file + "'.");
     }
-    Pointcloud* pc = new Pointcloud();
-    pc->readText( data, sample, format );
     data.close();
+    Pointcloud* pc = new Pointcloud();
+    pc->readTextFile( file, sample, format );
 
     Environment* env = fn->getEnvironment();
     env->attachItem(pc);
@@ -135,21 +701,64 @@ void Pointcloud::copyFrom( Pointcloud* source, bool transform )
 
     // get relative transform 
     Transform t = source->getFrameNode()->relativeTransform( getFrameNode() );
-    bool needsTransform = !t.isApprox( Transform( Transform::Identity() ) );
+    bool needsTransform = transform && !t.isApprox( Transform( Transform::Identity() ) );
 
-    if( !transform || !needsTransform )
+    if( storage == FLOAT_COLUMNS )
+    {
+	const size_t count = source->getVertexCount();
+	if( source->storage == FLOAT_COLUMNS )
+	{
+	    columns.x = source->columns.x;
+	    columns.y = source->columns.y;
+	    columns.z = source->columns.z;
+	}
+	else
+	{
+	    columns.resize( count );
+	    for( size_t i = 0; i < count; i++ )
+		columns.setPoint( i, source->vertices[i] );
+	}
+	// the attributes are not copied. The present attribute columns are
+	// recreated rather than resized, so that they are zero-filled instead
+	// of keeping values of the previous contents, like the attribute
+	// vectors are emptied for the DOUBLE_VERTICES storage
+	const PointColumns::Attribute attributes[] = { PointColumns::VARIANCE,
+	    PointColumns::COLOR, PointColumns::NORMAL, PointColumns::FLAGS };
+	for( size_t i = 0; i < sizeof(attributes) / sizeof(attributes[0]); i++ )
+	{
+	    if( columns.hasAttribute( attributes[i] ) )
+	    {
+		columns.removeAttribute( attributes[i] );
+		columns.addAttribute( attributes[i] );
+	    }
+	}
+	if( needsTransform )
+	    columns.transform( t );
+    }
+    else if( !needsTransform )
     {
-	vertices = source->vertices;
+	if( source->storage == FLOAT_COLUMNS )
+	{
+	    vertices.resize( source->columns.size() );
+	    for( size_t i = 0; i < vertices.size(); i++ )
+		vertices[i] = source->columns.getPoint( i );
+	}
+	else
+	    vertices = source->vertices;
     }
     else
     {
-	for( std::vector<Eigen::Vector3d>::iterator it = source->vertices.begin(); it != source->vertices.end(); it ++ )
-	    vertices.push_back( t * *it );
+	const size_t count = source->getVertexCount();
+	vertices.reserve( count );
+	for( size_t i = 0; i < count; i++ )
+	    vertices.push_back( t * source->getVertex( i ) );
     }
 }
 
 void Pointcloud::copyFrom(const base::samples::Pointcloud& source)
 {
+    const Storage previous = storage;
+    setStorage( DOUBLE_VERTICES );
     clear();
     // we have to use iterators here because of eigen do not align problem
     vertices.resize(source.points.size());
@@ -160,19 +769,139 @@ void Pointcloud::copyFrom(const base::samples::Pointcloud& source)
     colors.reserve(source.colors.size());
     for(;iter != source.colors.end();++iter)
         colors.push_back(Eigen::Vector3d((*iter)(0),(*iter)(1),(*iter)(2)));
+    setStorage( previous );
 }
 
 Pointcloud::Extents Pointcloud::getExtents() const
 {
     //TODO: Implement some sort of caching
     Extents res;
-    for(size_t i=0;i<vertices.size();i++)
+    const size_t count = getVertexCount();
+    for(size_t i=0;i<count;i++)
     {
-	res.extend( vertices[i] );
+	res.extend( getVertex(i) );
     }
     return res; 
 }
 
+const PointcloudIndex& Pointcloud::getSpatialIndex( double cellSize )
+{
+    if( hasData<PointcloudIndex>( SPATIAL_INDEX ) )
+    {
+	// the const access does not copy an index that is shared with a
+	// copy of this pointcloud
+	const PointcloudIndex& index( static_cast<const Pointcloud*>(this)->getData<PointcloudIndex>( SPATIAL_INDEX ) );
+	if( index.isUpToDate( *this ) && (cellSize == 0 || index.getCellSize() == cellSize) )
+	    return index;
+    }
+
+    // a new index is created rather than copying an outdated shared one
+    invalidateSpatialIndex();
+    PointcloudIndex& index( getData<PointcloudIndex>( SPATIAL_INDEX ) );
+    index.build( *this, cellSize );
+    return index;
+}
+
+void Pointcloud::invalidateSpatialIndex()
+{
+    if( hasData( SPATIAL_INDEX ) )
+	removeData( SPATIAL_INDEX );
+}
+
+void Pointcloud::requireDoubleVertices(const std::string& user) const
+{
+    if( storage != DOUBLE_VERTICES )
+	throw std::runtime_error(user + ": pointclouds with the FLOAT_COLUMNS storage are not supported, convert them with setStorage(DOUBLE_VERTICES)");
+}
+
+void Pointcloud::setStorage(Storage storage)
+{
+    if( storage == this->storage )
+	return;
+
+    if( storage == FLOAT_COLUMNS )
+    {
+	const size_t count = vertices.size();
+	columns = PointColumns();
+	if( hasData( VERTEX_VARIANCE ) && getVertexData<double>( VERTEX_VARIANCE ).size() == count )
+	    columns.addAttribute( PointColumns::VARIANCE );
+	if( hasData( VERTEX_COLOR ) && getVertexData<Eigen::Vector3d>( VERTEX_COLOR ).size() == count )
+	    columns.addAttribute( PointColumns::COLOR );
+	if( hasData( VERTEX_NORMAL ) && getVertexData<Eigen::Vector3d>( VERTEX_NORMAL ).size() == count )
+	    columns.addAttribute( PointColumns::NORMAL );
+	if( hasData( VERTEX_ATTRIBUTES ) && getVertexData<attr_flag>( VERTEX_ATTRIBUTES ).size() == count )
+	    columns.addAttribute( PointColumns::FLAGS );
+	columns.resize( count );
+
+	for( size_t i = 0; i < count; i++ )
+	    columns.setPoint( i, vertices[i] );
+	if( columns.hasAttribute( PointColumns::VARIANCE ) )
+	{
+	    std::vector<double>& variance( getVertexData<double>( VERTEX_VARIANCE ) );
+	    std::copy( variance.begin(), variance.end(), columns.variance.begin() );
+	}
+	if( columns.hasAttribute( PointColumns::COLOR ) )
+	{
+	    std::vector<Eigen::Vector3d>& colors( getVertexData<Eigen::Vector3d>( VERTEX_COLOR ) );
+	    for( size_t i = 0; i < count; i++ )
+		columns.setColor( i, colors[i] );
+	}
+	if( columns.hasAttribute( PointColumns::NORMAL ) )
+	{
+	    std::vector<Eigen::Vector3d>& normals( getVertexData<Eigen::Vector3d>( VERTEX_NORMAL ) );
+	    for( size_t i = 0; i < count; i++ )
+		columns.setNormal( i, normals[i] );
+	}
+	if( columns.hasAttribute( PointColumns::FLAGS ) )
+	{
+	    std::vector<attr_flag>& flags( getVertexData<attr_flag>( VERTEX_ATTRIBUTES ) );
+	    std::copy( flags.begin(), flags.end(), columns.flags.begin() );
+	}
+
+	// swap to actually release the memory
+	std::vector<Eigen::Vector3d>().swap( vertices );
+	removeData( VERTEX_VARIANCE );
+	removeData( VERTEX_COLOR );
+	removeData( VERTEX_NORMAL );
+	removeData( VERTEX_ATTRIBUTES );
+    }
+    else
+    {
+	const size_t count = columns.size();
+	vertices.resize( count );
+	for( size_t i = 0; i < count; i++ )
+	    vertices[i] = columns.getPoint( i );
+	if( columns.hasAttribute( PointColumns::VARIANCE ) )
+	{
+	    std::vector<double>& variance( getVertexData<double>( VERTEX_VARIANCE ) );
+	    variance.assign( columns.variance.begin(), columns.variance.end() );
+	}
+	if( columns.hasAttribute( PointColumns::COLOR ) )
+	{
+	    std::vector<Eigen::Vector3d>& colors( getVertexData<Eigen::Vector3d>( VERTEX_COLOR ) );
+	    colors.resize( count );
+	    for( size_t i = 0; i < count; i++ )
+		colors[i] = columns.getColor( i );
+	}
+	if( columns.hasAttribute( PointColumns::NORMAL ) )
+	{
+	    std::vector<Eigen::Vector3d>& normals( getVertexData<Eigen::Vector3d>( VERTEX_NORMAL ) );
+	    normals.resize( count );
+	    for( size_t i = 0; i < count; i++ )
+		normals[i] = columns.getNormal( i );
+	}
+	if( columns.hasAttribute( PointColumns::FLAGS ) )
+	{
+	    std::vector<attr_flag>& flags( getVertexData<attr_flag>( VERTEX_ATTRIBUTES ) );
+	    flags.resize( count );
+	    for( size_t i = 0; i < count; i++ )
+		flags[i] = static_cast<attr_flag>( columns.flags[i] );
+	}
+	columns = PointColumns();
+    }
+    this->storage = storage;
+}
+
 void Pointcloud::setSensorOrigin(const Transform& origin)
 {
     this->sensor_origin = origin;
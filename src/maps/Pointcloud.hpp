@@ -7,6 +7,72 @@
 #include <base/samples/Pointcloud.hpp>
 
 namespace envire {
+    class PointcloudIndex;
+
+    /** Single precision, structure-of-arrays storage of the vertices of a
+     * Pointcloud, see Pointcloud::setStorage()
+     *
+     * The coordinates and each attribute are stored in separate contiguous
+     * arrays, so that loops over them can be vectorized by the compiler. An
+     * attribute column is either empty, if the attribute is not present,
+     * or holds one element per vertex. Use resize() rather than resizing
+     * the columns one by one to keep them consistent.
+     */
+    class PointColumns
+    {
+    public:
+	/** the optional attribute columns */
+	enum Attribute
+	{
+	    VARIANCE = 0x01,
+	    COLOR = 0x02,
+	    NORMAL = 0x04,
+	    FLAGS = 0x08
+	};
+
+	std::vector<float> x, y, z;
+	/** variance of each vertex */
+	std::vector<float> variance;
+	/** color of each vertex, in [0, 255] */
+	std::vector<uint8_t> red, green, blue;
+	std::vector<float> normal_x, normal_y, normal_z;
+	/** bitfield of Pointcloud::attr_flag values */
+	std::vector<uint8_t> flags;
+
+	PointColumns() : attributes(0) {}
+
+	size_t size() const { return x.size(); }
+	bool empty() const { return x.empty(); }
+
+	/** @return the bitfield of the attributes that are present */
+	int getAttributes() const { return attributes; }
+	bool hasAttribute(Attribute attribute) const { return attributes & attribute; }
+	/** adds the column of the given attribute, initialized to zero, if it
+	 * is not present yet */
+	void addAttribute(Attribute attribute);
+	void removeAttribute(Attribute attribute);
+
+	/** resizes the coordinates and all present attributes */
+	void resize(size_t size);
+	void reserve(size_t size);
+	/** removes all vertices, the present attributes stay present */
+	void clear();
+
+	Eigen::Vector3d getPoint(size_t i) const { return Eigen::Vector3d(x[i], y[i], z[i]); }
+	void setPoint(size_t i, const Eigen::Vector3d& point);
+	/** @return the color of vertex i, in [0, 1] */
+	Eigen::Vector3d getColor(size_t i) const;
+	void setColor(size_t i, const Eigen::Vector3d& color);
+	Eigen::Vector3d getNormal(size_t i) const { return Eigen::Vector3d(normal_x[i], normal_y[i], normal_z[i]); }
+	void setNormal(size_t i, const Eigen::Vector3d& normal);
+
+	/** applies t to all vertices, and its linear part to the normals */
+	void transform(const Eigen::Affine3d& t);
+
+    private:
+	int attributes;
+    };
+
     class Pointcloud : public Map<3> 
     {
 	ENVIRONMENT_ITEM( Pointcloud )
@@ -18,6 +84,8 @@ namespace envire {
 	static const std::string VERTEX_NORMAL;
 	static const std::string VERTEX_ATTRIBUTES;
 	static const std::string VERTEX_VARIANCE;
+	/** key of the PointcloudIndex data, see getSpatialIndex() */
+	static const std::string SPATIAL_INDEX;
 
 	enum TextFormat
 	{
@@ -30,10 +98,27 @@ namespace envire {
 	    SCAN_EDGE = 0x01 // vertex point is at the edge of a laserscan
 	};
 
+	/** how the vertices and their attributes are stored */
+	enum Storage
+	{
+	    /** in vertices, with the attributes in the VERTEX_* data items */
+	    DOUBLE_VERTICES = 0,
+	    /** in columns, in single precision */
+	    FLOAT_COLUMNS = 1
+	};
+
 	/** definition of 3d points
 	 */
 	std::vector<Eigen::Vector3d> vertices;
 
+	/** the vertices and their attributes if the storage is
+	 * FLOAT_COLUMNS. This halves the memory per vertex, but code that
+	 * accesses vertices directly does not see them, use getVertexCount()
+	 * and getVertex() to support both storages, or reject the columns with
+	 * requireDoubleVertices()
+	 */
+	PointColumns columns;
+
     /** sensor acquisition pose
      */
     Transform sensor_origin;
@@ -55,10 +140,12 @@ namespace envire {
 	void clear()
 	{
 	    vertices.clear();
+	    columns.clear();
 	    if( hasData( VERTEX_COLOR ) ) getVertexData<Eigen::Vector3d>( VERTEX_COLOR ).clear();
 	    if( hasData( VERTEX_NORMAL ) ) getVertexData<Eigen::Vector3d>( VERTEX_NORMAL ).clear();
 	    if( hasData( VERTEX_ATTRIBUTES ) ) getVertexData<attr_flag>( VERTEX_ATTRIBUTES ).clear();
 	    if( hasData( VERTEX_VARIANCE ) ) getVertexData<double>( VERTEX_VARIANCE ).clear();
+	    invalidateSpatialIndex();
 	};
 
 	Pointcloud();
@@ -73,15 +160,91 @@ namespace envire {
         void unserialize(Serialization& so, bool handleMap = true);
 
 	bool writeText(std::ostream& os);
+	/** Appends the points of the given text to the pointcloud, one point
+	 * per line. The fields are separated by white space or commas.
+	 * Lines that can not be parsed are skipped.
+	 *
+	 * The input is split in line aligned chunks, which are parsed in
+	 * parallel.
+	 *
+	 * @param sample if larger than one, only one in \c sample lines is
+	 *        read, on average. The lines are selected by their position in
+	 *        the input, the selection does not depend on the number of
+	 *        threads.
+	 * @param format XYZR stores the remission of the points in the red
+	 *        channel of their color. Lines without a remission are read
+	 *        with a remission of 0.
+	 */
 	bool readText(std::istream& is, int sample = 1, TextFormat = XYZR );
+	/** @overload */
+	bool readText(const char* data, size_t size, int sample = 1, TextFormat = XYZR );
+	/** @overload
+	 *
+	 * Maps the file to memory instead of reading it.
+	 * @return false if the file can not be opened
+	 */
+	bool readTextFile(const std::string& path, int sample = 1, TextFormat = XYZR );
 
 	bool writePly(const std::string& filename, std::ostream& os, bool const doublePrecision = true);
 	bool readPly(const std::string& filename, std::istream& is);
 
 	Extents getExtents() const;
 
+	Storage getStorage() const { return storage; }
+	/** Converts the vertices and their attributes to the given storage.
+	 * Precision is lost when converting to FLOAT_COLUMNS. The attributes
+	 * which do not have one value per vertex are dropped.
+	 */
+	void setStorage(Storage storage);
+
+	/** Throws std::runtime_error if the storage is not DOUBLE_VERTICES.
+	 * Used by the code that only handles vertices, so that it does not
+	 * take a FLOAT_COLUMNS pointcloud for an empty one.
+	 *
+	 * @param user the name of the caller, for the error message
+	 */
+	void requireDoubleVertices(const std::string& user) const;
+
+	/** @return the number of vertices, in either storage */
+	size_t getVertexCount() const
+	{
+	    return storage == FLOAT_COLUMNS ? columns.size() : vertices.size();
+	}
+	/** @return the vertex i, in either storage */
+	Eigen::Vector3d getVertex(size_t i) const
+	{
+	    return storage == FLOAT_COLUMNS ? columns.getPoint(i) : vertices[i];
+	}
+
+	/** @return the spatial index of the vertices, for neighbourhood
+	 * queries.
+	 *
+	 * The index is stored as SPATIAL_INDEX data, so that it is shared by
+	 * all users of the pointcloud. It is built on first use, and rebuilt
+	 * if it is outdated, i.e. if the number of vertices or the storage
+	 * changed, or if the pointcloud has been marked as modified. Code that
+	 * changes the vertices otherwise has to call
+	 * invalidateSpatialIndex().
+	 *
+	 * If the index is up to date when the pointcloud is serialized, it is
+	 * written next to the PLY file and restored on unserialization.
+	 *
+	 * Building the index modifies the pointcloud, so this method must not
+	 * be called concurrently. The queries of the returned index can.
+	 *
+	 * @param cellSize the cell size of the index, 0 to accept any existing
+	 *        index or to build one with PointcloudIndex::getDefaultCellSize()
+	 */
+	const PointcloudIndex& getSpatialIndex( double cellSize = 0 );
+
+	/** removes the spatial index, see getSpatialIndex() */
+	void invalidateSpatialIndex();
+
     void setSensorOrigin(const Transform& origin);
     const Transform& getSensorOrigin() const;
+
+    private:
+	Storage storage;
     };
 }
 
@@ -1,7 +1,7 @@
 #include "TraversabilityGrid.hpp"
 #include <boost/bind.hpp>
-#include <tools/RadialLookUpTable.hpp>
-#include <tools/BoxLookUpTable.hpp>
+#include <envire/tools/FootprintCache.hpp>
+#include <envire/tools/ParallelFor.hpp>
 #include <Eigen/Geometry>
 
 using namespace envire;
@@ -25,8 +25,6 @@ const std::vector<std::string> &TraversabilityGrid::bands = initTraversabilityBa
 
 class StatisticHelper
 {
-    static RadialLookUpTable *lut;
-    static BoxLookUpTable *boxLut;
     const base::Pose2D &pose;
     Eigen::Rotation2D<double> inverseOrientation;
     const TraversabilityGrid &grid;
@@ -35,39 +33,36 @@ class StatisticHelper
     TraversabilityStatistic *outerStats;
     double scaleX;
     double scaleY;
+    double sizeX;
+    double sizeY;
     size_t xCenter;
     size_t yCenter;
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-    StatisticHelper(const base::Pose2D &pose, const TraversabilityGrid &grid, double sizeX, double sizeY, double borderWidth) : pose(pose), 
+    // the distances are computed directly, instead of through lookup tables
+    // shared by all instances, so that statistics can be computed from
+    // several threads at once
+    StatisticHelper(const base::Pose2D &pose, const TraversabilityGrid &grid, double sizeX, double sizeY) : pose(pose), 
     inverseOrientation(Eigen::Rotation2D<double>(pose.orientation).inverse()), grid(grid), gridData(grid.getGridData(TraversabilityGrid::TRAVERSABILITY))
-    , scaleX(grid.getScaleX()), scaleY(grid.getScaleY())
+    , scaleX(grid.getScaleX()), scaleY(grid.getScaleY()), sizeX(sizeX), sizeY(sizeY)
     {
-        if(!lut)
-            lut = new RadialLookUpTable();
-        lut->recompute(grid.getScaleX(), std::max(sizeX, sizeY));
-        
-        if(!boxLut)
-            boxLut = new BoxLookUpTable();
-        //note the scale should be higher than the grid scale because 
-        //of the roation. Else we get aliasing problems.
-        boxLut->recompute(scaleX / 10.0, sizeX, sizeY, borderWidth * 2);
-        
         grid.toGrid(pose.position.x(), pose.position.y(), xCenter, yCenter);
     }
 
-    void addInnerVal(size_t x, size_t y)
+    void addInnerVal(size_t x, size_t y) const
     {
-        innerStats->addMeasurement(gridData[y][x], lut->getDistance(x-xCenter, y-yCenter));
+        const double dx = (static_cast<double>(x) - static_cast<double>(xCenter)) * scaleX;
+        const double dy = (static_cast<double>(y) - static_cast<double>(yCenter)) * scaleY;
+        innerStats->addMeasurement(gridData[y][x], sqrt(dx * dx + dy * dy));
     }
     
-    void addOuterVal(size_t x, size_t y)
+    void addOuterVal(size_t x, size_t y) const
     {
         Vector2d pos_map;
         grid.fromGrid(x, y, pos_map.x(), pos_map.y());
         Vector2d posAligned = inverseOrientation * (pos_map - pose.position);
         
-        outerStats->addMeasurement(gridData[y][x], boxLut->getDistanceToBox(posAligned.x(), posAligned.y()));
+        outerStats->addMeasurement(gridData[y][x], FootprintCache::getDistanceToRectangle(posAligned.x(), posAligned.y(), sizeX, sizeY));
     }
 
     void setInnerStatistic(TraversabilityStatistic *innerStat)
@@ -80,9 +75,6 @@ public:
     }
 };
 
-RadialLookUpTable *StatisticHelper::lut;
-BoxLookUpTable *StatisticHelper::boxLut;
-
 void addVal(size_t x, size_t y, std::vector<uint8_t> &stats, const TraversabilityGrid::ArrayType &gridData)
 {
     stats[gridData[y][x]]++;
@@ -90,34 +82,65 @@ void addVal(size_t x, size_t y, std::vector<uint8_t> &stats, const Traversabilit
 
 void TraversabilityGrid::computeStatistic(const base::Pose2D &pose, double sizeX, double sizeY, TraversabilityStatistic &innerStatistic) const
 {
-    StatisticHelper helper(pose, *this, sizeX, sizeY, 0);
+    StatisticHelper helper(pose, *this, sizeX, sizeY);
     helper.setInnerStatistic(&innerStatistic);
     forEachInRectangle(pose, sizeX, sizeY, boost::bind( &StatisticHelper::addInnerVal, &helper,  _1, _2));
 }
 
 void TraversabilityGrid::computeStatistic(const base::Pose2D &pose, double sizeX, double sizeY, double borderWidth, TraversabilityStatistic &innerStatistic, TraversabilityStatistic &outerStatistic) const
 {
-    StatisticHelper helper(pose, *this, sizeX, sizeY, borderWidth);
+    StatisticHelper helper(pose, *this, sizeX, sizeY);
     helper.setInnerStatistic(&innerStatistic);
     helper.setOuterStatistic(&outerStatistic);
     forEachInRectangles(pose, sizeX, sizeY, boost::bind( &StatisticHelper::addInnerVal, &helper,  _1, _2), 
                         sizeX + borderWidth, sizeY + borderWidth, boost::bind( &StatisticHelper::addOuterVal, &helper,  _1, _2));
 }
 
-const TraversabilityClass& TraversabilityGrid::getWorstTraversabilityClassInRectangle(const base::Pose2D& pose, double sizeX, double sizeY) const
+bool TraversabilityGrid::computeStatistic(const FootprintCache& footprint, const base::Pose2D& pose, TraversabilityStatistic& innerStatistic, TraversabilityStatistic* outerStatistic) const
+{
+    if(!footprint.matchesScale(getScaleX(), getScaleY()))
+        throw std::runtime_error("TraversabilityGrid: the footprint has been computed for a different grid scale");
+
+    size_t xCenter, yCenter;
+    if(!toGrid(pose.position.x(), pose.position.y(), xCenter, yCenter))
+        return false;
+
+    const FootprintCache::Mask &mask(footprint.getMask(pose.orientation));
+    const int x = xCenter, y = yCenter;
+    if(x + mask.minDx < 0 || x + mask.maxDx >= static_cast<int>(cellSizeX) ||
+       y + mask.minDy < 0 || y + mask.maxDy >= static_cast<int>(cellSizeY))
+        return false;
+
+    const ArrayType &data(getGridData(TRAVERSABILITY));
+    for(std::vector<FootprintCache::Span>::const_iterator it = mask.inner.begin(); it != mask.inner.end(); it++)
+    {
+        const uint8_t *row = &data[y + it->dy][x];
+        const float *distances = &mask.innerDistances[it->offset];
+        for(int dx = it->dx0; dx <= it->dx1; dx++)
+            innerStatistic.addMeasurement(row[dx], *distances++);
+    }
+
+    if(!outerStatistic)
+        return true;
+
+    for(std::vector<FootprintCache::Span>::const_iterator it = mask.outer.begin(); it != mask.outer.end(); it++)
+    {
+        const uint8_t *row = &data[y + it->dy][x];
+        const float *distances = &mask.outerDistances[it->offset];
+        for(int dx = it->dx0; dx <= it->dx1; dx++)
+            outerStatistic->addMeasurement(row[dx], *distances++);
+    }
+    return true;
+}
+
+int TraversabilityGrid::getWorstTraversabilityClass(const TraversabilityStatistic& statistic) const
 {
     double curDrivability = std::numeric_limits< double >::max();
     int curClass = -1;
-    
-    TraversabilityStatistic innerStatistic;
-    computeStatistic(pose, sizeX, sizeY, innerStatistic);
 
-    for(uint8_t i = 0; i <= innerStatistic.getHighestTraversabilityClass(); i++)
+    for(int i = 0; i <= statistic.getHighestTraversabilityClass(); i++)
     {
-        size_t count;
-        double dist;
-        innerStatistic.getStatisticForClass(i, dist, count);
-        if(count)
+        if(statistic.getClassCount(i))
         {
             const TraversabilityClass &klass(getTraversabilityClass(i));
             if(curDrivability > klass.getDrivability())
@@ -126,11 +149,106 @@ const TraversabilityClass& TraversabilityGrid::getWorstTraversabilityClassInRect
                 curDrivability = klass.getDrivability();
                 //can't get worse than not traversable
                 if(!klass.isTraversable())
-                    return klass;
+                    return curClass;
             }
         }
     }
-    
+    return curClass;
+}
+
+const TraversabilityClass& TraversabilityGrid::getWorstTraversabilityClassInRectangle(const FootprintCache& footprint, const base::Pose2D& pose) const
+{
+    TraversabilityStatistic innerStatistic;
+    computeStatistic(footprint, pose, innerStatistic);
+
+    int curClass = getWorstTraversabilityClass(innerStatistic);
+    if(curClass < 0)
+        throw std::runtime_error("TraversabilityGrid::Error, terrain class could not be identified");
+    return getTraversabilityClass(curClass);
+}
+
+namespace
+{
+    /** evaluates the poses [first, last[, see TraversabilityGrid::evaluateFootprints */
+    struct EvaluateFootprints
+    {
+        const TraversabilityGrid &grid;
+        const FootprintCache &footprint;
+        const TraversabilityGrid::ArrayType &probabilities;
+        const std::vector<base::Pose2D> &poses;
+        std::vector<TraversabilityGrid::FootprintEvaluation> &results;
+        boost::function<int (const TraversabilityStatistic&)> getWorstClass;
+
+        EvaluateFootprints(const TraversabilityGrid &grid, const FootprintCache &footprint,
+                const TraversabilityGrid::ArrayType &probabilities, const std::vector<base::Pose2D> &poses,
+                std::vector<TraversabilityGrid::FootprintEvaluation> &results,
+                boost::function<int (const TraversabilityStatistic&)> getWorstClass)
+            : grid(grid), footprint(footprint), probabilities(probabilities), poses(poses), results(results), getWorstClass(getWorstClass) {}
+
+        void operator()(size_t first, size_t last) const
+        {
+            for(size_t i = first; i < last; i++)
+            {
+                const base::Pose2D &pose(poses[i]);
+                TraversabilityGrid::FootprintEvaluation &result(results[i]);
+                result = TraversabilityGrid::FootprintEvaluation();
+                result.valid = grid.computeStatistic(footprint, pose, result.innerStatistic, &result.outerStatistic);
+                if(!result.valid)
+                    continue;
+                result.worstClass = getWorstClass(result.innerStatistic);
+
+                // computeStatistic checked that the whole mask is inside of
+                // the grid
+                size_t xCenter, yCenter;
+                grid.toGrid(pose.position.x(), pose.position.y(), xCenter, yCenter);
+                const FootprintCache::Mask &mask(footprint.getMask(pose.orientation));
+                uint8_t worst = std::numeric_limits<uint8_t>::max();
+                for(std::vector<FootprintCache::Span>::const_iterator it = mask.inner.begin(); it != mask.inner.end(); it++)
+                {
+                    const uint8_t *row = &probabilities[yCenter + it->dy][xCenter];
+                    for(int dx = it->dx0; dx <= it->dx1; dx++)
+                        worst = std::min(worst, row[dx]);
+                }
+                result.worstProbability = static_cast<double>(worst) / std::numeric_limits<uint8_t>::max();
+            }
+        }
+    };
+}
+
+void TraversabilityGrid::evaluateFootprints(const FootprintCache& footprint, const std::vector<base::Pose2D>& poses, std::vector<FootprintEvaluation>& results, size_t threads) const
+{
+    if(!footprint.matchesScale(getScaleX(), getScaleY()))
+        throw std::runtime_error("TraversabilityGrid: the footprint has been computed for a different grid scale");
+
+    // the bands are looked up once here, a missing probability band has
+    // zeros in all cells
+    const ArrayType *probabilityBand = getBandArray(PROBABILITY, probabilityCache);
+    ArrayType zeros;
+    if(!probabilityBand)
+        zeros.resize(boost::extents[getCellSizeY()][getCellSizeX()]);
+    const ArrayType &probabilities(probabilityBand ? *probabilityBand : zeros);
+    getGridData(TRAVERSABILITY);
+
+    results.resize(poses.size());
+    EvaluateFootprints evaluate(*this, footprint, probabilities, poses, results,
+            boost::bind(&TraversabilityGrid::getWorstTraversabilityClass, this, _1));
+    // the cost of a pose is in the order of the footprint area, small
+    // batches are not worth a thread
+    parallelFor(0, poses.size(), evaluate, threads, 16);
+}
+
+void TraversabilityGrid::evaluateFootprints(const std::vector<base::Pose2D>& poses, double sizeX, double sizeY, double borderWidth, std::vector<FootprintEvaluation>& results, size_t threads) const
+{
+    FootprintCache footprint(getScaleX(), getScaleY(), sizeX, sizeY, borderWidth);
+    evaluateFootprints(footprint, poses, results, threads);
+}
+
+const TraversabilityClass& TraversabilityGrid::getWorstTraversabilityClassInRectangle(const base::Pose2D& pose, double sizeX, double sizeY) const
+{
+    TraversabilityStatistic innerStatistic;
+    computeStatistic(pose, sizeX, sizeY, innerStatistic);
+
+    int curClass = getWorstTraversabilityClass(innerStatistic);
     if(curClass < 0)
     {        
         std::cout << "Pose " << pose.position.transpose() << " sizeY " << sizeY << " sizeX " << sizeX << " Total Count " << innerStatistic.getTotalCount() << std::endl;
@@ -170,14 +288,13 @@ void TraversabilityGrid::setTraversabilityAndProbability(uint8_t klass, double p
 
 void TraversabilityGrid::setTraversability(uint8_t klass, size_t x, size_t y)
 {
-    setTraversabilityArray();
-    (*traversabilityArray)[y][x] = klass;
+    getBandArray(TRAVERSABILITY, traversabilityCache)[y][x] = klass;
 }
 
 const TraversabilityClass& TraversabilityGrid::getTraversability(size_t x, size_t y) const
 {
-    setTraversabilityArray();
-    return traversabilityClasses[(*traversabilityArray)[y][x]];
+    const ArrayType *data = getBandArray(TRAVERSABILITY, traversabilityCache);
+    return traversabilityClasses[data ? (*data)[y][x] : 0];
 }
 
 bool TraversabilityGrid::registerNewTraversabilityClass(uint8_t& retId, const TraversabilityClass& klass)
@@ -208,52 +325,17 @@ const TraversabilityClass& TraversabilityGrid::getTraversabilityClass(uint8_t kl
     return traversabilityClasses[klass];
 }
 
-void TraversabilityGrid::setProbabilityArray()
-{
-    if(!probabilityArray)
-    {
-        probabilityArray = &(getData<ArrayType>(PROBABILITY));
-        //hm, why is the resize done here ?
-        probabilityArray->resize(boost::extents[getCellSizeY()][getCellSizeX()]);
-    }
-}
-
-void TraversabilityGrid::setTraversabilityArray()
-{
-    if(!traversabilityArray)
-    {
-        traversabilityArray = &(getData<ArrayType>(TRAVERSABILITY));
-		traversabilityArray->resize(boost::extents[getCellSizeY()][getCellSizeX()]);
-    }
-}
-
-
-void TraversabilityGrid::setProbabilityArray() const
-{
-    TraversabilityGrid *nonConst = const_cast<TraversabilityGrid *>(this);
-    nonConst->setProbabilityArray();
-}
-
-void TraversabilityGrid::setTraversabilityArray() const
-{
-    TraversabilityGrid *nonConst = const_cast<TraversabilityGrid *>(this);
-    nonConst->setTraversabilityArray();
-}
-
 void TraversabilityGrid::setProbability(double probability, size_t x, size_t y) 
 {
-    setProbabilityArray();
-    
     const uint8_t probVal = std::max<uint32_t>(std::numeric_limits< uint8_t >::max(), probability * std::numeric_limits< uint8_t >::max());
     
-    (*probabilityArray)[y][x] = probVal;
+    getBandArray(PROBABILITY, probabilityCache)[y][x] = probVal;
 }
 
 double TraversabilityGrid::getProbability(size_t x, size_t y) const
 {
-    const_cast<TraversabilityGrid *>(this)->setProbabilityArray();
-    
-    return ((double) (*probabilityArray)[y][x]) / std::numeric_limits< uint8_t >::max();
+    const ArrayType *data = getBandArray(PROBABILITY, probabilityCache);
+    return data ? ((double) (*data)[y][x]) / std::numeric_limits< uint8_t >::max() : 0.0;
 }
 
 void TraversabilityGrid::serialize(Serialization& so)
@@ -288,9 +370,9 @@ TraversabilityGrid& TraversabilityGrid::operator=(const TraversabilityGrid& othe
     *baseGrid = *obaseGrid;
     
     traversabilityClasses = other.traversabilityClasses;
+    // the assignment changes the data generation, which drops the cached
+    // bands
     
-    traversabilityArray = NULL;
-    probabilityArray = NULL;
     return *this;
 }
 
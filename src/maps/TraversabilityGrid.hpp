@@ -2,6 +2,7 @@
 #define ENVIRE_TRAVERSABILITYGRID_H
 
 #include <envire/maps/Grid.hpp>
+#include <envire/tools/FootprintCache.hpp>
 #include <base/samples/DistanceImage.hpp>
 #include <boost/function.hpp>
 
@@ -132,23 +133,79 @@ public:
 private:
     const static std::vector<std::string> &bands;
     std::vector<TraversabilityClass> traversabilityClasses;
-    ArrayType *probabilityArray;
-    ArrayType *traversabilityArray;
     
     void probabilityCallback(size_t x, size_t y, double &worst) const; 
-    void setProbabilityArray() const;
-    void setTraversabilityArray() const;
-    void setProbabilityArray();
-    void setTraversabilityArray();
+    /** returns the class of the statistic with the lowest drivability, or -1 if it is empty */
+    int getWorstTraversabilityClass(const TraversabilityStatistic &statistic) const;
+    /** pointer to one of the bands, which is kept as long as the data
+     * generation of the grid does not change (see
+     * Layer::getDataGeneration), so that the per cell accessors do not
+     * look up the band on every call */
+    struct BandCache
+    {
+        /** NULL unless the band has been accessed for modification */
+        ArrayType *writable;
+        const ArrayType *readable;
+        unsigned long generation;
+        BandCache() : writable(NULL), readable(NULL), generation(0) {}
+    };
+    mutable BandCache traversabilityCache;
+    mutable BandCache probabilityCache;
+
+    bool isCacheValid(const BandCache &cache) const
+    {
+        return cache.generation == getDataGeneration()
+            && cache.readable->shape()[0] == getCellSizeY() && cache.readable->shape()[1] == getCellSizeX();
+    }
+    /** return the given band for modification, which is created if it
+     * does not exist yet. Its cached statistics and overviews are dropped
+     * as in getGridData() */
+    ArrayType &getBandArray(const std::string &band, BandCache &cache)
+    {
+        if(!cache.writable || !isCacheValid(cache))
+        {
+            ArrayType &data(getGridData(band));
+            cache.writable = &data;
+            cache.readable = &data;
+            // taken after the access, which changes the generation if the
+            // band was shared
+            cache.generation = getDataGeneration();
+        }
+        else
+            bandModified(band);
+        return *cache.writable;
+    }
+    /** return the given band, or NULL if it does not exist, in which case
+     * all its cells are zero. A shared band is not copied. */
+    const ArrayType *getBandArray(const std::string &band, BandCache &cache) const
+    {
+        if(!cache.readable || !isCacheValid(cache))
+        {
+            cache.writable = NULL;
+            cache.readable = NULL;
+            if(!hasBand(band))
+                return NULL;
+            const ArrayType &data(getGridData(band));
+            if(data.shape()[0] != getCellSizeY() || data.shape()[1] != getCellSizeX())
+                return NULL;
+            cache.readable = &data;
+            cache.generation = getDataGeneration();
+        }
+        return cache.readable;
+    }
 public:
-    TraversabilityGrid() : Grid<uint8_t>(), probabilityArray(NULL), traversabilityArray(NULL)
+    TraversabilityGrid() : Grid<uint8_t>()
     {
     };
     TraversabilityGrid(size_t cellSizeX, size_t cellSizeY, 
                         double scalex, double scaley, 
                         double offsetx = 0.0, double offsety = 0.0,
-                        std::string const& id = Environment::ITEM_NOT_ATTACHED):Grid<uint8_t>::Grid(cellSizeX,cellSizeY,scalex,scaley,offsetx, offsety, id), 
-                        probabilityArray(NULL), traversabilityArray(NULL)
+                        std::string const& id = Environment::ITEM_NOT_ATTACHED):Grid<uint8_t>::Grid(cellSizeX,cellSizeY,scalex,scaley,offsetx, offsety, id)
+    {
+    };
+    /** the bands are copied, and the copy does not refer to the bands of
+     * other */
+    TraversabilityGrid(const TraversabilityGrid &other) : Grid<uint8_t>(other), traversabilityClasses(other.traversabilityClasses)
     {
     };
     
@@ -207,12 +264,80 @@ public:
      * @arg pose Center and Orientation of the rectangle
      * @arg sizeX Size in X of the rectangle (before orienting)
      * @arg sizeY Size in Y of the rectangle (before orienting)
+     * @arg borderWidth the amount by which the border rectangle is larger
+     *      than the inner one along both axes, i.e. half of it on each side
      * @arg innerStatistic resulting statistic
      * */
     void computeStatistic(const base::Pose2D& pose, double sizeX, double sizeY,  envire::TraversabilityStatistic& innerStatistic) const;
     void computeStatistic(const base::Pose2D &pose, double sizeX, double sizeY, double borderWidth, TraversabilityStatistic &innerStatistic, TraversabilityStatistic &outerStatistic) const;
 
     const TraversabilityClass &getWorstTraversabilityClassInRectangle(const base::Pose2D &pose, double sizeX, double sizeY) const;
+
+    /**
+     * Computes the statistic of the footprint of \c footprint at the given
+     * pose, using its precomputed cell masks. The pose is snapped to the
+     * center of its cell and to the closest heading bin of the cache.
+     *
+     * Unlike the other forms of computeStatistic, this does not compute any
+     * geometry per call, and can be used from several threads at once.
+     *
+     * @arg outerStatistic if not NULL, the statistic of the border around
+     *      the footprint, see FootprintCache
+     * @return false if the footprint is not completely inside of the grid.
+     *      The statistics are not changed in that case.
+     * @throw std::runtime_error if the footprint has been computed for a
+     *      different scale than the one of the grid
+     * */
+    bool computeStatistic(const FootprintCache &footprint, const base::Pose2D &pose, TraversabilityStatistic &innerStatistic, TraversabilityStatistic *outerStatistic = NULL) const;
+
+    /** @overload
+     *
+     * Uses the precomputed masks of \c footprint, see computeStatistic
+     */
+    const TraversabilityClass &getWorstTraversabilityClassInRectangle(const FootprintCache &footprint, const base::Pose2D &pose) const;
+
+    /** Result of the evaluation of a single pose, see evaluateFootprints */
+    struct FootprintEvaluation
+    {
+        /** false if the footprint is not completely inside of the grid. The
+         * other fields are not set in that case */
+        bool valid;
+        /** the class with the lowest drivability under the footprint, or -1
+         * if it could not be identified */
+        int worstClass;
+        /** the lowest probability under the footprint, in [0, 1] */
+        double worstProbability;
+        TraversabilityStatistic innerStatistic;
+        /** statistic of the border around the footprint, empty if the
+         * footprint has no border */
+        TraversabilityStatistic outerStatistic;
+
+        FootprintEvaluation() : valid(false), worstClass(-1), worstProbability(1.0) {}
+    };
+
+    /**
+     * Evaluates the footprint of \c footprint at each of the given poses,
+     * e.g. for all the candidate poses of a planner step. Poses whose
+     * heading falls in the same bin share the same precomputed mask, and
+     * large batches are split over several threads.
+     *
+     * The poses are snapped to cell centers and heading bins, see
+     * computeStatistic(const FootprintCache&, ...)
+     *
+     * @arg results resized to poses.size(), results[i] is the evaluation
+     *      of poses[i]
+     * @arg threads the number of threads to use, 0 for one per core
+     * @throw std::runtime_error if the footprint has been computed for a
+     *      different scale than the one of the grid
+     * */
+    void evaluateFootprints(const FootprintCache &footprint, const std::vector<base::Pose2D> &poses, std::vector<FootprintEvaluation> &results, size_t threads = 0) const;
+
+    /** @overload
+     *
+     * Computes the footprint masks of a sizeX x sizeY rectangle with the
+     * given border once for the whole batch
+     */
+    void evaluateFootprints(const std::vector<base::Pose2D> &poses, double sizeX, double sizeY, double borderWidth, std::vector<FootprintEvaluation> &results, size_t threads = 0) const;
     
     virtual void serialize(Serialization& so);
     virtual void unserialize(Serialization& so);
@@ -27,6 +27,8 @@ void TriMesh::unserialize(Serialization& so)
 
 void TriMesh::calcVertexNormals()
 {
+    requireDoubleVertices("TriMesh");
+
     // calculate the Triangle normals first
     std::vector<Eigen::Vector3d>& point_normal(getVertexData<Eigen::Vector3d>(TriMesh::VERTEX_NORMAL));
     point_normal.resize( vertices.size(), Eigen::Vector3d::Zero() );
@@ -3,6 +3,7 @@
 
 #include <envire/Core.hpp>
 #include <envire/maps/Grid.hpp>
+#include <envire/maps/GridKernels.hpp>
 
 namespace envire {
     /** Classification of terrain into symbolic traversability classes, based on
@@ -26,6 +27,22 @@ namespace envire {
     public:
         std::map<Input, Output> class_map;
 
+        /** maps a single cell through class_map */
+        struct ProjectClass
+        {
+            std::map<Input, Output> const& class_map;
+            explicit ProjectClass(std::map<Input, Output> const& class_map)
+                : class_map(class_map) {}
+
+            Output operator()(Input value) const
+            {
+                typename std::map<Input, Output>::const_iterator it = class_map.find(value);
+                if (it == class_map.end())
+                    throw std::runtime_error("found class " + boost::lexical_cast<std::string>(value) + ", for with there is no projection information");
+                return it->second;
+            }
+        };
+
         ClassGridProjection()
             : envire::Operator(1, 1) {}
 
@@ -37,23 +54,7 @@ namespace envire {
             if (!input->isAlignedWith(*output))
                 throw std::runtime_error("trying to apply ClassGridProjection on " + input->getUniqueId() + " -> " + output->getUniqueId() + ", which are not aligned with each other");
 
-            boost::multi_array<Input, 2> const& input_data = input->getGridData();
-            boost::multi_array<Output, 2>& output_data = output->getGridData();
-
-            int xSize = input->getCellSizeX(), ySize = input->getCellSizeY();
-            for (int y = 0; y < ySize; ++y)
-            {
-                Input const* input_line = &input_data[y][0];
-                Output* output_line = &output_data[y][0];
-                for (int x = 0; x < xSize; ++x)
-                {
-                    typename std::map<Input, Output>::const_iterator it = class_map.find(input_line[x]);
-                    if (it == class_map.end())
-                        throw std::runtime_error("found class " + boost::lexical_cast<std::string>(input_line[x]) + ", for with there is no projection information");
-
-                    output_line[x] = it->second;
-                }
-            }
+            GridKernels::map(input->getGridData(), output->getGridData(), ProjectClass(class_map));
 
             return true;
         }
@@ -76,6 +76,8 @@ bool CutPointcloud::updateAll(){
     Pointcloud* sourcecloud = dynamic_cast<envire::Pointcloud*>(env->getInputs(this).front());
     assert( sourcecloud );
     assert( sourcecloud != targetcloud );
+    sourcecloud->requireDoubleVertices("CutPointcloud");
+    targetcloud->requireDoubleVertices("CutPointcloud");
 
     // get meta data
     std::vector<Eigen::Vector3d> *source_vertex_normal_data = NULL;
@@ -20,7 +20,7 @@ bool DistanceGridToPointcloud::updateAll()
     // get the inputs, we need a distance grid, and we can have an optional ImageGrid
     std::list<Layer*> inputs = env->getInputs(this);
     ImageRGB24 *image = NULL;
-    ImageRGB24::ArrayType *ir = NULL, *ig = NULL, *ib = NULL;
+    ImageRGB24::ArrayType const *ir = NULL, *ig = NULL, *ib = NULL;
     
     DistanceGrid* dist = NULL;
     for( std::list<Layer*>::iterator it = inputs.begin(); it != inputs.end(); it++ )
@@ -28,9 +28,10 @@ bool DistanceGridToPointcloud::updateAll()
 	if( dynamic_cast<ImageRGB24*>( *it ) )
 	{
 	    image = dynamic_cast<ImageRGB24*>( *it );
-	    ir = &image->getGridData( ImageRGB24::R );
-	    ig = &image->getGridData( ImageRGB24::G );
-	    ib = &image->getGridData( ImageRGB24::B );
+	    ImageRGB24 const& const_image( *image );
+	    ir = &const_image.getGridData( ImageRGB24::R );
+	    ig = &const_image.getGridData( ImageRGB24::G );
+	    ib = &const_image.getGridData( ImageRGB24::B );
 	}
 
 	if( dynamic_cast<DistanceGrid*>( *it ) )
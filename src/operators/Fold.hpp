@@ -3,24 +3,70 @@
 
 #include "../core/Operator.hpp"
 #include "../maps/Grid.hpp"
+#include <envire/tools/ParallelFor.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
 
 namespace envire {
 
     
+/** Applies a box filter to bands of the input grid, and writes the result to
+ * the bands with the same name in the output grid.
+ *
+ * The window of a cell (x, y) covers the offsets [-n, n - 1] along both axes,
+ * with n = ceil(neighbourhood / 2). Cells of the window that are outside of
+ * the grid are ignored.
+ *
+ * All fold types are separable and computed with one pass along the rows and
+ * one along the columns, using the van Herk/Gil-Werman algorithm, so that the
+ * cost per cell does not depend on the neighbourhood size. For the box sum and
+ * mean, the running sums restart every window length. A NaN or infinite cell
+ * therefore only affects the windows that contain it, as with a direct sum,
+ * and the rounding error does not grow with the size of the grid. Both passes
+ * are run in parallel over the rows, respectively columns, of all bands.
+ */
 template <typename T>
 class FoldOperator: public envire::Operator {
     
 
 
 public:
+    enum FoldType
+    {
+        MEAN,
+        SUM,
+        MIN,
+        MAX
+    };
     
-    FoldOperator(): neighbourhood(0) {};
+    FoldOperator(): neighbourhood(0), type(MEAN) {};
     
     void setNeightbourHoodSize(size_t size)
     {
         neighbourhood = size;
     }
+
+    /** Sets the function that is applied to the window, the default is
+     * MEAN */
+    void setFoldType(FoldType type)
+    {
+        this->type = type;
+    }
+
+    /** Sets the bands that are processed. If empty, which is the default,
+     * the first band of the input grid is processed.
+     */
+    void setBands(std::vector<std::string> const& bands)
+    {
+        this->bands = bands;
+    }
     
+    /** Computes the mean of the window of the cell (xs, ys) directly.
+     *
+     * This is O(neighbourhood^2) per cell, updateAll() does not use it.
+     */
     void fold(const typename Grid< T >::ArrayType &inputData, typename Grid< T >::ArrayType &outputData, size_t xs, size_t ys)
     {
         size_t cnt = 0;
@@ -34,7 +80,7 @@ public:
                 size_t yr = ys + y;
                 
                 //no negative check needed, will overflow if negative
-                if(xr > maxX || yr > maxY)
+                if(xr >= maxX || yr >= maxY)
                     continue;
                 
                 cnt++;
@@ -62,19 +108,37 @@ public:
         if(inputGrid->getCellSizeX() != outputGrid->getCellSizeX() || inputGrid->getCellSizeY() != outputGrid->getCellSizeY())
             throw std::runtime_error("FoldOperator: Error, grids have different sizes");
 
-        typename envire::Grid<T>::ArrayType &inputData(inputGrid->getGridData());
-        typename envire::Grid<T>::ArrayType &outputData(outputGrid->getGridData());
-
         maxX = inputGrid->getCellSizeX();
         maxY = inputGrid->getCellSizeY();
-        
-        for(size_t y = 0;y < maxY; y++)
+
+        std::vector<std::string> band_names(bands);
+        if (band_names.empty())
+            band_names.push_back(inputGrid->getBands().front());
+
+        // the arrays are all looked up before the threads are started, as
+        // getGridData() may create or resize the bands
+        Passes passes(*this);
+        envire::Grid<T> const& constInput(*inputGrid);
+        for (size_t i = 0; i < band_names.size(); ++i)
         {
-            for(size_t x = 0;x < maxX; x++)
-            {
-                fold(inputData, outputData, x, y);
-            }
+            passes.inputs.push_back(&constInput.getGridData(band_names[i]));
+            passes.outputs.push_back(&outputGrid->getGridData(band_names[i]));
+        }
+        passes.temp.resize(band_names.size());
+        for (size_t i = 0; i < band_names.size(); ++i)
+            passes.temp[i].resize(maxX * maxY);
+
+        if (neighbourhood == 0 || maxX == 0 || maxY == 0)
+        {
+            // empty window
+            for (size_t i = 0; i < passes.outputs.size(); ++i)
+                std::fill(passes.outputs[i]->data(), passes.outputs[i]->data() + passes.outputs[i]->num_elements(), T());
+            return true;
         }
+
+        passes.column_blocks = (maxX + Passes::BLOCK - 1) / Passes::BLOCK;
+        parallelFor(0, band_names.size() * maxY, RowPass(passes));
+        parallelFor(0, band_names.size() * passes.column_blocks, ColumnPass(passes));
         
         return true;
     }
@@ -85,6 +149,182 @@ protected:
     size_t maxY;
 
     size_t neighbourhood;
+    FoldType type;
+    std::vector<std::string> bands;
+
+    struct MinOp { double operator()(double a, double b) const { return b < a ? b : a; } };
+    struct MaxOp { double operator()(double a, double b) const { return b > a ? b : a; } };
+    struct SumOp { double operator()(double a, double b) const { return a + b; } };
+
+    /** Workspace of the 1D kernels, one per thread */
+    struct Workspace
+    {
+        std::vector<double> a, b;
+    };
+
+    /** Applies the fold to the n values of in, with the window [i - lo, i +
+     * hi] for the element i
+     */
+    void fold1D(const double* in, double* out, size_t n, size_t lo, size_t hi, Workspace& ws) const
+    {
+        switch (type)
+        {
+            case MEAN:
+            case SUM:
+                boxSum1D(in, out, n, lo, hi, ws);
+                break;
+            case MIN:
+                vanHerk1D(in, out, n, lo, hi, std::numeric_limits<double>::infinity(), MinOp(), ws);
+                break;
+            case MAX:
+                vanHerk1D(in, out, n, lo, hi, -std::numeric_limits<double>::infinity(), MaxOp(), ws);
+                break;
+        }
+    }
+
+    /** Sums the windows with the block scans of blockScan1D(). Unlike min
+     * and max, the sum of a window that is a whole block must only count
+     * the block once.
+     */
+    static void boxSum1D(const double* in, double* out, size_t n, size_t lo, size_t hi, Workspace& ws)
+    {
+        const size_t w = lo + hi + 1;
+        blockScan1D(in, n, lo, hi, 0.0, SumOp(), ws);
+        const std::vector<double>& prefix(ws.a);
+        const std::vector<double>& suffix(ws.b);
+        for (size_t i = 0; i < n; ++i)
+            out[i] = (i % w == 0) ? suffix[i] : suffix[i] + prefix[i + w - 1];
+    }
+
+    /** van Herk/Gil-Werman running min/max, see blockScan1D() */
+    template <class Op>
+    static void vanHerk1D(const double* in, double* out, size_t n, size_t lo, size_t hi, double identity, Op op, Workspace& ws)
+    {
+        const size_t w = lo + hi + 1;
+        blockScan1D(in, n, lo, hi, identity, op, ws);
+        const std::vector<double>& prefix(ws.a);
+        const std::vector<double>& suffix(ws.b);
+        for (size_t i = 0; i < n; ++i)
+            out[i] = op(suffix[i], prefix[i + w - 1]);
+    }
+
+    /** Computes the prefix (ws.a) and suffix (ws.b) scans of the blocks of
+     * the van Herk/Gil-Werman algorithm. The input is padded with \c
+     * identity on both sides, and split into blocks of the window size.
+     * The result for a window is the combination of the suffix of the block
+     * it starts in, and the prefix of the block it ends in.
+     */
+    template <class Op>
+    static void blockScan1D(const double* in, size_t n, size_t lo, size_t hi, double identity, Op op, Workspace& ws)
+    {
+        const size_t w = lo + hi + 1;
+        const size_t length = n + lo + hi;
+        std::vector<double>& prefix(ws.a);
+        std::vector<double>& suffix(ws.b);
+        prefix.resize(length);
+        suffix.resize(length);
+
+        for (size_t j = 0; j < length; ++j)
+        {
+            const double value = (j < lo || j >= lo + n) ? identity : in[j - lo];
+            prefix[j] = (j % w == 0) ? value : op(prefix[j - 1], value);
+        }
+        for (size_t j = length; j-- > 0;)
+        {
+            const double value = (j < lo || j >= lo + n) ? identity : in[j - lo];
+            suffix[j] = (j % w == w - 1 || j == length - 1) ? value : op(suffix[j + 1], value);
+        }
+    }
+
+    /** the number of cells of the window [i - lo, i + hi] inside [0, n[ */
+    static size_t windowCount(size_t i, size_t n, size_t lo, size_t hi)
+    {
+        return std::min(n, i + hi + 1) - (i > lo ? i - lo : 0);
+    }
+
+    /** State that is shared by the row and column passes */
+    struct Passes
+    {
+        enum { BLOCK = 16 };
+
+        FoldOperator const& op;
+        size_t lo, hi;
+        size_t column_blocks;
+        std::vector<typename Grid<T>::ArrayType const*> inputs;
+        std::vector<typename Grid<T>::ArrayType*> outputs;
+        /** result of the row pass, per band */
+        std::vector< std::vector<double> > temp;
+
+        explicit Passes(FoldOperator const& op)
+            : op(op), column_blocks(0)
+        {
+            lo = ceil(op.neighbourhood / 2.0);
+            hi = lo ? lo - 1 : 0;
+        }
+    };
+
+    /** folds the rows, the index is band * maxY + row */
+    struct RowPass
+    {
+        Passes& p;
+        explicit RowPass(Passes& p) : p(p) {}
+
+        void operator()(size_t first, size_t last) const
+        {
+            const size_t width = p.op.maxX, height = p.op.maxY;
+            Workspace ws;
+            std::vector<double> in(width);
+            for (size_t idx = first; idx < last; ++idx)
+            {
+                const size_t band = idx / height, y = idx % height;
+                const T* row = p.inputs[band]->data() + y * width;
+                std::copy(row, row + width, in.begin());
+                p.op.fold1D(&in[0], &p.temp[band][y * width], width, p.lo, p.hi, ws);
+            }
+        }
+    };
+
+    /** folds blocks of columns, the index is band * column_blocks + block */
+    struct ColumnPass
+    {
+        Passes& p;
+        explicit ColumnPass(Passes& p) : p(p) {}
+
+        void operator()(size_t first, size_t last) const
+        {
+            const size_t width = p.op.maxX, height = p.op.maxY;
+            Workspace ws;
+            std::vector<double> in(height * Passes::BLOCK), out(height);
+            for (size_t idx = first; idx < last; ++idx)
+            {
+                const size_t band = idx / p.column_blocks;
+                const size_t x0 = (idx % p.column_blocks) * Passes::BLOCK;
+                const size_t count = std::min<size_t>(Passes::BLOCK, width - x0);
+                const std::vector<double>& temp(p.temp[band]);
+                T* output = p.outputs[band]->data();
+
+                // copy the columns row by row, so that the memory is read
+                // sequentially
+                for (size_t y = 0; y < height; ++y)
+                    for (size_t i = 0; i < count; ++i)
+                        in[i * height + y] = temp[y * width + x0 + i];
+
+                for (size_t i = 0; i < count; ++i)
+                {
+                    const size_t x = x0 + i;
+                    p.op.fold1D(&in[i * height], &out[0], height, p.lo, p.hi, ws);
+                    if (p.op.type == MEAN)
+                    {
+                        const size_t cnt_x = windowCount(x, width, p.lo, p.hi);
+                        for (size_t y = 0; y < height; ++y)
+                            out[y] /= cnt_x * windowCount(y, height, p.lo, p.hi);
+                    }
+                    for (size_t y = 0; y < height; ++y)
+                        output[y * width + x] = static_cast<T>(out[y]);
+                }
+            }
+        }
+    };
 };
 
 
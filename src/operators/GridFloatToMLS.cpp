@@ -51,11 +51,13 @@ static void convert(Grid<T>* grid, std::string const& band_name, MLSGrid* mls)
 {
     Transform mls2grid = grid->getEnvironment()->relativeTransform( grid, mls );
     
-    boost::multi_array<T, 2>* grid_data;
+    // read-only access, so that a shared band is not copied
+    Grid<T> const& const_grid(*grid);
+    boost::multi_array<T, 2> const* grid_data;
     if (band_name.empty())
-        grid_data = &grid->getGridData();
+        grid_data = &const_grid.getGridData();
     else
-        grid_data = &grid->getGridData(band_name);
+        grid_data = &const_grid.getGridData(band_name);
 
     for (size_t yi = 0; yi < mls->getCellSizeY(); ++yi)
     {
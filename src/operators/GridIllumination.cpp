@@ -1,5 +1,6 @@
 #include "GridIllumination.hpp"
 #include <envire/maps/ElevationGrid.hpp>
+#include <envire/tools/ParallelFor.hpp>
 
 using namespace envire;
 using namespace Eigen;
@@ -7,102 +8,318 @@ using namespace Eigen;
 ENVIRONMENT_ITEM_DEF( GridIllumination )
 
 GridIllumination::GridIllumination()
-    : lightSource( base::Vector3d::Zero() ), lightDiameter( 0.0 ), band( ElevationGrid::ILLUMINATION )
+    : lightSource( base::Vector3d::Zero() ), lightDiameter( 0.0 ), band( ElevationGrid::ILLUMINATION ), method( AUTO )
 {
 }
 
-bool GridIllumination::updateAll()
+namespace
 {
-    // get output grid
-    ElevationGrid* grid = getOutput<envire::ElevationGrid*>();
-
-    // and get the array
-    ElevationGrid::ArrayType &harray = grid->getGridData( ElevationGrid::ELEVATION_MAX );
-    ElevationGrid::ArrayType &iarray = grid->getGridData( band );
-
-    // get the position of the light source
-    ElevationGrid::Position lightPos;
-    bool lightInGrid = grid->toGrid( lightSource, lightPos.x, lightPos.y );
-
-    for( size_t x = 0; x < grid->getCellSizeX(); x++ )
+    /** Limits of the slope towards the light source, between which the
+     * light source is partially visible from a cell at height z
+     */
+    struct LightRange
     {
-	for( size_t y = 0; y < grid->getCellSizeY(); y++ )
+	double lightMin, lightMax;
+
+	LightRange( const Vector3d& lightSource, double lightDiameter, const Vector3d& cell )
 	{
-	    Vector3d cell = grid->fromGrid( x, y );
-	    // get z-value from array
-	    cell.z() = harray[y][x];
 	    Vector3d dir3 = lightSource - cell;
 	    // the direction to the light source in 2d
 	    Vector2d dir = dir3.head<2>();
 
 	    // min/max height at 1m distance where the light is visible
-	    double 
-		lightMin = (dir3.z() - .5*lightDiameter) / dir.norm(),
-		lightMax = (dir3.z() + .5*lightDiameter) / dir.norm();
-
-	    // starting from the current cell, we want to advance towards the
-	    // light source until either the cell of the light source is
-	    // reached, or we leave the grid.
-	    //
-	    // the algorithm is based on 
-	    // "A Fast Voxel Traversal Algorithm for Ray Tracing"
-	    // John Amanatides, Andrew Woo
-	    // http://www.cse.yorku.ca/~amana/research/grid.pdf
-	    //
-	    size_t cx = x, cy = y;
-	    // set directions in x and y
-	    int 
-		stepx = dir.x() > 0 ? 1 : -1,
-		stepy = dir.y() > 0 ? 1 : -1;
-	    // this is the distance along the ray until a new cell is reached
-	    const double 
-		deltax = (dir / dir.x() * grid->getScaleX()).norm(),
-		deltay = (dir / dir.y() * grid->getScaleY()).norm();
-	    // starting distance until a new cell is reached.
-	    // since we start in the center of the cell, this is half the 
-	    // deltax, and deltay
-	    double 
-		maxx = deltax * 0.5,
-		maxy = deltay * 0.5; 
-
-	    double maxLight = 0.0; 
-	    while( true )
+	    lightMin = (dir3.z() - .5*lightDiameter) / dir.norm();
+	    lightMax = (dir3.z() + .5*lightDiameter) / dir.norm();
+	}
+
+	/** z height normalized to dist and mapped to min/max light */
+	double relative( double slope ) const
+	{
+	    return (slope - lightMin ) / (lightMax - lightMin);
+	}
+    };
+
+    /** Per cell ray traversal for the columns [first, last[ */
+    struct RayCaster
+    {
+	ElevationGrid const& grid;
+	ElevationGrid::ArrayType const& harray;
+	ElevationGrid::ArrayType& iarray;
+	Vector3d lightSource;
+	double lightDiameter;
+	bool lightInGrid;
+	ElevationGrid::Position lightPos;
+
+	RayCaster( ElevationGrid const& grid, ElevationGrid::ArrayType const& harray, ElevationGrid::ArrayType& iarray,
+		const Vector3d& lightSource, double lightDiameter )
+	    : grid( grid ), harray( harray ), iarray( iarray ),
+	    lightSource( lightSource ), lightDiameter( lightDiameter )
+	{
+	    // get the position of the light source
+	    lightInGrid = grid.toGrid( lightSource, lightPos.x, lightPos.y );
+	}
+
+	void operator()( size_t first, size_t last ) const
+	{
+	    for( size_t x = first; x < last; x++ )
 	    {
-		// advance to next cell
-		if( maxx < maxy )
+		for( size_t y = 0; y < grid.getCellSizeY(); y++ )
 		{
-		    maxx += deltax;
-		    cx += stepx;
-		}
-		else
-		{
-		    maxy += deltay;
-		    cy += stepy;
+		    Vector3d cell = grid.fromGrid( x, y );
+		    // get z-value from array
+		    cell.z() = harray[y][x];
+		    Vector2d dir = (lightSource - cell).head<2>();
+		    LightRange range( lightSource, lightDiameter, cell );
+
+		    // starting from the current cell, we want to advance towards the
+		    // light source until either the cell of the light source is
+		    // reached, or we leave the grid.
+		    //
+		    // the algorithm is based on 
+		    // "A Fast Voxel Traversal Algorithm for Ray Tracing"
+		    // John Amanatides, Andrew Woo
+		    // http://www.cse.yorku.ca/~amana/research/grid.pdf
+		    //
+		    size_t cx = x, cy = y;
+		    // set directions in x and y
+		    int 
+			stepx = dir.x() > 0 ? 1 : -1,
+			stepy = dir.y() > 0 ? 1 : -1;
+		    // this is the distance along the ray until a new cell is reached
+		    const double 
+			deltax = (dir / dir.x() * grid.getScaleX()).norm(),
+			deltay = (dir / dir.y() * grid.getScaleY()).norm();
+		    // starting distance until a new cell is reached.
+		    // since we start in the center of the cell, this is half the 
+		    // deltax, and deltay
+		    double 
+			maxx = deltax * 0.5,
+			maxy = deltay * 0.5; 
+
+		    double maxLight = 0.0; 
+		    while( true )
+		    {
+			// advance to next cell
+			if( maxx < maxy )
+			{
+			    maxx += deltax;
+			    cx += stepx;
+			}
+			else
+			{
+			    maxy += deltay;
+			    cy += stepy;
+			}
+
+			// see if we are still within bounds
+			if( !(cx >= 0 && cx < grid.getCellSizeX() && cy >= 0 && cy < grid.getCellSizeY()) )
+			    break;
+			// check if we already are on the light-source
+			if( lightInGrid && ElevationGrid::Position(cx, cy) == lightPos )
+			    break;
+
+			// get distance value on x/y plane
+			double dist = (grid.fromGrid( cx, cy ).head<2>() - cell.head<2>()).norm();
+
+			// now get the elevationvalue from the grid relative to the
+			// current cell
+			double zDiff = harray[cy][cx] - cell.z();
+			maxLight = std::max( maxLight, range.relative( zDiff / dist ) );
+		    }
+
+		    // set the light value in the illumination band
+		    iarray[y][x] = 1.0 - std::min( maxLight, 1.0 );
 		}
+	    }
+	}
+    };
+
+    /** Horizon propagation along the lines [first, last[ of a family of
+     * parallel digital lines.
+     *
+     * The lines run along the major axis of the direction towards the
+     * light, and have one cell per major index. Line k contains the cells
+     * (m, k + offsets[m]) in (major, minor) coordinates. Each line is
+     * processed starting at the side of the light source, while the upper
+     * convex hull of the (distance, height) profile that has been seen so
+     * far is kept on a stack. The horizon of a cell is the tangent from the
+     * cell to that hull.
+     */
+    struct HorizonSweep
+    {
+	ElevationGrid const& grid;
+	ElevationGrid::ArrayType const& harray;
+	ElevationGrid::ArrayType& iarray;
+	Vector3d lightSource;
+	double lightDiameter;
 
-		// see if we are still within bounds
-		if( !(cx >= 0 && cx < grid->getCellSizeX() && cy >= 0 && cy < grid->getCellSizeY()) )
-		    break;
-		// check if we already are on the light-source
-		if( lightInGrid && ElevationGrid::Position(cx, cy) == lightPos )
-		    break;
-
-		// get distance value on x/y plane
-		double dist = (grid->fromGrid( cx, cy ).head<2>() - cell.head<2>()).norm();
-
-		// now get the elevationvalue from the grid relative to the
-		// current cell
-		double zDiff = harray[cy][cx] - cell.z();
-		// z height normalized to dist and mapped to min/max light
-		double zRel = (zDiff / dist - lightMin ) / (lightMax - lightMin); 
-		maxLight = std::max( maxLight, zRel );
+	/** true if the major axis is y */
+	bool swapped;
+	size_t majorSize, minorSize;
+	/** minor offset of the line for each major index */
+	std::vector<long> offsets;
+	/** smallest line index */
+	long firstLine;
+	/** true if the light is in the direction of increasing major index */
+	bool towardsMax;
+	/** the distance along the light direction is tMajor * m + tMinor * n */
+	double tMajor, tMinor;
+	/** number of lines that intersect the grid */
+	size_t lineCount;
+
+	HorizonSweep( ElevationGrid const& grid, ElevationGrid::ArrayType const& harray, ElevationGrid::ArrayType& iarray,
+		const Vector3d& lightSource, double lightDiameter, const Vector2d& direction )
+	    : grid( grid ), harray( harray ), iarray( iarray ),
+	    lightSource( lightSource ), lightDiameter( lightDiameter )
+	{
+	    const Vector2d dir = direction.normalized();
+	    // direction in cell units
+	    const double cx = dir.x() / grid.getScaleX(), cy = dir.y() / grid.getScaleY();
+	    swapped = std::abs( cy ) > std::abs( cx );
+
+	    const double major = swapped ? cy : cx, minor = swapped ? cx : cy;
+	    majorSize = swapped ? grid.getCellSizeY() : grid.getCellSizeX();
+	    minorSize = swapped ? grid.getCellSizeX() : grid.getCellSizeY();
+	    towardsMax = major > 0;
+	    tMajor = swapped ? dir.y() * grid.getScaleY() : dir.x() * grid.getScaleX();
+	    tMinor = swapped ? dir.x() * grid.getScaleX() : dir.y() * grid.getScaleY();
+
+	    const double slope = minor / major;
+	    offsets.resize( majorSize );
+	    long minOffset = 0, maxOffset = 0;
+	    for( size_t m = 0; m < majorSize; m++ )
+	    {
+		offsets[m] = static_cast<long>( floor( slope * m + 0.5 ) );
+		minOffset = std::min( minOffset, offsets[m] );
+		maxOffset = std::max( maxOffset, offsets[m] );
 	    }
+	    firstLine = -maxOffset;
+	    lineCount = minorSize + maxOffset - minOffset;
+	}
 
-	    // set the light value in the illumination band
-	    iarray[y][x] = 1.0 - std::min( maxLight, 1.0 );
+	void operator()( size_t first, size_t last ) const
+	{
+	    // upper hull of the (distance, height) points seen so far
+	    std::vector< std::pair<double, double> > hull;
+	    hull.reserve( majorSize );
+
+	    for( size_t line = first; line < last; line++ )
+	    {
+		const long k = firstLine + static_cast<long>( line );
+		hull.clear();
+		bool inside = false;
+		for( size_t i = 0; i < majorSize; i++ )
+		{
+		    const size_t m = towardsMax ? majorSize - 1 - i : i;
+		    const long n = k + offsets[m];
+		    if( n < 0 || n >= static_cast<long>( minorSize ) )
+		    {
+			// the cells of a line inside the grid are contiguous
+			if( inside )
+			    break;
+			continue;
+		    }
+		    inside = true;
+
+		    const size_t x = swapped ? n : m, y = swapped ? m : n;
+		    const double t = tMajor * m + tMinor * n;
+		    const double h = harray[y][x];
+
+		    Vector3d cell = grid.fromGrid( x, y );
+		    cell.z() = h;
+		    LightRange range( lightSource, lightDiameter, cell );
+
+		    double maxLight = 0.0;
+		    if( h == h )
+		    {
+			// remove the hull points which are below the line
+			// from this cell to the point before them
+			while( hull.size() >= 2 )
+			{
+			    const std::pair<double, double> &a( hull[hull.size() - 1] ), &b( hull[hull.size() - 2] );
+			    if( (a.second - h) / (a.first - t) > (b.second - h) / (b.first - t) )
+				break;
+			    hull.pop_back();
+			}
+			if( !hull.empty() )
+			    maxLight = std::max( maxLight, range.relative( (hull.back().second - h) / (hull.back().first - t) ) );
+			hull.push_back( std::make_pair( t, h ) );
+		    }
+
+		    // set the light value in the illumination band
+		    iarray[y][x] = 1.0 - std::min( maxLight, 1.0 );
+		}
+	    }
 	}
+    };
+}
+
+bool GridIllumination::isLightDirectional( ElevationGrid const& grid ) const
+{
+    const size_t sx = grid.getCellSizeX(), sy = grid.getCellSizeY();
+    const Vector2d center = (grid.fromGrid( 0, 0 ).head<2>() + grid.fromGrid( sx - 1, sy - 1 ).head<2>()) / 2.0;
+    const Vector2d dir = lightSource.head<2>() - center;
+    const double extent = (grid.fromGrid( sx - 1, sy - 1 ).head<2>() - grid.fromGrid( 0, 0 ).head<2>()).norm();
+    if( dir.norm() <= extent )
+	return false;
+
+    // the lines are considered parallel if the directions towards the
+    // light differ by less than one cell over the extent of the grid
+    const double maxAngle = std::min( grid.getScaleX(), grid.getScaleY() ) / std::max( extent, 1e-9 );
+    const size_t cx[] = { 0, sx - 1, 0, sx - 1 }, cy[] = { 0, 0, sy - 1, sy - 1 };
+    for( int i = 0; i < 4; i++ )
+    {
+	const Vector2d cornerDir = lightSource.head<2>() - grid.fromGrid( cx[i], cy[i] ).head<2>();
+	const double cosAngle = cornerDir.normalized().dot( dir.normalized() );
+	if( acos( std::min( cosAngle, 1.0 ) ) > maxAngle )
+	    return false;
+    }
+    return true;
+}
+
+void GridIllumination::updateRayCasting( ElevationGrid& grid )
+{
+    ElevationGrid const& constGrid( grid );
+    RayCaster caster( grid, constGrid.getGridData( ElevationGrid::ELEVATION_MAX ), grid.getGridData( band ),
+	    lightSource, lightDiameter );
+    parallelFor( 0, grid.getCellSizeX(), caster );
+}
+
+void GridIllumination::updateHorizonSweep( ElevationGrid& grid )
+{
+    const Vector2d center = (grid.fromGrid( 0, 0 ).head<2>() + grid.fromGrid( grid.getCellSizeX() - 1, grid.getCellSizeY() - 1 ).head<2>()) / 2.0;
+    const Vector2d dir = lightSource.head<2>() - center;
+    if( dir.norm() == 0 )
+    {
+	updateRayCasting( grid );
+	return;
     }
 
+    ElevationGrid const& constGrid( grid );
+    HorizonSweep sweep( grid, constGrid.getGridData( ElevationGrid::ELEVATION_MAX ), grid.getGridData( band ),
+	    lightSource, lightDiameter, dir );
+    parallelFor( 0, sweep.lineCount, sweep );
+}
+
+bool GridIllumination::updateAll()
+{
+    // get output grid
+    ElevationGrid* grid = getOutput<envire::ElevationGrid*>();
+    // make sure both bands exist before they are accessed from several
+    // threads. The elevation is only read, and is not accessed for
+    // modification if it exists, as that would copy a shared band.
+    if( !grid->hasBand( ElevationGrid::ELEVATION_MAX ) )
+	grid->getGridData( ElevationGrid::ELEVATION_MAX );
+    grid->getGridData( band );
+
+    if( grid->getCellSizeX() == 0 || grid->getCellSizeY() == 0 )
+	return true;
+
+    if( method == HORIZON_SWEEP || (method == AUTO && isLightDirectional( *grid )) )
+	updateHorizonSweep( *grid );
+    else
+	updateRayCasting( *grid );
+
     return true;
 }
 
@@ -116,3 +333,8 @@ void GridIllumination::setOutputBand( const std::string& band )
 {
     this->band = band;
 }
+
+void GridIllumination::setMethod( Method method )
+{
+    this->method = method;
+}
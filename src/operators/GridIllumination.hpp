@@ -5,21 +5,53 @@
 
 namespace envire
 {
+class ElevationGrid;
+
+/** Computes how much of a light source is visible from each cell of an
+ * ElevationGrid, based on the ELEVATION_MAX band. The result is written to
+ * the illumination band of the output grid, with 1 for fully and 0 for not
+ * illuminated cells.
+ */
 class GridIllumination : public Operator
 {
     ENVIRONMENT_ITEM( GridIllumination )
 
 public:
+    enum Method
+    {
+        /** uses HORIZON_SWEEP if the light source is far enough from the
+         * grid that the directions towards it can be considered parallel,
+         * and RAY_CASTING otherwise */
+        AUTO,
+        /** traverses the ray from every cell towards the light source */
+        RAY_CASTING,
+        /** propagates the terrain horizon along parallel lines in the
+         * direction of the light source. The time per cell does not depend
+         * on the size of the grid, but the cells on the way to the light
+         * source are those of a digital straight line, which can differ
+         * from the ray traversal at the edges of shadows.
+         */
+        HORIZON_SWEEP
+    };
+
     GridIllumination();
     bool updateAll();
 
     void setLightSource( const base::Vector3d& ls, double diameter = 0.0 );
     void setOutputBand( const std::string& band );
 
+    /** Sets the algorithm, the default is AUTO */
+    void setMethod( Method method );
+
 private:
+    void updateRayCasting( ElevationGrid& grid );
+    void updateHorizonSweep( ElevationGrid& grid );
+    bool isLightDirectional( ElevationGrid const& grid ) const;
+
     base::Vector3d lightSource;
     double lightDiameter;
     std::string band;
+    Method method;
 };
 }
 #endif
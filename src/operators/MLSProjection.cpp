@@ -173,6 +173,12 @@ void MLSProjection::projectPointcloudWithUncertainty( envire::MultiLevelSurfaceG
 
 void MLSProjection::projectPointcloud( envire::MultiLevelSurfaceGrid* grid, envire::Pointcloud* pc )
 {
+    if( pc->getStorage() == Pointcloud::FLOAT_COLUMNS )
+    {
+	projectPointColumns( grid, pc->columns );
+	return;
+    }
+
     // note: the grid might actually be a local copy and not attached to an
     // environment
     std::vector<Eigen::Vector3d>& points(pc->vertices);
@@ -207,6 +213,29 @@ void MLSProjection::projectPointcloud( envire::MultiLevelSurfaceGrid* grid, envi
     }
 }
 
+void MLSProjection::projectPointColumns( envire::MultiLevelSurfaceGrid* grid, const envire::PointColumns& columns )
+{
+    const bool hasColor = columns.hasAttribute( PointColumns::COLOR );
+    if( hasColor )
+	grid->setHasCellColor( true );
+    const bool hasUncertainty = columns.hasAttribute( PointColumns::VARIANCE );
+
+    for(size_t i=0;i<columns.size();i++)
+    {
+	const double p_var = hasUncertainty? columns.variance[i] : defaultUncertainty;
+	const Eigen::Vector3d mean( C_m2g.getTransform() * columns.getPoint(i) );
+
+        if(use_boundary_box && !boundary_box.contains(mean))
+            continue;
+
+        MLSGrid::SurfacePatch patch( mean.z(), sqrt(p_var) );
+        if( hasColor )
+            patch.setColor( columns.getColor(i) );
+
+        grid->update( mean.head<2>(), patch );
+    }
+}
+
 bool MLSProjection::updateAll() 
 {
     std::list<Layer*> outputs = env->getOutputs(this);
@@ -39,6 +39,9 @@ namespace envire {
     protected:
 	void projectPointcloudWithUncertainty( envire::MultiLevelSurfaceGrid* grid, envire::Pointcloud* pc );
 	void projectPointcloud( envire::MultiLevelSurfaceGrid* grid, envire::Pointcloud* pc );
+	/** projectPointcloud for a pointcloud stored in columns, see
+	 * Pointcloud::FLOAT_COLUMNS */
+	void projectPointColumns( envire::MultiLevelSurfaceGrid* grid, const envire::PointColumns& columns );
 
 	bool withUncertainty;
 	bool m_negativeInformation;
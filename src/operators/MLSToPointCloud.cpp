@@ -32,6 +32,7 @@ bool MLSToPointCloud::updateAll()
     Pointcloud* pointcloud = dynamic_cast<Pointcloud*>(env->getOutput<Pointcloud*>(this));    
     MLSGrid* mls_grid = dynamic_cast<MLSGrid*>(env->getInput<MLSGrid*>(this));
     
+    pointcloud->requireDoubleVertices("MLSToPointCloud");
     pointcloud->clear();
 
     float vertical_distance = (mls_grid->getScaleX() + mls_grid->getScaleY()) * 0.5;
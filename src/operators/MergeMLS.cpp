@@ -91,34 +91,40 @@ bool MergeMLS::updateAll()
 	    transforms.push_back( C_g2m );
 	}
 
-	for(size_t m=0;m<output->getWidth();m++)
+	// the output cells are processed row by row, and each row is
+	// converted into the input grids in one batch. The inputs are still
+	// merged in order into each of the cells.
+	std::vector<GridBase::Position> row( output->getWidth() );
+	std::vector<Eigen::Vector3d> centers;
+	std::vector<GridBase::Position> s_cells;
+	std::vector<uint8_t> inGrid;
+	std::vector<double> heights;
+	for(size_t n=0;n<output->getHeight();n++)
 	{
-	    for(size_t n=0;n<output->getHeight();n++)
+	    // get 3d position of output gridcells
+	    for(size_t m=0;m<row.size();m++)
+		row[m] = GridBase::Position( m, n );
+	    output->fromGridBatch( row, centers );
+
+	    // go through the input grids
+	    // and have a look if we get a mapping
+	    for( size_t t=0; t<grids.size(); t++ )
 	    {
-		// get 3d position of output gridcell
-		Eigen::Vector3d pos;
-		pos << output->fromGrid( GridBase::Position( m, n ) ), 0;
+		MLSGrid* input = grids[t];
+		if( !input->toGridBatch( centers, s_cells, inGrid, transforms[t], &heights ) )
+		    continue;
 
-		// go through the input grids
-		// and have a look if we get a mapping
-		for( size_t t=0; t<grids.size(); t++ )
+		for(size_t m=0;m<row.size();m++)
 		{
-		    MLSGrid* input = grids[t];
+		    if( !inGrid[m] )
+			continue;
 
-		    // transform into target frame
-		    Eigen::Vector3d src_pos = transforms[t] * pos;
-
-		    // see if available in target grid
-		    MLSGrid::Position s_pos;
-		    if( input->toGrid( src_pos.head<2>(), s_pos ) )
+		    for( MLSGrid::iterator cit = input->beginCell(s_cells[m].x, s_cells[m].y); cit != input->endCell(); cit++ )
 		    {
-			for( MLSGrid::iterator cit = input->beginCell(s_pos.x, s_pos.y); cit != input->endCell(); cit++ )
-			{
-			    MLSGrid::SurfacePatch p( *cit );
-			    p.mean += src_pos.z();
+			MLSGrid::SurfacePatch p( *cit );
+			p.mean += heights[m];
 
-			    output->updateCell( m, n, p );
-			}
+			output->updateCell( m, n, p );
 		    }
 		}
 	    }
@@ -51,6 +51,7 @@ void MergePointcloud::setClearOutput( bool clear )
 bool MergePointcloud::updateAll(){
     Pointcloud* targetcloud = dynamic_cast<envire::Pointcloud*>(*env->getOutputs(this).begin());
     assert( targetcloud );
+    targetcloud->requireDoubleVertices("MergePointcloud");
     if( m_clearOutput )
 	targetcloud->clear();
 
@@ -65,6 +66,7 @@ bool MergePointcloud::updateAll(){
 	hasColor = hasColor || cloud->hasData( Pointcloud::VERTEX_COLOR );
 
 	assert( cloud != targetcloud );
+	cloud->requireDoubleVertices("MergePointcloud");
     }
 
     //for every cloud
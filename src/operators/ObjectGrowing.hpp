@@ -3,6 +3,8 @@
 
 #include <envire/core/Operator.hpp>
 #include <envire/maps/TraversabilityGrid.hpp>
+#include <envire/tools/DistanceTransform.hpp>
+#include <set>
 
 namespace envire {
     
@@ -19,7 +21,7 @@ public:
         policy[a][b] = isBigger;
     }
     
-    bool isBigger(X a, X b)
+    bool isBigger(X a, X b) const
     {
         return policy[a][b];
     }
@@ -32,56 +34,75 @@ template <typename Y>
 class ObjectGrowing
 {
 public:
+    /** Grows the objects of \c band_name in \c mapIn by \c newSize and
+     * writes the result into \c mapOut.
+     *
+     * A cell that is closer than \c newSize to a cell of value v is set to
+     * v if the policy declares v bigger than the value it currently has.
+     * The distances are computed with an exact euclidean distance
+     * transform per value, so that the cost does not depend on newSize.
+     * The values are applied in ascending order, which only matters if the
+     * policy is not a strict ordering.
+     */
     void growObjects(GrowthPolicy<Y> &policy, Grid< Y >& mapIn, Grid< Y >& mapOut, const std::string& band_name, double newSize)
     {
-        const double width_square = pow(newSize,2);
-        const int 
-            wx = newSize / mapIn.getScaleX() + 1, 
-            wy = newSize / mapIn.getScaleY() + 1;
-        const double 
-            sx = mapIn.getScaleX(),
-            sy = mapIn.getScaleY();
+        const float width_square = pow(newSize,2);
 
+        if(mapIn.getCellSizeX() != mapOut.getCellSizeX() || mapIn.getCellSizeY() != mapOut.getCellSizeY())
+            throw std::runtime_error("ObjectGrowing, input and output data have differens sizes");
 
-        typename Grid< Y >::ArrayType& orig_data = band_name.empty() ?
-            mapIn.getGridData() :
-            mapIn.getGridData(band_name);
+        const std::string band = band_name.empty() ? mapIn.getBands().front() : band_name;
 
-        typename Grid< Y >::ArrayType &data( mapOut.getGridData(band_name) );
+        // the output band shares the input band until it is written to,
+        // which it is not if no value grows. Only the const input band is
+        // accessed below, so that its references stay valid.
+        mapOut.shareBandFrom(mapIn, band);
 
-        if(orig_data.num_elements() != data.num_elements())
-            throw std::runtime_error("ObjectGrowing, input and output data have differens sizes");
-    
-        memcpy(data.data(), orig_data.data(), sizeof(Y) * orig_data.num_elements());
+        Grid< Y > const& constMapIn(mapIn);
+        typename Grid< Y >::ArrayType const& orig_data = constMapIn.getGridData(band);
 
-        assert(data.shape()[0] == mapIn.getCellSizeY());
-        assert(data.shape()[1] == mapIn.getCellSizeX());
         assert(orig_data.shape()[0] == mapIn.getCellSizeY());
         assert(orig_data.shape()[1] == mapIn.getCellSizeX());
-        
-        for (unsigned int y = 0; y < mapIn.getCellSizeY(); ++y)
+
+        const Y* orig = orig_data.data();
+        const size_t size = orig_data.num_elements();
+        std::set<Y> values;
+        for (size_t c = 0; c < size; ++c)
         {
-            for (unsigned int x = 0; x < mapIn.getCellSizeX(); ++x)
-            {
-                Y value = orig_data[y][x];
-                //grow all object in the radius
-                for( int oy = -wy; oy <= wy; ++oy )
+            // neighbouring cells mostly have the same value, skip the set
+            // lookup for them
+            if (c == 0 || orig[c] != orig[c - 1])
+                values.insert(orig[c]);
+        }
+
+        // only the values that are bigger than another value in the map
+        // can grow
+        std::vector<Y> growing;
+        for (typename std::set<Y>::const_iterator a = values.begin(); a != values.end(); ++a)
+            for (typename std::set<Y>::const_iterator b = values.begin(); b != values.end(); ++b)
+                if (policy.isBigger(*a, *b))
                 {
-                    for( int ox = -wx; ox <= wx; ++ox )
-                    {
-                        const int tx = x+ox;
-                        const int ty = y+oy;
-                        if( (pow(ox*sx,2) + pow(oy*sy,2) < width_square )
-                                && tx >= 0 && tx < (int)mapIn.getCellSizeX()
-                                && ty >= 0 && ty < (int)mapIn.getCellSizeY() )
-                        {
-                            if(policy.isBigger(value, data[ty][tx]))
-                            {
-                                data[ty][tx] = value;
-                            }
-                        }
-                    }
+                    growing.push_back(*a);
+                    break;
                 }
+        if (growing.empty())
+            return;
+
+        typename Grid< Y >::ArrayType &data( mapOut.getGridData(band) );
+        DistanceTransform::ArrayType distances(boost::extents[orig_data.shape()[0]][orig_data.shape()[1]]);
+        float* dist = distances.data();
+        for (size_t i = 0; i < growing.size(); ++i)
+        {
+            const Y value = growing[i];
+            for (size_t c = 0; c < size; ++c)
+                dist[c] = (orig[c] == value) ? 0 : DistanceTransform::infinity();
+            DistanceTransform::computeSquaredDistances(distances, mapIn.getScaleX(), mapIn.getScaleY());
+
+            Y* out = data.data();
+            for (size_t c = 0; c < size; ++c)
+            {
+                if (dist[c] < width_square && policy.isBigger(value, out[c]))
+                    out[c] = value;
             }
         }
     }
@@ -63,6 +63,10 @@ bool Projection::updateElevationMap()
     std::fill(elv_min.data(), elv_min.data() + elv_min.num_elements(), std::numeric_limits<double>::infinity());
     std::fill(elv_max.data(), elv_max.data() + elv_max.num_elements(), -std::numeric_limits<double>::infinity());
 
+    std::vector<GridBase::Position> cells;
+    std::vector<uint8_t> inGrid;
+    std::vector<double> heights;
+
     std::list<Layer*> inputs = env->getInputs(this);
     for( std::list<Layer*>::iterator it = inputs.begin(); it != inputs.end(); it++ )
     {
@@ -70,17 +74,19 @@ bool Projection::updateElevationMap()
 
 	FrameNode::TransformType C_m2g = env->relativeTransform( mesh->getFrameNode(), grid->getFrameNode() );
 
+	mesh->requireDoubleVertices("Projection");
 	std::vector<Eigen::Vector3d>& points(mesh->vertices);
+
+	// convert the whole cloud at once
+	grid->toGridBatch( points, cells, inGrid, env->getRootNode()->getTransform() * C_m2g, &heights );
 	
 	for(size_t i=0;i<points.size();i++)
 	{
-	    Eigen::Vector3d p = env->getRootNode()->getTransform() * C_m2g * points[i];
-
-	    size_t x, y;
-	    if( grid->toGrid( p.x(), p.y(), x, y ) )
+	    if( inGrid[i] )
 	    {
-		elv_max[y][x] = std::max( elv_max[y][x], p.z() );
-		elv_min[y][x] = std::min( elv_min[y][x], p.z() );
+		const size_t x = cells[i].x, y = cells[i].y;
+		elv_max[y][x] = std::max( elv_max[y][x], heights[i] );
+		elv_min[y][x] = std::min( elv_min[y][x], heights[i] );
 	    }
 	}
     }
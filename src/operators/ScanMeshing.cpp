@@ -119,6 +119,7 @@ bool ScanMeshing::updateAll()
     TriMesh* meshPtr = static_cast<envire::TriMesh*>(*env->getOutputs(this).begin());
     LaserScan* scanPtr = static_cast<envire::LaserScan*>(*env->getInputs(this).begin());
 
+    meshPtr->requireDoubleVertices("ScanMeshing");
     std::vector<Eigen::Vector3d>& points(meshPtr->vertices);
     std::vector<Eigen::Vector3d>& colors(meshPtr->getVertexData<Eigen::Vector3d>(TriMesh::VERTEX_COLOR));
     std::vector<TriMesh::vertex_attr>& point_attrs(meshPtr->getVertexData<TriMesh::vertex_attr>(TriMesh::VERTEX_ATTRIBUTES));
@@ -1,4 +1,6 @@
 #include "SimpleTraversability.hpp"
+#include <envire/tools/DistanceTransform.hpp>
+#include <envire/maps/GridKernels.hpp>
 #include <base-logging/Logging.hpp>
 #include <sstream>
 
@@ -6,6 +8,154 @@ using namespace envire;
 using envire::Grid;
 
 ENVIRONMENT_ITEM_DEF( SimpleTraversability );
+
+namespace
+{
+    /** Classifies the rows [first, last[ of the output, see
+     * SimpleTraversability::updateAll(). The input bands are NULL if they
+     * are not used.
+     */
+    struct ClassifyRows
+    {
+        size_t width;
+        const float* slope;
+        float slope_unknown;
+        const float* max_step;
+        float max_step_unknown;
+        double ground_clearance;
+        double maximum_slope;
+        int class_count;
+        /** class of each quantized slope, NULL if the slope is not
+         * classified */
+        const uint8_t* slope_classes;
+        uint8_t* result;
+        uint8_t* probability;
+
+        void operator()(size_t first, size_t last) const
+        {
+            const uint8_t known = std::numeric_limits< uint8_t >::max();
+            for (size_t y = first; y < last; ++y)
+            {
+                uint8_t* result_row = result + y * width;
+                uint8_t* probability_row = probability + y * width;
+                const float* slope_row = slope ? slope + y * width : 0;
+                const float* max_step_row = max_step ? max_step + y * width : 0;
+                for (size_t x = 0; x < width; ++x)
+                {
+                    // First, max_step is an ON/OFF threshold on the ground
+                    // clearance parameter
+                    if (max_step_row && max_step_row[x] != max_step_unknown && max_step_row[x] > ground_clearance)
+                    {
+                        result_row[x] = SimpleTraversability::CLASS_OBSTACLE;
+                        probability_row[x] = known;
+                        continue;
+                    }
+                    if (!slope_row)
+                        continue;
+
+                    // a NaN slope is unknown as well, it has no class
+                    const float value = slope_row[x];
+                    if (value == slope_unknown || value != value)
+                    {
+                        result_row[x] = SimpleTraversability::CLASS_UNKNOWN;
+                        continue;
+                    }
+                    if (slope_classes)
+                    {
+                        const double meanSlope(fabs(value));
+                        const size_t index = (meanSlope > maximum_slope) ?
+                            class_count + 1 :
+                            rint(meanSlope / maximum_slope * class_count);
+                        result_row[x] = slope_classes[index];
+                        probability_row[x] = known;
+                    }
+                }
+            }
+        }
+    };
+
+    /** counts the cells that are not CLASS_UNKNOWN, and sums their classes */
+    struct SumKnownClasses
+    {
+        void operator()(std::pair<double, double>& acc, uint8_t value) const
+        {
+            if (value != SimpleTraversability::CLASS_UNKNOWN)
+            {
+                acc.first += value;
+                acc.second += 1;
+            }
+        }
+        void combine(std::pair<double, double>& acc, std::pair<double, double> const& other) const
+        {
+            acc.first += other.first;
+            acc.second += other.second;
+        }
+    };
+
+    /** dist = 0 for the obstacle cells and infinity for the others, for the
+     * cells [first, last[ */
+    struct ObstacleSeeds
+    {
+        const uint8_t* classes;
+        float* dist;
+
+        ObstacleSeeds(const uint8_t* classes, float* dist)
+            : classes(classes), dist(dist) {}
+
+        void operator()(size_t first, size_t last) const
+        {
+            for (size_t i = first; i < last; ++i)
+                dist[i] = (classes[i] == SimpleTraversability::CLASS_OBSTACLE) ? 0 : DistanceTransform::infinity();
+        }
+    };
+
+    /** dist = 0 for the cells which are at least sqrt(min_distance) away
+     * from an obstacle, and infinity for the others */
+    struct ErodedSeeds
+    {
+        float* dist;
+        float min_distance;
+
+        ErodedSeeds(float* dist, float min_distance)
+            : dist(dist), min_distance(min_distance) {}
+
+        void operator()(size_t first, size_t last) const
+        {
+            for (size_t i = first; i < last; ++i)
+                dist[i] = (dist[i] >= min_distance) ? 0 : DistanceTransform::infinity();
+        }
+    };
+
+    /** marks the cells as obstacle if their distance is below max_distance
+     * (inside == true), or if they are not an obstacle yet and their
+     * distance is above max_distance (inside == false) */
+    struct MarkObstacles
+    {
+        const float* dist;
+        float max_distance;
+        bool inside;
+        uint8_t* classes;
+        uint8_t* probabilities;
+
+        MarkObstacles(const float* dist, float max_distance, bool inside, uint8_t* classes, uint8_t* probabilities)
+            : dist(dist), max_distance(max_distance), inside(inside), classes(classes), probabilities(probabilities) {}
+
+        void operator()(size_t first, size_t last) const
+        {
+            for (size_t i = first; i < last; ++i)
+            {
+                const bool mark = inside ?
+                    dist[i] < max_distance :
+                    (classes[i] != SimpleTraversability::CLASS_OBSTACLE && dist[i] > max_distance);
+                if (mark)
+                {
+                    classes[i] = SimpleTraversability::CLASS_OBSTACLE;
+                    probabilities[i] = std::numeric_limits< uint8_t >::max();
+                }
+            }
+        }
+    };
+}
 /* For backward compatibility reasons */
 static envire::SerializationPlugin< SimpleTraversability >  nav_graph_search_TraversabilityClassifier("nav_graph_search::TraversabilityClassifier");
 /* For backward compatibility reasons */
@@ -141,7 +291,10 @@ bool SimpleTraversability::updateAll()
         {
             input_layers[i] = getEnvironment()->getItem< Grid<float> >(input_layers_id[i]).get();
             has_data = true;
-            inputs[i] = &(input_layers[i]->getGridData(input_bands[i]));
+            inputs[i] = &(static_cast<const Grid<float>*>(input_layers[i])->getGridData(input_bands[i]));
+            // the rows are classified with the width of the output
+            if (inputs[i]->shape()[0] != result.shape()[0] || inputs[i]->shape()[1] != result.shape()[1])
+                throw std::runtime_error("SimpleTraversability: the input band " + input_bands[i] + " and the output have different sizes");
 
             std::pair<float, bool> no_data = input_layers[i]->getNoData(input_bands[i]);
             if (no_data.second)
@@ -160,66 +313,32 @@ bool SimpleTraversability::updateAll()
     //    throw std::runtime_error("a max_step band is available, but the ground clearance is set to zero");
 
     int width = output_layer->getWidth(), height = output_layer->getHeight();
-    for (int y = 0; y < height; ++y)
-    {
-        for (int x = 0; x < width; ++x)
-        {
-            // Read the values for this cell. Set to CLASS_UNKNOWN and ignore the cell
-            // if one of the available input bands has no information
-            double values[INPUT_COUNT];
-            bool has_value[INPUT_COUNT];
-            for (int band_idx = 0; band_idx < INPUT_COUNT; ++band_idx)
-            {
-                has_value[band_idx] = false;
-                if (!inputs[band_idx]) 
-                    continue;
-
-                double value = (*inputs[band_idx])[y][x];
-                if (value != input_unknown[band_idx])
-                {
-                    values[band_idx] = value;
-                    has_value[band_idx] = true;
-                }
-            }
-
-            bool has_slope = has_value[SLOPE],
-                 has_max_step    = has_value[MAX_STEP];
 
-            // First, max_step is an ON/OFF threshold on the ground clearance
-            // parameter
-            if (has_max_step && conf.ground_clearance && (values[MAX_STEP] > conf.ground_clearance))
-            {
-                result[y][x] = CLASS_OBSTACLE;
-                probabilityArray[y][x] = std::numeric_limits< uint8_t >::max();
-                continue;
-            }
-            
-            if (inputs[SLOPE] && !has_slope)
-            {
-                result[y][x] = CLASS_UNKNOWN;
-                continue;
-            }
-
-            if(has_slope && conf.maximum_slope)
-            {
-                const double meanSlope(fabs(values[SLOPE]));
-                if(meanSlope > conf.maximum_slope)
-                {
-                    result[y][x] = CLASS_OBSTACLE;
-                    probabilityArray[y][x] = std::numeric_limits< uint8_t >::max();
-
-                    continue;
-                }
-                else
-                {
-                    //scale current slope to cost classes
-                    int klass = conf.class_count - rint(meanSlope / conf.maximum_slope * conf.class_count);
-                    result[y][x] = CUSTOM_CLASSES + klass;
-                    probabilityArray[y][x] = std::numeric_limits< uint8_t >::max();
-                }
-            }
-        }
+    // the slope classes are looked up by their quantized slope, the last
+    // entry being for the slopes above maximum_slope
+    std::vector<uint8_t> slope_classes;
+    if (conf.maximum_slope)
+    {
+        if (conf.class_count < 0)
+            throw std::runtime_error("SimpleTraversability: the class count must not be negative");
+        for (int klass = conf.class_count; klass >= 0; --klass)
+            slope_classes.push_back(CUSTOM_CLASSES + klass);
+        slope_classes.push_back(CLASS_OBSTACLE);
     }
+
+    ClassifyRows classify;
+    classify.width = width;
+    classify.slope = inputs[SLOPE] ? inputs[SLOPE]->data() : 0;
+    classify.slope_unknown = inputs[SLOPE] ? input_unknown[SLOPE] : 0;
+    classify.max_step = (inputs[MAX_STEP] && conf.ground_clearance) ? inputs[MAX_STEP]->data() : 0;
+    classify.max_step_unknown = inputs[MAX_STEP] ? input_unknown[MAX_STEP] : 0;
+    classify.ground_clearance = conf.ground_clearance;
+    classify.maximum_slope = conf.maximum_slope;
+    classify.class_count = conf.class_count;
+    classify.slope_classes = slope_classes.empty() ? 0 : &slope_classes[0];
+    classify.result = result.data();
+    classify.probability = probabilityArray.data();
+    parallelFor(0, height, classify, 0, GridKernels::getMinBlockRows(width));
     
     // perform some post processing if required
     if( conf.min_width > 0 ) 
@@ -243,21 +362,9 @@ bool SimpleTraversability::updateAll()
     }
     
     // Calculates the mean traversability class of the current map ignoring unknown areas.
-    uint8_t class_value = 0;
-    double sum_classes = 0.0;
-    double counter = 0.0;
-    for (int y = 0; y < height; ++y)
-    {
-        for (int x = 0; x < width; ++x)
-        {
-            class_value = result[y][x];
-            // Sum up if not unknown.
-            if(class_value != CLASS_UNKNOWN) {
-                sum_classes += class_value;
-                counter++;
-            }
-        }
-    }
+    std::pair<double, double> sum = GridKernels::reduce(result, std::make_pair(0.0, 0.0), SumKnownClasses());
+    double sum_classes = sum.first;
+    double counter = sum.second;
 
     // Traversability class 7 contains the mean driveability (0.55).
     double mean_driveability = output_layer->getTraversabilityClass(7).getDrivability();
@@ -284,197 +391,56 @@ bool SimpleTraversability::updateAll()
     return true;
 }
 
-struct RadialLUT
-{
-    int centerx, centery;
-    unsigned int width, height;
-    boost::multi_array<std::pair<int, int>, 2>  parents;
-    boost::multi_array<bool, 2> in_distance;
-
-    void precompute(double distance, double scalex, double scaley)
-    {
-        double const radius2 = distance * distance;
-
-        width  = 2* ceil(distance / scalex) + 1;
-        height = 2* ceil(distance / scaley) + 1;
-        in_distance.resize(boost::extents[height][width]);
-        std::fill(in_distance.data(), in_distance.data() + in_distance.num_elements(), false);
-        parents.resize(boost::extents[height][width]);
-        std::fill(parents.data(), parents.data() + parents.num_elements(), std::make_pair(-1, -1));
-
-        centerx = width  / 2;
-        centery = height / 2;
-        parents[centery][centerx] = std::make_pair(-1, -1);
-
-        for (unsigned int y = 0; y < height; ++y)
-        {
-            for (unsigned int x = 0; x < width; ++x)
-            {
-                int dx = (centerx - x);
-                int dy = (centery - y);
-                if (dx == 0 && dy == 0) continue;
-
-                double d2 = dx * dx * scalex * scalex + dy * dy * scaley * scaley;
-                in_distance[y][x] = (d2 < radius2);
-                if (abs(dx) > abs(dy))
-                {
-                    int parentx = x + dx / abs(dx);
-                    int parenty = y + rint(static_cast<double>(dy) / abs(dx));
-                    parents[y][x] = std::make_pair(parentx, parenty);
-                }
-                else
-                {
-                    int parentx = x + rint(static_cast<double>(dx) / abs(dy));
-                    int parenty = y + dy / abs(dy);
-                    parents[y][x] = std::make_pair(parentx, parenty);
-                }
-            }
-        }
-    }
-
-    void markAllRadius(boost::multi_array<uint8_t, 2>& result, TraversabilityGrid::ArrayType &probabilityArray, int result_width, int result_height, int centerx, int centery, int value)
-    {
-        int base_x = centerx - this->centerx;
-        int base_y = centery - this->centery;
-        for (unsigned int y = 0; y < height; ++y)
-        {
-            int map_y = base_y + y;
-            if (map_y < 0 || map_y >= result_height)
-                continue;
-
-            for (unsigned int x = 0; x < width; ++x)
-            {
-                int map_x = base_x + x;
-                if (map_x < 0 || map_x >= result_width)
-                    continue;
-                if (in_distance[y][x] && result[map_y][map_x] == value)
-                {
-//                     LOG_DEBUG("  found cell with value %i (expected %i) at %i %i, marking radius", result[map_y][map_x], value, map_x, map_y);
-                    markSingleRadius(result, probabilityArray, centerx, centery, x, y, value, 255);
-                }
-            }
-        }
-    }
-
-    void markSingleRadius(boost::multi_array<uint8_t, 2>& result, TraversabilityGrid::ArrayType &probabilityArray, int centerx, int centery, int x, int y, int expected_value, int mark_value)
-    {
-        boost::tie(x, y) = parents[y][x];
-        while (x != -1 && y != -1)
-        {
-            int map_x = centerx + x - this->centerx;
-            int map_y = centery + y - this->centery;
-            uint8_t& current = result[map_y][map_x];
-            if (current != expected_value)
-	    {
-		current = mark_value;
-// 		LOG_DEBUG("  marking %i %i", map_x, map_y);
-                probabilityArray[map_y][map_x] = std::numeric_limits<uint8_t>::max();
-	    }
-            boost::tie(x, y) = parents[y][x];
-        }
-    }
-};
-
 void SimpleTraversability::growObstacles(OutputLayer& map, std::string const& band_name, double width)
 {
-    const double width_square = pow(width,2);
-    const int 
-	wx = width / map.getScaleX(), 
-	wy = width / map.getScaleY();
-    const double 
-	sx = map.getScaleX(),
-	sy = map.getScaleY();
-
+    const float width_square = pow(width,2);
 
-    OutputLayer::ArrayType& orig_data = band_name.empty() ?
+    OutputLayer::ArrayType& data = band_name.empty() ?
         map.getGridData() :
         map.getGridData(output_band);
-
-    OutputLayer::ArrayType data( orig_data );
     TraversabilityGrid::ArrayType &probabilityArray(map.getGridData(TraversabilityGrid::PROBABILITY));
 
-    for (unsigned int y = 0; y < map.getHeight(); ++y)
-    {
-        for (unsigned int x = 0; x < map.getWidth(); ++x)
-        {
-            int value = orig_data[y][x];
-            if (value == CLASS_OBSTACLE)
-            {
-		// make everything with radius width around the obstacle also
-		// an obstacle
-		for( int oy = -wy; oy <= wy; ++oy )
-		{
-		    for( int ox = -wx; ox <= wx; ++ox )
-		    {
-			const int tx = x+ox;
-			const int ty = y+oy;
-			if( (pow(ox*sx,2) + pow(oy*sy,2) < width_square )
-				&& tx >= 0 && tx < (int)map.getWidth()
-				&& ty >= 0 && ty < (int)map.getHeight() )
-                        {
-			    data[ty][tx] = CLASS_OBSTACLE;
-                            probabilityArray[y][x] = std::numeric_limits< uint8_t >::max();
-                        }
-		    }
-		}
-	    }
-	}
-    }
-
-    std::swap( data, orig_data );
+    // every cell that is closer than width to an obstacle becomes an
+    // obstacle as well. The distances are computed with a distance
+    // transform, whose cost does not depend on the width
+    const size_t size = data.num_elements();
+    DistanceTransform::ArrayType distances(boost::extents[data.shape()[0]][data.shape()[1]]);
+    float* dist = distances.data();
+    uint8_t* classes = data.data();
+    parallelFor(0, size, ObstacleSeeds(classes, dist), 0, GridKernels::MIN_BLOCK_CELLS);
+    DistanceTransform::computeSquaredDistances(distances, map.getScaleX(), map.getScaleY());
+
+    parallelFor(0, size, MarkObstacles(dist, width_square, true, classes, probabilityArray.data()),
+            0, GridKernels::MIN_BLOCK_CELLS);
 }
 
 void SimpleTraversability::closeNarrowPassages(SimpleTraversability::OutputLayer& map, std::string const& band_name, double min_width)
 {
-    RadialLUT lut;
-    lut.precompute(min_width, map.getScaleX(), map.getScaleY());
-    std::stringstream oss;
-    oss << std::endl;
-    for (unsigned int y = 0; y < lut.height; ++y)
-    {
-        for (unsigned int x = 0; x < lut.width; ++x) {
-            oss << "(" << lut.parents[y][x].first << " " << lut.parents[y][x].second << ") ";
-        }
-        oss << std::endl;
-    }
-    oss << std::endl;
-    for (unsigned int y = 0; y < lut.height; ++y)
-    {
-        for (unsigned int x = 0; x < lut.width; ++x) {
-            oss << "(" << lut.in_distance[y][x] << " ";
-        }
-        oss << std::endl;
-    }
-    LOG_DEBUG(oss.str().c_str());
-
-    TraversabilityGrid::ArrayType &probabilityArray(map.getGridData(TraversabilityGrid::PROBABILITY));
+    // Narrow passages are closed by a morphological opening of the space
+    // that is not an obstacle, with a disc of diameter min_width: the
+    // centers of the disc are the cells that are at least min_width / 2
+    // away from any obstacle, and every cell that is not within min_width
+    // / 2 of such a center becomes an obstacle. Both steps are exact
+    // distance transforms, whose cost does not depend on min_width
+    const float radius_square = pow(min_width / 2, 2);
 
     OutputLayer::ArrayType& data = band_name.empty() ?
         map.getGridData() :
         map.getGridData(output_band);
-    for (unsigned int y = 0; y < map.getHeight(); ++y)
-    {
-        for (unsigned int x = 0; x < map.getWidth(); ++x)
-        {
-            int value = data[y][x];
-            if (value == CLASS_OBSTACLE)
-            {
-//                 LOG_DEBUG("inspecting around obstacle cell %i %i", x, y);
-                lut.markAllRadius(data, probabilityArray, map.getWidth(), map.getHeight(), x, y, CLASS_OBSTACLE);
-            }
-        }
-    }
+    TraversabilityGrid::ArrayType &probabilityArray(map.getGridData(TraversabilityGrid::PROBABILITY));
 
-    for (size_t y = 0; y < map.getHeight(); ++y)
-    {
-        for (size_t x = 0; x < map.getWidth(); ++x)
-        {
-            if (data[y][x] == 255)
-            {
-                data[y][x] = CLASS_OBSTACLE;
-                probabilityArray[y][x] = std::numeric_limits< uint8_t >::max();
-            }
-        }
-    }
-}
+    const size_t size = data.num_elements();
+    DistanceTransform::ArrayType distances(boost::extents[data.shape()[0]][data.shape()[1]]);
+    float* dist = distances.data();
+    uint8_t* classes = data.data();
+    parallelFor(0, size, ObstacleSeeds(classes, dist), 0, GridKernels::MIN_BLOCK_CELLS);
+    DistanceTransform::computeSquaredDistances(distances, map.getScaleX(), map.getScaleY());
 
+    // erosion
+    parallelFor(0, size, ErodedSeeds(dist, radius_square), 0, GridKernels::MIN_BLOCK_CELLS);
+    // dilation
+    DistanceTransform::computeSquaredDistances(distances, map.getScaleX(), map.getScaleY());
+
+    parallelFor(0, size, MarkObstacles(dist, radius_square, false, classes, probabilityArray.data()),
+            0, GridKernels::MIN_BLOCK_CELLS);
+}
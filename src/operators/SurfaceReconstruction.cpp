@@ -78,6 +78,8 @@ bool SurfaceReconstruction::updateAll()
 	
     TriMesh* mesh_out = static_cast<envire::TriMesh*>(*env->getOutputs(this).begin());
     assert(mesh_out);
+    pc_in->requireDoubleVertices("SurfaceReconstruction");
+    mesh_out->requireDoubleVertices("SurfaceReconstruction");
 
     typedef CGAL::Exact_predicates_inexact_constructions_kernel Kernel;
     typedef Kernel::Point_3 Point;
@@ -1,5 +1,8 @@
 #include "TraversabilityGrassfire.hpp"
 #include <maps/MLSGrid.hpp>
+#include <envire/tools/ParallelFor.hpp>
+#include <boost/thread/barrier.hpp>
+#include <algorithm>
 
 using namespace envire;
 using envire::Grid;
@@ -11,6 +14,11 @@ int stepTooHigh = 0;
 int totalCnt = 0;
 int drivable = 0;
 
+TraversabilityGrassfire::TraversabilityGrassfire()
+    : trGrid(NULL), trData(NULL), mlsGrid(NULL), floodedGrid(NULL), floodedGeneration(0)
+{
+}
+
 void TraversabilityGrassfire::setProbability(size_t x, size_t y)
 {
     SurfacePatch *currentPatch = bestPatchMap[y][x];
@@ -164,61 +172,270 @@ double TraversabilityGrassfire::getStepHeight(SurfacePatch* from, SurfacePatch*
     return fabs((from->getMean() + from->getStdev()) - (to->getMean() + to->getStdev()));
 }
 
-void TraversabilityGrassfire::checkRecursive(size_t x, size_t y, SurfacePatch* origin)
+void TraversabilityGrassfire::checkCell(size_t x, size_t y, SurfacePatch* origin, int parent)
 {
-    if(visited[y][x])
-    {
-        return;
-    }
-    
-    visited[y][x] = true;
+    parents[y][x] = parent;
     
     bool isKnownObstacle;
     
     SurfacePatch *bestMatchingPatch = getNearestPatchWhereRobotFits(x, y, origin->getMean() + origin->getStdev(), isKnownObstacle);
 
-    if(bestMatchingPatch)
+    bestPatchMap[y][x] = bestMatchingPatch;
+    if(!bestMatchingPatch)
+        cellState[y][x] = CELL_NO_PATCH;
+    else if(isKnownObstacle)
+        cellState[y][x] = CELL_OBSTACLE;
+    else
+        cellState[y][x] = CELL_DRIVE_PLANE;
+}
+
+void TraversabilityGrassfire::addToFrontier(size_t x, size_t y, SurfacePatch* patch)
+{
+    bestPatchMap[y][x] = patch;
+    cellState[y][x] = CELL_DRIVE_PLANE;
+
+    FrontierItem item = { y * mlsGrid->getCellSizeX() + x, patch };
+    frontier.push_back(item);
+}
+
+/** State shared by the threads of flood() */
+struct TraversabilityGrassfire::FloodLevel
+{
+    FloodLevel(size_t threads) : barrier(threads), done(false), overflow(false), visited(threads), accepted(threads), errors(threads) {}
+
+    boost::barrier barrier;
+    bool done;
+    /** set if the frontier got too large for the claim values */
+    bool overflow;
+    /** the cells each thread visited in the current level, in claim order */
+    std::vector< std::vector<size_t> > visited;
+    /** the visited cells that are part of the drive plane */
+    std::vector< std::vector<FrontierItem> > accepted;
+    /** the message of the exception each thread got, if any */
+    std::vector<std::string> errors;
+};
+
+/** Processes the part of each flood level that is assigned to one thread
+ *
+ * The neighbours of the frontier cell i are claimed with the values 8 * i
+ * to 8 * i + 7, in the order in which the serial search visited them, and
+ * each unvisited cell is checked from the frontier cell with the lowest
+ * claim. This is exactly the cell the serial search would have reached it
+ * from first.
+ */
+struct TraversabilityGrassfire::FloodWorker
+{
+    TraversabilityGrassfire& op;
+    FloodLevel& level;
+    size_t thread;
+    size_t threads;
+
+    FloodWorker(TraversabilityGrassfire& op, FloodLevel& level, size_t thread, size_t threads)
+        : op(op), level(level), thread(thread), threads(threads) {}
+
+    /** calls f(i, cell, key) for each neighbour of the frontier cells of
+     * this thread */
+    template <class F>
+    void forEachNeighbour(F& f) const
     {
-        if(isKnownObstacle)
+        const size_t width = op.mlsGrid->getCellSizeX();
+        const size_t height = op.mlsGrid->getCellSizeY();
+        const size_t size = op.frontier.size();
+        for(size_t i = size * thread / threads; i < size * (thread + 1) / threads; i++)
         {
-            bestPatchMap[y][x] = bestMatchingPatch;
-            visited[y][x] = true;
+            const size_t x = op.frontier[i].cell % width;
+            const size_t y = op.frontier[i].cell / width;
+            uint32_t key = i * 8;
+            for(int yi = -1; yi <= 1; yi++)
+            {
+                for(int xi = -1; xi <= 1; xi++)
+                {
+                    if(yi == 0 && xi == 0)
+                        continue;
+                    
+                    size_t newX = x + xi;
+                    size_t newY = y + yi;
+                    if(newX < width && newY < height)
+                        f(i, newX, newY, key);
+                    key++;
+                }
+            }
         }
-        else
+    }
+
+    void claim(size_t i, size_t x, size_t y, uint32_t key) const
+    {
+        if(op.cellState[y][x] != CELL_UNVISITED)
+            return;
+
+        boost::atomic<uint32_t>& value(op.claims[y * op.mlsGrid->getCellSizeX() + x].value);
+        uint32_t current = value.load(boost::memory_order_relaxed);
+        while(key < current && !value.compare_exchange_weak(current, key, boost::memory_order_relaxed))
+            ;
+    }
+
+    void check(size_t i, size_t x, size_t y, uint32_t key) const
+    {
+        const size_t cell = y * op.mlsGrid->getCellSizeX() + x;
+        boost::atomic<uint32_t>& value(op.claims[cell].value);
+        if(value.load(boost::memory_order_relaxed) != key)
+            return;
+        value.store(Claim::NO_CLAIM, boost::memory_order_relaxed);
+
+        op.checkCell(x, y, op.frontier[i].patch, op.frontier[i].cell);
+        level.visited[thread].push_back(cell);
+        if(op.cellState[y][x] == CELL_DRIVE_PLANE)
         {
-            addNeightboursToSearchList(x, y, bestMatchingPatch);
+            FrontierItem item = { cell, op.bestPatchMap[y][x] };
+            level.accepted[thread].push_back(item);
         }
-    } 
-    else
+    }
+
+    struct ClaimNeighbour
     {
-        bestPatchMap[y][x] = NULL;
+        const FloodWorker& w;
+        ClaimNeighbour(const FloodWorker& w) : w(w) {}
+        void operator()(size_t i, size_t x, size_t y, uint32_t key) const { w.claim(i, x, y, key); }
+    };
+    struct CheckNeighbour
+    {
+        const FloodWorker& w;
+        CheckNeighbour(const FloodWorker& w) : w(w) {}
+        void operator()(size_t i, size_t x, size_t y, uint32_t key) const { w.check(i, x, y, key); }
+    };
+
+    void claimLevel() const
+    {
+        ClaimNeighbour claimer(*this);
+        forEachNeighbour(claimer);
+    }
+    void checkLevel() const
+    {
+        CheckNeighbour checker(*this);
+        forEachNeighbour(checker);
+    }
+    void finishLevel() const
+    {
+        op.nextFloodLevel(level);
     }
-        
-}
 
-void TraversabilityGrassfire::addNeightboursToSearchList(size_t x, size_t y, SurfacePatch* patch)
+    /** runs one phase of a level. An exception must neither leave the
+     * thread nor skip the barriers the other threads wait at, so it is
+     * stored and reported by flood() */
+    void run(void (FloodWorker::*phase)() const) const
+    {
+        try { (this->*phase)(); }
+        catch(std::exception const& e) { level.errors[thread] = e.what(); }
+        catch(...) { level.errors[thread] = "unknown exception"; }
+    }
+
+    /** processes the current level, in the calling thread if it is the
+     * only one */
+    void processLevel() const
+    {
+        run(&FloodWorker::claimLevel);
+        if(threads > 1)
+            level.barrier.wait();
+        run(&FloodWorker::checkLevel);
+        if(threads > 1)
+            level.barrier.wait();
+    }
+
+    /** the loop of the threads other than the calling one, which wait for
+     * flood() to start each parallel level */
+    void operator()() const
+    {
+        while(true)
+        {
+            level.barrier.wait();
+            if(level.done)
+                return;
+            processLevel();
+        }
+    }
+};
+
+void TraversabilityGrassfire::nextFloodLevel(FloodLevel& level)
 {
-    bestPatchMap[y][x] = patch;
-    visited[y][x] = true;
+    //the visited cells and the next frontier are concatenated in thread
+    //order, which keeps them in claim order
+    frontier.clear();
+    for(size_t t = 0; t < level.visited.size(); t++)
+    {
+        visitOrder.insert(visitOrder.end(), level.visited[t].begin(), level.visited[t].end());
+        frontier.insert(frontier.end(), level.accepted[t].begin(), level.accepted[t].end());
+        level.visited[t].clear();
+        level.accepted[t].clear();
+    }
+    level.overflow = frontier.size() > Claim::NO_CLAIM / 8;
+}
 
-    for(int yi = -1; yi <= 1; yi++)
+void TraversabilityGrassfire::flood()
+{
+    //the flood fill is a breadth first search, which is processed level by
+    //level. The cells of a large level are claimed and checked in
+    //parallel, see FloodWorker, while the small levels are processed by
+    //this thread alone, in the same way
+    const size_t threads = config.numThreads ? config.numThreads : getDefaultThreadCount();
+    FloodLevel level(threads);
+    FloodWorker serial(*this, level, 0, 1);
+    FloodWorker parallel(*this, level, 0, threads);
+    
+    //the other threads are only started by the first large level, and
+    //wait for the next one at the barrier in between
+    boost::thread_group group;
+    bool started = false;
+    while(!frontier.empty() && !level.overflow)
     {
-        for(int xi = -1; xi <= 1; xi++)
+        if(threads > 1 && frontier.size() >= std::max<size_t>(config.minParallelFrontier, 1))
         {
-            if(yi == 0 && xi == 0)
-                continue;
-            
-            size_t newX = x + xi;
-            size_t newY = y + yi;
-            if(newX < mlsGrid->getCellSizeX() && newY < mlsGrid->getCellSizeY())
+            if(!started)
             {
-                searchList.push(SearchItem(newX, newY, patch));
+                for(size_t t = 1; t < threads; t++)
+                    group.create_thread(FloodWorker(*this, level, t, threads));
+                started = true;
             }
+            level.barrier.wait();
+            parallel.processLevel();
         }
+        else
+            serial.processLevel();
+        
+        //the other threads are waiting for the next level, so errors are
+        //only reported once they are done
+        bool failed = false;
+        for(size_t t = 0; t < threads; t++)
+            failed = failed || !level.errors[t].empty();
+        if(failed)
+            break;
+        serial.run(&FloodWorker::finishLevel);
+        if(!level.errors[0].empty())
+            break;
+    }
+    
+    if(started)
+    {
+        level.done = true;
+        level.barrier.wait();
+        group.join_all();
+    }
+    
+    std::string error;
+    for(size_t t = 0; t < threads && error.empty(); t++)
+        error = level.errors[t];
+    if(error.empty() && level.overflow)
+        error = "TraversabilityGrassfire: the flood frontier is too large";
+    if(!error.empty())
+    {
+        //the drive plane is incomplete, and some cells may still be
+        //claimed, so the next update has to start from scratch
+        std::fill(claims.begin(), claims.end(), Claim());
+        frontier.clear();
+        floodedGrid = NULL;
+        throw std::runtime_error(error);
     }
 }
 
-
 bool TraversabilityGrassfire::determineDrivePlane(base::Vector3d startPos, bool searchSourunding)
 {
     size_t startX;
@@ -229,25 +446,48 @@ bool TraversabilityGrassfire::determineDrivePlane(base::Vector3d startPos, bool
     
     //make shure temp maps have correct size
     bestPatchMap.resize(boost::extents[mlsGrid->getCellSizeY()][mlsGrid->getCellSizeX()]);
-    visited.resize(boost::extents[mlsGrid->getCellSizeY()][mlsGrid->getCellSizeX()]);
+    cellState.resize(boost::extents[mlsGrid->getCellSizeY()][mlsGrid->getCellSizeX()]);
+    parents.resize(boost::extents[mlsGrid->getCellSizeY()][mlsGrid->getCellSizeX()]);
+    claims.resize(mlsGrid->getCellSizeY() * mlsGrid->getCellSizeX());
     trData->resize(boost::extents[mlsGrid->getCellSizeY()][mlsGrid->getCellSizeX()]);
 
     //fill them with defautl values
     SurfacePatch *emptyPatch = NULL;
     //Note passing directly NULL to fill makes the compiler cry....
     std::fill(bestPatchMap.data(), bestPatchMap.data() + bestPatchMap.num_elements(), emptyPatch);
-    std::fill(visited.data(), visited.data() + visited.num_elements(), false);
+    std::fill(cellState.data(), cellState.data() + cellState.num_elements(), CELL_UNVISITED);
+    std::fill(parents.data(), parents.data() + parents.num_elements(), -1);
+    visitOrder.clear();
     std::fill(trData->data(), trData->data() + trData->num_elements(), UNKNOWN);
     
     //init probability with zero
     TraversabilityGrid::ArrayType *probabilityArray = &(trGrid->getGridData(TraversabilityGrid::PROBABILITY));
     std::fill(probabilityArray->data(), probabilityArray->data() + probabilityArray->num_elements(), 0);  
     
+    size_t correctedStartX = startX;
+    size_t correctedStartY = startY;
+    SurfacePatch *bestMatchingPatch = findStartPatch(startPos, correctedStartX, correctedStartY);
+
+    if(!bestMatchingPatch)
+    {
+        //we are screwed, can't start the grassfire
+        return false;
+    }
+        
+    //recuse to surounding patches
+    visitOrder.push_back(correctedStartY * mlsGrid->getCellSizeX() + correctedStartX);
+    addToFrontier(correctedStartX, correctedStartY, bestMatchingPatch);
+    
+    return true;
+}
+
+SurfacePatch* TraversabilityGrassfire::findStartPatch(const base::Vector3d &startPos, size_t &startX, size_t &startY)
+{
     double bestHeightDiff = std::numeric_limits< double >::max();
     SurfacePatch *bestMatchingPatch = NULL;
 
-    size_t correctedStartX = startX;
-    size_t correctedStartY = startY;
+    const size_t centerX = startX;
+    const size_t centerY = startY;
     //search the sourounding of the start pos for a start patch
     for(int i = 0; i < 10; i++)
     {
@@ -259,8 +499,8 @@ bool TraversabilityGrassfire::determineDrivePlane(base::Vector3d startPos, bool
                 if(abs(yi) != i && abs(xi) != i)
                     continue;
                 
-                size_t newX = startX + xi;
-                size_t newY = startY + yi;
+                size_t newX = centerX + xi;
+                size_t newY = centerY + yi;
                 if(newX < mlsGrid->getCellSizeX() && newY < mlsGrid->getCellSizeY())
                 {
                     bool isObstacle;
@@ -273,8 +513,8 @@ bool TraversabilityGrassfire::determineDrivePlane(base::Vector3d startPos, bool
                         {
                             bestMatchingPatch = curPatch;
                             bestHeightDiff = curHeightDiff;
-                            correctedStartX = newX;
-                            correctedStartY = newY;
+                            startX = newX;
+                            startY = newY;
                         }
                         
                     }
@@ -285,16 +525,7 @@ bool TraversabilityGrassfire::determineDrivePlane(base::Vector3d startPos, bool
             break;
     }
 
-    if(!bestMatchingPatch)
-    {
-        //we are screwed, can't start the grassfire
-        return false;
-    }
-        
-    //recuse to surounding patches
-    addNeightboursToSearchList(correctedStartX, correctedStartY, bestMatchingPatch);
-    
-    return true;
+    return bestMatchingPatch;
 }
 
 SurfacePatch* TraversabilityGrassfire::getNearestPatchWhereRobotFits(size_t x, size_t y, double height, bool &isObstacle)
@@ -401,6 +632,148 @@ void TraversabilityGrassfire::setStartPosition(Eigen::Vector3d startPos)
     this->startPos = startPos;
 }
 
+bool TraversabilityGrassfire::updateIncremental()
+{
+    if(!floodedGrid || floodedGrid != mlsGrid)
+        return false;
+
+    const size_t width = mlsGrid->getCellSizeX();
+    const size_t height = mlsGrid->getCellSizeY();
+    if(cellState.shape()[0] != height || cellState.shape()[1] != width ||
+        trData->shape()[0] != height || trData->shape()[1] != width)
+        return false;
+
+    GridBase::CellExtents dirty = mlsGrid->getDirtyCellExtents(floodedGeneration);
+    dirty = dirty.intersection(GridBase::CellExtents(Eigen::Vector2i(0, 0), Eigen::Vector2i(width - 1, height - 1)));
+
+    std::vector<size_t> changed;
+    invalidate(dirty, changed);
+
+    //the drive plane is only kept if the robot still stands on it
+    size_t startX, startY;
+    if(!mlsGrid->toGrid(startPos, startX, startY, mlsGrid->getEnvironment()->getRootNode()))
+        return false;
+    SurfacePatch *startPatch = findStartPatch(startPos, startX, startY);
+    if(!startPatch || cellState[startY][startX] != CELL_DRIVE_PLANE || bestPatchMap[startY][startX] != startPatch)
+        return false;
+
+    const size_t firstNewCell = visitOrder.size();
+    flood();
+    changed.insert(changed.end(), visitOrder.begin() + firstNewCell, visitOrder.end());
+
+    computeTraversability(changed);
+    return true;
+}
+
+void TraversabilityGrassfire::invalidate(const GridBase::CellExtents &dirty, std::vector<size_t> &changed)
+{
+    if(dirty.isEmpty())
+        return;
+
+    const size_t width = mlsGrid->getCellSizeX();
+    const size_t height = mlsGrid->getCellSizeY();
+    
+    enum { VALID = 0, INVALID, SEED };
+    std::vector<uint8_t> marks(width * height, VALID);
+    
+    //the patches of the dirty cells may have changed, so their drive
+    //plane has to be determined again
+    for(int y = dirty.min().y(); y <= dirty.max().y(); y++)
+    {
+        for(int x = dirty.min().x(); x <= dirty.max().x(); x++)
+        {
+            changed.push_back(y * width + x);
+            if(cellState[y][x] != CELL_UNVISITED)
+                marks[y * width + x] = INVALID;
+        }
+    }
+
+    //as well as the drive plane of all cells that have been reached
+    //through them. A cell is always visited after the cell it has been
+    //reached from, so one pass over the visit order is enough
+    const int *parent = parents.data();
+    std::vector<size_t> invalidCells;
+    size_t kept = 0;
+    for(size_t i = 0; i < visitOrder.size(); i++)
+    {
+        const size_t idx = visitOrder[i];
+        if(marks[idx] == INVALID || (parent[idx] >= 0 && marks[parent[idx]] == INVALID))
+        {
+            marks[idx] = INVALID;
+            invalidCells.push_back(idx);
+        }
+        else
+            visitOrder[kept++] = idx;
+    }
+    visitOrder.resize(kept);
+
+    for(size_t i = 0; i < invalidCells.size(); i++)
+    {
+        const size_t x = invalidCells[i] % width;
+        const size_t y = invalidCells[i] / width;
+        cellState[y][x] = CELL_UNVISITED;
+        bestPatchMap[y][x] = NULL;
+        parents[y][x] = -1;
+        changed.push_back(invalidCells[i]);
+    }
+
+    //re-flood the invalid cells from the drive plane around them
+    for(size_t i = 0; i < invalidCells.size(); i++)
+    {
+        const size_t x = invalidCells[i] % width;
+        const size_t y = invalidCells[i] / width;
+        for(int yi = -1; yi <= 1; yi++)
+        {
+            for(int xi = -1; xi <= 1; xi++)
+            {
+                size_t newX = x + xi;
+                size_t newY = y + yi;
+                if(newX < width && newY < height && marks[newY * width + newX] == VALID 
+                    && cellState[newY][newX] == CELL_DRIVE_PLANE)
+                {
+                    marks[newY * width + newX] = SEED;
+                    FrontierItem item = { newY * width + newX, bestPatchMap[newY][newX] };
+                    frontier.push_back(item);
+                }
+            }
+        }
+    }
+}
+
+void TraversabilityGrassfire::computeTraversability(const std::vector<size_t> &changed)
+{
+    const size_t width = mlsGrid->getCellSizeX();
+    const size_t height = mlsGrid->getCellSizeY();
+
+    //the traversability of a cell depends on its 3x3 neighbourhood
+    std::vector<bool> marks(width * height, false);
+    std::vector<size_t> cells;
+    for(size_t i = 0; i < changed.size(); i++)
+    {
+        const size_t x = changed[i] % width;
+        const size_t y = changed[i] / width;
+        for(int yi = -1; yi <= 1; yi++)
+        {
+            for(int xi = -1; xi <= 1; xi++)
+            {
+                size_t newX = x + xi;
+                size_t newY = y + yi;
+                if(newX < width && newY < height && !marks[newY * width + newX])
+                {
+                    marks[newY * width + newX] = true;
+                    cells.push_back(newY * width + newX);
+                }
+            }
+        }
+    }
+
+    for(size_t i = 0; i < cells.size(); i++)
+    {
+        setTraversability(cells[i] % width, cells[i] / width);
+        setProbability(cells[i] % width, cells[i] / width);
+    }
+}
+
 void TraversabilityGrassfire::computeTraversability()
 {
     size_t maxX = mlsGrid->getCellSizeX();
@@ -443,22 +816,26 @@ bool envire::TraversabilityGrassfire::updateAll()
         trGrid->setTraversabilityClass(OBSTACLE + i, TraversabilityClass(1.0 / numClasses * i));
     }
 
-    if(!determineDrivePlane(startPos))
-    {
-        std::cout << "TraversabilityGrassfire::Warning, could not find plane robot is driving on" << std::endl;
-        return false;
-    }
-    
-    while(!searchList.empty())
+    if(!config.incremental || !updateIncremental())
     {
-        SearchItem next = searchList.front();
-        searchList.pop();
+        //drop what may be left from an aborted incremental update
+        frontier.clear();
+        floodedGrid = NULL;
+        if(!determineDrivePlane(startPos))
+        {
+            std::cout << "TraversabilityGrassfire::Warning, could not find plane robot is driving on" << std::endl;
+            return false;
+        }
         
-        checkRecursive(next.x, next.y, next.origin);
+        flood();
         
+        computeTraversability();
     }
-    
-    computeTraversability();
+    floodedGrid = mlsGrid;
+    //the next incremental update starts from the cells modified after
+    //this one. Starting a generation does not drop the modified cells
+    //for other users of the grid.
+    floodedGeneration = mlsGrid->startCellGeneration();
 /*    
     std::cout << "stepTooHigh " << stepTooHigh << std::endl;
     std::cout << "slopeTooHigh " << slopeTooHigh << std::endl;
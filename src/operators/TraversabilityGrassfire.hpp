@@ -7,7 +7,8 @@
 #include <envire/maps/TraversabilityGrid.hpp>
 #include <envire/maps/MLSGrid.hpp>
 #include <envire/maps/MLSPatch.hpp>
-#include <queue>
+#include <boost/atomic.hpp>
+#include <vector>
 
 namespace envire {
 
@@ -18,7 +19,7 @@ public:
     class Config
     {
     public:
-        Config(): maxStepHeight(0), maxSlope(0), robotHeight(0), numTraversabilityClasses(0), numNominalMeasurements(1), outliertFilterMinMeasurements(0), outliertFilterMaxStdDev(0.0) {};
+        Config(): maxStepHeight(0), maxSlope(0), robotHeight(0), numTraversabilityClasses(0), numNominalMeasurements(1), outliertFilterMinMeasurements(0), outliertFilterMaxStdDev(0.0), incremental(false), numThreads(0), minParallelFrontier(2048) {};
         double maxStepHeight;
         double maxSlope;
         double robotHeight;
@@ -31,8 +32,39 @@ public:
         
         int outliertFilterMinMeasurements;
         double outliertFilterMaxStdDev;
+
+        /**
+         * If true, updateAll only recomputes the cells around the dirty
+         * cells of the input MLSGrid (see MLSGrid::getDirtyCellExtents),
+         * as long as the robot starts on the same drive plane as in the
+         * previous update. The drive plane of the invalidated cells is
+         * re-flooded from the cells around them, so the result can differ
+         * from a full update where cells can be reached from several
+         * patches.
+         *
+         * The operator starts a new generation of dirty cells on the input
+         * grid after each update (see MLSGrid::startCellGeneration).
+         * */
+        bool incremental;
+
+        /**
+         * The number of threads the drive plane search uses, 0 for the
+         * number of hardware threads
+         * */
+        size_t numThreads;
+
+        /**
+         * The levels of the drive plane search with fewer frontier cells
+         * are processed by the calling thread alone, as the
+         * synchronization of the threads costs more than they save on
+         * small levels. The threads are only started once a level
+         * reaches this size.
+         * */
+        size_t minParallelFrontier;
     };
     
+    TraversabilityGrassfire();
+
     virtual bool updateAll();
 
     void setStartPosition(Eigen::Vector3d startPos);
@@ -42,13 +74,21 @@ public:
     }
     
 private:
+    struct FloodLevel;
+    struct FloodWorker;
+
     SurfacePatch *getNearestPatchWhereRobotFits(size_t x, size_t y, double height, bool& isObstace);
-    void addNeightboursToSearchList(size_t x, size_t y, SurfacePatch *patch);
+    void addToFrontier(size_t x, size_t y, SurfacePatch *patch);
     
     double getStepHeight(SurfacePatch *from, SurfacePatch *to);
     void markAsObstacle(size_t x, size_t y);
     
     bool determineDrivePlane();
+    SurfacePatch *findStartPatch(const base::Vector3d &startPos, size_t &startX, size_t &startY);
+    void flood();
+    void nextFloodLevel(FloodLevel& level);
+    bool updateIncremental();
+    void invalidate(const GridBase::CellExtents &dirty, std::vector<size_t> &changed);
     
     base::Vector3d startPos;
     base::Vector2d startPos_map;
@@ -60,27 +100,57 @@ private:
     TraversabilityClass classUnknown;
     TraversabilityClass classObstacle;
     
-    class SearchItem
+    /** A drive plane cell, whose neighbours are checked in the next
+     * level of the flood fill */
+    struct FrontierItem
     {
-    public:
-        SearchItem(size_t x, size_t y, envire::SurfacePatch* origin) : x(x), y(y), origin(origin)
-        {
-        };
-        
-        size_t x;
-        size_t y;
-        envire::SurfacePatch* origin;
+        size_t cell;
+        envire::SurfacePatch* patch;
     };
     
-    std::queue<SearchItem> searchList;
-    
-    boost::multi_array<bool, 2> visited;
+    std::vector<FrontierItem> frontier;
+
+    /** Claim of an unvisited cell by one of the frontier cells next to it.
+     * The lowest claim wins, see flood(). Copies are reset to NO_CLAIM, so
+     * that the claims can be stored in a std::vector.
+     */
+    struct Claim
+    {
+        static const uint32_t NO_CLAIM = 0xffffffff;
+        boost::atomic<uint32_t> value;
+        Claim() : value(NO_CLAIM) {}
+        Claim(const Claim&) : value(NO_CLAIM) {}
+        Claim& operator=(const Claim&) { value.store(NO_CLAIM); return *this; }
+    };
+    /** the claims of the cells, NO_CLAIM outside of flood() */
+    std::vector<Claim> claims;
+
+    enum CELL_STATE
+    {
+        CELL_UNVISITED = 0,
+        CELL_NO_PATCH,
+        CELL_OBSTACLE,
+        CELL_DRIVE_PLANE
+    };
+    boost::multi_array<uint8_t, 2> cellState;
     boost::multi_array<envire::SurfacePatch *, 2> bestPatchMap;
+    /** index (y * width + x) of the cell each cell has been reached from,
+     * -1 for the start cell and the unvisited cells */
+    boost::multi_array<int, 2> parents;
+    /** the visited cells, in the order in which they have been visited */
+    std::vector<size_t> visitOrder;
+    /** the grid the drive plane has been computed on, NULL if there is
+     * none */
+    MLSGrid *floodedGrid;
+    /** the generation of dirty cells of floodedGrid that has been started
+     * after the last update, see MLSGrid::startCellGeneration */
+    size_t floodedGeneration;
 
     void computeTraversability();
+    void computeTraversability(const std::vector<size_t> &changed);
     void setTraversability(size_t x, size_t y);
     void setProbability(size_t x, size_t y);
-    void checkRecursive(size_t x, size_t y, envire::SurfacePatch* origin);
+    void checkCell(size_t x, size_t y, envire::SurfacePatch* origin, int parent);
     bool determineDrivePlane(base::Vector3d startPos, bool searchSourunding = true);
     
     enum TRCLASSES
@@ -1,4 +1,6 @@
 #include "TraversabilityGrowClasses.hpp"
+#include <envire/tools/DistanceTransform.hpp>
+#include <algorithm>
 
 using namespace envire;
 
@@ -16,31 +18,21 @@ void envire::TraversabilityGrowClasses::setTraversabilityGrid(envire::Traversabi
 
 void TraversabilityGrowClasses::growTerrains(TraversabilityGrid& mapIn, TraversabilityGrid& mapOut)
 {
-    const double width_square = pow(radius,2);
-    const int 
-        wx = radius / mapIn.getScaleX() + 1, 
-        wy = radius / mapIn.getScaleY() + 1;
-    const double 
-        sx = mapIn.getScaleX(),
-        sy = mapIn.getScaleY();
+    const float width_square = pow(radius,2);
 
-
-    TraversabilityGrid::ArrayType& trDataIn = mapIn.getGridData(TraversabilityGrid::TRAVERSABILITY);
-    TraversabilityGrid::ArrayType& probDataIn = mapIn.getGridData(TraversabilityGrid::PROBABILITY);
-
-    TraversabilityGrid::ArrayType& trDataOut = mapOut.getGridData(TraversabilityGrid::TRAVERSABILITY);
-    TraversabilityGrid::ArrayType& probDataOut = mapOut.getGridData(TraversabilityGrid::PROBABILITY);
-
-    if(trDataIn.num_elements() != trDataOut.num_elements())
+    if(mapIn.getCellSizeX() != mapOut.getCellSizeX() || mapIn.getCellSizeY() != mapOut.getCellSizeY())
         throw std::runtime_error("ObjectGrowing, input and output data have differens sizes");
 
-    memcpy(trDataOut.data(), trDataIn.data(), sizeof(uint8_t) * trDataIn.num_elements());
-    memcpy(probDataOut.data(), probDataIn.data(), sizeof(uint8_t) * probDataIn.num_elements());
+    // the output starts as a copy of the input
+    mapOut.copyBandFrom(mapIn, TraversabilityGrid::TRAVERSABILITY);
+    mapOut.copyBandFrom(mapIn, TraversabilityGrid::PROBABILITY);
+
+    TraversabilityGrid const& constMapIn(mapIn);
+    TraversabilityGrid::ArrayType const& trDataIn = constMapIn.getGridData(TraversabilityGrid::TRAVERSABILITY);
+    TraversabilityGrid::ArrayType const& probDataIn = constMapIn.getGridData(TraversabilityGrid::PROBABILITY);
 
     assert(trDataIn.shape()[0] == mapIn.getCellSizeY());
     assert(trDataIn.shape()[1] == mapIn.getCellSizeX());
-    assert(trDataOut.shape()[0] == mapIn.getCellSizeY());
-    assert(trDataOut.shape()[1] == mapIn.getCellSizeX());
     
     const std::vector<TraversabilityClass> &classes(grid->getTraversabilityClasses());
     
@@ -51,39 +43,62 @@ void TraversabilityGrowClasses::growTerrains(TraversabilityGrid& mapIn, Traversa
         i++;
     }
 
-    for (unsigned int y = 0; y < mapIn.getCellSizeY(); ++y)
+    // the drivability of each class index, and the distinct drivabilities
+    // of the known cells, worst first. Cells of unregistered classes are
+    // not grown
+    const size_t size = trDataIn.num_elements();
+    const uint8_t* classIn = trDataIn.data();
+    const uint8_t* probIn = probDataIn.data();
+    std::vector<double> drivability(256, 0);
+    std::vector<bool> used(256, false);
+    for(size_t c = 0; c < classes.size() && c < 256; c++)
+        drivability[c] = classes[c].getDrivability();
+    for(size_t c = 0; c < size; c++)
+    {
+        //don't grow unknown areas
+        if(probIn[c] && classIn[c] < classes.size())
+            used[classIn[c]] = true;
+    }
+    std::vector<double> levels;
+    for(size_t c = 0; c < used.size(); c++)
+        if(used[c])
+            levels.push_back(drivability[c]);
+    std::sort(levels.begin(), levels.end());
+    levels.erase(std::unique(levels.begin(), levels.end()), levels.end());
+    if(levels.empty())
+        return;
+
+    // a cell takes the class of the worst known cell within the radius.
+    // The drivabilities are processed worst first, with one distance
+    // transform each, so that the first level that reaches a cell is its
+    // final one. Within a level, the cell keeps its own class if it is part
+    // of the level, and takes the one of the closest cell of the level
+    // otherwise. The radius is exclusive, as in ObjectGrowing
+    std::vector<bool> done(size, false);
+    DistanceTransform::ArrayType distances(boost::extents[trDataIn.shape()[0]][trDataIn.shape()[1]]);
+    DistanceTransform::IndexArrayType nearest;
+    float* dist = distances.data();
+    TraversabilityGrid::ArrayType& trDataOut = mapOut.getGridData(TraversabilityGrid::TRAVERSABILITY);
+    TraversabilityGrid::ArrayType& probDataOut = mapOut.getGridData(TraversabilityGrid::PROBABILITY);
+    uint8_t* classOut = trDataOut.data();
+    uint8_t* probOut = probDataOut.data();
+    for(size_t l = 0; l < levels.size(); l++)
     {
-        for (unsigned int x = 0; x < mapIn.getCellSizeX(); ++x)
+        for(size_t c = 0; c < size; c++)
         {
-            double curProbability = mapIn.getProbability(x, y);
-            //don't grow unknown areas
-            if(curProbability <= 0.0001)
-                continue;
-            
-            uint8_t classNumber = trDataIn[y][x];
-            TraversabilityClass curClass(classes[classNumber]);
+            const bool seed = probIn[c] && classIn[c] < classes.size() && drivability[classIn[c]] == levels[l];
+            dist[c] = seed ? 0 : DistanceTransform::infinity();
+        }
+        DistanceTransform::computeSquaredDistances(distances, nearest, mapIn.getScaleX(), mapIn.getScaleY());
 
-            //grow all object in the radius
-            for( int oy = -wy; oy <= wy; ++oy )
-            {
-                for( int ox = -wx; ox <= wx; ++ox )
-                {
-                    const int tx = x+ox;
-                    const int ty = y+oy;
-                    if( (pow(ox*sx,2) + pow(oy*sy,2) < width_square )
-                            && tx >= 0 && tx < (int)mapIn.getCellSizeX()
-                            && ty >= 0 && ty < (int)mapIn.getCellSizeY() )
-                    {
-                        TraversabilityClass otherClass(classes[trDataOut[ty][tx]]);
-                        if((mapOut.getProbability(tx, ty) <= 0.0001)
-                           || (otherClass.getDrivability() > curClass.getDrivability()))
-                        {
-                            trDataOut[ty][tx] = classNumber;
-                            mapOut.setProbability(curProbability, tx, ty);
-                        }
-                    }
-                }
-            }
+        const int* source = nearest.data();
+        for(size_t c = 0; c < size; c++)
+        {
+            if(done[c] || !(dist[c] < width_square))
+                continue;
+            done[c] = true;
+            classOut[c] = classIn[source[c]];
+            probOut[c] = probIn[source[c]];
         }
     }
 }
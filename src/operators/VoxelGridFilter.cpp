@@ -0,0 +1,278 @@
+#include "VoxelGridFilter.hpp"
+
+#include <envire/tools/ParallelFor.hpp>
+#include <envire/tools/VoxelSort.hpp>
+#include <Eigen/Geometry>
+#include <algorithm>
+
+using namespace envire;
+using namespace std;
+
+ENVIRONMENT_ITEM_DEF( VoxelGridFilter )
+
+namespace
+{
+    /** read access to the points and attributes of a pointcloud in either
+     * storage */
+    struct PointSource
+    {
+	const Pointcloud& cloud;
+	bool columns;
+	size_t count;
+	const std::vector<Eigen::Vector3d> *colors, *normals;
+	const std::vector<double> *variances;
+	bool hasColor, hasNormal, hasVariance;
+
+	PointSource( Pointcloud& pc )
+	    : cloud( pc ), columns( pc.getStorage() == Pointcloud::FLOAT_COLUMNS ),
+	    count( pc.getVertexCount() ), colors( 0 ), normals( 0 ), variances( 0 )
+	{
+	    if( columns )
+	    {
+		hasColor = pc.columns.hasAttribute( PointColumns::COLOR );
+		hasNormal = pc.columns.hasAttribute( PointColumns::NORMAL );
+		hasVariance = pc.columns.hasAttribute( PointColumns::VARIANCE );
+		return;
+	    }
+
+	    // attributes which do not have one value per vertex are ignored
+	    if( pc.hasData( Pointcloud::VERTEX_COLOR ) )
+		colors = &pc.getVertexData<Eigen::Vector3d>( Pointcloud::VERTEX_COLOR );
+	    if( pc.hasData( Pointcloud::VERTEX_NORMAL ) )
+		normals = &pc.getVertexData<Eigen::Vector3d>( Pointcloud::VERTEX_NORMAL );
+	    if( pc.hasData( Pointcloud::VERTEX_VARIANCE ) )
+		variances = &pc.getVertexData<double>( Pointcloud::VERTEX_VARIANCE );
+	    hasColor = colors && colors->size() == count;
+	    hasNormal = normals && normals->size() == count;
+	    hasVariance = variances && variances->size() == count;
+	}
+
+	Eigen::Vector3d point( size_t i ) const
+	{
+	    return columns ? cloud.columns.getPoint( i ) : cloud.vertices[i];
+	}
+	Eigen::Vector3d color( size_t i ) const
+	{
+	    return columns ? cloud.columns.getColor( i ) : (*colors)[i];
+	}
+	Eigen::Vector3d normal( size_t i ) const
+	{
+	    return columns ? cloud.columns.getNormal( i ) : (*normals)[i];
+	}
+	double variance( size_t i ) const
+	{
+	    return columns ? cloud.columns.variance[i] : (*variances)[i];
+	}
+    };
+
+    /** write access to the points and attributes of a pointcloud in either
+     * storage. The constructor resizes the cloud to the given number of
+     * points, with the attributes of the given source. */
+    struct PointTarget
+    {
+	Pointcloud& cloud;
+	bool columns;
+	std::vector<Eigen::Vector3d> *colors, *normals;
+	std::vector<double> *variances;
+
+	PointTarget( Pointcloud& pc, const PointSource& source, size_t count )
+	    : cloud( pc ), columns( pc.getStorage() == Pointcloud::FLOAT_COLUMNS ),
+	    colors( 0 ), normals( 0 ), variances( 0 )
+	{
+	    pc.clear();
+	    if( columns )
+	    {
+		setAttribute( PointColumns::COLOR, source.hasColor );
+		setAttribute( PointColumns::NORMAL, source.hasNormal );
+		setAttribute( PointColumns::VARIANCE, source.hasVariance );
+		pc.columns.resize( count );
+		return;
+	    }
+
+	    pc.vertices.resize( count );
+	    if( source.hasColor )
+	    {
+		colors = &pc.getVertexData<Eigen::Vector3d>( Pointcloud::VERTEX_COLOR );
+		colors->resize( count );
+	    }
+	    if( source.hasNormal )
+	    {
+		normals = &pc.getVertexData<Eigen::Vector3d>( Pointcloud::VERTEX_NORMAL );
+		normals->resize( count );
+	    }
+	    if( source.hasVariance )
+	    {
+		variances = &pc.getVertexData<double>( Pointcloud::VERTEX_VARIANCE );
+		variances->resize( count );
+	    }
+	}
+
+	void setAttribute( PointColumns::Attribute attribute, bool present )
+	{
+	    if( present )
+		cloud.columns.addAttribute( attribute );
+	    else
+		cloud.columns.removeAttribute( attribute );
+	}
+
+	void setPoint( size_t i, const Eigen::Vector3d& point ) const
+	{
+	    if( columns )
+		cloud.columns.setPoint( i, point );
+	    else
+		cloud.vertices[i] = point;
+	}
+	void setColor( size_t i, const Eigen::Vector3d& color ) const
+	{
+	    if( columns )
+		cloud.columns.setColor( i, color );
+	    else
+		(*colors)[i] = color;
+	}
+	void setNormal( size_t i, const Eigen::Vector3d& normal ) const
+	{
+	    if( columns )
+		cloud.columns.setNormal( i, normal );
+	    else
+		(*normals)[i] = normal;
+	}
+	void setVariance( size_t i, double variance ) const
+	{
+	    if( columns )
+		cloud.columns.variance[i] = variance;
+	    else
+		(*variances)[i] = variance;
+	}
+    };
+
+    /** reduces the points of each voxel to their centroid */
+    struct AverageVoxels
+    {
+	const PointSource& source;
+	const PointTarget& target;
+	const std::vector<boost::uint32_t>& order;
+	const std::vector<size_t>& starts;
+	const Transform& transform;
+
+	AverageVoxels( const PointSource& source, const PointTarget& target,
+		const std::vector<boost::uint32_t>& order, const std::vector<size_t>& starts,
+		const Transform& transform )
+	    : source( source ), target( target ), order( order ), starts( starts ),
+	    transform( transform ) {}
+
+	void operator()( size_t first, size_t last ) const
+	{
+	    for( size_t v = first; v < last; v++ )
+	    {
+		Eigen::Vector3d point( Eigen::Vector3d::Zero() );
+		Eigen::Vector3d color( Eigen::Vector3d::Zero() );
+		Eigen::Vector3d normal( Eigen::Vector3d::Zero() );
+		double variance = 0;
+		for( size_t j = starts[v]; j < starts[v + 1]; j++ )
+		{
+		    const size_t i = order[j];
+		    point += source.point( i );
+		    if( source.hasColor )
+			color += source.color( i );
+		    if( source.hasNormal )
+			normal += source.normal( i );
+		    if( source.hasVariance )
+			variance += source.variance( i );
+		}
+
+		const double count = starts[v + 1] - starts[v];
+		target.setPoint( v, transform * (point / count) );
+		if( source.hasColor )
+		    target.setColor( v, color / count );
+		if( source.hasNormal )
+		{
+		    normal = transform.linear() * normal;
+		    if( normal.norm() > 0 )
+			normal.normalize();
+		    target.setNormal( v, normal );
+		}
+		if( source.hasVariance )
+		    target.setVariance( v, variance / count );
+	    }
+	}
+    };
+}
+
+VoxelGridFilter::VoxelGridFilter()
+    : voxelSize( 0.05 ), threads( 0 )
+{
+}
+
+void VoxelGridFilter::serialize(Serialization& so)
+{
+    Operator::serialize(so);
+    so.write( "voxel_size", voxelSize );
+}
+
+void VoxelGridFilter::unserialize(Serialization& so)
+{
+    Operator::unserialize(so);
+    if( so.hasKey( "voxel_size" ) )
+	so.read( "voxel_size", voxelSize );
+}
+
+void VoxelGridFilter::addInput( Pointcloud* input )
+{
+    if( env->getInputs(this).size() > 0 )
+        throw std::runtime_error("VoxelGridFilter can only have one input.");
+
+    Operator::addInput(input);
+}
+
+void VoxelGridFilter::addOutput( Pointcloud* output )
+{
+    if( env->getOutputs(this).size() > 0 )
+        throw std::runtime_error("VoxelGridFilter can only have one output.");
+
+    Operator::addOutput(output);
+}
+
+bool VoxelGridFilter::updateAll()
+{
+    Pointcloud* pc_in = dynamic_cast<envire::Pointcloud*>(env->getInputs(this).front());
+    assert(pc_in);
+
+    Pointcloud* pc_out = dynamic_cast<envire::Pointcloud*>(env->getOutputs(this).front());
+    assert(pc_out);
+    assert(pc_in != pc_out);
+
+    if( !(voxelSize > 0) )
+	throw std::runtime_error("VoxelGridFilter: the voxel size has to be positive.");
+
+    const PointSource source( *pc_in );
+    const size_t count = source.count;
+
+    // the voxels are relative to the bounding box of the input
+    VoxelKeys voxelKeys;
+    voxelKeys.init( computeFiniteBounds( *pc_in, threads ), voxelSize );
+
+    std::vector<boost::uint64_t> keys;
+    std::vector<boost::uint32_t> order;
+    computeVoxelKeys( *pc_in, voxelKeys, keys, order, threads );
+    radixSort( keys, order, voxelKeys.getBits() + 1, threads );
+
+    // the voxels are the runs of equal keys, the invalid points are at the
+    // end
+    std::vector<size_t> starts;
+    for( size_t i = 0; i < count && keys[i] != voxelKeys.getInvalidKey(); i++ )
+    {
+	if( i == 0 || keys[i] != keys[i - 1] )
+	    starts.push_back( i );
+    }
+    const size_t voxels = starts.size();
+    starts.push_back( std::lower_bound( keys.begin(), keys.end(), voxelKeys.getInvalidKey() ) - keys.begin() );
+
+    Transform trans =
+        env->relativeTransform( pc_in->getFrameNode(), pc_out->getFrameNode() );
+
+    const PointTarget target( *pc_out, source, voxels );
+    parallelFor( 0, voxels, AverageVoxels( source, target, order, starts, trans ), threads, 1024 );
+
+    env->itemModified( pc_out );
+    return true;
+}
@@ -0,0 +1,50 @@
+#ifndef __ENVIRE_VOXELGRIDFILTER_HPP__
+#define __ENVIRE_VOXELGRIDFILTER_HPP__
+
+#include <envire/Core.hpp>
+#include <envire/maps/Pointcloud.hpp>
+
+namespace envire {
+    /** Downsamples a pointcloud by replacing the points in each cell of a
+     * regular voxel grid with their centroid.
+     *
+     * The grid is aligned with the frame of the input. Color, variance and
+     * normals of the output points are the averages of the points of the
+     * voxel, the normals are normalized again. The output is written in the
+     * storage of the output cloud, and the points are sorted by their
+     * voxel, independently of the number of threads.
+     *
+     * The points are sorted by their voxel with a parallel radix sort, so
+     * that the runtime is linear in the number of points. Points which are
+     * not finite are dropped.
+     */
+    class VoxelGridFilter : public Operator
+    {
+	ENVIRONMENT_ITEM( VoxelGridFilter )
+
+    public:
+	VoxelGridFilter();
+
+	void serialize(Serialization& so);
+        void unserialize(Serialization& so);
+
+	void addInput( Pointcloud* input );
+	void addOutput( Pointcloud* output );
+
+	/** @throw std::runtime_error if the voxel size is too small to
+	 * index the extents of the input */
+	bool updateAll();
+
+	/** the edge length of the voxels */
+	void setVoxelSize( double value ) { voxelSize = value; }
+	double getVoxelSize() const { return voxelSize; }
+	/** the number of threads to use, 0 for the number of hardware
+	 * threads */
+	void setThreadCount( size_t value ) { threads = value; }
+
+    private:
+	double voxelSize;
+	size_t threads;
+    };
+}
+#endif
@@ -0,0 +1,307 @@
+#include "BandCodec.hpp"
+#include <envire/tools/ParallelFor.hpp>
+
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <stdint.h>
+
+namespace envire {
+
+const size_t BandCodec::DEFAULT_CHUNK_ROWS;
+
+namespace
+{
+    /** runs shorter than this are stored as literals */
+    const size_t MIN_RUN = 3;
+
+    void writeVarint(std::string& out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    uint64_t readVarint(const char*& in, const char* end)
+    {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            if (in == end)
+                throw std::runtime_error("BandCodec: truncated chunk");
+            const uint8_t byte = *in++;
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+        throw std::runtime_error("BandCodec: invalid chunk");
+    }
+
+    template <class Word>
+    void writeLiteral(std::string& out, const Word* words, size_t count)
+    {
+        if (!count)
+            return;
+        writeVarint(out, count << 1);
+        out.append(reinterpret_cast<const char*>(words), count * sizeof(Word));
+    }
+
+    /** encodes the n cells at data into out
+     *
+     * The chunk is a sequence of packets, each starting with a varint h. If
+     * h is odd, the packet is a run of h >> 1 copies of the difference that
+     * follows. Otherwise, h >> 1 differences follow.
+     */
+    template <class Word>
+    void encodeChunk(const Word* data, size_t n, std::string& out)
+    {
+        std::vector<Word> deltas(n);
+        Word previous = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            deltas[i] = data[i] - previous;
+            previous = data[i];
+        }
+
+        size_t literal_start = 0;
+        size_t i = 0;
+        while (i < n)
+        {
+            size_t j = i + 1;
+            while (j < n && deltas[j] == deltas[i])
+                ++j;
+            if (j - i >= MIN_RUN)
+            {
+                writeLiteral(out, &deltas[literal_start], i - literal_start);
+                writeVarint(out, ((j - i) << 1) | 1);
+                out.append(reinterpret_cast<const char*>(&deltas[i]), sizeof(Word));
+                literal_start = j;
+            }
+            i = j;
+        }
+        writeLiteral(out, &deltas[literal_start], n - literal_start);
+    }
+
+    template <class Word>
+    void decodeChunk(const char* in, const char* end, Word* data, size_t n)
+    {
+        Word previous = 0;
+        size_t i = 0;
+        while (i < n)
+        {
+            const uint64_t header = readVarint(in, end);
+            const uint64_t count = header >> 1;
+            if (count > n - i)
+                throw std::runtime_error("BandCodec: invalid chunk");
+
+            if (header & 1)
+            {
+                if (end - in < static_cast<ptrdiff_t>(sizeof(Word)))
+                    throw std::runtime_error("BandCodec: truncated chunk");
+                Word delta;
+                memcpy(&delta, in, sizeof(Word));
+                in += sizeof(Word);
+                for (uint64_t k = 0; k < count; ++k)
+                    data[i++] = previous = previous + delta;
+            }
+            else
+            {
+                if (static_cast<uint64_t>(end - in) < count * sizeof(Word))
+                    throw std::runtime_error("BandCodec: truncated chunk");
+                for (uint64_t k = 0; k < count; ++k)
+                {
+                    Word delta;
+                    memcpy(&delta, in, sizeof(Word));
+                    in += sizeof(Word);
+                    data[i++] = previous = previous + delta;
+                }
+            }
+        }
+        if (in != end)
+            throw std::runtime_error("BandCodec: invalid chunk");
+    }
+
+    /** encodes the chunks [first, last[ */
+    template <class Word>
+    struct EncodeChunks
+    {
+        const Word* data;
+        size_t width;
+        size_t height;
+        size_t chunk_rows;
+        std::vector<std::string>& chunks;
+
+        EncodeChunks(const Word* data, size_t width, size_t height, size_t chunk_rows, std::vector<std::string>& chunks)
+            : data(data), width(width), height(height), chunk_rows(chunk_rows), chunks(chunks) {}
+
+        void operator()(size_t first, size_t last) const
+        {
+            for (size_t c = first; c < last; ++c)
+            {
+                const size_t y0 = c * chunk_rows;
+                const size_t y1 = std::min(y0 + chunk_rows, height);
+                encodeChunk(data + y0 * width, (y1 - y0) * width, chunks[c]);
+            }
+        }
+    };
+
+    /** decodes the chunks [first, last[ */
+    template <class Word>
+    struct DecodeChunks
+    {
+        const std::vector<char>& payload;
+        const std::vector<uint64_t>& offsets;
+        Word* data;
+        size_t width;
+        size_t height;
+        size_t chunk_rows;
+
+        DecodeChunks(const std::vector<char>& payload, const std::vector<uint64_t>& offsets,
+                Word* data, size_t width, size_t height, size_t chunk_rows)
+            : payload(payload), offsets(offsets), data(data), width(width), height(height), chunk_rows(chunk_rows) {}
+
+        void operator()(size_t first, size_t last) const
+        {
+            const char* base = payload.empty() ? 0 : &payload[0];
+            for (size_t c = first; c < last; ++c)
+            {
+                const size_t y0 = c * chunk_rows;
+                const size_t y1 = std::min(y0 + chunk_rows, height);
+                decodeChunk(base + offsets[c], base + offsets[c + 1], data + y0 * width, (y1 - y0) * width);
+            }
+        }
+    };
+
+    template <class Word>
+    void encodeBand(const Word* data, size_t width, size_t height, size_t chunk_rows, std::vector<std::string>& chunks, size_t threads)
+    {
+        parallelFor(0, chunks.size(), EncodeChunks<Word>(data, width, height, chunk_rows, chunks), threads);
+    }
+
+    template <class Word>
+    void decodeBand(const std::vector<char>& payload, const std::vector<uint64_t>& offsets,
+            Word* data, size_t width, size_t height, size_t chunk_rows, size_t threads)
+    {
+        parallelFor(0, offsets.size() - 1, DecodeChunks<Word>(payload, offsets, data, width, height, chunk_rows), threads);
+    }
+
+    /** @return an upper bound of the size of a chunk of n cells of
+     * element_size bytes. Each packet covers at least one cell, and has a
+     * varint header of at most 10 bytes. */
+    uint64_t getMaxChunkSize(uint64_t n, size_t element_size)
+    {
+        return n * (element_size + 10);
+    }
+
+    /** @return the number of bytes left in is, or -1 if the stream can not
+     * tell */
+    std::streamoff getRemainingSize(std::istream& is)
+    {
+        const std::streampos position = is.tellg();
+        if (position < 0)
+            return -1;
+        is.seekg(0, std::ios::end);
+        const std::streampos end = is.tellg();
+        is.seekg(position);
+        if (end < 0 || !is)
+        {
+            is.clear();
+            is.seekg(position);
+            return -1;
+        }
+        return end - position;
+    }
+
+    template <class T>
+    void writeValue(std::ostream& os, T value)
+    {
+        os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <class T>
+    T readValue(std::istream& is)
+    {
+        T value;
+        if (!is.read(reinterpret_cast<char*>(&value), sizeof(T)))
+            throw std::runtime_error("BandCodec: truncated stream");
+        return value;
+    }
+}
+
+void BandCodec::encode(const void* data, size_t element_size, size_t width, size_t height,
+        std::ostream& os, size_t chunk_rows, size_t threads)
+{
+    if (!chunk_rows)
+        chunk_rows = DEFAULT_CHUNK_ROWS;
+    const size_t chunk_count = (height + chunk_rows - 1) / chunk_rows;
+    std::vector<std::string> chunks(chunk_count);
+    switch (element_size)
+    {
+        case 1: encodeBand(static_cast<const uint8_t*>(data), width, height, chunk_rows, chunks, threads); break;
+        case 2: encodeBand(static_cast<const uint16_t*>(data), width, height, chunk_rows, chunks, threads); break;
+        case 4: encodeBand(static_cast<const uint32_t*>(data), width, height, chunk_rows, chunks, threads); break;
+        case 8: encodeBand(static_cast<const uint64_t*>(data), width, height, chunk_rows, chunks, threads); break;
+        default: throw std::runtime_error("BandCodec: unsupported cell size");
+    }
+
+    // the chunk sizes are written upfront, so that the chunks can be
+    // located and decoded independently
+    writeValue<uint32_t>(os, element_size);
+    writeValue<uint32_t>(os, width);
+    writeValue<uint32_t>(os, height);
+    writeValue<uint32_t>(os, chunk_rows);
+    for (size_t c = 0; c < chunk_count; ++c)
+        writeValue<uint64_t>(os, chunks[c].size());
+    for (size_t c = 0; c < chunk_count; ++c)
+        os.write(chunks[c].data(), chunks[c].size());
+}
+
+void BandCodec::decode(std::istream& is, void* data, size_t element_size, size_t width, size_t height,
+        size_t threads)
+{
+    const size_t file_element_size = readValue<uint32_t>(is);
+    const size_t file_width = readValue<uint32_t>(is);
+    const size_t file_height = readValue<uint32_t>(is);
+    const size_t chunk_rows = readValue<uint32_t>(is);
+    if (file_element_size != element_size || file_width != width || file_height != height || !chunk_rows)
+        throw std::runtime_error("BandCodec: the encoded band does not match the expected size");
+
+    // the chunk sizes are checked before the payload is allocated, so that
+    // a corrupted stream is reported as such, instead of exhausting the
+    // memory
+    const size_t chunk_count = (height + chunk_rows - 1) / chunk_rows;
+    std::vector<uint64_t> offsets(chunk_count + 1, 0);
+    for (size_t c = 0; c < chunk_count; ++c)
+    {
+        const size_t rows = std::min<size_t>(chunk_rows, height - c * chunk_rows);
+        const uint64_t size = readValue<uint64_t>(is);
+        if (size > getMaxChunkSize(static_cast<uint64_t>(rows) * width, element_size))
+            throw std::runtime_error("BandCodec: invalid chunk size");
+        offsets[c + 1] = offsets[c] + size;
+    }
+    const std::streamoff remaining = getRemainingSize(is);
+    if (remaining >= 0 && offsets.back() > static_cast<uint64_t>(remaining))
+        throw std::runtime_error("BandCodec: truncated stream");
+
+    std::vector<char> payload(offsets.back());
+    if (!payload.empty() && !is.read(&payload[0], payload.size()))
+        throw std::runtime_error("BandCodec: truncated stream");
+
+    switch (element_size)
+    {
+        case 1: decodeBand(payload, offsets, static_cast<uint8_t*>(data), width, height, chunk_rows, threads); break;
+        case 2: decodeBand(payload, offsets, static_cast<uint16_t*>(data), width, height, chunk_rows, threads); break;
+        case 4: decodeBand(payload, offsets, static_cast<uint32_t*>(data), width, height, chunk_rows, threads); break;
+        case 8: decodeBand(payload, offsets, static_cast<uint64_t*>(data), width, height, chunk_rows, threads); break;
+        default: throw std::runtime_error("BandCodec: unsupported cell size");
+    }
+}
+
+}
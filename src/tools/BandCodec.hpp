@@ -0,0 +1,50 @@
+#ifndef ENVIRE_BANDCODEC_HPP
+#define ENVIRE_BANDCODEC_HPP
+
+#include <iosfwd>
+#include <cstddef>
+
+namespace envire
+{
+
+/**
+ * Lossless compression of raster bands, used by Grid<T> to serialize bands
+ * into binary streams.
+ *
+ * The cells are handled as unsigned integers of the size of the cell type.
+ * Each cell is replaced by its difference to the previous cell (delta
+ * coding), and the differences are run-length encoded. Constant areas, e.g.
+ * nodata or a single traversability class, as well as linear ramps of
+ * integer cells therefore reduce to a few bytes.
+ *
+ * The band is split into chunks of rows that are encoded independently, so
+ * that both encoding and decoding are done in parallel.
+ */
+class BandCodec
+{
+public:
+    /** default number of rows per chunk */
+    static const size_t DEFAULT_CHUNK_ROWS = 64;
+
+    /** Encodes the \c width x \c height cells of \c element_size bytes each,
+     * stored row by row at \c data, into \c os.
+     *
+     * @param threads the number of threads to use, 0 for the number of
+     *        hardware threads
+     * @throw std::runtime_error if element_size is not 1, 2, 4 or 8
+     */
+    static void encode(const void* data, size_t element_size, size_t width, size_t height,
+            std::ostream& os, size_t chunk_rows = DEFAULT_CHUNK_ROWS, size_t threads = 0);
+
+    /** Decodes a band that has been written by encode() from \c is into
+     * \c data, which must have room for \c width x \c height cells.
+     *
+     * @throw std::runtime_error if the stream does not contain a band of
+     *        the given size and cell size, or if it is corrupted
+     */
+    static void decode(std::istream& is, void* data, size_t element_size, size_t width, size_t height,
+            size_t threads = 0);
+};
+
+}
+#endif // ENVIRE_BANDCODEC_HPP
@@ -0,0 +1,172 @@
+#include "DistanceTransform.hpp"
+#include <envire/tools/ParallelFor.hpp>
+
+#include <vector>
+#include <algorithm>
+
+namespace envire {
+
+void DistanceTransform::transform1D(const float* f, float* d, size_t n, double weight, int* v, double* z, int* argmin)
+{
+    const double inf = std::numeric_limits<double>::infinity();
+
+    // lower envelope of the parabolas rooted at the finite values of f.
+    // v holds the positions of the parabolas, and [z[k], z[k+1][ the
+    // range in which parabola k is the lowest one
+    int k = -1;
+    for (size_t q = 0; q < n; ++q)
+    {
+        if (f[q] == infinity())
+            continue;
+
+        const double fq = f[q] + weight * q * q;
+        double s = -inf;
+        while (k >= 0)
+        {
+            const int p = v[k];
+            s = (fq - (f[p] + weight * p * p)) / (2 * weight * (q - p));
+            if (s > z[k])
+                break;
+            --k;
+        }
+        ++k;
+        v[k] = q;
+        z[k] = (k == 0) ? -inf : s;
+        z[k + 1] = inf;
+    }
+
+    if (k < 0)
+    {
+        std::fill(d, d + n, infinity());
+        if (argmin)
+            std::fill(argmin, argmin + n, -1);
+        return;
+    }
+
+    k = 0;
+    for (size_t q = 0; q < n; ++q)
+    {
+        while (z[k + 1] < q)
+            ++k;
+        const double dq = static_cast<double>(q) - v[k];
+        d[q] = weight * dq * dq + f[v[k]];
+        if (argmin)
+            argmin[q] = v[k];
+    }
+}
+
+namespace
+{
+    /** transforms the columns [first, last[ of the grid */
+    struct ColumnPass
+    {
+        DistanceTransform::ArrayType& grid;
+        double weight;
+        /** if not NULL, receives the row of the closest cell */
+        DistanceTransform::IndexArrayType* nearest;
+
+        ColumnPass(DistanceTransform::ArrayType& grid, double weight, DistanceTransform::IndexArrayType* nearest = NULL)
+            : grid(grid), weight(weight), nearest(nearest) {}
+
+        void operator()(size_t first, size_t last) const
+        {
+            // the columns are copied in blocks, so that the grid is read and
+            // written row by row
+            static const size_t BLOCK = 16;
+            const size_t height = grid.shape()[0], width = grid.shape()[1];
+            std::vector<float> f(height * BLOCK), d(height);
+            std::vector<int> v(height), argmin(nearest ? height * BLOCK : 0);
+            std::vector<double> z(height + 1);
+            float* data = grid.data();
+            for (size_t x0 = first; x0 < last; x0 += BLOCK)
+            {
+                const size_t count = std::min(BLOCK, last - x0);
+                for (size_t y = 0; y < height; ++y)
+                    for (size_t i = 0; i < count; ++i)
+                        f[i * height + y] = data[y * width + x0 + i];
+                for (size_t i = 0; i < count; ++i)
+                {
+                    DistanceTransform::transform1D(&f[i * height], &d[0], height, weight, &v[0], &z[0],
+                            nearest ? &argmin[i * height] : NULL);
+                    std::copy(d.begin(), d.end(), f.begin() + i * height);
+                }
+                for (size_t y = 0; y < height; ++y)
+                    for (size_t i = 0; i < count; ++i)
+                        data[y * width + x0 + i] = f[i * height + y];
+                if (nearest)
+                {
+                    int* rows = nearest->data();
+                    for (size_t y = 0; y < height; ++y)
+                        for (size_t i = 0; i < count; ++i)
+                            rows[y * width + x0 + i] = argmin[i * height + y];
+                }
+            }
+        }
+    };
+
+    /** transforms the rows [first, last[ of the grid */
+    struct RowPass
+    {
+        DistanceTransform::ArrayType& grid;
+        double weight;
+        /** if not NULL, holds the row of the closest cell of each column,
+         * and receives the closest cell */
+        DistanceTransform::IndexArrayType* nearest;
+
+        RowPass(DistanceTransform::ArrayType& grid, double weight, DistanceTransform::IndexArrayType* nearest = NULL)
+            : grid(grid), weight(weight), nearest(nearest) {}
+
+        void operator()(size_t first, size_t last) const
+        {
+            const size_t width = grid.shape()[1];
+            std::vector<float> f(width);
+            std::vector<int> v(width), argmin(nearest ? width : 0), rows(nearest ? width : 0);
+            std::vector<double> z(width + 1);
+            for (size_t y = first; y < last; ++y)
+            {
+                float* row = grid.data() + y * width;
+                std::copy(row, row + width, f.begin());
+                if (!nearest)
+                {
+                    DistanceTransform::transform1D(&f[0], row, width, weight, &v[0], &z[0]);
+                    continue;
+                }
+
+                int* cells = nearest->data() + y * width;
+                std::copy(cells, cells + width, rows.begin());
+                DistanceTransform::transform1D(&f[0], row, width, weight, &v[0], &z[0], &argmin[0]);
+                for (size_t x = 0; x < width; ++x)
+                {
+                    const int column = argmin[x];
+                    cells[x] = (column < 0 || rows[column] < 0) ? -1 : rows[column] * static_cast<int>(width) + column;
+                }
+            }
+        }
+    };
+}
+
+void DistanceTransform::computeSquaredDistances(ArrayType& grid, double scalex, double scaley, size_t threads)
+{
+    const size_t height = grid.shape()[0], width = grid.shape()[1];
+    if (width == 0 || height == 0)
+        return;
+
+    // small chunks do not pay off the cost of starting a thread
+    const size_t min_chunk = 16;
+    parallelFor(0, width, ColumnPass(grid, scaley * scaley), threads, min_chunk);
+    parallelFor(0, height, RowPass(grid, scalex * scalex), threads, min_chunk);
+}
+
+void DistanceTransform::computeSquaredDistances(ArrayType& grid, IndexArrayType& nearest, double scalex, double scaley, size_t threads)
+{
+    const size_t height = grid.shape()[0], width = grid.shape()[1];
+    nearest.resize(boost::extents[height][width]);
+    if (width == 0 || height == 0)
+        return;
+
+    const size_t min_chunk = 16;
+    parallelFor(0, width, ColumnPass(grid, scaley * scaley, &nearest), threads, min_chunk);
+    parallelFor(0, height, RowPass(grid, scalex * scalex, &nearest), threads, min_chunk);
+}
+
+}
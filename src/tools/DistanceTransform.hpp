@@ -0,0 +1,70 @@
+#ifndef ENVIRE_DISTANCETRANSFORM_HPP
+#define ENVIRE_DISTANCETRANSFORM_HPP
+
+#include <boost/multi_array.hpp>
+#include <limits>
+
+namespace envire
+{
+
+/**
+ * Exact euclidean distance transform of a two dimensional grid, following
+ * Felzenszwalb and Huttenlocher, "Distance Transforms of Sampled Functions".
+ *
+ * The transform is separable: it is first applied along the columns, and
+ * then along the rows of the grid. Both passes are linear in the number of
+ * cells, i.e. the cost does not depend on the distances involved. The
+ * columns and rows are processed in parallel.
+ *
+ * The grid is indexed as grid[y][x], like the bands of Grid<T>.
+ */
+class DistanceTransform
+{
+public:
+    typedef boost::multi_array<float, 2> ArrayType;
+    typedef boost::multi_array<int, 2> IndexArrayType;
+
+    /** value of the cells which are not seeds */
+    static float infinity() { return std::numeric_limits<float>::infinity(); }
+
+    /** Computes in-place, for every cell p,
+     *
+     * <code>
+     * min_q ( grid[q] + |p - q|^2 )
+     * </code>
+     *
+     * where |p - q| is the euclidean distance of the cells in world units,
+     * given the cell sizes \c scalex and \c scaley.
+     *
+     * If the seed cells are set to zero and all other cells to infinity(),
+     * the result is the squared distance to the closest seed. Cells stay
+     * at infinity() if there is no seed at all.
+     *
+     * @param threads the number of threads to use, 0 for the number of
+     *        hardware threads
+     */
+    static void computeSquaredDistances(ArrayType& grid, double scalex, double scaley, size_t threads = 0);
+
+    /** Like computeSquaredDistances(), and additionally stores in \c nearest
+     * the cell q for which the minimum is reached, as y * width + x. It is
+     * -1 for the cells that stay at infinity(). \c nearest is resized to the
+     * size of \c grid.
+     *
+     * If the seed cells are set to zero, this is the closest seed of each
+     * cell (feature transform).
+     */
+    static void computeSquaredDistances(ArrayType& grid, IndexArrayType& nearest, double scalex, double scaley, size_t threads = 0);
+
+    /** One dimensional transform of the n values f[0] ... f[n-1], which is
+     * written to d. f and d must not overlap.
+     *
+     * @param weight the squared size of a cell
+     * @param v, z workspace of at least n and n + 1 elements
+     * @param argmin if not NULL, receives for each element the index of
+     *        the value of f for which the minimum is reached, or -1
+     */
+    static void transform1D(const float* f, float* d, size_t n, double weight, int* v, double* z, int* argmin = NULL);
+};
+
+}
+#endif // ENVIRE_DISTANCETRANSFORM_HPP
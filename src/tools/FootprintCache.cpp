@@ -0,0 +1,135 @@
+#include "FootprintCache.hpp"
+#include <envire/maps/GridBase.hpp>
+
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <cmath>
+
+namespace envire {
+
+const size_t FootprintCache::DEFAULT_HEADING_BINS;
+
+FootprintCache::FootprintCache(double scaleX, double scaleY, double sizeX, double sizeY,
+        double borderWidth, size_t headingBins)
+    : scaleX(scaleX), scaleY(scaleY), sizeX(sizeX), sizeY(sizeY), borderWidth(borderWidth)
+{
+    if (scaleX <= 0 || scaleY <= 0)
+        throw std::runtime_error("FootprintCache: the cell sizes must be positive");
+    if (sizeX < 0 || sizeY < 0 || borderWidth < 0)
+        throw std::runtime_error("FootprintCache: the footprint size and border must not be negative");
+    if (!headingBins)
+        throw std::runtime_error("FootprintCache: at least one heading bin is required");
+
+    masks.resize(headingBins);
+    for (size_t i = 0; i < headingBins; ++i)
+        computeMask(2 * M_PI * i / headingBins, masks[i]);
+}
+
+size_t FootprintCache::getHeadingBin(double heading) const
+{
+    const double bins = masks.size();
+    double bin = floor(heading / (2 * M_PI) * bins + 0.5);
+    bin = fmod(bin, bins);
+    if (bin < 0)
+        bin += bins;
+    return std::min(static_cast<size_t>(bin), masks.size() - 1);
+}
+
+bool FootprintCache::matchesScale(double scaleX, double scaleY) const
+{
+    return fabs(scaleX - this->scaleX) < 1e-9 && fabs(scaleY - this->scaleY) < 1e-9;
+}
+
+double FootprintCache::getDistanceToRectangle(double x, double y, double sizeX, double sizeY)
+{
+    const double dx = std::max(0.0, fabs(x) - sizeX / 2);
+    const double dy = std::max(0.0, fabs(y) - sizeY / 2);
+    return sqrt(dx * dx + dy * dy);
+}
+
+namespace
+{
+    /** rasterizes the rectangle of size sizeX x sizeY, centered at the
+     * center of the cell (radiusX, radiusY) of a grid of (2 * radiusX + 1)
+     * x (2 * radiusY + 1) cells */
+    bool initRaster(GridBase::RectangleRaster& raster, double heading, double sizeX, double sizeY,
+            double scaleX, double scaleY, int radiusX, int radiusY)
+    {
+        const Eigen::Rotation2D<double> rot(heading);
+        const Eigen::Vector2d corners[4] = {
+            rot * Eigen::Vector2d(sizeX / 2, -sizeY / 2),
+            rot * Eigen::Vector2d(sizeX / 2, sizeY / 2),
+            rot * Eigen::Vector2d(-sizeX / 2, sizeY / 2),
+            rot * Eigen::Vector2d(-sizeX / 2, -sizeY / 2) };
+
+        double cornerX[4], cornerY[4];
+        for (int i = 0; i < 4; ++i)
+        {
+            cornerX[i] = radiusX + 0.5 + corners[i].x() / scaleX;
+            cornerY[i] = radiusY + 0.5 + corners[i].y() / scaleY;
+        }
+        return raster.init(cornerX, cornerY, 2 * radiusX + 1, 2 * radiusY + 1);
+    }
+}
+
+void FootprintCache::computeMask(double heading, Mask& mask) const
+{
+    const double outerSizeX = sizeX + borderWidth;
+    const double outerSizeY = sizeY + borderWidth;
+    const double radius = sqrt(outerSizeX * outerSizeX + outerSizeY * outerSizeY) / 2;
+    const int radiusX = ceil(radius / scaleX) + 1;
+    const int radiusY = ceil(radius / scaleY) + 1;
+
+    GridBase::RectangleRaster inner, outer;
+    if (!initRaster(inner, heading, sizeX, sizeY, scaleX, scaleY, radiusX, radiusY)
+            || !initRaster(outer, heading, outerSizeX, outerSizeY, scaleX, scaleY, radiusX, radiusY))
+        throw std::runtime_error("FootprintCache: internal error, the footprint is not inside of its mask");
+
+    const Eigen::Rotation2D<double> inverse(-heading);
+    mask.minDx = mask.minDy = std::numeric_limits<int>::max();
+    mask.maxDx = mask.maxDy = std::numeric_limits<int>::min();
+
+    size_t x0, x1, inner_x0, inner_x1;
+    for (size_t y = outer.getMinY(); y <= outer.getMaxY(); ++y)
+    {
+        if (!outer.getSpan(y, x0, x1))
+            continue;
+        const int dy = static_cast<int>(y) - radiusY;
+        mask.minDy = std::min(mask.minDy, dy);
+        mask.maxDy = std::max(mask.maxDy, dy);
+        mask.minDx = std::min(mask.minDx, static_cast<int>(x0) - radiusX);
+        mask.maxDx = std::max(mask.maxDx, static_cast<int>(x1) - radiusX);
+
+        // the outer spans are the parts of the outer row that are left and
+        // right of the inner row
+        int outer_spans[2][2] = { { static_cast<int>(x0), static_cast<int>(x1) }, { 1, 0 } };
+        if (inner.getSpan(y, inner_x0, inner_x1))
+        {
+            Span span = { dy, static_cast<int>(inner_x0) - radiusX, static_cast<int>(inner_x1) - radiusX, mask.innerDistances.size() };
+            mask.inner.push_back(span);
+            for (int dx = span.dx0; dx <= span.dx1; ++dx)
+                mask.innerDistances.push_back(sqrt(pow(dx * scaleX, 2) + pow(dy * scaleY, 2)));
+
+            outer_spans[0][1] = static_cast<int>(inner_x0) - 1;
+            outer_spans[1][0] = static_cast<int>(inner_x1) + 1;
+            outer_spans[1][1] = x1;
+        }
+
+        for (int i = 0; i < 2; ++i)
+        {
+            if (outer_spans[i][0] > outer_spans[i][1])
+                continue;
+            Span span = { dy, outer_spans[i][0] - radiusX, outer_spans[i][1] - radiusX, mask.outerDistances.size() };
+            mask.outer.push_back(span);
+            for (int dx = span.dx0; dx <= span.dx1; ++dx)
+            {
+                const Eigen::Vector2d aligned = inverse * Eigen::Vector2d(dx * scaleX, dy * scaleY);
+                mask.outerDistances.push_back(getDistanceToRectangle(aligned.x(), aligned.y(), sizeX, sizeY));
+            }
+        }
+    }
+}
+
+}
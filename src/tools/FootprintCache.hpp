@@ -0,0 +1,110 @@
+#ifndef ENVIRE_FOOTPRINTCACHE_HPP
+#define ENVIRE_FOOTPRINTCACHE_HPP
+
+#include <vector>
+#include <cstddef>
+
+namespace envire
+{
+
+/**
+ * Precomputed cell masks of an oriented rectangular footprint, e.g. of a
+ * robot, for a fixed grid scale.
+ *
+ * The heading is discretized into a number of bins. For each bin, the cells
+ * covered by the footprint are stored as spans of cell offsets relative to
+ * the cell that contains the center of the footprint, together with the
+ * distances that TraversabilityGrid::computeStatistic needs. Looking up the
+ * footprint of a pose is then a matter of picking the mask of its heading
+ * bin and offsetting it to the cell of its position.
+ *
+ * The center of the footprint is assumed to be at the center of its cell,
+ * i.e. the masks are exact for poses at cell centers whose heading is the
+ * center of a bin.
+ *
+ * All masks are computed in the constructor, and the cache is not modified
+ * afterwards. It can therefore be used from multiple threads at once.
+ */
+class FootprintCache
+{
+public:
+    /** default number of heading bins */
+    static const size_t DEFAULT_HEADING_BINS = 64;
+
+    /** The cells [dx0, dx1] of the row dy, as offsets to the center cell.
+     * The distances of these cells start at \c offset in the distance
+     * vector of the mask.
+     */
+    struct Span
+    {
+        int dy;
+        int dx0;
+        int dx1;
+        size_t offset;
+    };
+
+    struct Mask
+    {
+        /** cells covered by the footprint itself */
+        std::vector<Span> inner;
+        /** distance of each inner cell to the center of the footprint */
+        std::vector<float> innerDistances;
+        /** cells covered by the border around the footprint, but not by
+         * the footprint itself */
+        std::vector<Span> outer;
+        /** distance of each outer cell to the footprint */
+        std::vector<float> outerDistances;
+        /** bounding box of all spans */
+        int minDx, maxDx, minDy, maxDy;
+    };
+
+    /**
+     * @param scaleX, scaleY the size of the grid cells
+     * @param sizeX, sizeY the size of the footprint along its own X and Y
+     *        axes
+     * @param borderWidth the amount by which the border enlarges the
+     *        footprint along each of its axes, i.e. half of it is added on
+     *        each side. This is the borderWidth of
+     *        TraversabilityGrid::computeStatistic.
+     * @param headingBins the number of bins over [0, 2 pi[
+     */
+    FootprintCache(double scaleX, double scaleY, double sizeX, double sizeY,
+            double borderWidth = 0, size_t headingBins = DEFAULT_HEADING_BINS);
+
+    double getScaleX() const { return scaleX; }
+    double getScaleY() const { return scaleY; }
+    double getSizeX() const { return sizeX; }
+    double getSizeY() const { return sizeY; }
+    double getBorderWidth() const { return borderWidth; }
+    size_t getHeadingBinCount() const { return masks.size(); }
+
+    /** Returns the bin of the given heading, in radians */
+    size_t getHeadingBin(double heading) const;
+
+    /** Returns the mask of the heading bin closest to \c heading */
+    const Mask& getMask(double heading) const { return masks[getHeadingBin(heading)]; }
+
+    /** Returns true if the masks have been computed for cells of the given
+     * size
+     */
+    bool matchesScale(double scaleX, double scaleY) const;
+
+    /** Distance of the point (x, y) to the rectangle of size sizeX x sizeY
+     * centered at the origin and aligned with the axes. It is zero inside
+     * of the rectangle.
+     */
+    static double getDistanceToRectangle(double x, double y, double sizeX, double sizeY);
+
+private:
+    void computeMask(double heading, Mask& mask) const;
+
+    double scaleX;
+    double scaleY;
+    double sizeX;
+    double sizeY;
+    double borderWidth;
+    std::vector<Mask> masks;
+};
+
+}
+#endif // ENVIRE_FOOTPRINTCACHE_HPP
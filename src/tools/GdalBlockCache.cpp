@@ -0,0 +1,167 @@
+#include "GdalBlockCache.hpp"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <cstring>
+
+namespace envire {
+
+const size_t GdalBlockCache::DEFAULT_MAX_CACHE_SIZE;
+
+GdalBlockCache::GdalBlockCache(const std::string& path, size_t max_cache_size)
+    : path(path), dataset(0), max_cache_size(max_cache_size),
+    cache_size(0), block_reads(0)
+{
+    GDALAllRegister();
+    dataset = (GDALDataset *) GDALOpen(path.c_str(), GA_ReadOnly);
+    if (dataset == NULL)
+        throw std::runtime_error("GdalBlockCache: can not open file " + path);
+}
+
+GdalBlockCache::~GdalBlockCache()
+{
+    GDALClose((GDALDatasetH) dataset);
+}
+
+int GdalBlockCache::getRasterSizeX() const
+{
+    return dataset->GetRasterXSize();
+}
+
+int GdalBlockCache::getRasterSizeY() const
+{
+    return dataset->GetRasterYSize();
+}
+
+int GdalBlockCache::getRasterCount() const
+{
+    return dataset->GetRasterCount();
+}
+
+GDALRasterBand* GdalBlockCache::getBand(int band) const
+{
+    GDALRasterBand* poBand = 0;
+    if (band >= 1 && band <= dataset->GetRasterCount())
+        poBand = dataset->GetRasterBand(band);
+    if (!poBand)
+    {
+        std::stringstream strstr;
+        strstr << "GdalBlockCache: file " << path << " has " << dataset->GetRasterCount()
+            << " raster bands but the band " << band << " is required";
+        throw std::runtime_error(strstr.str());
+    }
+    return poBand;
+}
+
+GDALDataType GdalBlockCache::getRasterDataType(int band) const
+{
+    return getBand(band)->GetRasterDataType();
+}
+
+bool GdalBlockCache::getNoData(int band, double& value) const
+{
+    int has_nodata = 0;
+    value = getBand(band)->GetNoDataValue(&has_nodata);
+    return has_nodata;
+}
+
+bool GdalBlockCache::getGeoTransform(double* transform) const
+{
+    return dataset->GetGeoTransform(transform) != CE_Failure;
+}
+
+const GdalBlockCache::Block& GdalBlockCache::getBlock(const BlockKey& key)
+{
+    BlockMap::iterator it = blocks.find(key);
+    if (it != blocks.end())
+    {
+        lru.splice(lru.begin(), lru, it->second.lru_position);
+        return it->second;
+    }
+
+    GDALRasterBand* poBand = getBand(key.band);
+    int block_x, block_y;
+    poBand->GetBlockSize(&block_x, &block_y);
+
+    const int x0 = key.x * block_x;
+    const int y0 = key.y * block_y;
+    const int pixel_size = GDALGetDataTypeSize(key.type) / 8;
+
+    Block block;
+    block.width = std::min(block_x, dataset->GetRasterXSize() - x0);
+    block.height = std::min(block_y, dataset->GetRasterYSize() - y0);
+    block.data.resize(block.width * block.height * pixel_size);
+
+    if (poBand->RasterIO(GF_Read, x0, y0, block.width, block.height,
+                &block.data[0], block.width, block.height, key.type, 0, 0) == CE_Failure)
+        throw std::runtime_error("GdalBlockCache: failed to read from " + path);
+    block_reads++;
+
+    cache_size += block.data.size();
+    Block& result = blocks.insert(std::make_pair(key, Block())).first->second;
+    result.width = block.width;
+    result.height = block.height;
+    result.data.swap(block.data);
+    lru.push_front(key);
+    result.lru_position = lru.begin();
+    evict();
+    return result;
+}
+
+void GdalBlockCache::evict()
+{
+    // blocks are only evicted between reads, the block that has just been
+    // read is the most recently used one and therefore never dropped
+    while (cache_size > max_cache_size && blocks.size() > 1)
+    {
+        BlockMap::iterator oldest = blocks.find(lru.back());
+        cache_size -= oldest->second.data.size();
+        blocks.erase(oldest);
+        lru.pop_back();
+    }
+}
+
+void GdalBlockCache::read(int band, int x0, int y0, int width, int height,
+        GDALDataType data_type, void* dst, long line_space)
+{
+    if (x0 < 0 || y0 < 0 || x0 + width > dataset->GetRasterXSize() || y0 + height > dataset->GetRasterYSize())
+        throw std::runtime_error("GdalBlockCache: requested window is outside of the raster");
+    if (width <= 0 || height <= 0)
+        return;
+
+    int block_x, block_y;
+    getBand(band)->GetBlockSize(&block_x, &block_y);
+    const int pixel_size = GDALGetDataTypeSize(data_type) / 8;
+
+    BlockKey key;
+    key.band = band;
+    key.type = data_type;
+    for (key.y = y0 / block_y; key.y <= (y0 + height - 1) / block_y; ++key.y)
+    {
+        for (key.x = x0 / block_x; key.x <= (x0 + width - 1) / block_x; ++key.x)
+        {
+            const Block& block = getBlock(key);
+
+            // intersection of the block and the window in raster coordinates
+            const int bx0 = key.x * block_x, by0 = key.y * block_y;
+            const int ix0 = std::max(x0, bx0), ix1 = std::min(x0 + width, bx0 + block.width);
+            const int iy0 = std::max(y0, by0), iy1 = std::min(y0 + height, by0 + block.height);
+
+            for (int y = iy0; y < iy1; ++y)
+            {
+                const char* src = &block.data[((y - by0) * block.width + (ix0 - bx0)) * pixel_size];
+                char* target = static_cast<char*>(dst) + (y - y0) * line_space + (ix0 - x0) * pixel_size;
+                memcpy(target, src, (ix1 - ix0) * pixel_size);
+            }
+        }
+    }
+}
+
+void GdalBlockCache::clear()
+{
+    blocks.clear();
+    lru.clear();
+    cache_size = 0;
+}
+
+}
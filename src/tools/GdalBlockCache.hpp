@@ -0,0 +1,128 @@
+#ifndef ENVIRE_GDALBLOCKCACHE_HPP
+#define ENVIRE_GDALBLOCKCACHE_HPP
+
+#include <gdal/gdal_priv.h>
+#include <boost/noncopyable.hpp>
+#include <map>
+#include <list>
+#include <vector>
+#include <string>
+
+namespace envire
+{
+
+/**
+ * Read access to a GDAL raster file, which keeps the blocks that have been
+ * read in memory.
+ *
+ * Windows are read block by block, with RasterIO calls that are aligned to
+ * the natural block size of the file. When the requested window moves, only
+ * the blocks which are not cached yet are read from the file. The least
+ * recently used blocks are dropped once the cache exceeds its size limit.
+ *
+ * All coordinates are raster coordinates of the file, i.e. column and row
+ * indexes.
+ */
+class GdalBlockCache : boost::noncopyable
+{
+public:
+    static const size_t DEFAULT_MAX_CACHE_SIZE = 256 * 1024 * 1024;
+
+    /** Opens the file at \c path
+     *
+     * @param max_cache_size maximum number of bytes of block data that is kept
+     * @throw std::runtime_error if the file can not be opened
+     */
+    explicit GdalBlockCache(const std::string& path, size_t max_cache_size = DEFAULT_MAX_CACHE_SIZE);
+    ~GdalBlockCache();
+
+    const std::string& getPath() const { return path; }
+
+    int getRasterSizeX() const;
+    int getRasterSizeY() const;
+    int getRasterCount() const;
+    GDALDataType getRasterDataType(int band) const;
+
+    /** @return true if the given band has a nodata value, which is then
+     * written into \c value
+     */
+    bool getNoData(int band, double& value) const;
+
+    /** Writes the geotransform of the file into the 6 element array \c
+     * transform
+     *
+     * @return false if the file has no geotransform information
+     */
+    bool getGeoTransform(double* transform) const;
+
+    /** Reads the window [x0, x0 + width[ x [y0, y0 + height[ of the given
+     * band, converted to the type \c data_type.
+     *
+     * The value of the cell (x, y) of the window is written to
+     *
+     * <code>
+     * dst + y * line_space + x * GDALGetDataTypeSize(data_type) / 8
+     * </code>
+     *
+     * line_space is in bytes and can be negative, which allows to read the
+     * rows in reverse order.
+     */
+    void read(int band, int x0, int y0, int width, int height,
+            GDALDataType data_type, void* dst, long line_space);
+
+    /** Drops all cached blocks */
+    void clear();
+
+    /** @return the number of bytes that are currently cached */
+    size_t getCacheSize() const { return cache_size; }
+
+    /** @return the number of blocks that have been read from the file
+     * since the creation of this object
+     */
+    size_t getBlockReadCount() const { return block_reads; }
+
+private:
+    struct BlockKey
+    {
+        int band;
+        int x, y;
+        GDALDataType type;
+
+        bool operator<(const BlockKey& other) const
+        {
+            if (band != other.band) return band < other.band;
+            if (type != other.type) return type < other.type;
+            if (y != other.y) return y < other.y;
+            return x < other.x;
+        }
+    };
+
+    typedef std::list<BlockKey> LruList;
+
+    struct Block
+    {
+        int width, height;
+        /** position of the block in lru */
+        LruList::iterator lru_position;
+        std::vector<char> data;
+    };
+
+    typedef std::map<BlockKey, Block> BlockMap;
+
+    GDALRasterBand* getBand(int band) const;
+    const Block& getBlock(const BlockKey& key);
+    void evict();
+
+    std::string path;
+    GDALDataset* dataset;
+    BlockMap blocks;
+    /** the keys of the cached blocks, from the most to the least recently
+     * used one */
+    LruList lru;
+    size_t max_cache_size;
+    size_t cache_size;
+    size_t block_reads;
+};
+
+}
+#endif // ENVIRE_GDALBLOCKCACHE_HPP
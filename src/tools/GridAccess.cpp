@@ -5,7 +5,7 @@
 #include "maps/MLSGrid.hpp"
 #include <Eigen/LU>
 
-#include<kdtree++/kdtree.hpp>
+#include <envire/tools/PointcloudIndex.hpp>
 
 using namespace envire;
 
@@ -18,7 +18,7 @@ struct GridAccess::GridAccessImpl
     std::vector<ElevationGrid*> grids;
 
     ElevationGrid* grid;
-    ElevationGrid::ArrayType* gridData;
+    const ElevationGrid::ArrayType* gridData;
     Transform t;
     double z_offset;
 
@@ -61,7 +61,7 @@ struct GridAccess::GridAccessImpl
 			lgrid->getFrameNode() );
 
 	    grid = lgrid;
-	    gridData = &grid->getGridData(ElevationGrid::ELEVATION);
+	    gridData = &static_cast<const ElevationGrid*>(grid)->getGridData(ElevationGrid::ELEVATION);
 	    t = lt;
 	    z_offset = t.inverse(Eigen::Isometry)(2,3);
 
@@ -90,65 +90,113 @@ struct PointcloudAccess::PointcloudAccessImpl
 {
     Environment* env;
 
-    struct TreeNode
-    {
-	typedef double value_type;
-
-	TreeNode(const Eigen::Vector3d& point) : point(point) {};
-	Eigen::Vector3d point;
+    typedef Eigen::Transform<double,3,Eigen::Affine,Eigen::DontAlign> CloudTransform;
 
-	inline value_type operator[](size_t n) const
-	{
-	    return point[n];
-	}
+    /** a pointcloud and its transforms. The spatial index is not stored,
+     * as the pointcloud replaces it once its vertices changed, but taken
+     * from the pointcloud on every query, see getIndex(). */
+    struct Cloud
+    {
+	Pointcloud* pc;
+	CloudTransform toWorld, toCloud;
     };
 
-    typedef KDTree::KDTree<2, TreeNode> tree_type;
-
-    tree_type kdtree;
+    std::vector<Cloud> clouds;
 
     PointcloudAccessImpl(Environment* env) 
 	: env(env)
     {
-	fillTree(env);
-	std::cout << "kdtree inserted points: " << kdtree.size() << std::endl;
+	size_t pointCount = 0;
+	std::vector<Pointcloud*> pcs = env->getItems<Pointcloud>();
+	for(std::vector<Pointcloud*>::iterator it=pcs.begin();it!=pcs.end();it++)
+	{
+	    addCloud( *it );
+	    pointCount += getIndex( clouds.back() ).getPointCount();
+	}
+	std::cout << "pointcloud index points: " << pointCount << std::endl;
     };
 
-    void fillTree(Environment* env)
+    static Eigen::AlignedBox<double,3> transformBox(const CloudTransform& t, const Eigen::AlignedBox<double,3>& box)
     {
-	std::vector<Pointcloud*> pcs = env->getItems<Pointcloud>();
-	for(std::vector<Pointcloud*>::iterator it=pcs.begin();it!=pcs.end();it++)
+	Eigen::AlignedBox<double,3> result;
+	if( box.isEmpty() )
+	    return result;
+	for(int i=0;i<8;i++)
 	{
-	    fillTree( *it );
+	    Eigen::Vector3d corner( 
+		    (i & 1) ? box.max().x() : box.min().x(),
+		    (i & 2) ? box.max().y() : box.min().y(),
+		    (i & 4) ? box.max().z() : box.min().z() );
+	    result.extend( t * corner );
 	}
-	kdtree.optimize();
+	return result;
     }
 
-    void fillTree(Pointcloud* pc)
+    void addCloud(Pointcloud* pc)
     {
+	Cloud cloud;
+	cloud.pc = pc;
+
 	Transform t =
 	    env->relativeTransform( 
 		    pc->getFrameNode(),
 		    env->getRootNode() );
+	cloud.toWorld = CloudTransform( t.matrix() );
+	cloud.toCloud = cloud.toWorld.inverse();
+	clouds.push_back( cloud );
+    }
+
+    /** @return the spatial index of the current vertices of the cloud,
+     * which is shared with all other users of the pointcloud */
+    static const PointcloudIndex& getIndex(const Cloud& cloud)
+    {
+	return cloud.pc->getSpatialIndex();
+    }
 
-	for(std::vector<Eigen::Vector3d>::iterator it=pc->vertices.begin();it!=pc->vertices.end();it++)
+    /** @return the bounding box of all clouds, in world coordinates */
+    Eigen::AlignedBox<double,3> getBounds()
+    {
+	Eigen::AlignedBox<double,3> bounds;
+	for(std::vector<Cloud>::iterator it=clouds.begin();it!=clouds.end();it++)
 	{
-	    kdtree.insert( TreeNode(t * (*it)) );
+	    Eigen::AlignedBox<double,3> cloudBounds( transformBox( it->toWorld, getIndex( *it ).getBounds() ) );
+	    if( !cloudBounds.isEmpty() )
+		bounds.extend( cloudBounds );
 	}
+	return bounds;
     }
 
-    bool getElevation(Eigen::Vector3d& position, double xythresh, double zpos, double zthresh  )
+    /** appends the points of all clouds inside the given box, in world
+     * coordinates */
+    void findInBox(const Eigen::AlignedBox<double,3>& box, std::vector<Eigen::Vector3d>& points)
     {
-	std::vector<TreeNode> nodes;
+	std::vector<size_t> indices;
+	for(std::vector<Cloud>::iterator it=clouds.begin();it!=clouds.end();it++)
+	{
+	    indices.clear();
+	    getIndex( *it ).findInBox( transformBox( it->toCloud, box ), indices );
+	    for(size_t i=0;i<indices.size();i++)
+	    {
+		const Eigen::Vector3d p = it->toWorld * it->pc->getVertex( indices[i] );
+		if( box.contains( p ) )
+		    points.push_back( p );
+	    }
+	}
+    }
 
-	kdtree.find_within_range( TreeNode( position ), xythresh, std::back_insert_iterator<std::vector<TreeNode> >(nodes) );
-	for(std::vector<TreeNode>::iterator it=nodes.begin();it!=nodes.end();it++)
+    bool getElevation(Eigen::Vector3d& position, double xythresh, double zpos, double zthresh  )
+    {
+	Eigen::AlignedBox<double,3> box( 
+		Eigen::Vector3d( position.x() - xythresh, position.y() - xythresh, zpos - zthresh ),
+		Eigen::Vector3d( position.x() + xythresh, position.y() + xythresh, zpos + zthresh ) );
+	std::vector<Eigen::Vector3d> points;
+	findInBox( box, points );
+	for(std::vector<Eigen::Vector3d>::iterator it=points.begin();it!=points.end();it++)
 	{
-	    TreeNode &node(*it);
-	    if( abs(node.point.z() - zpos) < zthresh )
+	    if( fabs(it->z() - zpos) < zthresh )
 	    {
-		// for now return the first node found in range
-		position = node.point;
+		// for now return the first point found in range
+		position = *it;
 
 		return true;
 	    }
@@ -159,18 +207,29 @@ struct PointcloudAccess::PointcloudAccessImpl
 
     bool getElevation(Eigen::Vector3d& position, double threshold )
     {
-	std::pair<tree_type::const_iterator,double> found 
-	    = kdtree.find_nearest( TreeNode( position ), threshold );
-
-	if( found.first != kdtree.end() )
-	{
-	    position.z() = (found.first)->point.z();
-	    return true;
-	}
-	else 
-	{
+	// the nearest point in the xy plane, at any elevation
+	const Eigen::AlignedBox<double,3> bounds( getBounds() );
+	if( bounds.isEmpty() )
 	    return false;
+	Eigen::AlignedBox<double,3> box( 
+		Eigen::Vector3d( position.x() - threshold, position.y() - threshold, bounds.min().z() ),
+		Eigen::Vector3d( position.x() + threshold, position.y() + threshold, bounds.max().z() ) );
+	std::vector<Eigen::Vector3d> points;
+	findInBox( box, points );
+
+	bool found = false;
+	double best = threshold * threshold;
+	for(std::vector<Eigen::Vector3d>::iterator it=points.begin();it!=points.end();it++)
+	{
+	    const double dist = (it->head<2>() - position.head<2>()).squaredNorm();
+	    if( dist <= best )
+	    {
+		best = dist;
+		position.z() = it->z();
+		found = true;
+	    }
 	}
+	return found;
     }
 };
 
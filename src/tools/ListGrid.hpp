@@ -77,8 +77,9 @@ public:
     }
 
     ListGrid( const ListGrid<C>& other )
+	: mem_pool( NULL )
     {
-	// use the assignment operator
+	// use the assignment operator, whose clear() creates the pool
 	this->operator=( other );
     }
 
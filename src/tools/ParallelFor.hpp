@@ -0,0 +1,86 @@
+#ifndef ENVIRE_PARALLELFOR_HPP
+#define ENVIRE_PARALLELFOR_HPP
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/ref.hpp>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace envire
+{
+
+/** @return the number of threads that parallelFor() uses by default, which
+ * is the number of hardware threads of the machine
+ */
+inline size_t getDefaultThreadCount()
+{
+    const size_t count = boost::thread::hardware_concurrency();
+    return count ? count : 1;
+}
+
+namespace detail
+{
+    template <class F>
+    void runParallelForRange(F const& f, size_t first, size_t last, std::string* error)
+    {
+        // exceptions can not leave a thread, they are passed back to
+        // parallelFor() instead
+        try { f(first, last); }
+        catch (std::exception const& e) { *error = e.what(); }
+        catch (...) { *error = "unknown exception"; }
+    }
+}
+
+/** Splits the range [begin, end[ into contiguous chunks, and calls f(first,
+ * last) for each of the chunks [first, last[ in a separate thread.
+ *
+ * The call returns once all chunks have been processed. f must be safe to
+ * call concurrently for different chunks. The last chunk is processed in the
+ * calling thread.
+ *
+ * @param threads the number of threads to use, 0 for
+ *        getDefaultThreadCount()
+ * @param min_chunk_size the minimum number of elements per chunk. Ranges
+ *        that are smaller than twice this size are processed without
+ *        starting any thread.
+ * @throw std::runtime_error if f threw in one of the threads
+ */
+template <class F>
+void parallelFor(size_t begin, size_t end, F const& f, size_t threads = 0, size_t min_chunk_size = 1)
+{
+    if (end <= begin)
+        return;
+    if (threads == 0)
+        threads = getDefaultThreadCount();
+
+    const size_t size = end - begin;
+    const size_t chunks = std::max<size_t>(1, std::min(threads, size / std::max<size_t>(min_chunk_size, 1)));
+    if (chunks == 1)
+    {
+        f(begin, end);
+        return;
+    }
+
+    std::vector<std::string> errors(chunks);
+    boost::thread_group group;
+    for (size_t i = 0; i < chunks; ++i)
+    {
+        const size_t first = begin + size * i / chunks;
+        const size_t last = begin + size * (i + 1) / chunks;
+        if (i + 1 < chunks)
+            group.create_thread(boost::bind(&detail::runParallelForRange<F>, boost::cref(f), first, last, &errors[i]));
+        else
+            detail::runParallelForRange(f, first, last, &errors[i]);
+    }
+    group.join_all();
+
+    for (size_t i = 0; i < chunks; ++i)
+        if (!errors[i].empty())
+            throw std::runtime_error(errors[i]);
+}
+
+}
+#endif // ENVIRE_PARALLELFOR_HPP
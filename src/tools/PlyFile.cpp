@@ -1,5 +1,7 @@
 #include "PlyFile.hpp"
 #include <fstream>
+#include <sstream>
+#include <cstring>
 #include <tr1/functional>
 
 using namespace envire;
@@ -13,15 +15,14 @@ void PlyFile::scalar_property_callback(ScalarType scalar)
 template <typename ScalarType>
 void PlyFile::vector_property_callback(ScalarType scalar, std::vector<Eigen::Vector3d> *list, size_t idx, bool scale)
 {
-    static Eigen::Vector3d vector;
     if( scale )
-	vector[idx] = scalar/255.0;
+	vector_[idx] = scalar/255.0;
     else
-	vector[idx] = scalar;
+	vector_[idx] = scalar;
 
     if( idx == 2 )
     {
-	list->push_back( vector );
+	list->push_back( vector_ );
     }
 }
 
@@ -65,16 +66,13 @@ std::tr1::function<void (ScalarType)> PlyFile::scalar_property_definition_callba
     return std::tr1::bind(&PlyFile::scalar_property_callback<ScalarType>, this, _1);
 }
 
-int triangle_idx__;
-TriMesh::triangle_t triangle__;
-
 template <typename SizeType, typename ScalarType>
 void PlyFile::list_property_begin_callback(SizeType size)
 {
     if( size != 3 )
 	std::cerr << "no support for faces with edgecount different to 3 (is " << (int)size << ")." << std::endl;
 
-    triangle_idx__ = 0;
+    triangle_idx_ = 0;
 }
 
 template <typename SizeType, typename ScalarType>
@@ -83,21 +81,21 @@ void PlyFile::list_property_element_callback(ScalarType scalar)
     if( static_cast<size_t>(scalar) >= pco_->vertices.size() )
 	std::cerr << "vertex_index " << scalar << " is out of range!" << std::endl;
 
-    switch( triangle_idx__ )
+    switch( triangle_idx_ )
     {
-	case(0): triangle__.get<0>() = scalar; break;
-	case(1): triangle__.get<1>() = scalar; break;
-	case(2): triangle__.get<2>() = scalar; break;
+	case(0): triangle_.get<0>() = scalar; break;
+	case(1): triangle_.get<1>() = scalar; break;
+	case(2): triangle_.get<2>() = scalar; break;
 	default: break;
     }
 
-    triangle_idx__++;
+    triangle_idx_++;
 }
 
 template <typename SizeType, typename ScalarType>
 void PlyFile::list_property_end_callback()
 {
-    tmo_->faces.push_back( triangle__ );
+    tmo_->faces.push_back( triangle_ );
 }
 
 template <typename DummyType>
@@ -166,15 +164,112 @@ bool PlyFile::end_header_callback()
 }
 
 PlyFile::PlyFile( const std::string& filename )
-    : filename_( filename ), pco_(NULL), tmo_(NULL)
+    : filename_( filename ), pco_(NULL), tmo_(NULL), triangle_idx_(0)
 {
 }
 
+namespace
+{
+    /** number of elements which are converted and written at once */
+    const size_t WRITE_CHUNK = 16384;
+
+    /** buffers the output of the elements, to write them in blocks */
+    template <typename ScalarType>
+    class BlockWriter
+    {
+	std::ostream& data;
+	std::vector<ScalarType> buffer;
+
+    public:
+	BlockWriter(std::ostream& data, size_t size)
+	    : data(data) { buffer.reserve(size); }
+	~BlockWriter() { flush(); }
+
+	void push_back(ScalarType value)
+	{
+	    buffer.push_back(value);
+	    if( buffer.size() == buffer.capacity() )
+		flush();
+	}
+
+	void flush()
+	{
+	    if( !buffer.empty() )
+		data.write( reinterpret_cast<const char*>(&buffer[0]), buffer.size() * sizeof(ScalarType) );
+	    buffer.clear();
+	}
+    };
+
+    template <typename ScalarType>
+    void writeVectors(std::ostream& data, const std::vector<Eigen::Vector3d>& vectors)
+    {
+	BlockWriter<ScalarType> writer( data, 3 * WRITE_CHUNK );
+	for(size_t i = 0; i < vectors.size(); ++i)
+	{
+	    writer.push_back( vectors[i].x() );
+	    writer.push_back( vectors[i].y() );
+	    writer.push_back( vectors[i].z() );
+	}
+    }
+
+    template <typename ScalarType>
+    void writeColumns(std::ostream& data, const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& z)
+    {
+	BlockWriter<ScalarType> writer( data, 3 * WRITE_CHUNK );
+	for(size_t i = 0; i < x.size(); ++i)
+	{
+	    writer.push_back( x[i] );
+	    writer.push_back( y[i] );
+	    writer.push_back( z[i] );
+	}
+    }
+
+    /** writes the vertex, normal and color elements of a pointcloud whose
+     * storage is Pointcloud::FLOAT_COLUMNS */
+    void writeColumns(std::ostream& data, const PointColumns& columns, bool doublePrecision)
+    {
+	if( doublePrecision )
+	    writeColumns<double>( data, columns.x, columns.y, columns.z );
+	else
+	    writeColumns<float>( data, columns.x, columns.y, columns.z );
+
+	if( columns.hasAttribute( PointColumns::NORMAL ) )
+	{
+	    if( doublePrecision )
+		writeColumns<double>( data, columns.normal_x, columns.normal_y, columns.normal_z );
+	    else
+		writeColumns<float>( data, columns.normal_x, columns.normal_y, columns.normal_z );
+	}
+
+	if( columns.hasAttribute( PointColumns::COLOR ) )
+	{
+	    BlockWriter<unsigned char> writer( data, 3 * WRITE_CHUNK );
+	    for(size_t i=0;i<columns.size();i++)
+	    {
+		writer.push_back( columns.red[i] );
+		writer.push_back( columns.green[i] );
+		writer.push_back( columns.blue[i] );
+	    }
+	}
+    }
+}
+
 bool PlyFile::serialize(Pointcloud *pointcloud, std::ostream& data , bool const doublePrecision /* = true */)
 {
     const std::string version = "1.0";
     const std::string precision = doublePrecision ? "double" : "float";
 
+    // the vertices are either in the double precision vertices and the
+    // VERTEX_* data, or in the columns
+    const bool columns = pointcloud->getStorage() == Pointcloud::FLOAT_COLUMNS;
+    const size_t vertexCount = pointcloud->getVertexCount();
+    const bool hasNormals = columns ?
+	pointcloud->columns.hasAttribute( PointColumns::NORMAL ) :
+	pointcloud->hasData( Pointcloud::VERTEX_NORMAL );
+    const bool hasColors = columns ?
+	pointcloud->columns.hasAttribute( PointColumns::COLOR ) :
+	pointcloud->hasData( Pointcloud::VERTEX_COLOR );
+
     data << "ply" << "\n";
     data << "format ";
     if( ply::host_byte_order == ply::little_endian_byte_order )
@@ -188,22 +283,22 @@ bool PlyFile::serialize(Pointcloud *pointcloud, std::ostream& data , bool const
     data << " " << version << "\n";
     data << "comment generated by envire" << "\n";
 
-    data << "element vertex " << pointcloud->vertices.size() <<  "\n";
+    data << "element vertex " << vertexCount <<  "\n";
     data << "property " << precision << " x\n";
     data << "property " << precision << " y\n";
     data << "property " << precision << " z\n";
 
-    if( pointcloud->hasData( Pointcloud::VERTEX_NORMAL ) )
+    if( hasNormals )
     {
-	data << "element normal " << pointcloud->vertices.size() <<  "\n";
+	data << "element normal " << vertexCount <<  "\n";
 	data << "property " << precision << " x\n";
 	data << "property " << precision << " y\n";
 	data << "property " << precision << " z\n";
     }
 
-    if( pointcloud->hasData( Pointcloud::VERTEX_COLOR ) )
+    if( hasColors )
     {
-	data << "element color " << pointcloud->vertices.size() <<  "\n";
+	data << "element color " << vertexCount <<  "\n";
 	data << "property uchar red\n";
 	data << "property uchar green\n";
 	data << "property uchar blue\n";
@@ -220,93 +315,474 @@ bool PlyFile::serialize(Pointcloud *pointcloud, std::ostream& data , bool const
     data << "end_header\n";
 
     // write the binary raw data now
-    if(doublePrecision)
-    {
-      for(size_t i=0;i<pointcloud->vertices.size();i++)
-      {
-        Eigen::Vector3d &vertex( pointcloud->vertices[i] );
-        data.write( reinterpret_cast<char*>(&vertex.x()), sizeof(double) );
-        data.write( reinterpret_cast<char*>(&vertex.y()), sizeof(double) );
-        data.write( reinterpret_cast<char*>(&vertex.z()), sizeof(double) );
-      }
+    if(columns)
+    {
+	writeColumns( data, pointcloud->columns, doublePrecision );
     }
     else
     {
-      size_t const vSize = pointcloud->vertices.size();
-      for(size_t i = 0; i != vSize; ++i)
-      {
-        Eigen::Vector3d const &vertex( pointcloud->vertices[i] );
-        float tmp = static_cast<float>(vertex.x());
-        data.write( reinterpret_cast<char*>(&tmp), sizeof(float) );
-        tmp = static_cast<float>(vertex.y());
-        data.write( reinterpret_cast<char*>(&tmp), sizeof(float) );
-        tmp = static_cast<float>(vertex.z());
-        data.write( reinterpret_cast<char*>(&tmp), sizeof(float) );
-      }
+	if(doublePrecision)
+	    writeVectors<double>( data, pointcloud->vertices );
+	else
+	    writeVectors<float>( data, pointcloud->vertices );
+
+	if( hasNormals )
+	{
+	    std::vector<Eigen::Vector3d> &normals( pointcloud->getVertexData<Eigen::Vector3d>( Pointcloud::VERTEX_NORMAL ) );
+	    if( normals.size() != pointcloud->vertices.size() )
+		throw std::runtime_error("number of normals don't match number of vertices.");
+	    if(doublePrecision)
+		writeVectors<double>( data, normals );
+	    else
+		writeVectors<float>( data, normals );
+	}
+
+	if( hasColors )
+	{
+	    std::vector<Eigen::Vector3d> &colors( pointcloud->getVertexData<Eigen::Vector3d>( Pointcloud::VERTEX_COLOR ) );
+	    if( colors.size() != pointcloud->vertices.size() )
+		throw std::runtime_error("number of colors don't match number of vertices.");
+
+	    BlockWriter<unsigned char> writer( data, 3 * WRITE_CHUNK );
+	    for(size_t i=0;i<colors.size();i++)
+	    {
+		writer.push_back( colors[i].x()*255 );
+		writer.push_back( colors[i].y()*255 );
+		writer.push_back( colors[i].z()*255 );
+	    }
+	}
     }
 
-    if( pointcloud->hasData( Pointcloud::VERTEX_NORMAL ) )
-    {
-	std::vector<Eigen::Vector3d> &normals( pointcloud->getVertexData<Eigen::Vector3d>( Pointcloud::VERTEX_NORMAL ) );
-	if( normals.size() != pointcloud->vertices.size() )
-	    throw std::runtime_error("number of normals don't match number of vertices.");
-        if(doublePrecision)
-        {
-          for(size_t i=0;i<normals.size();i++)
-          {
-            Eigen::Vector3d &normal( normals[i] );
-            data.write( reinterpret_cast<char*>(&normal.x()), sizeof(double) );
-            data.write( reinterpret_cast<char*>(&normal.y()), sizeof(double) );
-            data.write( reinterpret_cast<char*>(&normal.z()), sizeof(double) );
-          }
-        }
-        else
-        {
-          size_t const nSize = normals.size();
-          for(size_t i = 0; i != nSize; ++i)
-          {
-            Eigen::Vector3d const &normal( normals[i] );
-            float tmp = static_cast<float>(normal.x());
-            data.write( reinterpret_cast<char*>(&tmp), sizeof(float) );
-            tmp = static_cast<float>(normal.y());
-            data.write( reinterpret_cast<char*>(&tmp), sizeof(float) );
-            tmp = static_cast<float>(normal.z());
-            data.write( reinterpret_cast<char*>(&tmp), sizeof(float) );
-          }
-        }
+    if( trimesh && !trimesh->faces.empty() )
+    {
+	// a face is the count as uchar followed by three int32 indices
+	const size_t faceSize = sizeof(unsigned char) + 3 * sizeof(int32_t);
+	BlockWriter<char> writer( data, faceSize * WRITE_CHUNK );
+	for(size_t i=0;i<trimesh->faces.size();i++)
+	{
+	    TriMesh::triangle_t &tri( trimesh->faces[i] );
+	    const int32_t indices[3] = { tri.get<0>(), tri.get<1>(), tri.get<2>() };
+	    const char* bytes = reinterpret_cast<const char*>(indices);
+	    writer.push_back( 3 );
+	    for(size_t j=0;j<sizeof(indices);j++)
+		writer.push_back( bytes[j] );
+	}
     }
 
-    if( pointcloud->hasData( Pointcloud::VERTEX_COLOR ) )
+    return true;
+}
+
+namespace
+{
+    enum ScalarType
+    {
+	INVALID_TYPE, INT8, UINT8, INT16, UINT16, INT32, UINT32, FLOAT32, FLOAT64
+    };
+
+    ScalarType parseScalarType(const std::string& name)
     {
-	std::vector<Eigen::Vector3d> &colors( pointcloud->getVertexData<Eigen::Vector3d>( Pointcloud::VERTEX_COLOR ) );
-	if( colors.size() != pointcloud->vertices.size() )
-	    throw std::runtime_error("number of colors don't match number of vertices.");
+	if( name == "char" || name == "int8" ) return INT8;
+	if( name == "uchar" || name == "uint8" ) return UINT8;
+	if( name == "short" || name == "int16" ) return INT16;
+	if( name == "ushort" || name == "uint16" ) return UINT16;
+	if( name == "int" || name == "int32" ) return INT32;
+	if( name == "uint" || name == "uint32" ) return UINT32;
+	if( name == "float" || name == "float32" ) return FLOAT32;
+	if( name == "double" || name == "float64" ) return FLOAT64;
+	return INVALID_TYPE;
+    }
 
-	for(size_t i=0;i<colors.size();i++)
+    size_t getScalarSize(ScalarType type)
+    {
+	switch( type )
 	{
-	    unsigned char r = colors[i].x()*255; 
-	    unsigned char g = colors[i].y()*255; 
-	    unsigned char b = colors[i].z()*255; 
-	    data.write( reinterpret_cast<char*>(&r), sizeof(unsigned char) );
-	    data.write( reinterpret_cast<char*>(&g), sizeof(unsigned char) );
-	    data.write( reinterpret_cast<char*>(&b), sizeof(unsigned char) );
+	    case INT8: case UINT8: return 1;
+	    case INT16: case UINT16: return 2;
+	    case INT32: case UINT32: case FLOAT32: return 4;
+	    case FLOAT64: return 8;
+	    default: return 0;
 	}
     }
 
-    if( trimesh )
+    struct PlyProperty
     {
-	for(size_t i=0;i<trimesh->faces.size();i++)
+	std::string name;
+	ScalarType type;
+	/** type of the element count for list properties, INVALID_TYPE for
+	 * scalar properties */
+	ScalarType countType;
+	/** offset of the property in its element, for elements without list
+	 * properties */
+	size_t offset;
+    };
+
+    struct PlyElement
+    {
+	std::string name;
+	size_t count;
+	std::vector<PlyProperty> properties;
+	/** size of an element, or zero if it has list properties */
+	size_t size;
+
+	/** @return the property with the given name, or NULL */
+	const PlyProperty* getProperty(const std::string& name) const
 	{
-	    unsigned char trinum = 3;
-	    TriMesh::triangle_t &tri( trimesh->faces[i] );
-	    int32_t e1 = tri.get<0>();
-	    int32_t e2 = tri.get<1>();
-	    int32_t e3 = tri.get<2>();
-	    data.write( reinterpret_cast<char*>(&trinum), sizeof(unsigned char) );
-	    data.write( reinterpret_cast<char*>(&e1), sizeof( int32_t ) );
-	    data.write( reinterpret_cast<char*>(&e2), sizeof( int32_t ) );
-	    data.write( reinterpret_cast<char*>(&e3), sizeof( int32_t ) );
+	    for( size_t i = 0; i < properties.size(); i++ )
+		if( properties[i].name == name )
+		    return &properties[i];
+	    return NULL;
+	}
+    };
+
+    /** parses the header of a binary PLY file in the byte order of this host
+     *
+     * @return false if it is not such a file, or if it uses types unknown
+     *         to the binary reader
+     */
+    bool parseBinaryHeader(std::istream& data, std::vector<PlyElement>& elements)
+    {
+	const std::string format = (ply::host_byte_order == ply::little_endian_byte_order) ?
+	    "binary_little_endian" : "binary_big_endian";
+
+	std::string line;
+	if( !std::getline( data, line ) || line.compare( 0, 3, "ply" ) != 0 )
+	    return false;
+
+	bool hasFormat = false;
+	while( std::getline( data, line ) )
+	{
+	    std::istringstream tokens( line );
+	    std::string keyword;
+	    tokens >> keyword;
+	    if( keyword == "format" )
+	    {
+		std::string name, version;
+		tokens >> name >> version;
+		if( name != format || version != "1.0" )
+		    return false;
+		hasFormat = true;
+	    }
+	    else if( keyword == "element" )
+	    {
+		PlyElement element;
+		if( !(tokens >> element.name >> element.count) )
+		    return false;
+		element.size = 0;
+		elements.push_back( element );
+	    }
+	    else if( keyword == "property" )
+	    {
+		if( elements.empty() )
+		    return false;
+		PlyElement& element( elements.back() );
+		PlyProperty property;
+		std::string type;
+		tokens >> type;
+		if( type == "list" )
+		{
+		    std::string countType;
+		    tokens >> countType >> type;
+		    property.countType = parseScalarType( countType );
+		    if( property.countType == INVALID_TYPE || property.countType == FLOAT32 || property.countType == FLOAT64 )
+			return false;
+		}
+		else
+		    property.countType = INVALID_TYPE;
+		property.type = parseScalarType( type );
+		if( property.type == INVALID_TYPE || !(tokens >> property.name) )
+		    return false;
+		property.offset = element.size;
+		element.properties.push_back( property );
+	    }
+	    else if( keyword == "end_header" )
+		break;
+	    else if( keyword != "comment" && keyword != "obj_info" )
+		return false;
+	}
+	if( !hasFormat || !data )
+	    return false;
+
+	for( size_t i = 0; i < elements.size(); i++ )
+	{
+	    PlyElement& element( elements[i] );
+	    for( size_t j = 0; j < element.properties.size(); j++ )
+	    {
+		const PlyProperty& property( element.properties[j] );
+		if( property.countType != INVALID_TYPE )
+		{
+		    element.size = 0;
+		    break;
+		}
+		element.size = property.offset + getScalarSize( property.type );
+		if( j + 1 < element.properties.size() )
+		    element.properties[j + 1].offset = element.size;
+	    }
 	}
+	return true;
+    }
+
+    /** reads a stream in large blocks, and hands out contiguous byte ranges
+     * of it */
+    class BlockReader
+    {
+	std::istream& data;
+	std::string filename;
+	std::vector<char> buffer;
+	size_t begin;
+	size_t end;
+
+    public:
+	BlockReader(std::istream& data, const std::string& filename, size_t size = 1 << 20)
+	    : data(data), filename(filename), buffer(size), begin(0), end(0) {}
+
+	/** @return the next n bytes, which stay valid until the next call
+	 * @throw std::runtime_error if the stream ends before */
+	const char* take(size_t n)
+	{
+	    if( end - begin < n )
+		fill( n );
+	    const char* bytes = &buffer[begin];
+	    begin += n;
+	    return bytes;
+	}
+
+	template <typename T>
+	T read()
+	{
+	    T value;
+	    std::memcpy( &value, take( sizeof(T) ), sizeof(T) );
+	    return value;
+	}
+
+	/** @return the number of elements of the given size which can be
+	 * taken at once without growing the buffer */
+	size_t getBlockCount(size_t elementSize) const
+	{
+	    return std::max<size_t>( 1, buffer.size() / elementSize );
+	}
+
+    private:
+	void fill(size_t n)
+	{
+	    std::copy( buffer.begin() + begin, buffer.begin() + end, buffer.begin() );
+	    end -= begin;
+	    begin = 0;
+	    if( buffer.size() < n )
+		buffer.resize( n );
+	    data.read( &buffer[end], buffer.size() - end );
+	    end += data.gcount();
+	    if( end < n )
+		throw std::runtime_error("could not parse ply file " + filename + ": unexpected end of file");
+	}
+    };
+
+    template <typename SourceType, typename TargetType>
+    void convertProperty(const char* elements, size_t elementSize, size_t count, TargetType* target, size_t targetStride, double divisor)
+    {
+	for( size_t i = 0; i < count; i++ )
+	{
+	    SourceType value;
+	    std::memcpy( &value, elements + i * elementSize, sizeof(SourceType) );
+	    target[i * targetStride] = value / divisor;
+	}
+    }
+
+    /** converts the property at the given offset of \c count elements to
+     * target[0], target[targetStride], ... */
+    template <typename TargetType>
+    void convertProperty(ScalarType type, const char* elements, size_t elementSize, size_t count, TargetType* target, size_t targetStride, double divisor = 1)
+    {
+	switch( type )
+	{
+	    case INT8: convertProperty<int8_t>( elements, elementSize, count, target, targetStride, divisor ); break;
+	    case UINT8: convertProperty<uint8_t>( elements, elementSize, count, target, targetStride, divisor ); break;
+	    case INT16: convertProperty<int16_t>( elements, elementSize, count, target, targetStride, divisor ); break;
+	    case UINT16: convertProperty<uint16_t>( elements, elementSize, count, target, targetStride, divisor ); break;
+	    case INT32: convertProperty<int32_t>( elements, elementSize, count, target, targetStride, divisor ); break;
+	    case UINT32: convertProperty<uint32_t>( elements, elementSize, count, target, targetStride, divisor ); break;
+	    case FLOAT32: convertProperty<float>( elements, elementSize, count, target, targetStride, divisor ); break;
+	    case FLOAT64: convertProperty<double>( elements, elementSize, count, target, targetStride, divisor ); break;
+	    default: throw std::logic_error("PlyFile: invalid scalar type");
+	}
+    }
+
+    int64_t readInteger(BlockReader& reader, ScalarType type)
+    {
+	switch( type )
+	{
+	    case INT8: return reader.read<int8_t>();
+	    case UINT8: return reader.read<uint8_t>();
+	    case INT16: return reader.read<int16_t>();
+	    case UINT16: return reader.read<uint16_t>();
+	    case INT32: return reader.read<int32_t>();
+	    case UINT32: return reader.read<uint32_t>();
+	    case FLOAT32: return reader.read<float>();
+	    case FLOAT64: return reader.read<double>();
+	    default: throw std::logic_error("PlyFile: invalid scalar type");
+	}
+    }
+
+    /** the target of the three properties of a vertex, normal or color
+     * element */
+    template <typename TargetType>
+    struct VectorTarget
+    {
+	TargetType* target[3];
+	/** distance between the values of two successive elements */
+	size_t stride;
+	double divisor;
+    };
+
+    template <typename TargetType>
+    void readVectors(BlockReader& reader, const PlyElement& element, const char* names[3], VectorTarget<TargetType> target)
+    {
+	const PlyProperty* properties[3];
+	for( int i = 0; i < 3; i++ )
+	    properties[i] = element.getProperty( names[i] );
+
+	const size_t block = reader.getBlockCount( element.size );
+	for( size_t first = 0; first < element.count; first += block )
+	{
+	    const size_t count = std::min( block, element.count - first );
+	    const char* elements = reader.take( count * element.size );
+	    for( int i = 0; i < 3; i++ )
+	    {
+		if( properties[i] )
+		    convertProperty( properties[i]->type, elements + properties[i]->offset, element.size, count,
+			    target.target[i] + first * target.stride, target.stride, target.divisor );
+	    }
+	}
+    }
+
+    /** skips an element with list properties */
+    void skipElements(BlockReader& reader, const PlyElement& element)
+    {
+	for( size_t i = 0; i < element.count; i++ )
+	{
+	    for( size_t j = 0; j < element.properties.size(); j++ )
+	    {
+		const PlyProperty& property( element.properties[j] );
+		size_t count = 1;
+		if( property.countType != INVALID_TYPE )
+		    count = readInteger( reader, property.countType );
+		reader.take( count * getScalarSize( property.type ) );
+	    }
+	}
+    }
+}
+
+bool PlyFile::unserializeBinary( std::istream& data )
+{
+    std::vector<PlyElement> elements;
+    if( !parseBinaryHeader( data, elements ) )
+	return false;
+
+    // check that all known elements have the layout that is supported
+    // here, before anything is read
+    const char* xyz[3] = { "x", "y", "z" };
+    const char* rgb[3] = { "red", "green", "blue" };
+    const bool columns = pco_->getStorage() == Pointcloud::FLOAT_COLUMNS;
+    size_t vertexCount = 0;
+    for( size_t i = 0; i < elements.size(); i++ )
+    {
+	const PlyElement& element( elements[i] );
+	if( element.name == "vertex" )
+	{
+	    if( !element.size || vertexCount )
+		return false;
+	    vertexCount = element.count;
+	}
+	else if( element.name == "normal" || element.name == "color" )
+	{
+	    // the columns need one normal and color per vertex
+	    if( !element.size || (columns && element.count != vertexCount) )
+		return false;
+	}
+	else if( element.name == "face" && tmo_ )
+	{
+	    if( element.properties.size() != 1 || element.properties[0].name != "vertex_index"
+		    || element.properties[0].countType == INVALID_TYPE
+		    || element.properties[0].type == FLOAT32 || element.properties[0].type == FLOAT64 )
+		return false;
+	}
+    }
+
+    BlockReader reader( data, filename_ );
+    const size_t firstVertex = pco_->getVertexCount();
+    for( size_t i = 0; i < elements.size(); i++ )
+    {
+	const PlyElement& element( elements[i] );
+	if( element.name == "vertex" || element.name == "normal" || element.name == "color" )
+	{
+	    const bool color = element.name == "color";
+	    if( columns )
+	    {
+		PointColumns& pc( pco_->columns );
+		if( !element.count )
+		    continue;
+		if( element.name == "vertex" )
+		{
+		    pc.resize( firstVertex + element.count );
+		    VectorTarget<float> target = { { &pc.x[firstVertex], &pc.y[firstVertex], &pc.z[firstVertex] }, 1, 1 };
+		    readVectors( reader, element, xyz, target );
+		}
+		else if( color )
+		{
+		    pc.addAttribute( PointColumns::COLOR );
+		    VectorTarget<uint8_t> target = { { &pc.red[firstVertex], &pc.green[firstVertex], &pc.blue[firstVertex] }, 1, 1 };
+		    readVectors( reader, element, rgb, target );
+		}
+		else
+		{
+		    pc.addAttribute( PointColumns::NORMAL );
+		    VectorTarget<float> target = { { &pc.normal_x[firstVertex], &pc.normal_y[firstVertex], &pc.normal_z[firstVertex] }, 1, 1 };
+		    readVectors( reader, element, xyz, target );
+		}
+	    }
+	    else
+	    {
+		std::vector<Eigen::Vector3d>& vectors( element.name == "vertex" ? pco_->vertices :
+			pco_->getVertexData<Eigen::Vector3d>( color ? Pointcloud::VERTEX_COLOR : Pointcloud::VERTEX_NORMAL ) );
+		const size_t first = vectors.size();
+		vectors.resize( first + element.count, Eigen::Vector3d::Zero() );
+		if( element.count )
+		{
+		    VectorTarget<double> target = { { &vectors[first].x(), &vectors[first].y(), &vectors[first].z() }, 3, color ? 255.0 : 1.0 };
+		    readVectors( reader, element, color ? rgb : xyz, target );
+		}
+	    }
+	}
+	else if( element.name == "face" && tmo_ )
+	{
+	    const PlyProperty& property( element.properties[0] );
+	    tmo_->faces.reserve( tmo_->faces.size() + element.count );
+	    for( size_t j = 0; j < element.count; j++ )
+	    {
+		const int64_t count = readInteger( reader, property.countType );
+		if( count != 3 )
+		    std::cerr << "no support for faces with edgecount different to 3 (is " << count << ")." << std::endl;
+
+		int indices[3] = { 0, 0, 0 };
+		for( int64_t k = 0; k < count; k++ )
+		{
+		    const int64_t index = readInteger( reader, property.type );
+		    if( index < 0 || static_cast<size_t>(index) >= pco_->getVertexCount() )
+			std::cerr << "vertex_index " << index << " is out of range!" << std::endl;
+		    if( k < 3 )
+			indices[k] = index;
+		}
+		tmo_->faces.push_back( TriMesh::triangle_t( indices[0], indices[1], indices[2] ) );
+	    }
+	}
+	else if( element.size )
+	{
+	    // unknown element, skipped in blocks
+	    const size_t block = reader.getBlockCount( element.size );
+	    for( size_t first = 0; first < element.count; first += block )
+		reader.take( std::min( block, element.count - first ) * element.size );
+	}
+	else
+	    skipElements( reader, element );
     }
 
     return true;
@@ -316,6 +792,22 @@ bool PlyFile::unserialize( Pointcloud *pointcloud , std::istream& data )
 {
     pco_ = pointcloud;
     tmo_ = dynamic_cast<TriMesh*>(pointcloud);
+
+    // binary files in the byte order of this host are read in blocks if
+    // their layout is known, the others through the libply callbacks. The
+    // stream has to be rewound for the latter.
+    const std::streampos start = data.tellg();
+    if( start != std::streampos(-1) )
+    {
+	if( unserializeBinary( data ) )
+	    return true;
+	data.clear();
+	data.seekg( start );
+    }
+
+    // the callbacks append to the double precision vertices
+    const Pointcloud::Storage storage = pointcloud->getStorage();
+    pointcloud->setStorage( Pointcloud::DOUBLE_VERTICES );
     
     ply::ply_parser::flags_type ply_parser_flags = 0;
     ply::ply_parser ply_parser(ply_parser_flags);
@@ -379,6 +871,7 @@ bool PlyFile::unserialize( Pointcloud *pointcloud , std::istream& data )
 
     ply_parser.parse(data);
 
+    pointcloud->setStorage( storage );
     return true;
 }
 
@@ -19,13 +19,28 @@ namespace envire
 	 */
 	bool serialize(Pointcloud *pointcloud, std::ostream& os , bool const doublePrecision = true);
 
-	/** similar to serialize this will also work for derived classes */
+	/** similar to serialize this will also work for derived classes
+	 *
+	 * Binary files in the byte order of the host, whose vertex, normal,
+	 * color and face elements have the layouts written by serialize(),
+	 * are read in blocks. Other files are parsed through libply, which
+	 * requires \c is to be seekable.
+	 */
 	bool unserialize( Pointcloud *pointcloud, std::istream& is );
 
     private:
 	std::string filename_;
 	Pointcloud* pco_;
 	TriMesh* tmo_;
+	/** state of the libply callbacks */
+	Eigen::Vector3d vector_;
+	int triangle_idx_;
+	TriMesh::triangle_t triangle_;
+
+	/** the block reader of unserialize()
+	 * @return false if the file is not supported by it. \c is has been
+	 *         read from in that case. */
+	bool unserializeBinary( std::istream& is );
 
     private:
 	void info_callback(const std::string& filename, std::size_t line_number, const std::string& message);
@@ -0,0 +1,452 @@
+#include "PointcloudIndex.hpp"
+#include <envire/maps/Pointcloud.hpp>
+#include <envire/tools/ParallelFor.hpp>
+
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+
+namespace envire {
+
+const size_t PointcloudIndex::DEFAULT_POINTS_PER_CELL;
+
+namespace
+{
+    const char INDEX_MAGIC[] = "envire_pointcloud_index";
+    const boost::uint32_t INDEX_VERSION = 1;
+
+    inline size_t hashKey(boost::uint64_t key, int bits)
+    {
+        return bits ? static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> (64 - bits)) : 0;
+    }
+
+    struct CopyPoints
+    {
+        const Pointcloud& pc;
+        const std::vector<boost::uint32_t>& indices;
+        const Eigen::Vector3d origin;
+        std::vector<Eigen::Vector3f>& points;
+
+        CopyPoints(const Pointcloud& pc, const std::vector<boost::uint32_t>& indices, const Eigen::Vector3d& origin, std::vector<Eigen::Vector3f>& points)
+            : pc(pc), indices(indices), origin(origin), points(points) {}
+
+        void operator()(size_t first, size_t last) const
+        {
+            // the difference is taken in double precision, so that only
+            // the small offsets are rounded
+            for (size_t i = first; i < last; i++)
+                points[i] = (pc.getVertex(indices[i]) - origin).cast<float>();
+        }
+    };
+
+    template <class T>
+    void writeValue(std::ostream& os, const T& value)
+    {
+        os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <class T>
+    bool readValue(std::istream& is, T& value)
+    {
+        return !is.read(reinterpret_cast<char*>(&value), sizeof(T)).fail();
+    }
+
+    template <class T>
+    void writeVector(std::ostream& os, const std::vector<T>& data)
+    {
+        writeValue<boost::uint64_t>(os, data.size());
+        if (!data.empty())
+            os.write(reinterpret_cast<const char*>(&data[0]), data.size() * sizeof(T));
+    }
+
+    template <class T>
+    bool readVector(std::istream& is, std::vector<T>& data, boost::uint64_t maxSize)
+    {
+        boost::uint64_t size;
+        if (!readValue(is, size) || size > maxSize)
+            return false;
+        data.resize(size);
+        return size == 0 || !is.read(reinterpret_cast<char*>(&data[0]), size * sizeof(T)).fail();
+    }
+}
+
+PointcloudIndex::PointcloudIndex()
+    : origin(Eigen::Vector3d::Zero()), tableBits(0), vertexCount(0), storage(-1), modificationCount(0)
+{
+}
+
+void PointcloudIndex::clear()
+{
+    bounds.setEmpty();
+    voxelKeys = VoxelKeys();
+    cellKeys.clear();
+    cellStarts.clear();
+    indices.clear();
+    points.clear();
+    origin.setZero();
+    table.clear();
+    tableBits = 0;
+    vertexCount = 0;
+    storage = -1;
+    modificationCount = 0;
+}
+
+double PointcloudIndex::getDefaultCellSize(const Eigen::AlignedBox<double,3>& bounds, size_t count)
+{
+    if (bounds.isEmpty() || count == 0)
+        return 1.0;
+
+    // a surface with count vertices covers about count / points per cell
+    // cells, which are spread along the two largest extents
+    const double extent = (bounds.max() - bounds.min()).maxCoeff();
+    const double cells = std::sqrt(std::max(1.0, static_cast<double>(count) / DEFAULT_POINTS_PER_CELL));
+    return extent > 0 ? extent / cells : 1.0;
+}
+
+void PointcloudIndex::build(const Pointcloud& pc, double cellSize, size_t threads)
+{
+    clear();
+
+    bounds = computeFiniteBounds(pc, threads);
+    if (cellSize == 0)
+        cellSize = getDefaultCellSize(bounds, pc.getVertexCount());
+    voxelKeys.init(bounds, cellSize);
+
+    std::vector<boost::uint64_t> keys;
+    std::vector<boost::uint32_t> order;
+    computeVoxelKeys(pc, voxelKeys, keys, order, threads);
+    radixSort(keys, order, voxelKeys.getBits() + 1, threads);
+
+    // the cells are the runs of equal keys, the vertices which are not
+    // finite are at the end and are not indexed
+    const size_t valid = std::lower_bound(keys.begin(), keys.end(), voxelKeys.getInvalidKey()) - keys.begin();
+    for (size_t i = 0; i < valid; i++)
+    {
+        if (i == 0 || keys[i] != keys[i - 1])
+        {
+            cellKeys.push_back(keys[i]);
+            cellStarts.push_back(i);
+        }
+    }
+    cellStarts.push_back(valid);
+
+    order.resize(valid);
+    indices.swap(order);
+    copyPoints(pc, threads);
+    buildTable();
+
+    vertexCount = pc.getVertexCount();
+    storage = pc.getStorage();
+    modificationCount = pc.getModificationCount();
+}
+
+void PointcloudIndex::copyPoints(const Pointcloud& pc, size_t threads)
+{
+    origin = bounds.isEmpty() ? Eigen::Vector3d::Zero() : bounds.min();
+    points.resize(indices.size());
+    parallelFor(0, indices.size(), CopyPoints(pc, indices, origin, points), threads, 1 << 16);
+}
+
+void PointcloudIndex::buildTable()
+{
+    // at most half of the entries are used
+    tableBits = 1;
+    while ((static_cast<size_t>(1) << tableBits) < 2 * cellKeys.size())
+        tableBits++;
+
+    const size_t mask = (static_cast<size_t>(1) << tableBits) - 1;
+    table.assign(mask + 1, 0);
+    for (size_t i = 0; i < cellKeys.size(); i++)
+    {
+        size_t entry = hashKey(cellKeys[i], tableBits);
+        while (table[entry])
+            entry = (entry + 1) & mask;
+        table[entry] = i + 1;
+    }
+}
+
+size_t PointcloudIndex::findCell(boost::uint64_t key) const
+{
+    if (table.empty())
+        return cellKeys.size();
+
+    const size_t mask = table.size() - 1;
+    for (size_t entry = hashKey(key, tableBits); table[entry]; entry = (entry + 1) & mask)
+    {
+        if (cellKeys[table[entry] - 1] == key)
+            return table[entry] - 1;
+    }
+    return cellKeys.size();
+}
+
+bool PointcloudIndex::isUpToDate(const Pointcloud& pc) const
+{
+    return storage == pc.getStorage()
+        && vertexCount == pc.getVertexCount()
+        && modificationCount == pc.getModificationCount();
+}
+
+template <class F>
+void PointcloudIndex::visitBox(const Eigen::AlignedBox<double,3>& box, F& f) const
+{
+    if (points.empty() || box.isEmpty())
+        return;
+
+    boost::int64_t first[3], last[3];
+    double cells = 1;
+    for (int d = 0; d < 3; d++)
+    {
+        first[d] = std::max<boost::int64_t>(0, voxelKeys.getIndex(box.min(), d));
+        last[d] = std::min(voxelKeys.getMaxIndex(d), voxelKeys.getIndex(box.max(), d));
+        if (first[d] > last[d])
+            return;
+        cells *= last[d] - first[d] + 1;
+    }
+
+    // for large boxes, visiting all vertices is faster than looking up
+    // all cells
+    if (cells > cellKeys.size())
+    {
+        for (size_t i = 0; i < points.size(); i++)
+            f(i);
+        return;
+    }
+
+    for (boost::int64_t x = first[0]; x <= last[0]; x++)
+        for (boost::int64_t y = first[1]; y <= last[1]; y++)
+            for (boost::int64_t z = first[2]; z <= last[2]; z++)
+            {
+                const size_t cell = findCell(voxelKeys.getKey(x, y, z));
+                if (cell == cellKeys.size())
+                    continue;
+                for (size_t i = cellStarts[cell]; i < cellStarts[cell + 1]; i++)
+                    f(i);
+            }
+}
+
+namespace
+{
+    struct CollectInBox
+    {
+        const std::vector<Eigen::Vector3f>& points;
+        const std::vector<boost::uint32_t>& indices;
+        Eigen::Vector3f min, max;
+        std::vector<size_t>& result;
+
+        CollectInBox(const std::vector<Eigen::Vector3f>& points, const std::vector<boost::uint32_t>& indices,
+                const Eigen::Vector3f& min, const Eigen::Vector3f& max, std::vector<size_t>& result)
+            : points(points), indices(indices), min(min), max(max), result(result) {}
+
+        void operator()(size_t i)
+        {
+            if ((points[i].array() >= min.array()).all() && (points[i].array() <= max.array()).all())
+                result.push_back(indices[i]);
+        }
+    };
+
+    struct CollectInRadius
+    {
+        const std::vector<Eigen::Vector3f>& points;
+        const std::vector<boost::uint32_t>& indices;
+        Eigen::Vector3f center;
+        float radiusSquared;
+        std::vector<size_t>& result;
+
+        CollectInRadius(const std::vector<Eigen::Vector3f>& points, const std::vector<boost::uint32_t>& indices,
+                const Eigen::Vector3f& center, double radius, std::vector<size_t>& result)
+            : points(points), indices(indices), center(center), radiusSquared(radius * radius), result(result) {}
+
+        void operator()(size_t i)
+        {
+            if ((points[i] - center).squaredNorm() <= radiusSquared)
+                result.push_back(indices[i]);
+        }
+    };
+
+    struct FindNearest
+    {
+        const std::vector<Eigen::Vector3f>& points;
+        Eigen::Vector3f center;
+        float bestSquared;
+        size_t best;
+
+        FindNearest(const std::vector<Eigen::Vector3f>& points, const Eigen::Vector3f& center, double maxDistance)
+            : points(points), center(center), bestSquared(maxDistance * maxDistance), best(points.size()) {}
+
+        void operator()(size_t i)
+        {
+            const float squared = (points[i] - center).squaredNorm();
+            if (squared <= bestSquared)
+            {
+                bestSquared = squared;
+                best = i;
+            }
+        }
+    };
+}
+
+void PointcloudIndex::findInBox(const Eigen::AlignedBox<double,3>& box, std::vector<size_t>& result) const
+{
+    if (box.isEmpty())
+        return;
+    CollectInBox collect(points, indices, toLocal(box.min()), toLocal(box.max()), result);
+    visitBox(box, collect);
+}
+
+void PointcloudIndex::findWithinRadius(const Eigen::Vector3d& p, double radius, std::vector<size_t>& result) const
+{
+    const Eigen::Vector3d r(Eigen::Vector3d::Constant(radius));
+    CollectInRadius collect(points, indices, toLocal(p), radius, result);
+    visitBox(Eigen::AlignedBox<double,3>(p - r, p + r), collect);
+}
+
+bool PointcloudIndex::findNearest(const Eigen::Vector3d& p, double maxDistance, size_t& index, double& distance) const
+{
+    if (points.empty() || !isFinite(p))
+        return false;
+
+    // the cells are searched in growing shells around the cell of p. The
+    // vertices beyond shell k are at least k cells away from p, so the
+    // search stops once the nearest vertex found so far is closer than
+    // that. If the shells get large, the remaining box is searched at once.
+    FindNearest nearest(points, toLocal(p), maxDistance);
+    const double cellSize = voxelKeys.getCellSize();
+    boost::int64_t center[3], shells = 0;
+    for (int d = 0; d < 3; d++)
+    {
+        center[d] = std::max<boost::int64_t>(0, std::min(voxelKeys.getIndex(p, d), voxelKeys.getMaxIndex(d)));
+        shells = std::max(shells, std::max(center[d], voxelKeys.getMaxIndex(d) - center[d]));
+    }
+    if (maxDistance / cellSize < shells)
+        shells = static_cast<boost::int64_t>(std::ceil(maxDistance / cellSize));
+
+    size_t visited = 0;
+    for (boost::int64_t k = 0; k <= shells; k++)
+    {
+        if (visited > cellKeys.size())
+        {
+            const Eigen::Vector3d r(Eigen::Vector3d::Constant(std::sqrt(nearest.bestSquared)));
+            visitBox(Eigen::AlignedBox<double,3>(p - r, p + r), nearest);
+            break;
+        }
+
+        const boost::int64_t x0 = std::max<boost::int64_t>(0, center[0] - k), x1 = std::min(voxelKeys.getMaxIndex(0), center[0] + k);
+        const boost::int64_t y0 = std::max<boost::int64_t>(0, center[1] - k), y1 = std::min(voxelKeys.getMaxIndex(1), center[1] + k);
+        for (boost::int64_t x = x0; x <= x1; x++)
+            for (boost::int64_t y = y0; y <= y1; y++)
+            {
+                // inside the shell, only the cells at its front and back
+                // along z belong to it
+                const bool side = std::abs(x - center[0]) == k || std::abs(y - center[1]) == k;
+                const boost::int64_t step = (side || k == 0) ? 1 : 2 * k;
+                for (boost::int64_t z = center[2] - k; z <= center[2] + k; z += step)
+                {
+                    if (z < 0 || z > voxelKeys.getMaxIndex(2))
+                        continue;
+                    visited++;
+                    const size_t cell = findCell(voxelKeys.getKey(x, y, z));
+                    if (cell == cellKeys.size())
+                        continue;
+                    for (size_t i = cellStarts[cell]; i < cellStarts[cell + 1]; i++)
+                        nearest(i);
+                }
+            }
+
+        if (nearest.best < points.size() && std::sqrt(nearest.bestSquared) <= k * cellSize)
+            break;
+    }
+
+    if (nearest.best == points.size())
+        return false;
+    index = indices[nearest.best];
+    distance = std::sqrt(nearest.bestSquared);
+    return true;
+}
+
+void PointcloudIndex::write(std::ostream& os) const
+{
+    os.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    writeValue(os, INDEX_VERSION);
+    writeValue<boost::uint64_t>(os, vertexCount);
+    writeValue<boost::int32_t>(os, storage);
+    writeValue(os, getCellSize());
+    writeValue<boost::uint8_t>(os, bounds.isEmpty());
+    for (int d = 0; d < 3; d++)
+    {
+        writeValue(os, bounds.min()[d]);
+        writeValue(os, bounds.max()[d]);
+    }
+    writeVector(os, cellKeys);
+    writeVector(os, cellStarts);
+    writeVector(os, indices);
+}
+
+bool PointcloudIndex::read(std::istream& is, const Pointcloud& pc)
+{
+    clear();
+
+    char magic[sizeof(INDEX_MAGIC)];
+    boost::uint32_t version;
+    boost::uint64_t count;
+    boost::int32_t stored;
+    double cellSize;
+    boost::uint8_t empty;
+    if (!is.read(magic, sizeof(magic)) || std::memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0
+            || !readValue(is, version) || version != INDEX_VERSION
+            || !readValue(is, count) || count != pc.getVertexCount()
+            || !readValue(is, stored) || stored != pc.getStorage()
+            || !readValue(is, cellSize) || !(cellSize > 0) || !readValue(is, empty))
+        return false;
+
+    Eigen::Vector3d min, max;
+    for (int d = 0; d < 3; d++)
+    {
+        if (!readValue(is, min[d]) || !readValue(is, max[d]))
+            return false;
+    }
+    if (!empty)
+        bounds = Eigen::AlignedBox<double,3>(min, max);
+
+    if (!readVector(is, cellKeys, count) || !readVector(is, cellStarts, count + 1)
+            || !readVector(is, indices, count) || cellStarts.size() != cellKeys.size() + 1
+            || cellStarts.back() != indices.size())
+    {
+        clear();
+        return false;
+    }
+    // the queries use the cell starts as ranges of indices without
+    // further checks
+    if (cellStarts.front() != 0)
+    {
+        clear();
+        return false;
+    }
+    for (size_t i = 1; i < cellStarts.size(); i++)
+    {
+        if (cellStarts[i] < cellStarts[i - 1] || cellStarts[i] > indices.size())
+        {
+            clear();
+            return false;
+        }
+    }
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        if (indices[i] >= count)
+        {
+            clear();
+            return false;
+        }
+    }
+
+    voxelKeys.init(bounds, cellSize);
+    copyPoints(pc, 0);
+    buildTable();
+
+    vertexCount = count;
+    storage = stored;
+    modificationCount = pc.getModificationCount();
+    return true;
+}
+
+}
@@ -0,0 +1,132 @@
+#ifndef ENVIRE_POINTCLOUDINDEX_HPP
+#define ENVIRE_POINTCLOUDINDEX_HPP
+
+#include <envire/tools/VoxelSort.hpp>
+#include <iosfwd>
+
+namespace envire
+{
+
+/**
+ * Spatial index of the vertices of a Pointcloud, for neighbourhood queries.
+ *
+ * The vertices are sorted into the cells of a regular voxel grid, see
+ * VoxelKeys. The occupied cells are found through an open addressing hash
+ * table, and the vertices of a cell are stored contiguously, together with
+ * a single precision copy of their position. Queries therefore only touch
+ * the cells around the query, and do not access the pointcloud itself.
+ * Distances are computed in single precision, relative to the minimum of
+ * the bounds, so that the precision does not depend on how far the
+ * vertices are from the origin of the pointcloud (e.g. for georeferenced
+ * clouds).
+ *
+ * Use Pointcloud::getSpatialIndex() rather than building an index
+ * directly. It stores the index as data of the pointcloud, so that all
+ * consumers share it, and rebuilds it once the vertices changed.
+ *
+ * The index is not modified by the queries, which can be run from several
+ * threads at once.
+ */
+class PointcloudIndex
+{
+public:
+    /** the average number of vertices per occupied cell that
+     * getDefaultCellSize() aims for, assuming that the vertices sample a
+     * surface */
+    static const size_t DEFAULT_POINTS_PER_CELL = 8;
+
+    PointcloudIndex();
+
+    /** Builds the index of the finite vertices of pc, in either storage.
+     *
+     * @param cellSize the edge length of the cells, 0 for
+     *        getDefaultCellSize()
+     * @param threads the number of threads, 0 for getDefaultThreadCount()
+     * @throw std::runtime_error if the cell size is too small for the
+     *        extents of pc
+     */
+    void build(const Pointcloud& pc, double cellSize = 0, size_t threads = 0);
+
+    /** @return a cell size for count vertices within bounds */
+    static double getDefaultCellSize(const Eigen::AlignedBox<double,3>& bounds, size_t count);
+
+    /** @return true if the index was built for the current vertices of pc,
+     * i.e. neither the number of vertices, nor the storage, nor the
+     * modification count of pc have changed since */
+    bool isUpToDate(const Pointcloud& pc) const;
+
+    double getCellSize() const { return voxelKeys.getCellSize(); }
+    /** @return the bounding box of the indexed vertices */
+    const Eigen::AlignedBox<double,3>& getBounds() const { return bounds; }
+    /** @return the number of indexed vertices, which does not include the
+     * vertices that are not finite */
+    size_t getPointCount() const { return indices.size(); }
+    size_t getCellCount() const { return cellKeys.size(); }
+
+    /** Appends the indices of the vertices within the given distance of p
+     * to result */
+    void findWithinRadius(const Eigen::Vector3d& p, double radius, std::vector<size_t>& result) const;
+
+    /** Appends the indices of the vertices inside box to result */
+    void findInBox(const Eigen::AlignedBox<double,3>& box, std::vector<size_t>& result) const;
+
+    /** Finds the vertex that is closest to p, and at most maxDistance
+     * away from it.
+     *
+     * @return false if there is no such vertex
+     */
+    bool findNearest(const Eigen::Vector3d& p, double maxDistance, size_t& index, double& distance) const;
+
+    /** Writes the index in a binary format. The positions of the vertices
+     * are not written, read() takes them from the pointcloud. */
+    void write(std::ostream& os) const;
+
+    /** Reads an index that write() has written for pc.
+     *
+     * @return false if the stream does not hold an index of the current
+     *         vertices of pc, in which case the index is empty
+     */
+    bool read(std::istream& is, const Pointcloud& pc);
+
+private:
+    /** @return the cell with the given key, or getCellCount() if it is not
+     * occupied */
+    size_t findCell(boost::uint64_t key) const;
+    void buildTable();
+    /** calls f(i) for the sorted vertices i in the cells that box
+     * overlaps */
+    template <class F>
+    void visitBox(const Eigen::AlignedBox<double,3>& box, F& f) const;
+    /** copies the positions of the indexed vertices from pc */
+    void copyPoints(const Pointcloud& pc, size_t threads);
+    /** @return p relative to origin, in single precision */
+    Eigen::Vector3f toLocal(const Eigen::Vector3d& p) const { return (p - origin).cast<float>(); }
+    void clear();
+
+    Eigen::AlignedBox<double,3> bounds;
+    VoxelKeys voxelKeys;
+    /** the keys of the occupied cells, sorted */
+    std::vector<boost::uint64_t> cellKeys;
+    /** the vertices of cell i are [cellStarts[i], cellStarts[i+1]) in
+     * indices and points */
+    std::vector<boost::uint32_t> cellStarts;
+    /** the indexed vertices, sorted by cell */
+    std::vector<boost::uint32_t> indices;
+    /** the positions of the indexed vertices relative to origin */
+    std::vector<Eigen::Vector3f> points;
+    /** the minimum of the bounds, or zero if they are empty */
+    Eigen::Vector3d origin;
+    /** hash table of the cells, with linear probing. An entry is the cell
+     * index plus one, or zero if the entry is empty. */
+    std::vector<boost::uint32_t> table;
+    int tableBits;
+
+    /** the state of the pointcloud the index was built for */
+    size_t vertexCount;
+    int storage;
+    unsigned long modificationCount;
+};
+
+}
+
+#endif
@@ -0,0 +1,375 @@
+#ifndef ENVIRE_TOOLS_TILEDARRAY_HPP__
+#define ENVIRE_TOOLS_TILEDARRAY_HPP__
+
+#include <algorithm>
+#include <vector>
+#include <stdexcept>
+#include <boost/multi_array.hpp>
+#include <boost/iterator/iterator_facade.hpp>
+
+namespace envire
+{
+
+/**
+ * Two dimensional array, which is split into square tiles that are only
+ * allocated once a cell inside them is written to.
+ *
+ * Cells of tiles that have not been allocated return the nodata value of the
+ * array. This makes it possible to keep very large, sparsely populated bands
+ * in memory. The tiles can be iterated over, so that algorithms only need to
+ * process the part of the array that actually holds data.
+ *
+ * Tiles always have the full tile size internally, the ones at the border of
+ * the array are only partially used. The cell (x, y) of the array is at
+ *
+ * <code>
+ * tile(x / tileSize, y / tileSize)[(y % tileSize) * tileSize + x % tileSize]
+ * </code>
+ */
+template <class T>
+class TiledArray
+{
+public:
+    static const size_t DEFAULT_TILE_SIZE = 256;
+
+    /** View of a single allocated tile of the array
+     *
+     * The cell coordinates given to operator() are relative to the tile.
+     * width and height are the number of cells of the tile that are inside
+     * the array.
+     */
+    template <class TV>
+    struct TileBase
+    {
+	size_t tileX, tileY;
+	size_t x0, y0;
+	size_t width, height;
+	size_t stride;
+	TV* data;
+
+	TileBase()
+	    : tileX(0), tileY(0), x0(0), y0(0), width(0), height(0), stride(0), data(NULL) {}
+
+	TV& operator()( size_t x, size_t y ) const
+	{
+	    return data[y * stride + x];
+	}
+
+	/** @return pointer to the first cell of row y of the tile */
+	TV* row( size_t y ) const
+	{
+	    return data + y * stride;
+	}
+    };
+
+    typedef TileBase<T> Tile;
+    typedef TileBase<const T> ConstTile;
+
+    /** Forward iterator over the allocated tiles of the array */
+    template <class A, class TV>
+    class tile_iterator_base : public boost::iterator_facade<
+	tile_iterator_base<A,TV>,
+	TileBase<TV>,
+	boost::forward_traversal_tag,
+	TileBase<TV>
+	>
+    {
+	friend class boost::iterator_core_access;
+	friend class TiledArray<T>;
+
+	A* m_array;
+	size_t m_idx;
+
+	tile_iterator_base(A* array, size_t idx)
+	    : m_array(array), m_idx(idx)
+	{
+	    skipUnallocated();
+	}
+
+	void skipUnallocated()
+	{
+	    while( m_idx < m_array->tiles.size() && m_array->tiles[m_idx].empty() )
+		m_idx++;
+	}
+
+	void increment()
+	{
+	    m_idx++;
+	    skipUnallocated();
+	}
+	bool equal( tile_iterator_base<A,TV> const& other ) const
+	{
+	    return m_array == other.m_array && m_idx == other.m_idx;
+	}
+	TileBase<TV> dereference() const
+	{
+	    return m_array->template makeTile<TV>( m_idx );
+	}
+
+	template <class A2, class TV2> friend class tile_iterator_base;
+
+    public:
+	tile_iterator_base() : m_array(NULL), m_idx(0) {}
+
+	/** allows the conversion from tile_iterator to const_tile_iterator */
+	template <class A2, class TV2>
+	tile_iterator_base(tile_iterator_base<A2,TV2> const& other)
+	    : m_array(other.m_array), m_idx(other.m_idx) {}
+    };
+
+    typedef tile_iterator_base<TiledArray<T>, T> tile_iterator;
+    typedef tile_iterator_base<const TiledArray<T>, const T> const_tile_iterator;
+
+    TiledArray()
+	: sizeX(0), sizeY(0), tileSize(DEFAULT_TILE_SIZE),
+	tileCountX(0), tileCountY(0), nodata(T()) {}
+
+    TiledArray( size_t sizeX, size_t sizeY, T nodata = T(), size_t tileSize = DEFAULT_TILE_SIZE )
+	: sizeX(0), sizeY(0), tileSize(tileSize),
+	tileCountX(0), tileCountY(0), nodata(nodata)
+    {
+	if( tileSize == 0 )
+	    throw std::runtime_error("TiledArray: tile size can not be zero.");
+	resize( sizeX, sizeY );
+    }
+
+    /** Changes the size of the array. This releases all the tiles if the
+     * size differs from the current one.
+     */
+    void resize( size_t sizeX, size_t sizeY )
+    {
+	if( this->sizeX == sizeX && this->sizeY == sizeY && !tiles.empty() )
+	    return;
+
+	this->sizeX = sizeX;
+	this->sizeY = sizeY;
+	tileCountX = (sizeX + tileSize - 1) / tileSize;
+	tileCountY = (sizeY + tileSize - 1) / tileSize;
+	tiles.clear();
+	tiles.resize( tileCountX * tileCountY );
+    }
+
+    /** Changes the tile size. This releases all the tiles. */
+    void setTileSize( size_t tileSize )
+    {
+	if( tileSize == 0 )
+	    throw std::runtime_error("TiledArray: tile size can not be zero.");
+	this->tileSize = tileSize;
+	const size_t x = sizeX, y = sizeY;
+	sizeX = sizeY = 0;
+	resize( x, y );
+    }
+
+    size_t getSizeX() const { return sizeX; }
+    size_t getSizeY() const { return sizeY; }
+    size_t getTileSize() const { return tileSize; }
+    size_t getTileCountX() const { return tileCountX; }
+    size_t getTileCountY() const { return tileCountY; }
+
+    /** The value returned for cells of tiles that are not allocated */
+    T getNoData() const { return nodata; }
+
+    /** Sets the value that is returned for cells in tiles that are not
+     * allocated, and that newly allocated tiles are initialized with.
+     * Already allocated tiles are not changed.
+     */
+    void setNoData( T value ) { nodata = value; }
+
+    /** @return true if a and b are equal, or if both are NaN. This is the
+     * comparison that is used for the nodata value, so that NaN can be
+     * used as nodata for floating point bands. */
+    static bool isSameValue( T a, T b )
+    {
+	return a == b || (a != a && b != b);
+    }
+
+    /** @return true if value is the nodata value, see isSameValue() */
+    bool isNoData( T value ) const { return isSameValue( value, nodata ); }
+
+    /** @return the value of the cell (x, y), or the nodata value if the
+     * tile of the cell has not been allocated
+     */
+    T get( size_t x, size_t y ) const
+    {
+	const std::vector<T>& tile( tiles[(y / tileSize) * tileCountX + x / tileSize] );
+	if( tile.empty() )
+	    return nodata;
+	return tile[(y % tileSize) * tileSize + x % tileSize];
+    }
+
+    /** @return a reference to the cell (x, y). The tile of the cell is
+     * allocated if required.
+     */
+    T& at( size_t x, size_t y )
+    {
+	std::vector<T>& tile( allocate( x / tileSize, y / tileSize ) );
+	return tile[(y % tileSize) * tileSize + x % tileSize];
+    }
+
+    /** Sets the cell (x, y) to value. Setting a cell of an unallocated tile
+     * to the nodata value does not allocate the tile.
+     */
+    void set( size_t x, size_t y, T value )
+    {
+	std::vector<T>& tile( tiles[(y / tileSize) * tileCountX + x / tileSize] );
+	if( tile.empty() )
+	{
+	    if( isNoData( value ) )
+		return;
+	    allocate( x / tileSize, y / tileSize );
+	}
+	tile[(y % tileSize) * tileSize + x % tileSize] = value;
+    }
+
+    bool isTileAllocated( size_t tileX, size_t tileY ) const
+    {
+	return !tiles[tileY * tileCountX + tileX].empty();
+    }
+
+    /** @return the number of tiles that are currently allocated */
+    size_t getAllocatedTileCount() const
+    {
+	size_t count = 0;
+	for( size_t i=0; i<tiles.size(); i++ )
+	    if( !tiles[i].empty() )
+		count++;
+	return count;
+    }
+
+    /** @return the number of bytes used by the cell data */
+    size_t getMemoryUsage() const
+    {
+	return getAllocatedTileCount() * tileSize * tileSize * sizeof(T);
+    }
+
+    /** @return the tile with the given tile index, allocating it if
+     * required
+     */
+    Tile getTile( size_t tileX, size_t tileY )
+    {
+	allocate( tileX, tileY );
+	return makeTile<T>( tileY * tileCountX + tileX );
+    }
+
+    /** @return the tile with the given tile index. The data pointer of the
+     * returned tile is NULL if the tile is not allocated.
+     */
+    ConstTile getTile( size_t tileX, size_t tileY ) const
+    {
+	return makeTile<const T>( tileY * tileCountX + tileX );
+    }
+
+    tile_iterator beginTiles() { return tile_iterator( this, 0 ); }
+    tile_iterator endTiles() { return tile_iterator( this, tiles.size() ); }
+    const_tile_iterator beginTiles() const { return const_tile_iterator( this, 0 ); }
+    const_tile_iterator endTiles() const { return const_tile_iterator( this, tiles.size() ); }
+
+    /** Releases all tiles, so that all the cells are set to nodata */
+    void clear()
+    {
+	for( size_t i=0; i<tiles.size(); i++ )
+	    std::vector<T>().swap( tiles[i] );
+    }
+
+    /** Releases the tiles in which all cells are set to the nodata value */
+    void releaseEmptyTiles()
+    {
+	for( size_t i=0; i<tiles.size(); i++ )
+	{
+	    std::vector<T>& tile( tiles[i] );
+	    size_t j = 0;
+	    while( j < tile.size() && isNoData( tile[j] ) )
+		j++;
+	    if( !tile.empty() && j == tile.size() )
+		std::vector<T>().swap( tile );
+	}
+    }
+
+    /** Copies the content of the array into the dense array \c array, which
+     * is indexed as array[y][x]
+     */
+    void toArray( boost::multi_array<T,2>& array ) const
+    {
+	array.resize( boost::extents[sizeY][sizeX] );
+	std::fill( array.data(), array.data() + array.num_elements(), nodata );
+	for( const_tile_iterator it = beginTiles(); it != endTiles(); it++ )
+	{
+	    ConstTile tile( *it );
+	    for( size_t y=0; y<tile.height; y++ )
+		std::copy( tile.row(y), tile.row(y) + tile.width, &array[tile.y0 + y][tile.x0] );
+	}
+    }
+
+    /** Sets the content of the array from the dense array \c array, which
+     * is indexed as array[y][x]. Only the tiles that contain cells which
+     * are not nodata are allocated.
+     */
+    void fromArray( const boost::multi_array<T,2>& array )
+    {
+	sizeX = sizeY = 0;
+	resize( array.shape()[1], array.shape()[0] );
+	for( size_t ty=0; ty<tileCountY; ty++ )
+	{
+	    for( size_t tx=0; tx<tileCountX; tx++ )
+	    {
+		const size_t x0 = tx * tileSize, y0 = ty * tileSize;
+		const size_t width = std::min( tileSize, sizeX - x0 );
+		const size_t height = std::min( tileSize, sizeY - y0 );
+
+		bool empty = true;
+		for( size_t y=0; y<height && empty; y++ )
+		    for( size_t x=0; x<width; x++ )
+			if( !isNoData( array[y0 + y][x0 + x] ) )
+			{
+			    empty = false;
+			    break;
+			}
+		if( empty )
+		    continue;
+
+		Tile tile( getTile( tx, ty ) );
+		for( size_t y=0; y<height; y++ )
+		    std::copy( &array[y0 + y][x0], &array[y0 + y][x0] + width, tile.row(y) );
+	    }
+	}
+    }
+
+private:
+    std::vector<T>& allocate( size_t tileX, size_t tileY )
+    {
+	std::vector<T>& tile( tiles[tileY * tileCountX + tileX] );
+	if( tile.empty() )
+	    tile.resize( tileSize * tileSize, nodata );
+	return tile;
+    }
+
+    template <class TV>
+    TileBase<TV> makeTile( size_t idx ) const
+    {
+	TileBase<TV> tile;
+	tile.tileX = idx % tileCountX;
+	tile.tileY = idx / tileCountX;
+	tile.x0 = tile.tileX * tileSize;
+	tile.y0 = tile.tileY * tileSize;
+	tile.width = std::min( tileSize, sizeX - tile.x0 );
+	tile.height = std::min( tileSize, sizeY - tile.y0 );
+	tile.stride = tileSize;
+	if( !tiles[idx].empty() )
+	    tile.data = const_cast<TV*>( &tiles[idx][0] );
+	return tile;
+    }
+
+    size_t sizeX, sizeY;
+    size_t tileSize;
+    size_t tileCountX, tileCountY;
+    T nodata;
+
+    /** tiles in row major order, unallocated tiles are empty */
+    std::vector< std::vector<T> > tiles;
+};
+
+template <class T> const size_t TiledArray<T>::DEFAULT_TILE_SIZE;
+
+}
+
+#endif
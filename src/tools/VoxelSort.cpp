@@ -0,0 +1,238 @@
+#include "VoxelSort.hpp"
+#include <envire/maps/Pointcloud.hpp>
+#include <envire/tools/ParallelFor.hpp>
+
+#include <limits>
+#include <stdexcept>
+
+namespace envire {
+
+namespace
+{
+    /** number of bits the radix sort handles per pass */
+    const int RADIX_BITS = 11;
+    const size_t RADIX_SIZE = 1 << RADIX_BITS;
+    /** the parallel passes use at most one chunk per this many points */
+    const size_t MIN_CHUNK_POINTS = 1 << 16;
+
+    /** @return the number of chunks to split count elements in */
+    size_t getChunkCount(size_t count, size_t threads)
+    {
+        if (threads == 0)
+            threads = getDefaultThreadCount();
+        return std::max<size_t>(1, std::min(threads, count / MIN_CHUNK_POINTS));
+    }
+
+    /** @return the first element of chunk c, if count elements are split
+     * in chunks chunks */
+    inline size_t chunkBegin(size_t count, size_t chunks, size_t c)
+    {
+        return count * c / chunks;
+    }
+
+    /** @return the number of bits needed to store value */
+    int bitCount(boost::uint64_t value)
+    {
+        int bits = 0;
+        while (value >> bits)
+            bits++;
+        return bits;
+    }
+
+    struct ComputeBounds
+    {
+        const Pointcloud& pc;
+        size_t chunks;
+        std::vector<Eigen::AlignedBox<double,3> >& bounds;
+
+        ComputeBounds(const Pointcloud& pc, size_t chunks, std::vector<Eigen::AlignedBox<double,3> >& bounds)
+            : pc(pc), chunks(chunks), bounds(bounds) {}
+
+        void operator()(size_t first, size_t last) const
+        {
+            const size_t count = pc.getVertexCount();
+            for (size_t c = first; c < last; c++)
+            {
+                Eigen::AlignedBox<double,3> box;
+                const size_t end = chunkBegin(count, chunks, c + 1);
+                for (size_t i = chunkBegin(count, chunks, c); i < end; i++)
+                {
+                    const Eigen::Vector3d p(pc.getVertex(i));
+                    if (isFinite(p))
+                        box.extend(p);
+                }
+                bounds[c] = box;
+            }
+        }
+    };
+
+    struct ComputeKeys
+    {
+        const Pointcloud& pc;
+        const VoxelKeys& voxelKeys;
+        std::vector<boost::uint64_t>& keys;
+        std::vector<boost::uint32_t>& order;
+
+        ComputeKeys(const Pointcloud& pc, const VoxelKeys& voxelKeys,
+                std::vector<boost::uint64_t>& keys, std::vector<boost::uint32_t>& order)
+            : pc(pc), voxelKeys(voxelKeys), keys(keys), order(order) {}
+
+        void operator()(size_t first, size_t last) const
+        {
+            for (size_t i = first; i < last; i++)
+            {
+                keys[i] = voxelKeys.getKey(pc.getVertex(i));
+                order[i] = static_cast<boost::uint32_t>(i);
+            }
+        }
+    };
+
+    /** counts the digits of one radix sort pass, per chunk */
+    struct CountDigits
+    {
+        const std::vector<boost::uint64_t>& keys;
+        int shift;
+        size_t chunks;
+        std::vector<size_t>& counts;
+
+        CountDigits(const std::vector<boost::uint64_t>& keys, int shift, size_t chunks, std::vector<size_t>& counts)
+            : keys(keys), shift(shift), chunks(chunks), counts(counts) {}
+
+        void operator()(size_t first, size_t last) const
+        {
+            for (size_t c = first; c < last; c++)
+            {
+                size_t* count = &counts[c * RADIX_SIZE];
+                std::fill(count, count + RADIX_SIZE, 0);
+                const size_t end = chunkBegin(keys.size(), chunks, c + 1);
+                for (size_t i = chunkBegin(keys.size(), chunks, c); i < end; i++)
+                    count[(keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+            }
+        }
+    };
+
+    /** moves the keys of each chunk to the offsets computed from the
+     * counts of CountDigits */
+    struct ScatterDigits
+    {
+        const std::vector<boost::uint64_t>& keys;
+        const std::vector<boost::uint32_t>& order;
+        std::vector<boost::uint64_t>& sortedKeys;
+        std::vector<boost::uint32_t>& sortedOrder;
+        int shift;
+        size_t chunks;
+        const std::vector<size_t>& offsets;
+
+        ScatterDigits(const std::vector<boost::uint64_t>& keys, const std::vector<boost::uint32_t>& order,
+                std::vector<boost::uint64_t>& sortedKeys, std::vector<boost::uint32_t>& sortedOrder,
+                int shift, size_t chunks, const std::vector<size_t>& offsets)
+            : keys(keys), order(order), sortedKeys(sortedKeys), sortedOrder(sortedOrder),
+            shift(shift), chunks(chunks), offsets(offsets) {}
+
+        void operator()(size_t first, size_t last) const
+        {
+            std::vector<size_t> offset(RADIX_SIZE);
+            for (size_t c = first; c < last; c++)
+            {
+                std::copy(offsets.begin() + c * RADIX_SIZE, offsets.begin() + (c + 1) * RADIX_SIZE, offset.begin());
+                const size_t end = chunkBegin(keys.size(), chunks, c + 1);
+                for (size_t i = chunkBegin(keys.size(), chunks, c); i < end; i++)
+                {
+                    const size_t target = offset[(keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+                    sortedKeys[target] = keys[i];
+                    sortedOrder[target] = order[i];
+                }
+            }
+        }
+    };
+}
+
+VoxelKeys::VoxelKeys()
+    : origin(Eigen::Vector3d::Zero()), cellSize(1.0), scale(1.0), bits(0)
+{
+    for (int d = 0; d < 3; d++)
+    {
+        maxIndex[d] = 0;
+        shift[d] = 0;
+    }
+}
+
+void VoxelKeys::init(const Eigen::AlignedBox<double,3>& box, double cellSize)
+{
+    if (!(cellSize > 0))
+        throw std::runtime_error("VoxelKeys: the cell size has to be positive.");
+
+    this->cellSize = cellSize;
+    scale = 1.0 / cellSize;
+    origin = box.isEmpty() ? Eigen::Vector3d::Zero() : box.min();
+
+    // Z uses the lowest bits, one more bit is left for the invalid key
+    bits = 0;
+    for (int d = 2; d >= 0; d--)
+    {
+        const double extent = box.isEmpty() ? 0 : std::floor((box.max()[d] - box.min()[d]) * scale);
+        if (!(extent < 1e18))
+            throw std::runtime_error("VoxelKeys: the cell size is too small for the extents of the points.");
+        maxIndex[d] = static_cast<boost::int64_t>(extent);
+        shift[d] = bits;
+        bits += bitCount(maxIndex[d]);
+    }
+    if (bits > 63)
+        throw std::runtime_error("VoxelKeys: the cell size is too small for the extents of the points.");
+}
+
+Eigen::AlignedBox<double,3> computeFiniteBounds(const Pointcloud& pc, size_t threads)
+{
+    const size_t chunks = getChunkCount(pc.getVertexCount(), threads);
+    std::vector<Eigen::AlignedBox<double,3> > bounds(chunks);
+    parallelFor(0, chunks, ComputeBounds(pc, chunks, bounds), threads);
+
+    Eigen::AlignedBox<double,3> box;
+    for (size_t c = 0; c < chunks; c++)
+        box.extend(bounds[c]);
+    return box;
+}
+
+void computeVoxelKeys(const Pointcloud& pc, const VoxelKeys& voxelKeys,
+        std::vector<boost::uint64_t>& keys, std::vector<boost::uint32_t>& order,
+        size_t threads)
+{
+    const size_t count = pc.getVertexCount();
+    if (count > std::numeric_limits<boost::uint32_t>::max())
+        throw std::runtime_error("computeVoxelKeys: too many points.");
+
+    keys.resize(count);
+    order.resize(count);
+    parallelFor(0, count, ComputeKeys(pc, voxelKeys, keys, order), threads, MIN_CHUNK_POINTS);
+}
+
+void radixSort(std::vector<boost::uint64_t>& keys, std::vector<boost::uint32_t>& order,
+        int bits, size_t threads)
+{
+    const size_t chunks = getChunkCount(keys.size(), threads);
+    std::vector<boost::uint64_t> sortedKeys(keys.size());
+    std::vector<boost::uint32_t> sortedOrder(order.size());
+    std::vector<size_t> counts(chunks * RADIX_SIZE);
+
+    for (int shift = 0; shift < bits; shift += RADIX_BITS)
+    {
+        parallelFor(0, chunks, CountDigits(keys, shift, chunks, counts), threads);
+
+        // the offset of a digit in a chunk follows all smaller digits, and
+        // the same digit in all previous chunks
+        size_t offset = 0;
+        for (size_t digit = 0; digit < RADIX_SIZE; digit++)
+            for (size_t c = 0; c < chunks; c++)
+            {
+                const size_t count = counts[c * RADIX_SIZE + digit];
+                counts[c * RADIX_SIZE + digit] = offset;
+                offset += count;
+            }
+
+        parallelFor(0, chunks, ScatterDigits(keys, order, sortedKeys, sortedOrder, shift, chunks, counts), threads);
+        keys.swap(sortedKeys);
+        order.swap(sortedOrder);
+    }
+}
+
+}
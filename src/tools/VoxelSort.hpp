@@ -0,0 +1,126 @@
+#ifndef ENVIRE_VOXELSORT_HPP
+#define ENVIRE_VOXELSORT_HPP
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace envire
+{
+
+class Pointcloud;
+
+/** @return false if a coordinate of p is infinite or NaN */
+inline bool isFinite(const Eigen::Vector3d& p)
+{
+    // the difference of a value to itself is NaN for both
+    return (p - p).cwiseAbs().sum() == 0;
+}
+
+/**
+ * Packs the indices of the cells of a regular 3D grid into 64 bit keys.
+ *
+ * The grid starts at the minimum of a bounding box, and each axis uses as
+ * many bits as the number of cells of the box along it needs. The X index
+ * is stored in the highest bits, so that sorting by key orders the cells
+ * by X, then Y, then Z. Sorting the points of a cloud by the key of their
+ * cell groups the points of each cell, see radixSort().
+ */
+class VoxelKeys
+{
+public:
+    VoxelKeys();
+
+    /**
+     * @param box the bounding box of the points to index. It can be empty,
+     *        in which case there is a single cell at the origin.
+     * @throw std::runtime_error if cellSize is not positive, or if the
+     *        cells of the box can not be indexed with 63 bits
+     */
+    void init(const Eigen::AlignedBox<double,3>& box, double cellSize);
+
+    double getCellSize() const { return cellSize; }
+    const Eigen::Vector3d& getOrigin() const { return origin; }
+    /** @return the number of bits of the keys of valid points */
+    int getBits() const { return bits; }
+    /** @return the key of the points which are not finite. It is larger
+     * than all other keys. */
+    boost::uint64_t getInvalidKey() const { return static_cast<boost::uint64_t>(1) << bits; }
+    /** @return the largest index along axis d */
+    boost::int64_t getMaxIndex(int d) const { return maxIndex[d]; }
+
+    /** @return the index of the cell of p along axis d. It is not clamped
+     * to the indexed box. */
+    boost::int64_t getIndex(const Eigen::Vector3d& p, int d) const
+    {
+        return static_cast<boost::int64_t>(std::floor((p[d] - origin[d]) * scale));
+    }
+
+    /** @return the key of the given cell indices, which have to be in
+     * [0, getMaxIndex()] */
+    boost::uint64_t getKey(boost::int64_t x, boost::int64_t y, boost::int64_t z) const
+    {
+        return (static_cast<boost::uint64_t>(x) << shift[0])
+            | (static_cast<boost::uint64_t>(y) << shift[1])
+            | (static_cast<boost::uint64_t>(z) << shift[2]);
+    }
+
+    /** @return the key of the cell of p. Points outside of the indexed box
+     * are put in the closest cell. */
+    boost::uint64_t getKey(const Eigen::Vector3d& p) const
+    {
+        if (!isFinite(p))
+            return getInvalidKey();
+
+        boost::int64_t index[3];
+        for (int d = 0; d < 3; d++)
+            index[d] = std::max<boost::int64_t>(0, std::min(getIndex(p, d), maxIndex[d]));
+        return getKey(index[0], index[1], index[2]);
+    }
+
+private:
+    Eigen::Vector3d origin;
+    double cellSize;
+    double scale;
+    boost::int64_t maxIndex[3];
+    int shift[3];
+    int bits;
+};
+
+/** @return the bounding box of the finite vertices of pc, in either
+ * storage, computed in parallel
+ *
+ * @param threads the number of threads, 0 for getDefaultThreadCount()
+ */
+Eigen::AlignedBox<double,3> computeFiniteBounds(const Pointcloud& pc, size_t threads = 0);
+
+/** Computes the key of each vertex of pc, in either storage, and sets
+ * order to the identity permutation
+ *
+ * @param threads the number of threads, 0 for getDefaultThreadCount()
+ * @throw std::runtime_error if pc has more than 2^32 - 1 vertices
+ */
+void computeVoxelKeys(const Pointcloud& pc, const VoxelKeys& voxelKeys,
+        std::vector<boost::uint64_t>& keys, std::vector<boost::uint32_t>& order,
+        size_t threads = 0);
+
+/**
+ * Sorts keys by their lowest \c bits bits, and applies the same permutation
+ * to order.
+ *
+ * This is a least significant digit radix sort. Each pass counts the
+ * digits of contiguous chunks of the keys in parallel, and then moves the
+ * chunks in parallel. The sort is stable, and its result does not depend
+ * on the number of threads.
+ *
+ * @param threads the number of threads, 0 for getDefaultThreadCount()
+ */
+void radixSort(std::vector<boost::uint64_t>& keys, std::vector<boost::uint32_t>& order,
+        int bits, size_t threads = 0);
+
+}
+
+#endif
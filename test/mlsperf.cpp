@@ -1,121 +1,295 @@
+/** Benchmark suite for the multi-level surface grid.
+ *
+ * Measures the throughput of the MLSGrid update path (direct and through
+ * MLSProjection from a Pointcloud), the cost of merging grids, and the
+ * binary map serialization, for all update models, for single- and
+ * multi-level scenes and over a range of grid sizes.
+ *
+ * The results are written as CSV, one metric per line, so that the output of
+ * two releases can be compared with mlsperf.py.
+ *
+ * usage: mls_perf [--quick] [--max-size N] [--max-points N] [--out file]
+ */
+#include <envire/Core.hpp>
 #include <envire/maps/MLSGrid.hpp>
+#include <envire/maps/Pointcloud.hpp>
+#include <envire/operators/MLSProjection.hpp>
+
+#include <base/Time.hpp>
+
 #include <boost/random/normal_distribution.hpp>
 #include <boost/random/uniform_real.hpp>
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/variate_generator.hpp>
+#include <boost/lexical_cast.hpp>
+
 #include <iostream>
 #include <fstream>
+#include <sstream>
 
 using namespace envire;
 using namespace Eigen;
 using namespace std;
 
-struct MLSTest 
+/** a single sample that is fed to the grid */
+struct Sample
 {
-    MLSGrid::Ptr grid;
+    Vector3d p;
+    float stdev;
+};
 
-    // generate random number generator
+/** Generates the measurements of a test scene in the grid area of
+ * [0, size] x [0, size]
+ *
+ * The single level scene is a smooth surface. The multi-level scene
+ * additionally places a fraction of the samples on two levels above the
+ * surface, which are further apart than the gap size of the grid, so that
+ * the grid has to maintain several patches per cell.
+ */
+struct SceneGenerator
+{
     boost::mt19937 eng;
-    boost::variate_generator<boost::mt19937,boost::normal_distribution<float> > norm;
-    boost::variate_generator<boost::mt19937,boost::uniform_real<float> > uni;
+    boost::variate_generator<boost::mt19937&,boost::normal_distribution<float> > norm;
+    boost::variate_generator<boost::mt19937&,boost::uniform_real<float> > uni;
 
-    MLSTest()
+    SceneGenerator()
 	: norm( eng, boost::normal_distribution<float>(0,1) ),
 	uni( eng, boost::uniform_real<float>(0,1) ) {};
 
-    virtual ~MLSTest() {};
-        
-    /** generate a grid on 0x0 to 1x1 */
-    void init( size_t cell_count )
+    void generate( size_t count, double size, bool multi_level, vector<Sample>& samples )
     {
-	grid = new MLSGrid( cell_count, cell_count, 1.0 / cell_count, 1.0 / cell_count );
-	grid->getConfig().thickness = 1.0;
-	grid->getConfig().gapSize = 1.5;
+	samples.resize( count );
+	for( size_t i=0; i<count; i++ )
+	{
+	    const double x = uni() * size;
+	    const double y = uni() * size;
+	    double z = func( x, y );
+	    if( multi_level )
+		z += 2.0 * (int)(uni() * 3.0);
+
+	    Sample &s( samples[i] );
+	    s.stdev = uni() * 0.1 + 0.01;
+	    s.p = Vector3d( x, y, z + norm() * s.stdev );
+	}
     }
 
-    void learnModel( size_t iterations, float var_range = 0.1 )
+    /** underlying surface of the scene */
+    static double func( double x, double y )
     {
-	for( size_t i=0; i<iterations; i++ )
-	{
-	    const float x = uni();
-	    const float y = uni();
-	    const float z = func( x, y );
+	return sin( x ) + cos( y ) - 1.0;
+    }
+};
 
-	    const float stdev = uni() * var_range + 0.01;
-	    const float z_meas = z + norm() * stdev;
+/** Collects the timings and writes them as CSV */
+struct Report
+{
+    ostream& os;
 
-	    MLSGrid::SurfacePatch patch( z_meas, stdev );
-	    grid->update( Vector2d( x, y ), patch );
-	}
+    explicit Report( ostream& os ) : os( os )
+    {
+	os << "benchmark,model,scene,grid_size,count,seconds,value,unit" << endl;
+    }
+
+    void add( const string& benchmark, const string& model, const string& scene, size_t grid_size,
+	    size_t count, double seconds, double value, const string& unit )
+    {
+	os << benchmark << "," << model << "," << scene << ","
+	    << grid_size << "," << count << "," << seconds << ","
+	    << value << "," << unit << endl;
     }
+};
 
-    void evaluateModel( size_t iterations, ostream& os )
+static double secondsSince( const base::Time& start )
+{
+    return (base::Time::now() - start).toSeconds();
+}
+
+static string modelName( MLSConfiguration::update_model model )
+{
+    switch( model )
     {
-	for( size_t i=0; i<iterations; i++ )
+	case MLSConfiguration::KALMAN: return "KALMAN";
+	case MLSConfiguration::SUM: return "SUM";
+	case MLSConfiguration::SLOPE: return "SLOPE";
+    }
+    return "UNKNOWN";
+}
+
+static size_t countPatches( const MLSGrid& grid )
+{
+    size_t count = 0;
+    for(size_t xi=0;xi<grid.getCellSizeX();xi++)
+	for(size_t yi=0;yi<grid.getCellSizeY();yi++)
+	    for( MLSGrid::const_iterator it = grid.beginCell( xi,yi ); it != grid.endCell(); it++ )
+		count++;
+    return count;
+}
+
+struct MLSBenchmark
+{
+    Report& report;
+    MLSConfiguration::update_model model;
+    string model_name;
+    string scene;
+    size_t grid_size;
+    const vector<Sample>& samples;
+
+    MLSBenchmark( Report& report, MLSConfiguration::update_model model,
+	    const string& scene, size_t grid_size, const vector<Sample>& samples )
+	: report( report ), model( model ), model_name( modelName( model ) ),
+	scene( scene ), grid_size( grid_size ), samples( samples ) {}
+
+    /** creates a grid with one meter cells */
+    MLSGrid* createGrid() const
+    {
+	MLSGrid* grid = new MLSGrid( grid_size, grid_size, 1.0, 1.0 );
+	grid->getConfig().updateModel = model;
+	grid->getConfig().thickness = 0.05;
+	grid->getConfig().gapSize = 1.0;
+	return grid;
+    }
+
+    void add( const string& benchmark, size_t count, double seconds, double value, const string& unit )
+    {
+	report.add( benchmark, model_name, scene, grid_size, count, seconds, value, unit );
+    }
+
+    void run()
+    {
+	MLSGrid::Ptr grid( createGrid() );
+
+	// direct update of the grid with single measurements
+	base::Time start = base::Time::now();
+	for( size_t i=0; i<samples.size(); i++ )
 	{
-	    const float x = uni();
-	    const float y = uni();
-	    const float z = func( x, y );
-	    MLSGrid::SurfacePatch *patch;
-	    double p_z = z, p_stdev = 1.0;
-	    if( (patch = grid->get( Vector2d( x, y ), p_z, p_stdev )) )
-	    {
-		const float diff = (p_z - z);
-	        const float ndiff = diff / p_stdev;
+	    MLSGrid::SurfacePatch patch( samples[i].p.z(), samples[i].stdev );
+	    grid->update( samples[i].p.head<2>(), patch );
+	}
+	double sec = secondsSince( start );
+	add( "update", samples.size(), sec, samples.size() / sec, "points/s" );
 
-		os << diff << " " << ndiff << endl;
-	    }
+	const size_t patches = countPatches( *grid );
+	add( "patches", patches, 0, (double)patches / (grid_size * grid_size), "patches/cell" );
+
+	// binary map serialization
+	ostringstream os;
+	start = base::Time::now();
+	grid->writeMap( os );
+	sec = secondsSince( start );
+	const string data = os.str();
+	const double mbytes = data.size() / 1e6;
+	add( "save", data.size(), sec, mbytes / sec, "MB/s" );
+	add( "size", patches, 0, patches ? (double)data.size() / patches : 0.0, "bytes/patch" );
+
+	MLSGrid::Ptr loaded( createGrid() );
+	{
+	    istringstream is( data );
+	    start = base::Time::now();
+	    loaded->readMap( is );
+	    sec = secondsSince( start );
 	}
+	add( "load", data.size(), sec, mbytes / sec, "MB/s" );
+
+	// merge the loaded copy back into the original grid, which
+	// requires a patch merge for every patch in the source
+	start = base::Time::now();
+	grid->merge( *loaded, Affine3d::Identity(), MLSGrid::SurfacePatch( 0, 0 ) );
+	sec = secondsSince( start );
+	add( "merge", patches, sec, patches ? sec * 1e9 / patches : 0.0, "ns/patch" );
     }
 
-    void saveEnv( const string& name )
+    void runPointcloud()
     {
 	Environment env;
-	env.attachItem( grid.get() );
+
+	MLSGrid* grid = createGrid();
+	env.attachItem( grid );
 	grid->setFrameNode( env.getRootNode() );
 
-	env.serialize( name );
-    }
+	Pointcloud* pc = new Pointcloud();
+	env.attachItem( pc );
+	pc->setFrameNode( env.getRootNode() );
+	pc->vertices.reserve( samples.size() );
+	for( size_t i=0; i<samples.size(); i++ )
+	    pc->vertices.push_back( samples[i].p );
 
-    /** underlying function that is learned */
-    virtual float func( float x, float y )
-    {
-	return (sin( x ) + cos( y ) - 1.0)*1.0;
+	MLSProjection* proj = new MLSProjection();
+	env.attachItem( proj );
+	proj->addInput( pc );
+	proj->addOutput( grid );
+
+	base::Time start = base::Time::now();
+	proj->updateAll();
+	double sec = secondsSince( start );
+	add( "projection", samples.size(), sec, samples.size() / sec, "points/s" );
     }
 };
 
+static void usage()
+{
+    cerr << "usage: mls_perf [--quick] [--max-size N] [--max-points N] [--out file]" << endl
+	<< "  --quick         only run the small grid sizes" << endl
+	<< "  --max-size N    largest grid size (cells per side) to run, default 4000" << endl
+	<< "  --max-points N  upper limit of samples per run, default 16000000" << endl
+	<< "  --out file      write the CSV results to file instead of stdout" << endl;
+}
+
 int main(int argc, char* argv[])
 {
-    const int grid_size = 5;
-    const int learn_steps = 10000;
-    const int eval_steps = 10000;
-    {
-    MLSTest test;
-    test.init(grid_size);
-    test.learnModel( learn_steps );
-    ofstream of("samples.dat");
-    test.evaluateModel( eval_steps, of );
-    test.saveEnv("/tmp/test.env");
-    }
+    size_t max_size = 4000;
+    size_t max_points = 16000000;
+    string out_file;
 
+    for( int i=1; i<argc; i++ )
     {
-    MLSTest test;
-    test.init(grid_size);
-    test.grid->getConfig().updateModel = MLSConfiguration::SUM;
-    test.learnModel( learn_steps );
-    ofstream of("samples2.dat");
-    test.evaluateModel( eval_steps, of );
-    test.saveEnv("/tmp/test2.env");
+	string arg( argv[i] );
+	if( arg == "--quick" )
+	    max_size = 500;
+	else if( arg == "--max-size" && i+1 < argc )
+	    max_size = boost::lexical_cast<size_t>( argv[++i] );
+	else if( arg == "--max-points" && i+1 < argc )
+	    max_points = boost::lexical_cast<size_t>( argv[++i] );
+	else if( arg == "--out" && i+1 < argc )
+	    out_file = argv[++i];
+	else
+	{
+	    usage();
+	    return 1;
+	}
     }
 
+    ofstream of;
+    if( !out_file.empty() )
+	of.open( out_file.c_str() );
+    Report report( out_file.empty() ? cout : of );
+
+    const size_t grid_sizes[] = { 100, 500, 1000, 2000, 4000 };
+    const MLSConfiguration::update_model models[] =
+	{ MLSConfiguration::KALMAN, MLSConfiguration::SUM, MLSConfiguration::SLOPE };
+
+    SceneGenerator gen;
+    vector<Sample> samples;
+    for( size_t s=0; s<sizeof(grid_sizes)/sizeof(size_t); s++ )
     {
-    MLSTest test;
-    test.init(grid_size);
-    test.grid->getConfig().updateModel = MLSConfiguration::SLOPE;
-    test.learnModel( learn_steps );
-    ofstream of("samples3.dat");
-    test.evaluateModel( eval_steps, of );
-    test.saveEnv("/tmp/test3.env");
+	const size_t grid_size = grid_sizes[s];
+	if( grid_size > max_size )
+	    break;
+
+	// on average four measurements per cell
+	const size_t points = min( grid_size * grid_size * 4, max_points );
+
+	for( int multi=0; multi<2; multi++ )
+	{
+	    const string scene = multi ? "multi" : "single";
+	    gen.generate( points, grid_size, multi, samples );
+	    for( size_t m=0; m<3; m++ )
+	    {
+		MLSBenchmark bench( report, models[m], scene, grid_size, samples );
+		bench.run();
+		bench.runPointcloud();
+	    }
+	}
     }
-}
 
+    return 0;
+}
@@ -1,33 +1,48 @@
 #!/usr/bin/env python
+# Compares the CSV output of two mls_perf runs.
+#
+# usage: mlsperf.py baseline.csv current.csv [threshold]
+#
+# Prints the relative change of every metric and returns with a non-zero exit
+# code if any metric got worse by more than threshold (default 0.1 = 10%).
+from __future__ import print_function
 import sys
-import numpy as np
-import matplotlib.mlab as mlab
-import matplotlib.pyplot as plt
-
-x = np.genfromtxt( sys.argv[1] )
-xmodel = x[:,0]
-xmap = x[:,1]
-
-print "model mu: {} sigma: {}".format( np.mean(xmodel), np.std(xmodel) )
-print "map mu: {} sigma: {}".format( np.mean(xmap), np.std(xmap) )
-
-# the histogram of the data
-n, bins, patches = plt.hist(x[:,1], 50, normed=1, facecolor='green', alpha=0.75)
-
-print np.mean(x[:,1])
-print np.std(x[:,1]) 
-
-# add a 'best fit' line
-y = mlab.normpdf( bins, 0, 1)
-l = plt.plot(bins, y, 'r--', linewidth=1)
-
-y = mlab.normpdf( bins, np.mean(xmap), np.std(xmap) )
-l = plt.plot(bins, y, 'r--', linewidth=1)
-
-plt.xlabel('Smarts')
-plt.ylabel('Probability')
-plt.title(r'$\mathrm{Histogram\ of\ IQ:}\ \mu=100,\ \sigma=15$')
-#plt.axis([40, 160, 0, 0.03])
-plt.grid(True)
-
-plt.show()
+import csv
+
+# for these units a smaller value is better
+LOWER_IS_BETTER = set(["ns/patch", "bytes/patch"])
+# these metrics describe the result, not the performance
+IGNORE = set(["patches/cell"])
+
+def load(path):
+    result = {}
+    with open(path) as f:
+        for row in csv.DictReader(f):
+            key = (row["benchmark"], row["model"], row["scene"], int(row["grid_size"]))
+            result[key] = (float(row["value"]), row["unit"])
+    return result
+
+if len(sys.argv) < 3:
+    print("usage: mlsperf.py baseline.csv current.csv [threshold]")
+    sys.exit(1)
+
+base = load(sys.argv[1])
+current = load(sys.argv[2])
+threshold = float(sys.argv[3]) if len(sys.argv) > 3 else 0.1
+
+regressions = 0
+for key in sorted(current.keys()):
+    value, unit = current[key]
+    if key not in base or unit in IGNORE or base[key][0] == 0:
+        continue
+    change = (value - base[key][0]) / base[key][0]
+    if unit in LOWER_IS_BETTER:
+        change = -change
+    flag = ""
+    if change < -threshold:
+        flag = "REGRESSION"
+        regressions += 1
+    print("{:<12}{:<8}{:<8}{:>6} {:>14.4g} {:>14.4g} {:<12} {:+7.1%} {}".format(
+        key[0], key[1], key[2], key[3], base[key][0], value, unit, change, flag))
+
+sys.exit(1 if regressions else 0)
@@ -12,8 +12,10 @@
 #define BOOST_TEST_MODULE EnvireTest 
 #include <boost/test/included/unit_test.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <clocale>
 
 #include "envire/tools/GridAccess.hpp"
+#include "envire/tools/PointcloudIndex.hpp"
 #include "envire/maps/Grids.hpp"
 #include "envire/maps/ElevationGrid.hpp"
 
@@ -290,6 +292,221 @@ BOOST_AUTO_TEST_CASE( pointcloud_access )
 	pa.getElevation( v, 0.1, 0, 0.2 );
     }
     cout << b << endl;
+
+    // the queries use the index of the current vertices
+    pc->vertices.resize( 1 );
+    pc->vertices[0] = Eigen::Vector3d( 0.5, 0.5, 3 );
+    pc->invalidateSpatialIndex();
+    v = Eigen::Vector3d( 0.52, 0.5, 0 );
+    BOOST_CHECK( pa.getElevation( v, 0.05 ) );
+    BOOST_CHECK_EQUAL( v.z(), 3 );
+    v = Eigen::Vector3d( -0.5, -0.5, 0 );
+    BOOST_CHECK( !pa.getElevation( v, 0.1, 0, 0.2 ) );
+    pc->vertices.clear();
+    BOOST_CHECK( !pa.getElevation( v, 0.1 ) );
+}
+
+BOOST_AUTO_TEST_CASE( pointcloud_columns ) 
+{
+    Pointcloud pc;
+    std::vector<Eigen::Vector3d>& colors( pc.getVertexData<Eigen::Vector3d>( Pointcloud::VERTEX_COLOR ) );
+    std::vector<double>& variances( pc.getVertexData<double>( Pointcloud::VERTEX_VARIANCE ) );
+    for(int i=0;i<100;i++)
+    {
+	// values that are exact in single precision
+	pc.vertices.push_back( Eigen::Vector3d( i * 0.25, -i * 0.5, i ) );
+	colors.push_back( Eigen::Vector3d( i % 2, 1, 0 ) );
+	variances.push_back( i * 0.125 );
+    }
+
+    std::ostringstream vertices_ply;
+    pc.writePly( "test.ply", vertices_ply, false );
+    const Pointcloud::Extents extents( pc.getExtents() );
+
+    pc.setStorage( Pointcloud::FLOAT_COLUMNS );
+    BOOST_CHECK_EQUAL( pc.getStorage(), Pointcloud::FLOAT_COLUMNS );
+    BOOST_CHECK( pc.vertices.empty() );
+    BOOST_CHECK( !pc.hasData( Pointcloud::VERTEX_COLOR ) );
+    BOOST_REQUIRE_EQUAL( pc.getVertexCount(), 100 );
+    BOOST_CHECK( pc.columns.hasAttribute( PointColumns::COLOR ) );
+    BOOST_CHECK( pc.columns.hasAttribute( PointColumns::VARIANCE ) );
+    BOOST_CHECK( !pc.columns.hasAttribute( PointColumns::NORMAL ) );
+    BOOST_CHECK_EQUAL( pc.getVertex( 10 ), Eigen::Vector3d( 2.5, -5, 10 ) );
+    BOOST_CHECK_EQUAL( pc.columns.getColor( 3 ), Eigen::Vector3d( 1, 1, 0 ) );
+    BOOST_CHECK_EQUAL( pc.columns.variance[8], 1.0 );
+    BOOST_CHECK( pc.getExtents().isApprox( extents ) );
+    // code that only handles vertices rejects the columns
+    BOOST_CHECK_THROW( pc.requireDoubleVertices( "test" ), std::runtime_error );
+
+    // the writer consumes the columns directly
+    std::ostringstream columns_ply;
+    pc.writePly( "test.ply", columns_ply, false );
+    BOOST_CHECK( vertices_ply.str() == columns_ply.str() );
+
+    Eigen::Affine3d t( Eigen::AngleAxisd( 0.5, Eigen::Vector3d::UnitZ() ) );
+    t.translation() = Eigen::Vector3d( 1, 2, 3 );
+    pc.columns.transform( t );
+    BOOST_CHECK( pc.getVertex( 10 ).isApprox( t * Eigen::Vector3d( 2.5, -5, 10 ), 1e-6 ) );
+
+    pc.setStorage( Pointcloud::DOUBLE_VERTICES );
+    BOOST_CHECK( pc.columns.empty() );
+    pc.requireDoubleVertices( "test" );
+    BOOST_REQUIRE_EQUAL( pc.vertices.size(), 100 );
+    BOOST_CHECK_EQUAL( pc.getVertexData<Eigen::Vector3d>( Pointcloud::VERTEX_COLOR ).size(), 100 );
+    BOOST_CHECK_EQUAL( pc.getVertexData<double>( Pointcloud::VERTEX_VARIANCE )[8], 1.0 );
+    BOOST_CHECK( pc.vertices[10].isApprox( t * Eigen::Vector3d( 2.5, -5, 10 ), 1e-6 ) );
+
+    // copying the vertices of another pointcloud does not keep the
+    // attributes of the previous vertices
+    boost::scoped_ptr<Environment> env( new Environment() );
+    Pointcloud *target = new Pointcloud();
+    env->attachItem( target );
+    target->setFrameNode( env->getRootNode() );
+    target->setStorage( Pointcloud::FLOAT_COLUMNS );
+    target->columns.addAttribute( PointColumns::COLOR );
+    target->columns.resize( 10 );
+    for(int i=0;i<10;i++)
+	target->columns.setColor( i, Eigen::Vector3d( 1, 1, 1 ) );
+    Pointcloud *source = new Pointcloud();
+    env->attachItem( source );
+    source->setFrameNode( env->getRootNode() );
+    for(int i=0;i<20;i++)
+	source->vertices.push_back( Eigen::Vector3d( i, 0, 0 ) );
+    target->copyFrom( source );
+    BOOST_REQUIRE_EQUAL( target->getVertexCount(), 20 );
+    BOOST_CHECK_EQUAL( target->getVertex( 15 ), Eigen::Vector3d( 15, 0, 0 ) );
+    BOOST_REQUIRE_EQUAL( target->columns.red.size(), 20 );
+    for(int i=0;i<20;i++)
+	BOOST_CHECK_EQUAL( target->columns.getColor( i ), Eigen::Vector3d::Zero() );
+}
+
+BOOST_AUTO_TEST_CASE( pointcloud_readtext ) 
+{
+    // large enough to be split between threads
+    std::ostringstream text;
+    text << "x y z remission\n";
+    for(int i=0;i<100000;i++)
+	text << i * 0.5 << " " << -i << ",1e-3\t" << i % 256 << "\n";
+    const std::string data( text.str() );
+
+    Pointcloud pc;
+    pc.readText( data.c_str(), data.size() );
+    BOOST_REQUIRE_EQUAL( pc.vertices.size(), 100000 );
+    std::vector<Eigen::Vector3d>& colors( pc.getVertexData<Eigen::Vector3d>( Pointcloud::VERTEX_COLOR ) );
+    BOOST_REQUIRE_EQUAL( colors.size(), 100000 );
+    for(int i=0;i<100000;i++)
+    {
+	BOOST_CHECK_EQUAL( pc.vertices[i], Eigen::Vector3d( i * 0.5, -i, 1e-3 ) );
+	BOOST_CHECK_EQUAL( colors[i], Eigen::Vector3d( (i % 256) / 255.0, 0, 0 ) );
+    }
+
+    // the remission is optional, e.g. in the files written by writeText()
+    const std::string mixed_text( "1 2 3\n4 5 6 7\n" );
+    Pointcloud mixed;
+    mixed.readText( mixed_text.c_str(), mixed_text.size() );
+    BOOST_REQUIRE_EQUAL( mixed.vertices.size(), 2 );
+    BOOST_CHECK_EQUAL( mixed.vertices[0], Eigen::Vector3d( 1, 2, 3 ) );
+    BOOST_CHECK_EQUAL( mixed.getVertexData<Eigen::Vector3d>( Pointcloud::VERTEX_COLOR )[0], Eigen::Vector3d::Zero() );
+    BOOST_CHECK_EQUAL( mixed.getVertexData<Eigen::Vector3d>( Pointcloud::VERTEX_COLOR )[1], Eigen::Vector3d( 7 / 255.0, 0, 0 ) );
+
+    // the sampled lines do not depend on how the input is read
+    Pointcloud sampled, streamed;
+    sampled.readText( data.c_str(), data.size(), 10, Pointcloud::XYZ );
+    std::istringstream is( data );
+    streamed.readText( is, 10, Pointcloud::XYZ );
+    BOOST_CHECK( sampled.vertices == streamed.vertices );
+    BOOST_CHECK( !sampled.hasData( Pointcloud::VERTEX_COLOR ) );
+    BOOST_CHECK( sampled.vertices.size() > 9000 && sampled.vertices.size() < 11000 );
+
+    // numbers with more than 15 digits do not depend on the locale either
+    const std::string precise( "0.12345678901234567 -1234567.8901234567 1.5\n" );
+    const char* oldLocale = setlocale( LC_NUMERIC, 0 );
+    const std::string previous( oldLocale ? oldLocale : "C" );
+    if( !setlocale( LC_NUMERIC, "de_DE.UTF-8" ) )
+	BOOST_TEST_MESSAGE( "de_DE.UTF-8 is not available, using the current locale" );
+    Pointcloud digits;
+    digits.readText( precise.c_str(), precise.size(), 1, Pointcloud::XYZ );
+    setlocale( LC_NUMERIC, previous.c_str() );
+    BOOST_REQUIRE_EQUAL( digits.vertices.size(), 1 );
+    BOOST_CHECK_EQUAL( digits.vertices[0], Eigen::Vector3d( 0.12345678901234567, -1234567.8901234567, 1.5 ) );
+}
+
+BOOST_AUTO_TEST_CASE( pointcloud_spatialindex ) 
+{
+    Pointcloud pc;
+    srand( 7 );
+    for(int i=0;i<5000;i++)
+	pc.vertices.push_back( Eigen::Vector3d::Random() * 10 );
+
+    const PointcloudIndex& index( pc.getSpatialIndex( 0.5 ) );
+    BOOST_CHECK_EQUAL( index.getPointCount(), 5000 );
+    BOOST_CHECK_EQUAL( &pc.getSpatialIndex(), &index );
+
+    for(int q=0;q<100;q++)
+    {
+	const Eigen::Vector3d p( Eigen::Vector3d::Random() * 11 );
+	std::vector<size_t> expected, found;
+	size_t nearest = pc.vertices.size();
+	for(size_t i=0;i<pc.vertices.size();i++)
+	{
+	    const double dist = (pc.vertices[i] - p).norm();
+	    if( dist <= 1.2 )
+		expected.push_back( i );
+	    if( dist <= 3 && (nearest == pc.vertices.size() || dist < (pc.vertices[nearest] - p).norm()) )
+		nearest = i;
+	}
+	index.findWithinRadius( p, 1.2, found );
+	std::sort( found.begin(), found.end() );
+	BOOST_CHECK( found == expected );
+
+	size_t found_nearest;
+	double distance;
+	BOOST_CHECK_EQUAL( index.findNearest( p, 3, found_nearest, distance ), nearest != pc.vertices.size() );
+	if( nearest != pc.vertices.size() )
+	{
+	    BOOST_CHECK_EQUAL( found_nearest, nearest );
+	    BOOST_CHECK_CLOSE( distance, (pc.vertices[nearest] - p).norm(), 1e-3 );
+	}
+    }
+
+    // the index survives a write, and is rebuilt after modifications
+    std::stringstream stream;
+    index.write( stream );
+    PointcloudIndex restored;
+    BOOST_CHECK( restored.read( stream, pc ) );
+    BOOST_CHECK_EQUAL( restored.getCellCount(), index.getCellCount() );
+
+    // cell ranges beyond the indexed vertices are rejected. The cell
+    // starts follow the header and the cell keys.
+    std::string corrupted( stream.str() );
+    const size_t header = sizeof("envire_pointcloud_index") + 4 + 8 + 4 + 8 + 1 + 6 * 8;
+    const boost::uint32_t beyond = 6000;
+    corrupted.replace( header + 8 + 8 * index.getCellCount() + 8 + 4, 4, reinterpret_cast<const char*>( &beyond ), 4 );
+    std::istringstream corrupted_stream( corrupted );
+    BOOST_CHECK( !restored.read( corrupted_stream, pc ) );
+    BOOST_CHECK_EQUAL( restored.getPointCount(), 0 );
+
+    pc.vertices.push_back( Eigen::Vector3d::Zero() );
+    BOOST_CHECK( !index.isUpToDate( pc ) );
+    BOOST_CHECK_EQUAL( pc.getSpatialIndex().getPointCount(), 5001 );
+    pc.clear();
+    BOOST_CHECK( !pc.hasData( Pointcloud::SPATIAL_INDEX ) );
+
+    // georeferenced vertices keep centimetre resolution
+    Pointcloud utm;
+    const Eigen::Vector3d offset( 500000.0, 5000000.0, 100.0 );
+    for(int i=0;i<100;i++)
+	utm.vertices.push_back( offset + Eigen::Vector3d( 0.01 * i, 0, 0 ) );
+    std::vector<size_t> near;
+    utm.getSpatialIndex().findWithinRadius( offset + Eigen::Vector3d( 0.5, 0, 0 ), 0.015, near );
+    std::sort( near.begin(), near.end() );
+    BOOST_REQUIRE_EQUAL( near.size(), 3 );
+    BOOST_CHECK_EQUAL( near[0], 49 );
+    BOOST_CHECK_EQUAL( near[2], 51 );
+    size_t utm_nearest;
+    double utm_distance;
+    BOOST_CHECK( utm.getSpatialIndex().findNearest( offset + Eigen::Vector3d( 0.302, 0, 0 ), 0.1, utm_nearest, utm_distance ) );
+    BOOST_CHECK_EQUAL( utm_nearest, 30 );
 }
 
 BOOST_AUTO_TEST_CASE( env_eventsync ) 
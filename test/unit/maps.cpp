@@ -6,6 +6,13 @@
 #include <envire/maps/ElevationGrid.hpp>
 #include <envire/tools/VoxelTraversal.hpp>
 #include <envire/tools/BoxLookUpTable.hpp>
+#include <envire/operators/ObjectGrowing.hpp>
+#include <envire/operators/GridIllumination.hpp>
+#include <envire/operators/Fold.hpp>
+#include <envire/maps/GridKernels.hpp>
+#include <envire/operators/SimpleTraversability.hpp>
+#include <envire/operators/TraversabilityGrowClasses.hpp>
+#include <envire/operators/VoxelGridFilter.hpp>
 
 using namespace envire;
 using namespace Eigen;
@@ -280,3 +287,1012 @@ BOOST_AUTO_TEST_CASE( test_BoxLookupTable )
     }  
 }
 
+
+BOOST_AUTO_TEST_CASE( test_tiledband )
+{
+    Grid<float> grid( 1000, 600, 0.1, 0.1 );
+    grid.setNoData( "height", -1.0f );
+
+    Grid<float>::TiledArrayType& tiled( grid.getTiledGridData( "height", 128 ) );
+    BOOST_CHECK( grid.hasTiledBand( "height" ) );
+    BOOST_CHECK( !grid.hasBand( "height" ) );
+    BOOST_CHECK_EQUAL( tiled.getTileCountX(), 8 );
+    BOOST_CHECK_EQUAL( tiled.getTileCountY(), 5 );
+    BOOST_CHECK_EQUAL( tiled.getAllocatedTileCount(), 0 );
+    BOOST_CHECK_EQUAL( tiled.get( 999, 599 ), -1.0f );
+
+    // writing nodata does not allocate
+    tiled.set( 10, 10, -1.0f );
+    BOOST_CHECK_EQUAL( tiled.getAllocatedTileCount(), 0 );
+
+    tiled.set( 999, 599, 2.0f );
+    tiled.at( 130, 5 ) = 3.0f;
+    BOOST_CHECK_EQUAL( tiled.getAllocatedTileCount(), 2 );
+    BOOST_CHECK_EQUAL( tiled.get( 999, 599 ), 2.0f );
+    BOOST_CHECK_EQUAL( tiled.get( 998, 599 ), -1.0f );
+    BOOST_CHECK_EQUAL( tiled.get( 130, 5 ), 3.0f );
+
+    size_t tiles = 0;
+    for( Grid<float>::TiledArrayType::tile_iterator it = tiled.beginTiles(); it != tiled.endTiles(); it++ )
+    {
+	Grid<float>::TiledArrayType::Tile tile( *it );
+	if( tile.tileX == 7 )
+	{
+	    // border tile, which is only partially inside the grid
+	    BOOST_CHECK_EQUAL( tile.width, 1000 - 7 * 128 );
+	    BOOST_CHECK_EQUAL( tile.height, 600 - 4 * 128 );
+	    BOOST_CHECK_EQUAL( tile( 999 - tile.x0, 599 - tile.y0 ), 2.0f );
+	}
+	tiles++;
+    }
+    BOOST_CHECK_EQUAL( tiles, 2 );
+
+    // the stream format is the same as for dense bands
+    std::stringstream ss;
+    grid.writeGridData( "height", ss );
+    BOOST_CHECK_EQUAL( ss.str().size(), 1000 * 600 * sizeof(float) );
+
+    Grid<float> dense( 1000, 600, 0.1, 0.1 );
+    dense.readGridData( "height", ss );
+    BOOST_CHECK_EQUAL( dense.getGridData( "height" )[599][999], 2.0f );
+    BOOST_CHECK_EQUAL( dense.getGridData( "height" )[5][130], 3.0f );
+    BOOST_CHECK_EQUAL( dense.getGridData( "height" )[0][0], -1.0f );
+
+    // conversion between the storage types
+    dense.setNoData( "height", -1.0f );
+    dense.convertToTiledBand( "height", 128 );
+    BOOST_CHECK_EQUAL( dense.getTiledGridData( "height" ).getAllocatedTileCount(), 2 );
+    dense.convertToDenseBand( "height" );
+    BOOST_CHECK( dense.hasBand( "height" ) );
+    BOOST_CHECK_EQUAL( dense.getGridData( "height" )[599][999], 2.0f );
+    BOOST_CHECK_THROW( dense.getTiledGridData( "height" ), std::runtime_error );
+
+    // copying keeps the tiled storage
+    Grid<float> copy( 1000, 600, 0.1, 0.1 );
+    copy.copyBandFrom( grid, "height" );
+    BOOST_CHECK( copy.hasTiledBand( "height" ) );
+    BOOST_CHECK_EQUAL( copy.getTiledGridData( "height" ).get( 130, 5 ), 3.0f );
+
+    // NaN nodata values are recognized as well
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    Grid<float>::TiledArrayType sparse( 1000, 600, nan, 128 );
+    sparse.set( 10, 10, nan );
+    BOOST_CHECK_EQUAL( sparse.getAllocatedTileCount(), 0 );
+    sparse.set( 999, 599, 2.0f );
+    sparse.at( 130, 5 ) = 3.0f;
+    sparse.at( 130, 5 ) = nan;
+    sparse.releaseEmptyTiles();
+    BOOST_CHECK_EQUAL( sparse.getAllocatedTileCount(), 1 );
+    BOOST_CHECK( sparse.isNoData( sparse.get( 130, 5 ) ) );
+
+    boost::multi_array<float,2> nanArray( boost::extents[600][1000] );
+    std::fill( nanArray.data(), nanArray.data() + nanArray.num_elements(), nan );
+    nanArray[599][999] = 2.0f;
+    sparse.fromArray( nanArray );
+    BOOST_CHECK_EQUAL( sparse.getAllocatedTileCount(), 1 );
+    BOOST_CHECK_EQUAL( sparse.get( 999, 599 ), 2.0f );
+}
+
+BOOST_AUTO_TEST_CASE( test_bandstatistics )
+{
+    Grid<float> grid( 10, 10, 0.1, 0.1 );
+    Grid<float>::ArrayType& data( grid.getGridData( "height" ) );
+    std::fill( data.data(), data.data() + data.num_elements(), -2.0f );
+    grid.setNoData( "height", -1.0f );
+    data[0][0] = -1.0f;
+    data[0][1] = std::numeric_limits<float>::quiet_NaN();
+    data[5][5] = 10.0f;
+
+    // negative floats were not handled by the old min/max initialization
+    float min, max;
+    grid.getMinMaxValues( "height", min, max );
+    BOOST_CHECK_EQUAL( min, -2.0f );
+    BOOST_CHECK_EQUAL( max, 10.0f );
+
+    const Grid<float>::BandStatistics& stats( grid.getStatistics( "height", 4 ) );
+    BOOST_CHECK_EQUAL( stats.count, 98 );
+    BOOST_CHECK_EQUAL( stats.nodata_count, 2 );
+    BOOST_CHECK_CLOSE( stats.mean, (97 * -2.0 + 10.0) / 98, 1e-6 );
+    BOOST_REQUIRE_EQUAL( stats.histogram.size(), 4 );
+    BOOST_CHECK_EQUAL( stats.histogram[0], 97 );
+    BOOST_CHECK_EQUAL( stats.histogram[3], 1 );
+
+    // the statistics are cached until the grid is marked as modified
+    data[5][5] = 20.0f;
+    BOOST_CHECK_EQUAL( grid.getStatistics( "height", 4 ).max, 10.0f );
+    grid.itemModified();
+    BOOST_CHECK_EQUAL( grid.getStatistics( "height" ).max, 20.0f );
+
+    // a copy starts with its own modification count, and does not take over
+    // the cached statistics
+    Grid<float> copy( grid );
+    copy.getGridData( "height" )[5][5] = 30.0f;
+    copy.itemModified();
+    BOOST_CHECK_EQUAL( copy.getStatistics( "height" ).max, 30.0f );
+    grid = copy;
+    BOOST_CHECK_EQUAL( grid.getStatistics( "height" ).max, 30.0f );
+
+    // reading new data into a band drops its cached statistics, without
+    // marking the grid as modified
+    Grid<float> other( 10, 10, 0.1, 0.1 );
+    Grid<float>::ArrayType& other_data( other.getGridData( "height" ) );
+    std::fill( other_data.data(), other_data.data() + other_data.num_elements(), 5.0f );
+    other_data[2][2] = 40.0f;
+    std::stringstream band;
+    other.writeGridData( "height", band );
+    const unsigned long modification_count = grid.getModificationCount();
+    grid.readGridData( "height", band );
+    BOOST_CHECK_EQUAL( grid.getModificationCount(), modification_count );
+    BOOST_CHECK_EQUAL( grid.getStatistics( "height" ).min, 5.0f );
+    BOOST_CHECK_EQUAL( grid.getStatistics( "height" ).max, 40.0f );
+    other_data[2][2] = 50.0f;
+    grid.copyBandFrom( other, "height" );
+    BOOST_CHECK_EQUAL( grid.getStatistics( "height" ).max, 50.0f );
+
+    // so does writing to the band through the non-const accessor, whereas
+    // reading it does not
+    grid.getGridData( "height" )[3][3] = 60.0f;
+    BOOST_CHECK_EQUAL( grid.getStatistics( "height" ).max, 60.0f );
+    const Grid<float>::BandStatistics* cached = &grid.getStatistics( "height" );
+    static_cast<Grid<float> const&>( grid ).getGridData( "height" );
+    BOOST_CHECK_EQUAL( &grid.getStatistics( "height" ), cached );
+
+    // unallocated tiles only count as nodata
+    Grid<uint8_t> tiled( 100, 100, 0.1, 0.1 );
+    tiled.setNoData( "class", 255 );
+    tiled.getTiledGridData( "class", 16 ).set( 50, 50, 3 );
+    const Grid<uint8_t>::BandStatistics& tiled_stats( tiled.getStatistics( "class" ) );
+    BOOST_CHECK_EQUAL( tiled_stats.count, 1 );
+    BOOST_CHECK_EQUAL( tiled_stats.nodata_count, 100 * 100 - 1 );
+    BOOST_CHECK_EQUAL( tiled_stats.min, 3 );
+    BOOST_CHECK_EQUAL( tiled_stats.max, 3 );
+}
+
+BOOST_AUTO_TEST_CASE( test_sharedband )
+{
+    Grid<float> source( 100, 50, 0.1, 0.1 );
+    source.getGridData( "height" )[10][20] = 1.0f;
+
+    // sharing a band does not copy the data
+    Grid<float> target( 100, 50, 0.1, 0.1 );
+    target.shareBandFrom( source, "height" );
+    BOOST_CHECK( source.isDataShared( "height" ) );
+    BOOST_CHECK( target.isDataShared( "height" ) );
+    Grid<float> const& const_source( source );
+    Grid<float> const& const_target( target );
+    BOOST_CHECK_EQUAL( const_source.getGridData( "height" ).data(), const_target.getGridData( "height" ).data() );
+
+    // reading a shared band does not copy it
+    std::stringstream band;
+    target.writeGridData( "height", band );
+    BOOST_CHECK( target.isDataShared( "height" ) );
+
+    // the data is duplicated once one of the grids modifies it
+    target.getGridData( "height" )[10][20] = 2.0f;
+    BOOST_CHECK( !source.isDataShared( "height" ) );
+    BOOST_CHECK( !target.isDataShared( "height" ) );
+    BOOST_CHECK_EQUAL( const_source.getGridData( "height" )[10][20], 1.0f );
+    BOOST_CHECK_EQUAL( const_target.getGridData( "height" )[10][20], 2.0f );
+
+    Grid<float> other_size( 10, 10, 0.1, 0.1 );
+    BOOST_CHECK_THROW( other_size.shareBandFrom( source, "height" ), std::runtime_error );
+
+    // copies of bands and of whole grids are never shared
+    Grid<float> band_copy( 100, 50, 0.1, 0.1 );
+    band_copy.copyBandFrom( source, "height" );
+    BOOST_CHECK( !band_copy.isDataShared( "height" ) );
+    BOOST_CHECK( !source.isDataShared( "height" ) );
+    Grid<float> copy( source );
+    BOOST_CHECK( !copy.isDataShared( "height" ) );
+    source.getGridData( "height" )[10][20] = 3.0f;
+    BOOST_CHECK_EQUAL( copy.getGridData( "height" )[10][20], 1.0f );
+    BOOST_CHECK_EQUAL( band_copy.getGridData( "height" )[10][20], 1.0f );
+
+    // the accessors of TraversabilityGrid keep a pointer to the bands,
+    // which must not write into a band that has become shared
+    TraversabilityGrid traversability( 10, 10, 0.1, 0.1 );
+    traversability.setTraversability( 0, 5, 5 );
+    TraversabilityGrid traversability_copy( traversability );
+    traversability.setTraversability( 1, 5, 5 );
+    BOOST_CHECK_EQUAL( static_cast<TraversabilityGrid const&>( traversability_copy ).getGridData( TraversabilityGrid::TRAVERSABILITY )[5][5], 0 );
+    BOOST_CHECK_EQUAL( static_cast<TraversabilityGrid const&>( traversability ).getGridData( TraversabilityGrid::TRAVERSABILITY )[5][5], 1 );
+    traversability_copy.shareBandFrom( traversability, TraversabilityGrid::TRAVERSABILITY );
+    traversability.setTraversability( 3, 5, 5 );
+    traversability_copy.setTraversability( 2, 5, 5 );
+    BOOST_CHECK_EQUAL( static_cast<TraversabilityGrid const&>( traversability_copy ).getGridData( TraversabilityGrid::TRAVERSABILITY )[5][5], 2 );
+    BOOST_CHECK_EQUAL( static_cast<TraversabilityGrid const&>( traversability ).getGridData( TraversabilityGrid::TRAVERSABILITY )[5][5], 3 );
+
+    // a missing band reads as zero, and is not created by reading
+    TraversabilityGrid const& const_traversability( traversability );
+    BOOST_CHECK_EQUAL( const_traversability.getProbability( 5, 5 ), 0.0 );
+    BOOST_CHECK( !traversability.hasBand( TraversabilityGrid::PROBABILITY ) );
+}
+
+BOOST_AUTO_TEST_CASE( test_objectgrowing )
+{
+    Grid<uint8_t> in( 60, 40, 0.1, 0.05 );
+    Grid<uint8_t> out( 60, 40, 0.1, 0.05 );
+    Grid<uint8_t>::ArrayType& data( in.getGridData( "class" ) );
+    std::fill( data.data(), data.data() + data.num_elements(), 0 );
+    data[10][10] = 1;
+    data[30][40] = 2;
+    data[31][43] = 1;
+
+    // 2 > 1 > 0
+    GrowthPolicy<uint8_t> policy( 3 );
+    policy.setBigger( 1, 0, true );
+    policy.setBigger( 2, 0, true );
+    policy.setBigger( 2, 1, true );
+
+    const double radius = 0.45;
+    ObjectGrowing<uint8_t> growing;
+    growing.growObjects( policy, in, out, "class", radius );
+
+    // compare against the cell-by-cell growing
+    Grid<uint8_t>::ArrayType const& result( static_cast<Grid<uint8_t> const&>( out ).getGridData( "class" ) );
+    for( int y=0; y<40; y++ )
+    {
+        for( int x=0; x<60; x++ )
+        {
+            uint8_t expected = data[y][x];
+            for( int sy=0; sy<40; sy++ )
+                for( int sx=0; sx<60; sx++ )
+                {
+                    const double dx = (x - sx) * 0.1, dy = (y - sy) * 0.05;
+                    if( dx * dx + dy * dy < radius * radius && policy.isBigger( data[sy][sx], expected ) )
+                        expected = data[sy][sx];
+                }
+            BOOST_CHECK_EQUAL( (int)result[y][x], (int)expected );
+        }
+    }
+    BOOST_CHECK_EQUAL( (int)result[10][14], 1 );
+    BOOST_CHECK_EQUAL( (int)result[10][15], 0 );
+    BOOST_CHECK_EQUAL( (int)result[31][43], 2 );
+}
+
+BOOST_AUTO_TEST_CASE( test_gridillumination )
+{
+    Environment env;
+    ElevationGrid* grid = new ElevationGrid( 100, 60, 0.5, 0.5 );
+    env.attachItem( grid );
+    ElevationGrid::ArrayType& elevation( grid->getGridData( ElevationGrid::ELEVATION_MAX ) );
+    std::fill( elevation.data(), elevation.data() + elevation.num_elements(), 0.0 );
+    // a wall of 5m height at x = 50
+    for( size_t y = 0; y < 60; y++ )
+        elevation[y][50] = 5.0;
+
+    GridIllumination* op = new GridIllumination();
+    env.attachItem( op );
+    op->addOutput( grid );
+    // sun far away in +x direction, 30 degrees above the horizon
+    const double distance = 1e9;
+    op->setLightSource( Eigen::Vector3d( distance, 15.0, distance * tan( M_PI / 6 ) ), distance * 0.01 );
+
+    op->setMethod( GridIllumination::RAY_CASTING );
+    op->setOutputBand( "ray" );
+    op->updateAll();
+    op->setMethod( GridIllumination::HORIZON_SWEEP );
+    op->setOutputBand( "sweep" );
+    op->updateAll();
+
+    ElevationGrid::ArrayType const& ray( grid->getGridData( "ray" ) );
+    ElevationGrid::ArrayType const& sweep( grid->getGridData( "sweep" ) );
+    for( size_t y = 0; y < 60; y++ )
+    {
+        for( size_t x = 0; x < 100; x++ )
+            BOOST_CHECK_CLOSE( ray[y][x], sweep[y][x], 1e-6 );
+    }
+    // the shadow of the wall is 5m / tan(30deg) = 8.7m long
+    BOOST_CHECK_EQUAL( sweep[30][40], 0.0 );
+    BOOST_CHECK_EQUAL( sweep[30][30], 1.0 );
+    BOOST_CHECK_EQUAL( sweep[30][60], 1.0 );
+
+    // diagonal directions, 25 degrees above the horizon, for which the
+    // lines of the sweep are not aligned with the grid. Near the upper
+    // border, the rays leave the grid before they reach the wall, where the
+    // two methods may differ by a cell.
+    const double azimuths[] = { M_PI / 6, M_PI / 4 };
+    for( int i = 0; i < 2; i++ )
+    {
+        op->setLightSource( Eigen::Vector3d( distance * cos( azimuths[i] ), distance * sin( azimuths[i] ),
+                    distance * tan( 25.0 / 180 * M_PI ) ), distance * 0.01 );
+        op->setMethod( GridIllumination::RAY_CASTING );
+        op->setOutputBand( "ray" );
+        op->updateAll();
+        op->setMethod( GridIllumination::HORIZON_SWEEP );
+        op->setOutputBand( "sweep" );
+        op->updateAll();
+
+        for( size_t y = 0; y < 40; y++ )
+        {
+            for( size_t x = 0; x < 100; x++ )
+                BOOST_CHECK_CLOSE( ray[y][x], sweep[y][x], 1e-6 );
+        }
+    }
+    // the shadow is 5m / tan(25deg) * cos(45deg) = 7.6m long in x
+    BOOST_CHECK_EQUAL( sweep[20][35], 0.0 );
+    BOOST_CHECK_EQUAL( sweep[20][34], 1.0 );
+}
+
+BOOST_AUTO_TEST_CASE( test_fold )
+{
+    Environment env;
+    Grid<double>* input = new Grid<double>( 20, 10, 0.1, 0.1 );
+    Grid<double>* output = new Grid<double>( 20, 10, 0.1, 0.1 );
+    env.attachItem( input );
+    env.attachItem( output );
+    Grid<double>::ArrayType& data( input->getGridData( "height" ) );
+    std::fill( data.data(), data.data() + data.num_elements(), 1.0 );
+    data[5][10] = 9.0;
+
+    DoubleFoldOperator* op = new DoubleFoldOperator();
+    env.attachItem( op );
+    op->addInput( input );
+    op->addOutput( output );
+    op->setBands( std::vector<std::string>( 1, "height" ) );
+    // the window covers the offsets [-2, 1]
+    op->setNeightbourHoodSize( 4 );
+
+    op->setFoldType( DoubleFoldOperator::MAX );
+    op->updateAll();
+    Grid<double>::ArrayType const& result( static_cast<Grid<double> const*>( output )->getGridData( "height" ) );
+    BOOST_CHECK_EQUAL( result[5][9], 9.0 );
+    BOOST_CHECK_EQUAL( result[5][12], 9.0 );
+    BOOST_CHECK_EQUAL( result[5][13], 1.0 );
+    BOOST_CHECK_EQUAL( result[5][8], 1.0 );
+
+    op->setFoldType( DoubleFoldOperator::MEAN );
+    op->updateAll();
+    BOOST_CHECK_CLOSE( result[5][10], (15 * 1.0 + 9.0) / 16, 1e-9 );
+    // window clipped at the corner: 2 x 2 cells
+    BOOST_CHECK_CLOSE( result[0][0], 1.0, 1e-9 );
+
+    op->setFoldType( DoubleFoldOperator::SUM );
+    op->updateAll();
+    BOOST_CHECK_CLOSE( result[0][0], 4.0, 1e-9 );
+    BOOST_CHECK_CLOSE( result[5][10], 24.0, 1e-9 );
+
+    // non-finite cells only affect the windows that contain them
+    data[2][3] = std::numeric_limits<double>::quiet_NaN();
+    data[8][16] = std::numeric_limits<double>::infinity();
+    op->updateAll();
+    BOOST_CHECK( result[2][3] != result[2][3] );
+    BOOST_CHECK( result[4][5] != result[4][5] );
+    BOOST_CHECK_CLOSE( result[2][6], 16.0, 1e-9 );
+    BOOST_CHECK_CLOSE( result[5][3], 16.0, 1e-9 );
+    BOOST_CHECK_EQUAL( result[8][17], std::numeric_limits<double>::infinity() );
+    BOOST_CHECK_CLOSE( result[8][14], 16.0, 1e-9 );
+    BOOST_CHECK_CLOSE( result[5][10], 24.0, 1e-9 );
+
+    op->setFoldType( DoubleFoldOperator::MEAN );
+    op->updateAll();
+    BOOST_CHECK( result[2][3] != result[2][3] );
+    BOOST_CHECK_CLOSE( result[2][6], 1.0, 1e-9 );
+    BOOST_CHECK_CLOSE( result[9][19], 1.0, 1e-9 );
+}
+
+struct ScaleKernel
+{
+    double operator()( double value ) const { return 2.0 * value; }
+};
+
+struct LaplaceKernel
+{
+    double operator()( Neighbourhood<double, 1, 1> const& n ) const
+    { return n(-1,0) + n(1,0) + n(0,-1) + n(0,1) - 4.0 * n(0,0); }
+};
+
+struct SumKernel
+{
+    void operator()( double& acc, double value ) const { acc += value; }
+    void combine( double& acc, double const& other ) const { acc += other; }
+};
+
+BOOST_AUTO_TEST_CASE( test_gridkernels )
+{
+    Grid<double> grid( 300, 200, 0.1, 0.1 );
+    Grid<double>::ArrayType& data( grid.getGridData( "height" ) );
+    for( size_t y = 0; y < grid.getHeight(); y++ )
+	for( size_t x = 0; x < grid.getWidth(); x++ )
+	    data[y][x] = x;
+
+    GridKernels::map( grid, "height", grid, "scaled", ScaleKernel(), 4 );
+    Grid<double>::ArrayType const& scaled( static_cast<Grid<double> const&>( grid ).getGridData( "scaled" ) );
+    BOOST_CHECK_EQUAL( scaled[100][150], 300.0 );
+
+    // the height is linear in x, so the laplacian is zero except where the
+    // clamped border breaks the slope
+    GridKernels::stencil<1, 1>( grid, "height", grid, "laplace", LaplaceKernel(), GridKernels::BORDER_CLAMP, 0.0, 4 );
+    Grid<double>::ArrayType const& laplace( static_cast<Grid<double> const&>( grid ).getGridData( "laplace" ) );
+    BOOST_CHECK_EQUAL( laplace[100][150], 0.0 );
+    BOOST_CHECK_EQUAL( laplace[0][150], 0.0 );
+    BOOST_CHECK_EQUAL( laplace[100][0], 1.0 );
+    BOOST_CHECK_EQUAL( laplace[100][299], -1.0 );
+
+    double sum = GridKernels::reduce( grid, "height", 0.0, SumKernel(), 4 );
+    BOOST_CHECK_EQUAL( sum, 200.0 * 299 * 300 / 2 );
+    // same result with a single thread
+    BOOST_CHECK_EQUAL( sum, GridKernels::reduce( grid, "height", 0.0, SumKernel(), 1 ) );
+
+    BOOST_CHECK_THROW( ( GridKernels::stencil<1, 1>( grid, "height", grid, "height", LaplaceKernel() ) ), std::runtime_error );
+}
+
+BOOST_AUTO_TEST_CASE( test_overviews )
+{
+    Grid<double> grid( 5, 3, 0.1, 0.1 );
+    Grid<double>::ArrayType& data( grid.getGridData( "height" ) );
+    for( size_t y = 0; y < 3; y++ )
+	for( size_t x = 0; x < 5; x++ )
+	    data[y][x] = y * 5 + x;
+    grid.setNoData( "height", -1.0 );
+    data[0][1] = -1.0;
+
+    grid.setOverviews( "height", 2 );
+    BOOST_CHECK_EQUAL( grid.getOverviewCount( "height" ), 2 );
+    Grid<double>::ArrayType const& level1( grid.getOverview( "height", 1 ) );
+    BOOST_CHECK_EQUAL( level1.shape()[0], 2 );
+    BOOST_CHECK_EQUAL( level1.shape()[1], 3 );
+    // the nodata cell is ignored
+    BOOST_CHECK_CLOSE( level1[0][0], (0.0 + 5 + 6) / 3, 1e-9 );
+    // border cells only cover the cells inside of the grid
+    BOOST_CHECK_CLOSE( level1[0][2], (4.0 + 9) / 2, 1e-9 );
+    BOOST_CHECK_CLOSE( level1[1][2], 14.0, 1e-9 );
+    Grid<double>::ArrayType const& level2( grid.getOverview( "height", 2 ) );
+    BOOST_CHECK_EQUAL( level2.shape()[0], 1 );
+    BOOST_CHECK_EQUAL( level2.shape()[1], 2 );
+
+    // only the dirty region is updated
+    data[2][4] = 100.0;
+    data[0][0] = 100.0;
+    grid.setOverviewDirty( "height", 4, 2, 5, 3 );
+    BOOST_CHECK_CLOSE( grid.getOverview( "height", 1 )[1][2], 100.0, 1e-9 );
+    BOOST_CHECK_CLOSE( grid.getOverview( "height", 1 )[0][0], (0.0 + 5 + 6) / 3, 1e-9 );
+    BOOST_CHECK_CLOSE( grid.getOverview( "height", 2 )[0][1], ((4.0 + 9) / 2 + 100) / 2, 1e-9 );
+
+    grid.setOverviews( "height", 1, Grid<double>::OVERVIEW_MAX );
+    BOOST_CHECK_CLOSE( grid.getOverview( "height", 1 )[0][0], 100.0, 1e-9 );
+    BOOST_CHECK_THROW( grid.getOverview( "height", 2 ), std::runtime_error );
+
+    // cells without any valid source cell are nodata
+    data[0][4] = data[1][4] = -1.0;
+    grid.invalidateOverviews( "height" );
+    BOOST_CHECK_EQUAL( grid.getOverview( "height", 1 )[0][2], -1.0 );
+
+    // itemModified() invalidates the cached overviews, and a copy of the
+    // grid does not share them with the original
+    grid.itemModified();
+    BOOST_CHECK_CLOSE( grid.getOverview( "height", 1 )[1][2], 100.0, 1e-9 );
+    Grid<double> copy( grid );
+    copy.getGridData( "height" )[2][4] = 7.0;
+    copy.itemModified();
+    BOOST_CHECK_CLOSE( copy.getOverview( "height", 1 )[1][2], 7.0, 1e-9 );
+    BOOST_CHECK_CLOSE( grid.getOverview( "height", 1 )[1][2], 100.0, 1e-9 );
+
+    // reading a band rebuilds its overviews
+    std::stringstream band;
+    copy.writeGridData( "height", band );
+    grid.readGridData( "height", band );
+    BOOST_CHECK_CLOSE( grid.getOverview( "height", 1 )[1][2], 7.0, 1e-9 );
+
+    // as does writing to it through the non-const accessor
+    grid.getGridData( "height" )[2][4] = 8.0;
+    BOOST_CHECK_CLOSE( grid.getOverview( "height", 1 )[1][2], 8.0, 1e-9 );
+}
+
+BOOST_AUTO_TEST_CASE( test_bandencoding )
+{
+    Grid<uint8_t> grid( 200, 100, 0.1, 0.1 );
+    Grid<uint8_t>::ArrayType& data( grid.getGridData( "class" ) );
+    std::fill( data.data(), data.data() + data.num_elements(), 2 );
+    for( size_t x = 50; x < 80; x++ )
+	data[40][x] = 7;
+    grid.getTiledGridData( "tiled", 16 ).set( 150, 20, 9 );
+
+    std::stringstream raw;
+    grid.writeGridData( "class", raw );
+    BOOST_CHECK_EQUAL( raw.str().size(), 200 * 100 );
+
+    grid.setBandEncoding( "class", Grid<uint8_t>::ENCODING_DELTA_RLE );
+    grid.setBandEncoding( "tiled", Grid<uint8_t>::ENCODING_DELTA_RLE );
+    std::stringstream encoded;
+    grid.writeGridData( "class", encoded );
+    grid.writeGridData( "tiled", encoded );
+    BOOST_CHECK( encoded.str().size() < 1000 );
+
+    Grid<uint8_t> copy( 200, 100, 0.1, 0.1 );
+    copy.setBandEncoding( "class", Grid<uint8_t>::ENCODING_DELTA_RLE );
+    copy.setBandEncoding( "tiled", Grid<uint8_t>::ENCODING_DELTA_RLE );
+    copy.getTiledGridData( "tiled", 16 );
+    copy.readGridData( "class", encoded );
+    copy.readGridData( "tiled", encoded );
+    Grid<uint8_t> const& result( copy );
+    BOOST_CHECK( result.getGridData( "class" ) == data );
+    BOOST_CHECK_EQUAL( result.getTiledGridData( "tiled" ).get( 150, 20 ), 9 );
+    BOOST_CHECK_EQUAL( result.getTiledGridData( "tiled" ).get( 149, 20 ), 0 );
+
+    // the encoded band has to match the size of the grid
+    Grid<uint8_t> other( 100, 100, 0.1, 0.1 );
+    other.setBandEncoding( "class", Grid<uint8_t>::ENCODING_DELTA_RLE );
+    std::stringstream wrong_size( encoded.str() );
+    BOOST_CHECK_THROW( other.readGridData( "class", wrong_size ), std::runtime_error );
+
+    // corrupted chunk sizes are reported before the payload is allocated.
+    // The first chunk size follows the four 32 bit header fields.
+    const uint64_t huge_chunk = uint64_t( 1 ) << 40;
+    std::string corrupted( encoded.str() );
+    corrupted.replace( 16, 8, reinterpret_cast<const char*>( &huge_chunk ), 8 );
+    std::stringstream corrupted_stream( corrupted );
+    BOOST_CHECK_THROW( copy.readGridData( "class", corrupted_stream ), std::runtime_error );
+}
+
+struct CountCells
+{
+    size_t& count;
+    explicit CountCells( size_t& count ) : count( count ) {}
+    void operator()( size_t x, size_t y ) const { count++; }
+};
+
+void countCell( size_t x, size_t y, size_t& count )
+{
+    count++;
+}
+
+BOOST_AUTO_TEST_CASE( test_rectanglespans )
+{
+    TraversabilityGrid tr( 40, 40, 0.125, 0.125 );
+
+    // the rectangle covers exactly the cells [12, 19] x [14, 17]
+    std::vector<GridBase::Span> spans;
+    BOOST_CHECK( tr.getRectangleSpans( base::Pose2D( Eigen::Vector2d( 2.0, 2.0 ), 0 ), 1.0, 0.5, spans ) );
+    BOOST_REQUIRE_EQUAL( spans.size(), 4 );
+    for( size_t i = 0; i < spans.size(); i++ )
+    {
+	BOOST_CHECK_EQUAL( spans[i].y, 14 + i );
+	BOOST_CHECK_EQUAL( spans[i].x0, 12 );
+	BOOST_CHECK_EQUAL( spans[i].x1, 19 );
+    }
+
+    // the template and boost::function versions visit the same cells
+    base::Pose2D p( Eigen::Vector2d( 2.0, 2.15 ), 42 * M_PI / 180.0 );
+    size_t count = 0, function_count = 0;
+    BOOST_CHECK( tr.forEachInRectangle( p, 1.0, 0.5, CountCells( count ) ) );
+    boost::function<void (size_t, size_t)> callback( boost::bind( countCell, _1, _2, boost::ref( function_count ) ) );
+    BOOST_CHECK( tr.forEachInRectangle( p, 1.0, 0.5, callback ) );
+    BOOST_CHECK_EQUAL( count, function_count );
+    BOOST_CHECK( tr.getRectangleSpans( p, 1.0, 0.5, spans ) );
+    size_t span_count = 0;
+    for( size_t i = 0; i < spans.size(); i++ )
+	span_count += spans[i].x1 - spans[i].x0 + 1;
+    BOOST_CHECK_EQUAL( count, span_count );
+
+    // inner and outer cells partition the outer rectangle
+    size_t inner = 0, outer = 0, all = 0;
+    BOOST_CHECK( tr.forEachInRectangles( p, 1.0, 0.5, CountCells( inner ), 1.6, 1.1, CountCells( outer ) ) );
+    tr.forEachInRectangle( p, 1.6, 1.1, CountCells( all ) );
+    BOOST_CHECK_EQUAL( inner, count );
+    BOOST_CHECK_EQUAL( inner + outer, all );
+
+    BOOST_CHECK( !tr.forEachInRectangle( base::Pose2D( Eigen::Vector2d( 0.1, 0.1 ), 0 ), 1.0, 0.5, CountCells( count ) ) );
+}
+
+static void checkSameStatistic( const TraversabilityStatistic& a, const TraversabilityStatistic& b )
+{
+    BOOST_CHECK_EQUAL( a.getTotalCount(), b.getTotalCount() );
+    BOOST_REQUIRE_EQUAL( a.getHighestTraversabilityClass(), b.getHighestTraversabilityClass() );
+    for( int klass = 0; klass <= a.getHighestTraversabilityClass(); klass++ )
+    {
+	double a_dist, b_dist;
+	size_t a_count, b_count;
+	a.getStatisticForClass( klass, a_dist, a_count );
+	b.getStatisticForClass( klass, b_dist, b_count );
+	BOOST_CHECK_EQUAL( a_count, b_count );
+	if( a_count && b_count )
+	    BOOST_CHECK_SMALL( a_dist - b_dist, 1e-5 );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_footprintcache )
+{
+    TraversabilityGrid tr( 40, 40, 0.1, 0.1 );
+    TraversabilityGrid::ArrayType& data( tr.getGridData( TraversabilityGrid::TRAVERSABILITY ) );
+    data[20][22] = 3;
+    data[20][25] = 4;
+
+    // the border adds 0.2 on each side
+    FootprintCache footprint( 0.1, 0.1, 0.73, 0.47, 0.4 );
+    // center of the cell (20, 20), the masks are exact there
+    base::Pose2D p( Eigen::Vector2d( 2.05, 2.05 ), 0 );
+
+    TraversabilityStatistic inner, outer;
+    BOOST_CHECK( tr.computeStatistic( footprint, p, inner, &outer ) );
+    size_t count = 0;
+    tr.forEachInRectangle( p, 0.73, 0.47, CountCells( count ) );
+    BOOST_CHECK_EQUAL( inner.getTotalCount(), count );
+    BOOST_CHECK_EQUAL( inner.getTotalCount(), 9 * 5 );
+
+    double dist;
+    size_t class_count;
+    inner.getStatisticForClass( 3, dist, class_count );
+    BOOST_CHECK_EQUAL( class_count, 1 );
+    BOOST_CHECK_CLOSE( dist, 0.2, 1e-4 );
+    outer.getStatisticForClass( 4, dist, class_count );
+    BOOST_CHECK_EQUAL( class_count, 1 );
+    BOOST_CHECK_CLOSE( dist, 0.5 - 0.365, 1e-4 );
+    BOOST_CHECK_EQUAL( inner.getClassCount( 4 ), 0 );
+
+    // headings are snapped to the closest bin
+    TraversabilityStatistic rotated;
+    BOOST_CHECK( tr.computeStatistic( footprint, base::Pose2D( p.position, 2 * M_PI - 0.01 ), rotated ) );
+    BOOST_CHECK_EQUAL( rotated.getTotalCount(), inner.getTotalCount() );
+
+    TraversabilityStatistic border;
+    BOOST_CHECK( !tr.computeStatistic( footprint, base::Pose2D( Eigen::Vector2d( 0.15, 2.05 ), 0 ), border ) );
+    BOOST_CHECK_EQUAL( border.getTotalCount(), 0 );
+
+    TraversabilityGrid coarse( 40, 40, 0.2, 0.2 );
+    BOOST_CHECK_THROW( coarse.computeStatistic( footprint, p, border ), std::runtime_error );
+
+    // at cell centers and the center headings of the bins, the statistics
+    // are the ones of the direct computation, with the same border
+    data[17][18] = 1;
+    data[23][21] = 2;
+    for( size_t bin = 0; bin < footprint.getHeadingBinCount(); bin++ )
+    {
+	const base::Pose2D pose( Eigen::Vector2d( 2.05, 1.95 ), 2 * M_PI * bin / footprint.getHeadingBinCount() );
+	TraversabilityStatistic cached_inner, cached_outer, direct_inner, direct_outer;
+	BOOST_CHECK( tr.computeStatistic( footprint, pose, cached_inner, &cached_outer ) );
+	tr.computeStatistic( pose, 0.73, 0.47, 0.4, direct_inner, direct_outer );
+	checkSameStatistic( cached_inner, direct_inner );
+	checkSameStatistic( cached_outer, direct_outer );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_evaluatefootprints )
+{
+    TraversabilityGrid tr( 60, 60, 0.1, 0.1 );
+    tr.setTraversabilityClass( 0, TraversabilityClass( 1.0 ) );
+    tr.setTraversabilityClass( 1, TraversabilityClass( 0.5 ) );
+    tr.setTraversabilityClass( 2, TraversabilityClass( 0.0 ) );
+    for( size_t y = 0; y < 60; y++ )
+	for( size_t x = 0; x < 60; x++ )
+	    tr.setTraversabilityAndProbability( rand() % 10 == 0 ? 1 + rand() % 2 : 0, 1.0, x, y );
+    TraversabilityGrid::ArrayType& probabilities( tr.getGridData( TraversabilityGrid::PROBABILITY ) );
+    probabilities[30][30] = 51;
+
+    std::vector<base::Pose2D> poses;
+    for( int i = 0; i < 500; i++ )
+	poses.push_back( base::Pose2D( Eigen::Vector2d( rand() / (double)RAND_MAX * 6.0, rand() / (double)RAND_MAX * 6.0 ),
+		    rand() / (double)RAND_MAX * 2 * M_PI ) );
+    poses.push_back( base::Pose2D( Eigen::Vector2d( 3.05, 3.05 ), 0 ) );
+
+    FootprintCache footprint( 0.1, 0.1, 0.6, 0.4, 0.1 );
+    std::vector<TraversabilityGrid::FootprintEvaluation> results, single;
+    tr.evaluateFootprints( footprint, poses, results, 4 );
+    tr.evaluateFootprints( poses, 0.6, 0.4, 0.1, single, 1 );
+    BOOST_REQUIRE_EQUAL( results.size(), poses.size() );
+    BOOST_REQUIRE_EQUAL( single.size(), poses.size() );
+
+    size_t valid = 0;
+    for( size_t i = 0; i < poses.size(); i++ )
+    {
+	TraversabilityStatistic inner, outer;
+	bool in = tr.computeStatistic( footprint, poses[i], inner, &outer );
+	BOOST_CHECK_EQUAL( results[i].valid, in );
+	BOOST_CHECK_EQUAL( single[i].valid, in );
+	if( !in )
+	    continue;
+	valid++;
+	BOOST_CHECK_EQUAL( results[i].innerStatistic.getTotalCount(), inner.getTotalCount() );
+	BOOST_CHECK_EQUAL( results[i].outerStatistic.getTotalCount(), outer.getTotalCount() );
+	BOOST_CHECK_EQUAL( results[i].worstClass, single[i].worstClass );
+	BOOST_CHECK_EQUAL( results[i].worstProbability, single[i].worstProbability );
+	BOOST_CHECK_EQUAL( &tr.getTraversabilityClass( results[i].worstClass ),
+		&tr.getWorstTraversabilityClassInRectangle( footprint, poses[i] ) );
+    }
+    BOOST_CHECK( valid > 0 && valid < poses.size() );
+    BOOST_CHECK_CLOSE( results.back().worstProbability, 0.2, 1e-6 );
+
+    // at cell centers and the center headings of the bins, the results
+    // are the ones of the direct computation
+    FootprintCache odd_footprint( 0.1, 0.1, 0.63, 0.37 );
+    std::vector<base::Pose2D> centered;
+    for( int i = 0; i < 200; i++ )
+	centered.push_back( base::Pose2D( Eigen::Vector2d( 1.05 + 0.1 * (rand() % 40), 1.05 + 0.1 * (rand() % 40) ),
+		    2 * M_PI * (rand() % odd_footprint.getHeadingBinCount()) / odd_footprint.getHeadingBinCount() ) );
+    centered.push_back( base::Pose2D( Eigen::Vector2d( 3.05, 3.05 ), 0 ) );
+    tr.evaluateFootprints( odd_footprint, centered, results );
+    for( size_t i = 0; i < centered.size(); i++ )
+    {
+	BOOST_REQUIRE( results[i].valid );
+	BOOST_CHECK_EQUAL( &tr.getTraversabilityClass( results[i].worstClass ),
+		&tr.getWorstTraversabilityClassInRectangle( centered[i], 0.63, 0.37 ) );
+	BOOST_CHECK_EQUAL( results[i].worstProbability, tr.getWorstProbabilityInRectangle( centered[i], 0.63, 0.37 ) );
+    }
+    BOOST_CHECK_CLOSE( results.back().worstProbability, 0.2, 1e-6 );
+}
+
+BOOST_AUTO_TEST_CASE( test_batchtogrid )
+{
+    Grid<double> grid( 30, 20, 0.1, 0.2, -1.0, 0.5 );
+
+    Eigen::Affine3d transform( Eigen::AngleAxisd( 0.3, Eigen::Vector3d::UnitZ() ) );
+    transform.translation() = Eigen::Vector3d( 0.2, 1.5, -0.4 );
+
+    std::vector<Eigen::Vector3d> points;
+    for( int i = 0; i < 1000; i++ )
+	points.push_back( Eigen::Vector3d( rand() / (double)RAND_MAX * 6.0 - 3.0,
+		    rand() / (double)RAND_MAX * 8.0 - 4.0,
+		    rand() / (double)RAND_MAX ) );
+
+    std::vector<GridBase::Position> cells;
+    std::vector<uint8_t> inGrid;
+    std::vector<double> z;
+    size_t valid = grid.toGridBatch( points, cells, inGrid, transform, &z );
+
+    size_t count = 0;
+    for( size_t i = 0; i < points.size(); i++ )
+    {
+	Eigen::Vector3d p = transform * points[i];
+	size_t x, y;
+	bool in = grid.toGrid( p.x(), p.y(), x, y );
+	BOOST_CHECK_EQUAL( in, (bool)inGrid[i] );
+	if( in )
+	{
+	    BOOST_CHECK_EQUAL( cells[i].x, x );
+	    BOOST_CHECK_EQUAL( cells[i].y, y );
+	    count++;
+	}
+	BOOST_CHECK_CLOSE( z[i], p.z(), 1e-6 );
+    }
+    BOOST_CHECK_EQUAL( valid, count );
+    BOOST_CHECK( valid > 0 && valid < points.size() );
+
+    // points on the borders of the cells end up in the same cells as with
+    // toGrid(), for scales that are not exact in binary
+    std::vector<Eigen::Vector3d> borders;
+    for( size_t i = 0; i <= 30; i++ )
+	borders.push_back( Eigen::Vector3d( grid.getOffsetX() + i * grid.getScaleX(), grid.getOffsetY() + (i % 20) * grid.getScaleY(), 0 ) );
+    grid.toGridBatch( borders, cells, inGrid );
+    for( size_t i = 0; i < borders.size(); i++ )
+    {
+	size_t x, y;
+	bool in = grid.toGrid( borders[i].x(), borders[i].y(), x, y );
+	BOOST_CHECK_EQUAL( in, (bool)inGrid[i] );
+	if( in )
+	{
+	    BOOST_CHECK_EQUAL( cells[i].x, x );
+	    BOOST_CHECK_EQUAL( cells[i].y, y );
+	}
+    }
+
+    std::vector<GridBase::Position> corners;
+    corners.push_back( GridBase::Position( 0, 0 ) );
+    corners.push_back( GridBase::Position( 29, 19 ) );
+    std::vector<Eigen::Vector3d> centers;
+    grid.fromGridBatch( corners, centers, transform );
+    for( size_t i = 0; i < corners.size(); i++ )
+    {
+	Eigen::Vector3d center;
+	center << grid.fromGrid( corners[i] ), 0;
+	BOOST_CHECK( (transform * center - centers[i]).norm() < 1e-9 );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_closenarrowpassages )
+{
+    TraversabilityGrid tr( 40, 20, 0.1, 0.1 );
+    TraversabilityGrid::ArrayType& data( tr.getGridData( TraversabilityGrid::TRAVERSABILITY ) );
+    TraversabilityGrid::ArrayType& probability( tr.getGridData( TraversabilityGrid::PROBABILITY ) );
+    std::fill( data.data(), data.data() + data.num_elements(), SimpleTraversability::CUSTOM_CLASSES );
+    std::fill( probability.data(), probability.data() + probability.num_elements(), 0 );
+
+    // a passage of 0.3m between the columns 10 and 14, and one of 0.8m
+    // between the columns 25 and 34
+    for( size_t y = 0; y < 20; y++ )
+    {
+	data[y][10] = data[y][14] = SimpleTraversability::CLASS_OBSTACLE;
+	data[y][25] = data[y][34] = SimpleTraversability::CLASS_OBSTACLE;
+    }
+
+    SimpleTraversability op;
+    op.closeNarrowPassages( tr, "", 0.5 );
+
+    for( size_t y = 0; y < 20; y++ )
+    {
+	for( size_t x = 0; x < 40; x++ )
+	{
+	    bool obstacle = (x >= 10 && x <= 14) || x == 25 || x == 34;
+	    BOOST_CHECK_EQUAL( data[y][x] == SimpleTraversability::CLASS_OBSTACLE, obstacle );
+	    if( obstacle && x > 10 && x < 14 )
+		BOOST_CHECK_EQUAL( probability[y][x], 255 );
+	}
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_growclasses )
+{
+    Environment env;
+    TraversabilityGrid* in = new TraversabilityGrid( 40, 30, 0.1, 0.1 );
+    TraversabilityGrid* out = new TraversabilityGrid( 40, 30, 0.1, 0.1 );
+    env.attachItem( in );
+    env.attachItem( out );
+    in->setTraversabilityClass( 0, TraversabilityClass( 1.0 ) );
+    in->setTraversabilityClass( 1, TraversabilityClass( 0.0 ) );
+    in->setTraversabilityClass( 2, TraversabilityClass( 0.5 ) );
+    in->setTraversabilityClass( 3, TraversabilityClass( 0.9 ) );
+
+    TraversabilityGrid::ArrayType& data( in->getGridData( TraversabilityGrid::TRAVERSABILITY ) );
+    TraversabilityGrid::ArrayType& probability( in->getGridData( TraversabilityGrid::PROBABILITY ) );
+    std::fill( data.data(), data.data() + data.num_elements(), 3 );
+    std::fill( probability.data(), probability.data() + probability.num_elements(), 200 );
+    data[10][10] = 1;
+    data[10][13] = 2;
+    probability[10][13] = 100;
+    // unknown cells are not grown
+    data[20][30] = 1;
+    probability[20][30] = 0;
+
+    TraversabilityGrowClasses* op = new TraversabilityGrowClasses();
+    env.attachItem( op );
+    op->addInput( in );
+    op->addOutput( out );
+    op->setRadius( 0.25 );
+    op->updateAll();
+
+    TraversabilityGrid::ArrayType const& grown( out->getGridData( TraversabilityGrid::TRAVERSABILITY ) );
+    TraversabilityGrid::ArrayType const& grown_probability( out->getGridData( TraversabilityGrid::PROBABILITY ) );
+    for( int y = 0; y < 30; y++ )
+    {
+	for( int x = 0; x < 40; x++ )
+	{
+	    // the worst class within the radius wins
+	    const double d1 = hypot( x - 10, y - 10 ) * 0.1;
+	    const double d2 = hypot( x - 13, y - 10 ) * 0.1;
+	    int expected = 3;
+	    if( d1 < 0.25 )
+		expected = 1;
+	    else if( d2 < 0.25 )
+		expected = 2;
+	    else if( x == 30 && y == 20 )
+		expected = 1;
+	    BOOST_CHECK_EQUAL( grown[y][x], expected );
+	}
+    }
+    BOOST_CHECK_EQUAL( grown_probability[10][14], 100 );
+    BOOST_CHECK_EQUAL( grown_probability[20][30], 0 );
+    BOOST_CHECK_EQUAL( grown_probability[0][0], 200 );
+}
+
+BOOST_AUTO_TEST_CASE( test_simpletraversability )
+{
+    Environment env;
+    const size_t width = 70, height = 50;
+    Grid<float>* slope = new Grid<float>( width, height, 0.1, 0.1 );
+    Grid<float>* max_step = new Grid<float>( width, height, 0.1, 0.1 );
+    TraversabilityGrid* out = new TraversabilityGrid( width, height, 0.1, 0.1 );
+    env.attachItem( slope );
+    env.attachItem( max_step );
+    env.attachItem( out );
+
+    Grid<float>::ArrayType& slope_data( slope->getGridData( "slope" ) );
+    Grid<float>::ArrayType& step_data( max_step->getGridData( "max_step" ) );
+    slope->setNoData( "slope", -1 );
+    srand( 3 );
+    for( size_t i = 0; i < slope_data.num_elements(); i++ )
+    {
+	slope_data.data()[i] = (rand() % 10 == 0) ? -1 : rand() / (float)RAND_MAX - 0.5;
+	step_data.data()[i] = rand() / (float)RAND_MAX * 0.2;
+    }
+    slope_data[10][20] = slope_data[11][20] = std::numeric_limits<float>::quiet_NaN();
+    step_data[10][20] = 0.0;
+    step_data[11][20] = 0.2;
+
+    SimpleTraversabilityConfig conf;
+    conf.maximum_slope = 0.4;
+    conf.class_count = 5;
+    conf.ground_clearance = 0.15;
+    SimpleTraversability* op = new SimpleTraversability( conf );
+    env.attachItem( op );
+    op->setSlope( slope, "slope" );
+    op->setMaxStep( max_step, "max_step" );
+    op->setOutput( out, TraversabilityGrid::TRAVERSABILITY );
+    op->updateAll();
+
+    TraversabilityGrid::ArrayType const& result( out->getGridData( TraversabilityGrid::TRAVERSABILITY ) );
+    TraversabilityGrid::ArrayType const& probability( out->getGridData( TraversabilityGrid::PROBABILITY ) );
+    for( size_t y = 0; y < height; y++ )
+    {
+	for( size_t x = 0; x < width; x++ )
+	{
+	    int expected;
+	    if( step_data[y][x] > 0.15 || (slope_data[y][x] != -1 && fabs( slope_data[y][x] ) > 0.4) )
+		expected = SimpleTraversability::CLASS_OBSTACLE;
+	    else if( slope_data[y][x] == -1 || slope_data[y][x] != slope_data[y][x] )
+		expected = SimpleTraversability::CLASS_UNKNOWN;
+	    else
+		expected = SimpleTraversability::CUSTOM_CLASSES + 5 - rint( fabs( slope_data[y][x] ) / 0.4 * 5 );
+	    BOOST_CHECK_EQUAL( result[y][x], expected );
+	    BOOST_CHECK_EQUAL( probability[y][x], expected == SimpleTraversability::CLASS_UNKNOWN ? 0 : 255 );
+	}
+    }
+
+    // the inputs have to be of the size of the output
+    Grid<float>* small_slope = new Grid<float>( width - 1, height, 0.1, 0.1 );
+    env.attachItem( small_slope );
+    small_slope->getGridData( "slope" );
+    op->setSlope( small_slope, "slope" );
+    BOOST_CHECK_THROW( op->updateAll(), std::runtime_error );
+}
+
+BOOST_AUTO_TEST_CASE( test_voxelgridfilter )
+{
+    Environment env;
+    Pointcloud* in = new Pointcloud();
+    Pointcloud* out = new Pointcloud();
+    env.attachItem( in );
+    env.attachItem( out );
+    in->setFrameNode( env.getRootNode() );
+    out->setFrameNode( env.getRootNode() );
+
+    // enough points for several radix sort chunks
+    std::vector<Vector3d>& colors( in->getVertexData<Vector3d>( Pointcloud::VERTEX_COLOR ) );
+    srand( 5 );
+    for( int i = 0; i < 200000; i++ )
+    {
+	in->vertices.push_back( Vector3d::Random() );
+	colors.push_back( Vector3d::Random().cwiseAbs() );
+    }
+    in->vertices[7] = Vector3d( std::numeric_limits<double>::quiet_NaN(), 0, 0 );
+
+    // reference, with the voxels relative to the minimum of the points
+    const double size = 0.1;
+    Vector3d min( Vector3d::Constant( 1 ) );
+    for( size_t i = 0; i < in->vertices.size(); i++ )
+	if( i != 7 )
+	    min = min.cwiseMin( in->vertices[i] );
+    typedef std::map<std::vector<long>, std::pair<int, Vector3d> > VoxelMap;
+    VoxelMap voxels, voxel_colors;
+    for( size_t i = 0; i < in->vertices.size(); i++ )
+    {
+	if( i == 7 )
+	    continue;
+	std::vector<long> key( 3 );
+	for( int d = 0; d < 3; d++ )
+	    key[d] = floor( (in->vertices[i][d] - min[d]) / size );
+	std::pair<int, Vector3d>& voxel( voxels.insert( std::make_pair( key, std::make_pair( 0, Vector3d( Vector3d::Zero() ) ) ) ).first->second );
+	std::pair<int, Vector3d>& voxel_color( voxel_colors.insert( std::make_pair( key, std::make_pair( 0, Vector3d( Vector3d::Zero() ) ) ) ).first->second );
+	voxel.first++;
+	voxel.second += in->vertices[i];
+	voxel_color.second += colors[i];
+    }
+
+    VoxelGridFilter* op = new VoxelGridFilter();
+    env.attachItem( op );
+    op->addInput( in );
+    op->addOutput( out );
+    op->setVoxelSize( size );
+    BOOST_CHECK_THROW( op->addInput( out ), std::runtime_error );
+
+    for( int threads = 1; threads <= 4; threads += 3 )
+    {
+	op->setThreadCount( threads );
+	op->updateAll();
+
+	BOOST_REQUIRE_EQUAL( out->vertices.size(), voxels.size() );
+	std::vector<Vector3d>& out_colors( out->getVertexData<Vector3d>( Pointcloud::VERTEX_COLOR ) );
+	BOOST_REQUIRE_EQUAL( out_colors.size(), voxels.size() );
+	size_t i = 0;
+	for( VoxelMap::iterator it = voxels.begin(); it != voxels.end(); it++, i++ )
+	{
+	    BOOST_CHECK( out->vertices[i].isApprox( it->second.second / it->second.first ) );
+	    BOOST_CHECK( out_colors[i].isApprox( voxel_colors[it->first].second / it->second.first ) );
+	}
+    }
+
+    // single precision output
+    out->setStorage( Pointcloud::FLOAT_COLUMNS );
+    op->updateAll();
+    BOOST_REQUIRE_EQUAL( out->columns.size(), voxels.size() );
+    BOOST_CHECK( out->columns.hasAttribute( PointColumns::COLOR ) );
+    BOOST_CHECK( out->columns.getPoint( 0 ).isApprox( voxels.begin()->second.second / voxels.begin()->second.first, 1e-6 ) );
+}
@@ -7,6 +7,7 @@
 #include "envire/maps/MLSGrid.hpp"
 #include "envire/operators/MLSProjection.hpp"
 #include "envire/operators/MergeMLS.hpp"
+#include "envire/operators/TraversabilityGrassfire.hpp"
 
 #include "envire/tools/ListGrid.hpp"
 
@@ -244,3 +245,168 @@ BOOST_AUTO_TEST_CASE( mls_patch )
 }
 
 
+
+BOOST_AUTO_TEST_CASE( grassfire_incremental )
+{
+    boost::scoped_ptr<Environment> env( new Environment() );
+
+    MLSGrid *mls = new MLSGrid( 40, 40, 0.1, 0.1 );
+    env->attachItem( mls );
+    mls->setFrameNode( env->getRootNode() );
+    for( size_t m=0; m<40; m++ )
+	for( size_t n=0; n<40; n++ )
+	    mls->insertHead( m, n, MLSGrid::SurfacePatch( 0.02 * m, 0.01 ) );
+
+    TraversabilityGrassfire::Config config;
+    config.maxStepHeight = 0.2;
+    config.maxSlope = 0.5;
+    config.robotHeight = 0.5;
+    config.numTraversabilityClasses = 10;
+
+    // both operators use the same grid, and each of them only sees the
+    // cells that have been modified since its own last update
+    TraversabilityGrid *full_tr = new TraversabilityGrid( 40, 40, 0.1, 0.1 );
+    env->attachItem( full_tr );
+    full_tr->setFrameNode( env->getRootNode() );
+    TraversabilityGrassfire *full = new TraversabilityGrassfire();
+    env->attachItem( full );
+    full->addInput( mls );
+    full->addOutput( full_tr );
+    config.incremental = false;
+    full->setConfig( config );
+    full->setStartPosition( Eigen::Vector3d( 0.5, 0.5, 0.1 ) );
+
+    TraversabilityGrid *incremental_tr = new TraversabilityGrid( 40, 40, 0.1, 0.1 );
+    env->attachItem( incremental_tr );
+    incremental_tr->setFrameNode( env->getRootNode() );
+    TraversabilityGrassfire *incremental = new TraversabilityGrassfire();
+    env->attachItem( incremental );
+    incremental->addInput( mls );
+    incremental->addOutput( incremental_tr );
+    config.incremental = true;
+    incremental->setConfig( config );
+    incremental->setStartPosition( Eigen::Vector3d( 0.5, 0.5, 0.1 ) );
+    incremental->updateAll();
+    full->updateAll();
+
+    // a low ceiling over some cells turns them into obstacles
+    size_t generation = mls->startCellGeneration();
+    BOOST_CHECK( mls->getDirtyCellExtents( generation ).isEmpty() );
+    for( size_t m=20; m<23; m++ )
+	for( size_t n=10; n<30; n++ )
+	    mls->insertHead( m, n, MLSGrid::SurfacePatch( 0.02 * m + 0.4, 0.01 ) );
+    BOOST_CHECK_EQUAL( mls->getDirtyCellExtents( generation ).min().x(), 20 );
+    BOOST_CHECK_EQUAL( mls->getDirtyCellExtents( generation ).max().y(), 29 );
+    // the other operator does not hide the modified cells from the
+    // incremental one
+    full->updateAll();
+    BOOST_CHECK_EQUAL( mls->getDirtyCellExtents( generation ).min().x(), 20 );
+    incremental->updateAll();
+
+    const TraversabilityGrid::ArrayType &a( incremental_tr->getGridData( TraversabilityGrid::TRAVERSABILITY ) );
+    const TraversabilityGrid::ArrayType &b( full_tr->getGridData( TraversabilityGrid::TRAVERSABILITY ) );
+    const TraversabilityGrid::ArrayType &pa( incremental_tr->getGridData( TraversabilityGrid::PROBABILITY ) );
+    const TraversabilityGrid::ArrayType &pb( full_tr->getGridData( TraversabilityGrid::PROBABILITY ) );
+    BOOST_CHECK( std::equal( a.data(), a.data() + a.num_elements(), b.data() ) );
+    BOOST_CHECK( std::equal( pa.data(), pa.data() + pa.num_elements(), pb.data() ) );
+    BOOST_CHECK_EQUAL( a[20][20], 1 );
+
+    // erasing a patch marks its cell, or the whole grid if the cell is not
+    // given, so that the incremental operator drops the patch
+    generation = mls->startCellGeneration();
+    mls->erase( 21, 15, mls->beginCell( 21, 15 ) );
+    BOOST_CHECK_EQUAL( mls->getDirtyCellExtents( generation ).min().x(), 21 );
+    BOOST_CHECK_EQUAL( mls->getDirtyCellExtents( generation ).max().y(), 15 );
+    full->updateAll();
+    incremental->updateAll();
+    BOOST_CHECK( std::equal( a.data(), a.data() + a.num_elements(), b.data() ) );
+    generation = mls->startCellGeneration();
+    mls->erase( mls->beginCell( 22, 15 ) );
+    BOOST_CHECK_EQUAL( mls->getDirtyCellExtents( generation ).min().x(), 0 );
+    BOOST_CHECK_EQUAL( mls->getDirtyCellExtents( generation ).max().y(), 39 );
+    full->updateAll();
+    incremental->updateAll();
+    BOOST_CHECK( std::equal( a.data(), a.data() + a.num_elements(), b.data() ) );
+
+    // the assignment replaces all patches, including the ones the
+    // incremental operator still refers to
+    MLSGrid copy( *mls );
+    for( size_t m=5; m<8; m++ )
+	for( size_t n=10; n<30; n++ )
+	    copy.insertHead( m, n, MLSGrid::SurfacePatch( 0.02 * m + 0.4, 0.01 ) );
+    generation = mls->startCellGeneration();
+    *mls = copy;
+    BOOST_CHECK_EQUAL( mls->getDirtyCellExtents( generation ).min().x(), 0 );
+    BOOST_CHECK_EQUAL( mls->getDirtyCellExtents( generation ).min().y(), 0 );
+    BOOST_CHECK_EQUAL( mls->getDirtyCellExtents( generation ).max().x(), 39 );
+    BOOST_CHECK_EQUAL( mls->getDirtyCellExtents( generation ).max().y(), 39 );
+    full->updateAll();
+    incremental->updateAll();
+
+    // the modification count of the layer is still maintained
+    const size_t count = mls->getModificationCount();
+    mls->setDirty();
+    BOOST_CHECK( mls->isDirty() );
+    BOOST_CHECK_EQUAL( mls->getModificationCount(), count + 1 );
+    BOOST_CHECK( std::equal( a.data(), a.data() + a.num_elements(), b.data() ) );
+    BOOST_CHECK( std::equal( pa.data(), pa.data() + pa.num_elements(), pb.data() ) );
+    BOOST_CHECK_EQUAL( a[20][5], 1 );
+}
+
+BOOST_AUTO_TEST_CASE( grassfire_threads )
+{
+    boost::scoped_ptr<Environment> env( new Environment() );
+
+    MLSGrid *mls = new MLSGrid( 60, 60, 0.1, 0.1 );
+    env->attachItem( mls );
+    mls->setFrameNode( env->getRootNode() );
+    srand( 42 );
+    for( size_t m=0; m<60; m++ )
+    {
+	for( size_t n=0; n<60; n++ )
+	{
+	    mls->insertHead( m, n, MLSGrid::SurfacePatch( 0.1 * sin( m * 0.2 ) + 0.05 * rand() / RAND_MAX, 0.01 ) );
+	    if( rand() % 10 == 0 )
+		mls->insertHead( m, n, MLSGrid::SurfacePatch( 0.3 + 0.5 * rand() / RAND_MAX, 0.01 ) );
+	}
+    }
+
+    TraversabilityGrassfire::Config config;
+    config.maxStepHeight = 0.1;
+    config.maxSlope = 0.5;
+    config.robotHeight = 0.5;
+    config.numTraversabilityClasses = 10;
+
+    // the flood fill has to give the same result as the serial one, for
+    // any number of threads, and whether the levels are processed in
+    // parallel or not
+    std::vector<TraversabilityGrid*> results;
+    const size_t threads[] = { 1, 4, 4 };
+    const size_t minParallelFrontier[] = { 2048, 1, 2048 };
+    for( size_t i = 0; i < 3; i++ )
+    {
+	TraversabilityGrid *tr = new TraversabilityGrid( 60, 60, 0.1, 0.1 );
+	env->attachItem( tr );
+	tr->setFrameNode( env->getRootNode() );
+	TraversabilityGrassfire *op = new TraversabilityGrassfire();
+	env->attachItem( op );
+	op->addInput( mls );
+	op->addOutput( tr );
+	config.numThreads = threads[i];
+	config.minParallelFrontier = minParallelFrontier[i];
+	op->setConfig( config );
+	op->setStartPosition( Eigen::Vector3d( 3.0, 3.0, 0.0 ) );
+	op->updateAll();
+	results.push_back( tr );
+    }
+
+    const TraversabilityGrid::ArrayType &a( results[0]->getGridData( TraversabilityGrid::TRAVERSABILITY ) );
+    const TraversabilityGrid::ArrayType &pa( results[0]->getGridData( TraversabilityGrid::PROBABILITY ) );
+    for( size_t i = 1; i < results.size(); i++ )
+    {
+	const TraversabilityGrid::ArrayType &b( results[i]->getGridData( TraversabilityGrid::TRAVERSABILITY ) );
+	const TraversabilityGrid::ArrayType &pb( results[i]->getGridData( TraversabilityGrid::PROBABILITY ) );
+	BOOST_CHECK( std::equal( a.data(), a.data() + a.num_elements(), b.data() ) );
+	BOOST_CHECK( std::equal( pa.data(), pa.data() + pa.num_elements(), pb.data() ) );
+    }
+}
@@ -7,6 +7,7 @@
 
 #include "envire/maps/MLSGrid.hpp"
 #include "envire/maps/Grids.hpp"
+#include "envire/maps/TriMesh.hpp"
 
 using namespace envire;
 
@@ -275,4 +276,164 @@ BOOST_AUTO_TEST_CASE( ImageRGB24_serialization )
     BOOST_CHECK_EQUAL(dg2->getFromRaster( ImageRGB24::B, 20, 1 ), 30 );
 }
 
+BOOST_AUTO_TEST_CASE( Grid_window_read ) 
+{
+    Grid<float> grid( 200, 100, 0.5, 0.5, 10.0, 20.0 );
+    for( size_t y=0; y<grid.getCellSizeY(); y++ )
+	for( size_t x=0; x<grid.getCellSizeX(); x++ )
+	    grid.getFromRaster( "band", x, y ) = x + 1000 * y;
+
+    std::string path = serialization_test_path + "/window.tiff";
+    grid.writeGridData( "band", path );
+
+    GdalBlockCache cache( path );
+    Grid<float> window;
+    GridBase::Extents extents( Eigen::Vector2d( 20.0, 30.0 ), Eigen::Vector2d( 25.0, 32.0 ) );
+    BOOST_CHECK( window.readGridDataWindow( "band", cache, extents ) );
+    BOOST_CHECK_EQUAL( window.getCellSizeX(), 10 );
+    BOOST_CHECK_EQUAL( window.getCellSizeY(), 4 );
+    BOOST_CHECK_CLOSE( window.getOffsetX(), 20.0, 1e-6 );
+    BOOST_CHECK_CLOSE( window.getOffsetY(), 30.0, 1e-6 );
+    BOOST_CHECK_EQUAL( window.getFromRaster( "band", 0, 0 ), 20 + 1000 * 20 );
+    BOOST_CHECK_EQUAL( window.getFromRaster( "band", 9, 3 ), 29 + 1000 * 23 );
+    BOOST_CHECK_EQUAL( window.get( "band", 22.2, 31.2 ), 24 + 1000 * 22 );
+
+    // the margin is clipped at the raster border
+    BOOST_CHECK( window.readGridDataWindow( "band", cache, extents, 100.0 ) );
+    BOOST_CHECK_EQUAL( window.getCellSizeX(), 200 );
+    BOOST_CHECK_EQUAL( window.getCellSizeY(), 100 );
+
+    // all blocks are in the cache now
+    const size_t reads = cache.getBlockReadCount();
+    BOOST_CHECK( window.readGridDataWindow( "band", cache, extents, 1.0 ) );
+    BOOST_CHECK_EQUAL( cache.getBlockReadCount(), reads );
+    BOOST_CHECK_EQUAL( window.getFromRaster( "band", 2, 2 ), 20 + 1000 * 20 );
+
+    GridBase::Extents outside( Eigen::Vector2d( 200.0, 0.0 ), Eigen::Vector2d( 210.0, 10.0 ) );
+    BOOST_CHECK( !window.readGridDataWindow( "band", cache, outside ) );
+}
+
+BOOST_AUTO_TEST_CASE( Grid_window_read_north_up ) 
+{
+    // most GeoTiffs store the rows from north to south, i.e. with a
+    // negative y resolution. The pixel (x, y) of the file has the value
+    // x + 1000 * y, and the file covers [10, 110] x [20, 70].
+    std::string path = serialization_test_path + "/window_north_up.tiff";
+    {
+	GDALAllRegister();
+	char **options = NULL;
+	options = CSLSetNameValue( options, "TILED", "YES" );
+	options = CSLSetNameValue( options, "BLOCKXSIZE", "32" );
+	options = CSLSetNameValue( options, "BLOCKYSIZE", "16" );
+	GDALDataset *dataset = GetGDALDriverManager()->GetDriverByName( "GTiff" )->Create( path.c_str(), 200, 100, 1, GDT_Float32, options );
+	CSLDestroy( options );
+	BOOST_REQUIRE( dataset );
+	double transform[6] = { 10.0, 0.5, 0.0, 70.0, 0.0, -0.5 };
+	dataset->SetGeoTransform( transform );
+	std::vector<float> row( 200 );
+	for( int y=0; y<100; y++ )
+	{
+	    for( int x=0; x<200; x++ )
+		row[x] = x + 1000 * y;
+	    dataset->GetRasterBand( 1 )->RasterIO( GF_Write, 0, y, 200, 1, &row[0], 200, 1, GDT_Float32, 0, 0 );
+	}
+	GDALClose( dataset );
+    }
+
+    // the cache holds three blocks only, so that blocks are evicted while
+    // the windows are read
+    const size_t block_size = 32 * 16 * sizeof(float);
+    GdalBlockCache cache( path, 3 * block_size );
+    Grid<float> window;
+    GridBase::Extents extents( Eigen::Vector2d( 20.0, 30.0 ), Eigen::Vector2d( 25.0, 32.0 ) );
+    BOOST_CHECK( window.readGridDataWindow( "band", cache, extents ) );
+    BOOST_CHECK_EQUAL( window.getCellSizeX(), 10 );
+    BOOST_CHECK_EQUAL( window.getCellSizeY(), 4 );
+    BOOST_CHECK_CLOSE( window.getOffsetX(), 20.0, 1e-6 );
+    BOOST_CHECK_CLOSE( window.getOffsetY(), 30.0, 1e-6 );
+    // the rows of the grid are along increasing y, i.e. from south to north
+    BOOST_CHECK_EQUAL( window.getFromRaster( "band", 0, 0 ), 20 + 1000 * 79 );
+    BOOST_CHECK_EQUAL( window.getFromRaster( "band", 9, 3 ), 29 + 1000 * 76 );
+    BOOST_CHECK_EQUAL( window.get( "band", 22.2, 31.2 ), 24 + 1000 * 77 );
+
+    BOOST_CHECK( window.readGridDataWindow( "band", cache, extents, 100.0 ) );
+    BOOST_CHECK_EQUAL( window.getCellSizeX(), 200 );
+    BOOST_CHECK_EQUAL( window.getCellSizeY(), 100 );
+    BOOST_CHECK_CLOSE( window.getOffsetY(), 20.0, 1e-6 );
+    BOOST_CHECK_EQUAL( window.getFromRaster( "band", 0, 0 ), 1000 * 99 );
+    BOOST_CHECK_EQUAL( window.getFromRaster( "band", 199, 99 ), 199 );
+    BOOST_CHECK( cache.getCacheSize() <= 3 * block_size );
+
+    // the most recently used blocks are kept, the window of the first
+    // read is in a single block that has been evicted since
+    const size_t reads = cache.getBlockReadCount();
+    BOOST_CHECK( window.readGridDataWindow( "band", cache, extents ) );
+    BOOST_CHECK_EQUAL( cache.getBlockReadCount(), reads + 1 );
+    BOOST_CHECK_EQUAL( window.getFromRaster( "band", 0, 0 ), 20 + 1000 * 79 );
+    BOOST_CHECK( window.readGridDataWindow( "band", cache, extents ) );
+    BOOST_CHECK_EQUAL( cache.getBlockReadCount(), reads + 1 );
+}
+
+BOOST_AUTO_TEST_CASE( TriMesh_ply )
+{
+    TriMesh mesh;
+    std::vector<Eigen::Vector3d>& colors( mesh.getVertexData<Eigen::Vector3d>( Pointcloud::VERTEX_COLOR ) );
+    std::vector<Eigen::Vector3d>& normals( mesh.getVertexData<Eigen::Vector3d>( Pointcloud::VERTEX_NORMAL ) );
+    for( int i = 0; i < 10000; i++ )
+    {
+	mesh.vertices.push_back( Eigen::Vector3d::Random() );
+	normals.push_back( Eigen::Vector3d::Random().normalized() );
+	colors.push_back( Eigen::Vector3d( i % 2, 1, 0 ) );
+    }
+    for( int i = 0; i < 100; i++ )
+	mesh.faces.push_back( TriMesh::triangle_t( i, i + 1, i + 2 ) );
+
+    for( int doublePrecision = 0; doublePrecision < 2; doublePrecision++ )
+    {
+	std::stringstream ply;
+	mesh.writePly( "mesh.ply", ply, doublePrecision );
+	const std::string data( ply.str() );
+
+	TriMesh read;
+	BOOST_REQUIRE( read.readPly( "mesh.ply", ply ) );
+	BOOST_REQUIRE_EQUAL( read.vertices.size(), mesh.vertices.size() );
+	BOOST_REQUIRE_EQUAL( read.faces.size(), mesh.faces.size() );
+	BOOST_CHECK_EQUAL( read.faces[5].get<2>(), mesh.faces[5].get<2>() );
+	const double precision = doublePrecision ? 1e-12 : 1e-6;
+	for( size_t i = 0; i < mesh.vertices.size(); i++ )
+	{
+	    BOOST_CHECK_SMALL( (read.vertices[i] - mesh.vertices[i]).norm(), precision );
+	    BOOST_CHECK_SMALL( (read.getVertexData<Eigen::Vector3d>( Pointcloud::VERTEX_NORMAL )[i] - normals[i]).norm(), precision );
+	    BOOST_CHECK_EQUAL( read.getVertexData<Eigen::Vector3d>( Pointcloud::VERTEX_COLOR )[i], colors[i] );
+	}
+
+	// the blocks are read into the columns directly
+	std::stringstream column_ply( data );
+	TriMesh columns;
+	columns.setStorage( Pointcloud::FLOAT_COLUMNS );
+	BOOST_REQUIRE( columns.readPly( "mesh.ply", column_ply ) );
+	BOOST_CHECK_EQUAL( columns.getStorage(), Pointcloud::FLOAT_COLUMNS );
+	BOOST_REQUIRE_EQUAL( columns.getVertexCount(), mesh.vertices.size() );
+	BOOST_CHECK( columns.columns.hasAttribute( PointColumns::NORMAL ) );
+	BOOST_CHECK_EQUAL( columns.columns.getColor( 3 ), colors[3] );
+	BOOST_CHECK_SMALL( (columns.getVertex( 42 ) - mesh.vertices[42]).norm(), 1e-6 );
+
+	std::stringstream truncated( data.substr( 0, data.size() - 10 ) );
+	TriMesh broken;
+	BOOST_CHECK_THROW( broken.readPly( "mesh.ply", truncated ), std::runtime_error );
+    }
+
+    // ascii files go through libply
+    std::stringstream ascii( "ply\nformat ascii 1.0\nelement vertex 3\n"
+	    "property float x\nproperty float y\nproperty float z\n"
+	    "element face 1\nproperty list uchar int vertex_index\nend_header\n"
+	    "0 0 0\n1 0 0\n0 1 0\n3 0 1 2\n" );
+    TriMesh triangle;
+    BOOST_REQUIRE( triangle.readPly( "triangle.ply", ascii ) );
+    BOOST_REQUIRE_EQUAL( triangle.vertices.size(), 3 );
+    BOOST_CHECK_EQUAL( triangle.vertices[1], Eigen::Vector3d( 1, 0, 0 ) );
+    BOOST_REQUIRE_EQUAL( triangle.faces.size(), 1 );
+    BOOST_CHECK_EQUAL( triangle.faces[0].get<2>(), 2 );
+}
+
 BOOST_AUTO_TEST_SUITE_END()
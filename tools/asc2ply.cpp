@@ -41,8 +41,11 @@ int main( int argc, char* argv[] )
     Pointcloud::Ptr pc = new Pointcloud();
     env.attachItem( pc.get() );
     env.setFrameNode( pc.get(), env.getRootNode() );
-    ifstream asc( asc_file.c_str() );
-    pc->readText( asc, sampling, Pointcloud::XYZR );
+    if( !pc->readTextFile( asc_file, sampling, Pointcloud::XYZR ) )
+    {
+	std::cerr << "could not open " << asc_file << std::endl;
+	exit(1);
+    }
 
     if( cell_size > 0 )
     {
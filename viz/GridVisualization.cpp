@@ -78,7 +78,7 @@ namespace envire
     unsigned char* end_pos = &mydata[size];
 
     {
-        envire::Grid<float> *grid = dynamic_cast<envire::Grid<float>*>(item);
+        const envire::Grid<float> *grid = dynamic_cast<const envire::Grid<float>*>(item);
         if( grid )
         {
             float min, max;
@@ -88,7 +88,7 @@ namespace envire
     }
 
     {
-        envire::Grid<double> *grid = dynamic_cast<envire::Grid<double>*>(item);
+        const envire::Grid<double> *grid = dynamic_cast<const envire::Grid<double>*>(item);
         if( grid )
         {
             double min, max;
@@ -98,7 +98,7 @@ namespace envire
     }
 
     {
-        envire::Grid<unsigned char> *grid = dynamic_cast<envire::Grid<unsigned char>*>(item);
+        const envire::Grid<unsigned char> *grid = dynamic_cast<const envire::Grid<unsigned char>*>(item);
         if( grid )
             copyGridData( pos, end_pos, grid->getGridData().data(), 1, color, !showEmptyCells );
     }
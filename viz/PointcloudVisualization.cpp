@@ -83,8 +83,21 @@ void PointcloudVisualization::updateNode(envire::EnvironmentItem* item, osg::Gro
 	pointColor = osg::Vec4( ((col*88734)%256)/255.0, ((col*398482)%256)/255.0, ((col*36784787)%256)/255.0, 1.0 ); 
     }
 
+    // the vertices and their attributes are read in either storage
+    const envire::PointColumns* columns = pointcloud->getStorage() == envire::Pointcloud::FLOAT_COLUMNS ? &pointcloud->columns : 0;
+
     // create color
-    if( pointcloud->hasData(envire::Pointcloud::VERTEX_COLOR) )
+    if( columns && columns->hasAttribute(envire::PointColumns::COLOR) )
+    {
+	for(size_t n=0;n<columns->size();n++) {
+	    Eigen::Vector3d c( columns->getColor(n) );
+	    color->push_back(osg::Vec4(c.x(), c.y(), c.z(), 1.0));
+	}
+
+	geom->setColorArray(color.get());
+	geom->setColorBinding( osg::Geometry::BIND_PER_VERTEX );
+    }
+    else if( !columns && pointcloud->hasData(envire::Pointcloud::VERTEX_COLOR) )
     {
 	std::vector<Eigen::Vector3d> &pc_color(pointcloud->getVertexData<Eigen::Vector3d>(envire::Pointcloud::VERTEX_COLOR));
 	for(std::vector<Eigen::Vector3d>::const_iterator it = pc_color.begin(); it != pc_color.end(); it++) {
@@ -105,8 +118,9 @@ void PointcloudVisualization::updateNode(envire::EnvironmentItem* item, osg::Gro
     // create vertices
     osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array;
     
-    for(std::vector<Eigen::Vector3d>::const_iterator it = pointcloud->vertices.begin(); it != pointcloud->vertices.end(); it++) {
-	vertices->push_back(osg::Vec3(it->x(),it->y(), it->z()));
+    for(size_t n=0;n<pointcloud->getVertexCount();n++) {
+	Eigen::Vector3d point( pointcloud->getVertex(n) );
+	vertices->push_back(osg::Vec3(point.x(),point.y(), point.z()));
     }
     
     //attach vertivces to geometry
@@ -121,7 +135,8 @@ void PointcloudVisualization::updateNode(envire::EnvironmentItem* item, osg::Gro
     point->setMaxSize( 5.0 );
     geom->getOrCreateStateSet()->setAttribute( point, osg::StateAttribute::ON );
 
-    if( pointcloud->hasData(envire::Pointcloud::VERTEX_NORMAL) && showNormals )
+    const bool hasNormals = columns ? columns->hasAttribute(envire::PointColumns::NORMAL) : pointcloud->hasData(envire::Pointcloud::VERTEX_NORMAL);
+    if( hasNormals && showNormals )
     {
 	osg::ref_ptr<osg::Geometry> ngeom = new osg::Geometry;
 	osg::ref_ptr<osg::Vec4Array> ncolor = new osg::Vec4Array;
@@ -131,11 +146,11 @@ void PointcloudVisualization::updateNode(envire::EnvironmentItem* item, osg::Gro
 
 	osg::ref_ptr<osg::Vec3Array> nvertices = new osg::Vec3Array;
 
-	std::vector<Eigen::Vector3d> &normals(pointcloud->getVertexData<Eigen::Vector3d>(envire::Pointcloud::VERTEX_NORMAL));
+	std::vector<Eigen::Vector3d> *normals = columns ? 0 : &pointcloud->getVertexData<Eigen::Vector3d>(envire::Pointcloud::VERTEX_NORMAL);
 
-	for(size_t n=0;n<pointcloud->vertices.size();n++) {
-	    Eigen::Vector3d &point( pointcloud->vertices[n] );
-	    Eigen::Vector3d normal( normals[n] * normalScaling );
+	for(size_t n=0;n<pointcloud->getVertexCount();n++) {
+	    Eigen::Vector3d point( pointcloud->getVertex(n) );
+	    Eigen::Vector3d normal( (columns ? columns->getNormal(n) : (*normals)[n]) * normalScaling );
 	    nvertices->push_back(osg::Vec3(point.x(),point.y(), point.z()));
 	    nvertices->push_back(osg::Vec3(point.x()+normal.x(),point.y()+normal.y(), point.z()+normal.z()));
 	}
@@ -164,8 +179,8 @@ void PointcloudVisualization::updateNode(envire::EnvironmentItem* item, osg::Gro
 	for(size_t n=0;n<featurecloud->keypoints.size();n++) {
 	    // asume the origin as the origin of the original acquisition
 	    envire::KeyPoint &keypoint( featurecloud->keypoints[n] );
-	    Eigen::Vector3d point( pointcloud->vertices[n] );
-	    Eigen::Vector3d nview( -pointcloud->vertices[n].normalized() );
+	    Eigen::Vector3d point( pointcloud->getVertex(n) );
+	    Eigen::Vector3d nview( -point.normalized() );
 
 	    const size_t circle_segments = 12 + keypoint.size * 12;
 	    Eigen::Vector3d s = nview.cross( Eigen::Vector3d::UnitX() ).normalized() * keypoint.size;